@@ -0,0 +1,40 @@
+#version 430
+
+// One blur pass over the listed tiles, see SparseBloom.h
+// Same 3x3 kernel as gaussianBlur_f.glsl, one group per listed tile
+#define TILE_SIZE 8		// must match SparseBloom::TILE_SIZE
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D u_source;
+layout(rgba8, binding = 0) writeonly uniform image2D u_target;
+
+layout(std430, binding = 5) readonly buffer TileList { uint tileList[]; };
+
+// xy: part of the targets in use, in texels, z: tiles across
+uniform vec4 u_size;
+
+void main()
+{
+	uint tile = tileList[gl_WorkGroupID.x];
+	int tilesX = int(u_size.z);
+	ivec2 size = ivec2(u_size.xy);
+
+	ivec2 texel = ivec2(int(tile) % tilesX, int(tile) / tilesX) * TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+	if (any(greaterThanEqual(texel, size)))
+		return;
+
+	// Centre, sides and corners, clamped to the edge like the texture is
+	const float weights[3] = float[3](0.195346, 0.123317, 0.077847);
+
+	vec3 blurred = vec3(0.0);
+	for (int y = -1; y <= 1; y++)
+	{
+		for (int x = -1; x <= 1; x++)
+		{
+			ivec2 tap = clamp(texel + ivec2(x, y), ivec2(0), size - 1);
+			blurred += texelFetch(u_source, tap, 0).rgb * weights[abs(x) + abs(y)];
+		}
+	}
+
+	imageStore(u_target, texel, vec4(blurred, 1.0));
+}
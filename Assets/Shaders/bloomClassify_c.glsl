@@ -0,0 +1,36 @@
+#version 430
+
+// Finds the brightest texel of every tile of the bloom target, see SparseBloom.h
+// One group per tile, the downsample already thresholded the image, so
+// anything above zero has to bloom
+#define TILE_SIZE 8		// must match SparseBloom::TILE_SIZE
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D u_bloom;
+
+layout(std430, binding = 4) writeonly buffer TileMax { uint tileMax[]; };
+
+// xy: part of u_bloom in use, in texels, z: tiles across
+uniform vec4 u_size;
+
+shared uint groupMax;
+
+void main()
+{
+	if (gl_LocalInvocationIndex == 0)
+		groupMax = 0;
+	barrier();
+
+	ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+	if (all(lessThan(texel, ivec2(u_size.xy))))
+	{
+		vec3 c = texelFetch(u_bloom, texel, 0).rgb;
+
+		// Positive floats sort the same way as their bits, so atomicMax works on them
+		atomicMax(groupMax, floatBitsToUint(max(c.r, max(c.g, c.b))));
+	}
+	barrier();
+
+	if (gl_LocalInvocationIndex == 0)
+		tileMax[gl_WorkGroupID.y * uint(u_size.z) + gl_WorkGroupID.x] = groupMax;
+}
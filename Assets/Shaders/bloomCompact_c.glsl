@@ -0,0 +1,44 @@
+#version 430
+
+// Lists the tiles that have a bright tile within blur reach, see SparseBloom.h
+// One thread per tile. The counters are the group counts of the blur and
+// composite dispatches, so every listed tile adds one group to both
+layout(local_size_x = 64) in;
+
+layout(std430, binding = 4) readonly buffer TileMax { uint tileMax[]; };
+layout(std430, binding = 5) writeonly buffer TileList { uint tileList[]; };
+layout(std430, binding = 6) buffer DispatchArgs
+{
+	uint blurGroups[3];
+	uint compositeGroups[3];
+};
+
+// xy: tiles across and down, z: how many tiles light can spread into
+uniform vec4 u_tiles;
+
+void main()
+{
+	ivec2 tiles = ivec2(u_tiles.xy);
+	uint tile = gl_GlobalInvocationID.x;
+	if (tile >= uint(tiles.x * tiles.y))
+		return;
+
+	ivec2 coord = ivec2(int(tile) % tiles.x, int(tile) / tiles.x);
+	int dilation = int(u_tiles.z);
+	ivec2 first = max(coord - ivec2(dilation), ivec2(0));
+	ivec2 last = min(coord + ivec2(dilation), tiles - 1);
+
+	for (int y = first.y; y <= last.y; y++)
+	{
+		for (int x = first.x; x <= last.x; x++)
+		{
+			if (tileMax[y * tiles.x + x] != 0)
+			{
+				uint slot = atomicAdd(blurGroups[0], 1u);
+				atomicAdd(compositeGroups[0], 1u);
+				tileList[slot] = tile;
+				return;
+			}
+		}
+	}
+}
@@ -0,0 +1,46 @@
+#version 430
+
+// Adds the blurred bloom onto the scene, in place, in the listed tiles only
+// See SparseBloom.h. Every listed tile covers a block of scene pixels, the
+// group's y and z pick the TILE_SIZE x TILE_SIZE part of that block it does
+#define TILE_SIZE 8		// must match SparseBloom::TILE_SIZE
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE) in;
+
+layout(binding = 0) uniform sampler2D u_bloom;
+layout(rgba8, binding = 0) uniform image2D u_scene;
+
+layout(std430, binding = 5) readonly buffer TileList { uint tileList[]; };
+
+// xy: part of u_bloom in use, in texels, z: tiles across
+// It is stretched over the whole scene, which upscales it
+uniform vec4 u_bloomSize;
+
+// xy: size of u_scene in pixels
+uniform vec4 u_sceneSize;
+
+// Only pixels from xy up to (not including) zw are written
+uniform vec4 u_rect;
+
+void main()
+{
+	uint tile = tileList[gl_WorkGroupID.x];
+	int tilesX = int(u_bloomSize.z);
+	ivec2 coord = ivec2(int(tile) % tilesX, int(tile) / tilesX);
+
+	// Scene pixels of this tile, neighbouring tiles round the same way so none are done twice
+	vec2 scale = u_sceneSize.xy / u_bloomSize.xy;
+	ivec2 first = ivec2(floor(vec2(coord * TILE_SIZE) * scale));
+	ivec2 end = min(ivec2(floor(vec2((coord + 1) * TILE_SIZE) * scale)), ivec2(u_sceneSize.xy));
+
+	ivec2 pixel = first + ivec2(gl_WorkGroupID.yz) * TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+	if (any(greaterThanEqual(pixel, end)) || any(lessThan(pixel, ivec2(u_rect.xy))) || any(greaterThanEqual(pixel, ivec2(u_rect.zw))))
+		return;
+
+	vec2 bloomSize = vec2(textureSize(u_bloom, 0));
+	vec2 uv = (vec2(pixel) + 0.5) / u_sceneSize.xy * u_bloomSize.xy / bloomSize;
+	uv = min(uv, (u_bloomSize.xy - 0.5) / bloomSize);
+	vec3 bloom = textureLod(u_bloom, uv, 0.0).rgb;
+	vec3 scene = imageLoad(u_scene, pixel).rgb;
+
+	imageStore(u_scene, pixel, vec4(scene + bloom, 1.0));
+}
@@ -4,6 +4,21 @@
 layout(binding = 0) uniform sampler2D u_bright; // bright pass image
 layout(binding = 1) uniform sampler2D u_scene; // original scene image
 
+// xy: scale the quad's uv to the part of each texture that was drawn into, zw: largest uv inside it
+// Both are drawn at the render scale, reading them like this upscales them to the frame
+uniform vec4 u_brightUVScale;
+uniform vec4 u_sceneUVScale;
+
+// 1: upscale the scene with the edge adaptive filter and sharpen it, 0: bilinear
+// Only worth it when the scene was drawn below the frame's resolution
+uniform int u_upscale;
+
+// 0 - 1, how hard the upscaled scene is sharpened
+uniform float u_sharpness;
+
+// 0 only copies the scene, u_bright is not read
+uniform int u_addBloom;
+
 // Fragment Shader Inputs
 in VertexData
 {
@@ -15,6 +30,136 @@ in VertexData
 
 layout(location = 0) out vec4 FragColor;
 
+float luma(vec3 c)
+{
+	return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+// Polynomial stand in for a 2 lobe Lanczos filter, x2 is the squared distance in texels
+// window 1/4 gives the full lobe out to 2 texels, up to 1/2 gives a narrower, sharper one
+float lanczos2(float x2, float window)
+{
+	x2 = min(x2, 1.0 / window);
+	float base = 2.0 / 5.0 * x2 - 1.0;
+	base = 25.0 / 16.0 * base * base - (25.0 / 16.0 - 1.0);
+	float w = window * x2 - 1.0;
+	return base * w * w;
+}
+
+// The 4x4 scene texels around the sample, texels[y * 4 + x] is base + (x - 1, y - 1)
+vec3 texels[16];
+float lumas[16];
+
+// Bilinear sample between texel (x, y) and the three after it, at fraction f
+vec3 bilinear(int x, int y, vec2 f)
+{
+	vec3 bottom = mix(texels[y * 4 + x], texels[y * 4 + x + 1], f.x);
+	vec3 top = mix(texels[(y + 1) * 4 + x], texels[(y + 1) * 4 + x + 1], f.x);
+	return mix(bottom, top, f.y);
+}
+
+// Edge adaptive upscale, followed by contrast adaptive sharpening
+//
+// The upscale is a Lanczos style filter over the 4x4 texels around the sample.
+// The luma gradient of the middle 2x2 texels says which way an edge runs and
+// how clean it is. Along a clean edge the kernel is stretched, so it averages
+// along the edge, and squeezed across it, so the edge stays hard instead of
+// going soft like it does with bilinear. Noise and flat areas get the plain
+// round kernel. The result is clamped to the middle 2x2 texels, which keeps
+// the negative lobes from ringing.
+//
+// The sharpening then pushes the result away from its four neighbours one
+// texel out, less where the contrast is already high, so edges do not halo
+// and already sharp detail does not get noisy.
+vec3 upscaleScene(vec2 uv)
+{
+	ivec2 size = textureSize(u_scene, 0);
+	ivec2 last = ivec2(u_sceneUVScale.xy * vec2(size) + 0.5) - 1;
+
+	vec2 p = uv * vec2(size) - 0.5;
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - vec2(base);
+
+	for (int y = 0; y < 4; y++)
+	{
+		for (int x = 0; x < 4; x++)
+		{
+			ivec2 texel = clamp(base + ivec2(x - 1, y - 1), ivec2(0), last);
+			texels[y * 4 + x] = texelFetch(u_scene, texel, 0).rgb;
+			lumas[y * 4 + x] = luma(texels[y * 4 + x]);
+		}
+	}
+
+	// Gradient and edge strength of the middle 2x2 texels, weighted by how close the sample is
+	// A clean edge has one big step between neighbours, so the difference across
+	// the texel is as big as the biggest step, noise goes up and down and comes out near 0
+	vec2 direction = vec2(0.0);
+	float edge = 0.0;
+	for (int y = 1; y <= 2; y++)
+	{
+		for (int x = 1; x <= 2; x++)
+		{
+			float w = (x == 1 ? 1.0 - f.x : f.x) * (y == 1 ? 1.0 - f.y : f.y);
+
+			float left = lumas[y * 4 + x - 1], right = lumas[y * 4 + x + 1];
+			float down = lumas[(y - 1) * 4 + x], up = lumas[(y + 1) * 4 + x];
+			float centre = lumas[y * 4 + x];
+
+			vec2 gradient = vec2(right - left, up - down);
+			vec2 biggestStep = vec2(max(abs(right - centre), abs(centre - left)), max(abs(up - centre), abs(centre - down)));
+			vec2 clean = clamp(abs(gradient) / max(biggestStep, vec2(1.0 / 1024.0)), 0.0, 1.0);
+
+			direction += gradient * w;
+			edge += (clean.x * clean.x + clean.y * clean.y) * 0.5 * w;
+		}
+	}
+
+	// No gradient at all, any direction works
+	float directionLength = length(direction);
+	direction = directionLength > 1.0 / 65536.0 ? direction / directionLength : vec2(1.0, 0.0);
+
+	// Diagonals have texels further apart, stretch reaches them too
+	float stretch = 1.0 / max(abs(direction.x), abs(direction.y));
+	vec2 axisScale = vec2(1.0 + (stretch - 1.0) * edge, 1.0 - 0.5 * edge);
+	float window = 0.5 - 0.29 * edge;
+
+	vec3 colour = vec3(0.0);
+	float totalWeight = 0.0;
+	for (int y = 0; y < 4; y++)
+	{
+		for (int x = 0; x < 4; x++)
+		{
+			// x across the edge, y along it
+			vec2 offset = vec2(float(x - 1), float(y - 1)) - f;
+			vec2 rotated = vec2(dot(offset, direction), dot(offset, vec2(-direction.y, direction.x))) * axisScale;
+
+			float w = lanczos2(dot(rotated, rotated), window);
+			colour += texels[y * 4 + x] * w;
+			totalWeight += w;
+		}
+	}
+	colour /= totalWeight;
+
+	vec3 minimum = min(min(texels[5], texels[6]), min(texels[9], texels[10]));
+	vec3 maximum = max(max(texels[5], texels[6]), max(texels[9], texels[10]));
+	colour = clamp(colour, minimum, maximum);
+
+	// Contrast adaptive sharpening, the neighbours are bilinear samples one texel away
+	vec3 centre = bilinear(1, 1, f);
+	vec3 left = bilinear(0, 1, f);
+	vec3 right = bilinear(2, 1, f);
+	vec3 down = bilinear(1, 0, f);
+	vec3 up = bilinear(1, 2, f);
+
+	vec3 ringMin = min(centre, min(min(left, right), min(down, up)));
+	vec3 ringMax = max(centre, max(max(left, right), max(down, up)));
+	vec3 amount = sqrt(clamp(min(ringMin, 1.0 - ringMax) / max(ringMax, vec3(1.0 / 1024.0)), 0.0, 1.0));
+	vec3 lobe = amount * -1.0 / mix(8.0, 5.0, u_sharpness);
+
+	colour = (colour + (left + right + down + up) * lobe) / (1.0 + 4.0 * lobe);
+	return max(colour, vec3(0.0));
+}
+
 void main()
 {
 	//////////////////////////////////////////////////////////////////////////
@@ -22,8 +167,12 @@ void main()
 	// - Sample from the two textures and add the colors together
 	////////////////////////////////////////////////////////////////////////// 
 
-	vec3 bright = texture(u_bright, vIn.texCoord.xy).rgb;
-	vec3 scene = texture(u_scene, vIn.texCoord.xy).rgb;
+	vec2 sceneUV = min(vIn.texCoord.xy * u_sceneUVScale.xy, u_sceneUVScale.zw);
+	vec3 scene = u_upscale != 0 ? upscaleScene(sceneUV) : texture(u_scene, sceneUV).rgb;
+
+	vec3 bright = vec3(0.0);
+	if (u_addBloom != 0)
+		bright = texture(u_bright, min(vIn.texCoord.xy * u_brightUVScale.xy, u_brightUVScale.zw)).rgb;
 
 	FragColor = vec4(bright + scene,1.0);
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+#version 420
+
+// One step of the bloom downsample chain, halves the image
+// Every output texel averages four bilinear taps, which together cover the
+// 4x4 source texels around it, so nothing is skipped and the result does
+// not shimmer when the camera moves
+
+layout(binding = 0) uniform sampler2D u_source;		// scene colour, or the previous step
+layout(binding = 1) uniform sampler2D u_emissive;	// first step only, what objects emit on purpose
+
+// Texel size of u_source, xy only
+uniform vec4 u_texelSize;
+
+// xy: scales the quad's uv to the part of u_source that was drawn into, zw: largest uv inside it
+uniform vec4 u_uvScale;
+
+// 1 for the first step: threshold the scene, add the emissive colour and use the Karis average
+uniform int u_prefilter;
+
+// Brightness where bloom starts, and how wide the soft curve into it is
+uniform float u_bloomThreshold;
+uniform float u_bloomKnee;
+
+// Fragment Shader Inputs
+in VertexData
+{
+	vec3 normal;
+	vec3 texCoord;
+	vec4 colour;
+	vec3 posEye;
+} vIn;
+
+layout(location = 0) out vec4 FragColor;
+
+// Keeps the part of c above the threshold
+// Inside the knee the response is quadratic instead of a hard cut, so pixels
+// near the threshold fade in and out instead of popping
+vec3 softThreshold(vec3 c)
+{
+	float brightness = max(c.r, max(c.g, c.b));
+	float knee = u_bloomThreshold * u_bloomKnee + 0.00001;
+
+	float soft = clamp(brightness - u_bloomThreshold + knee, 0.0, 2.0 * knee);
+	soft = soft * soft / (4.0 * knee);
+
+	float contribution = max(soft, brightness - u_bloomThreshold) / max(brightness, 0.00001);
+	return c * contribution;
+}
+
+vec3 prefiltered(vec2 uv)
+{
+	return softThreshold(texture(u_source, uv).rgb) + texture(u_emissive, uv).rgb;
+}
+
+// Karis average, every tap is weighted by 1 / (1 + luma)
+// One very bright pixel can not outweigh its neighbours, so it can not make
+// the whole bloom flicker as it moves between texels
+float karisWeight(vec3 c)
+{
+	return 1.0 / (1.0 + dot(c, vec3(0.2126, 0.7152, 0.0722)));
+}
+
+void main()
+{
+	vec2 uv = vIn.texCoord.xy * u_uvScale.xy;
+	vec2 offset = u_texelSize.xy;
+
+	vec2 taps[4] = vec2[4](uv + vec2(-offset.x, -offset.y), uv + vec2(offset.x, -offset.y), uv + vec2(-offset.x, offset.y), uv + vec2(offset.x, offset.y));
+
+	// Nothing past the drawn part is read, like the edge of the texture
+	for (int i = 0; i < 4; i++)
+		taps[i] = min(taps[i], u_uvScale.zw);
+
+	vec3 result = vec3(0.0);
+
+	if (u_prefilter != 0)
+	{
+		float totalWeight = 0.0;
+		for (int i = 0; i < 4; i++)
+		{
+			vec3 c = prefiltered(taps[i]);
+			float w = karisWeight(c);
+			result += c * w;
+			totalWeight += w;
+		}
+		result /= totalWeight;
+	}
+	else
+	{
+		for (int i = 0; i < 4; i++)
+			result += texture(u_source, taps[i]).rgb;
+		result *= 0.25;
+	}
+
+	FragColor = vec4(result, 1.0);
+}
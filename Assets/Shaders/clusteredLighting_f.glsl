@@ -0,0 +1,93 @@
+#version 430
+
+// Same as default_f.glsl, but lit by every light whose cluster this fragment is in
+// See LightClusters.h for how the lights get into the clusters
+
+uniform vec4 u_colour;
+uniform vec4 u_emissive;
+
+// xy: clusters per pixel, zw: slice = floor(log(depth) * z + w) + 1
+uniform vec4 u_clusterParams;
+
+// Shows how many lights every cluster has instead of the lighting
+uniform int u_showClusterLights;
+
+layout(binding = 0) uniform sampler2D u_rgb; // rgb texture
+
+struct PointLight
+{
+	vec4 positionRadius;	// view space position, radius
+	vec4 colour;			// colour times intensity
+};
+
+layout(std430, binding = 0) readonly buffer Lights { PointLight lights[]; };
+layout(std430, binding = 2) readonly buffer ClusterRanges { uvec2 clusterRanges[]; };	// offset, count
+layout(std430, binding = 3) readonly buffer LightIndices { uint lightIndices[]; };
+
+// Must match LightClusters::CLUSTERS_X / Y / Z
+const ivec3 CLUSTERS = ivec3(16, 9, 24);
+
+// Fragment Shader Inputs
+in VertexData
+{
+	vec3 normal;
+	vec3 texCoord;
+	vec4 colour;
+	vec3 posEye;
+} vIn;
+
+layout(location = 0) out vec4 FragColor;
+layout(location = 1) out vec4 FragEmissive;	// glows no matter how bright, see default_f.glsl
+
+uvec2 findCluster()
+{
+	ivec2 tile = min(ivec2(gl_FragCoord.xy * u_clusterParams.xy), CLUSTERS.xy - 1);
+	int slice = int(floor(log(-vIn.posEye.z) * u_clusterParams.z + u_clusterParams.w)) + 1;
+	slice = clamp(slice, 0, CLUSTERS.z - 1);
+
+	return clusterRanges[tile.x + tile.y * CLUSTERS.x + slice * CLUSTERS.x * CLUSTERS.y];
+}
+
+vec3 diffuse(vec3 N, uvec2 range)
+{
+	vec3 diffuseColor = texture(u_rgb, vIn.texCoord.xy).rgb;
+
+	if (length(diffuseColor) == 0)
+		diffuseColor = vec3(0.5);
+
+	vec3 lighting = vec3(0.0);
+	for (uint i = 0; i < range.y; i++)
+	{
+		PointLight light = lights[lightIndices[range.x + i]];
+
+		vec3 L = light.positionRadius.xyz - vIn.posEye;
+		float dist = length(L);
+		float ndotl = max(0.0, dot(N, L / dist));
+
+		// Fades out smoothly to 0 at the radius, so the light stops exactly
+		// where the clusters stop including it
+		float falloff = clamp(1.0 - pow(dist / light.positionRadius.w, 4.0), 0.0, 1.0);
+		falloff *= falloff;
+
+		lighting += ndotl * falloff * light.colour.rgb;
+	}
+
+	return lighting * diffuseColor;
+}
+
+void main()
+{
+	vec3 N = normalize(vIn.normal);
+	uvec2 range = findCluster();
+
+	if (u_showClusterLights != 0)
+	{
+		// Blue with no lights, through green to red at 32 or more
+		float t = clamp(float(range.y) / 32.0, 0.0, 1.0);
+		FragColor = vec4(clamp(vec3(2.0 * t - 1.0, 1.0 - abs(2.0 * t - 1.0), 1.0 - 2.0 * t), 0.0, 1.0), 1.0);
+	}
+	else
+		FragColor = vec4(diffuse(N, range) + u_colour.rgb, 1.0);
+
+	FragEmissive = vec4(u_emissive.rgb, 1.0);
+}
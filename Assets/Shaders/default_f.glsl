@@ -2,6 +2,7 @@
 
 uniform vec4 u_lightPos;
 uniform vec4 u_colour;
+uniform vec4 u_emissive;
 
 // Note: Uniform bindings
 // This lets you specify the texture unit directly in the shader!
@@ -19,8 +20,9 @@ in VertexData
 // Multiple render targets!
 // Notice that we now have two outputs
 // This means this fragment shader can write to 2 different textures!
+// The second one is what glows on purpose, bloom starts from it and the bright parts of the first
 layout(location = 0) out vec4 FragColor;
-layout(location = 1) out vec4 FragNormal;
+layout(location = 1) out vec4 FragEmissive;
 
 vec3 diffuse()
 {
@@ -44,13 +46,7 @@ void main()
 	// Write to color texture (FBO attachment 0)
 	FragColor = vec4(diffuse() + u_colour.rgb, 1.0);
 
-	// Write to normal texture (FBO attachment 1)
-	vec3 N = normalize(vIn.normal);
-
-	// Normals can be in the range of (-1, 1) but our textures
-	// can only store data between the range (0, 1)
-	// So we need to shift the normal from the range (-1, 1) to (0, 1)
-	N = N * 0.5 + 0.5;
-
-	FragNormal = vec4(N, 1.0);
+	// Write to emissive texture (FBO attachment 1)
+	// The threshold is applied later, while bloom downsamples the scene
+	FragEmissive = vec4(u_emissive.rgb, 1.0);
 }
\ No newline at end of file
@@ -22,6 +22,9 @@ out VertexData
 	vec3 posEye;
 } vOut;
 
+// Must match the depth pre-pass shader exactly (see depthOnly_v.glsl)
+invariant gl_Position;
+
 void main() 
 {
 	vOut.texCoord = vIn_uv;
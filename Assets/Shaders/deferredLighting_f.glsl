@@ -0,0 +1,98 @@
+#version 430
+
+// Lights the G-buffer written by gBuffer_f.glsl, one full screen pass
+// Every pixel loops over the lights of its cluster, the same lists the
+// forward clustered shader uses (see LightClusters.h), so the cost depends
+// on the number of pixels and not on how many times the scene was overdrawn
+
+layout(binding = 0) uniform sampler2D u_albedo;
+layout(binding = 1) uniform sampler2D u_normal;
+layout(binding = 2) uniform sampler2D u_colour;
+layout(binding = 3) uniform sampler2D u_depth;
+
+uniform mat4 u_inverseProjection;
+
+// xy: pixels of the G-buffer the scene was drawn into
+uniform vec4 u_sceneSize;
+
+// xy: clusters per pixel, zw: slice = floor(log(depth) * z + w) + 1
+uniform vec4 u_clusterParams;
+
+// Shows how many lights every cluster has instead of the lighting
+uniform int u_showClusterLights;
+
+struct PointLight
+{
+	vec4 positionRadius;	// view space position, radius
+	vec4 colour;			// colour times intensity
+};
+
+layout(std430, binding = 0) readonly buffer Lights { PointLight lights[]; };
+layout(std430, binding = 2) readonly buffer ClusterRanges { uvec2 clusterRanges[]; };	// offset, count
+layout(std430, binding = 3) readonly buffer LightIndices { uint lightIndices[]; };
+
+// Must match LightClusters::CLUSTERS_X / Y / Z
+const ivec3 CLUSTERS = ivec3(16, 9, 24);
+
+// Bloom reads the G-buffer's emissive colour itself, so only the lit colour is written
+layout(location = 0) out vec4 FragColor;
+
+vec3 octahedronDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(u_depth, pixel, 0).r;
+
+	// Nothing was drawn here, same as the scene FBO's clear colour
+	if (depth == 1.0)
+	{
+		FragColor = vec4(0.0);
+		return;
+	}
+
+	// View space position from the depth buffer
+	vec2 uv = (gl_FragCoord.xy) / u_sceneSize.xy;
+	vec4 position = u_inverseProjection * vec4(vec3(uv, depth) * 2.0 - 1.0, 1.0);
+	vec3 posEye = position.xyz / position.w;
+
+	ivec2 tile = min(ivec2(gl_FragCoord.xy * u_clusterParams.xy), CLUSTERS.xy - 1);
+	int slice = clamp(int(floor(log(-posEye.z) * u_clusterParams.z + u_clusterParams.w)) + 1, 0, CLUSTERS.z - 1);
+	uvec2 range = clusterRanges[tile.x + tile.y * CLUSTERS.x + slice * CLUSTERS.x * CLUSTERS.y];
+
+	if (u_showClusterLights != 0)
+	{
+		// Blue with no lights, through green to red at 32 or more
+		float t = clamp(float(range.y) / 32.0, 0.0, 1.0);
+		FragColor = vec4(clamp(vec3(2.0 * t - 1.0, 1.0 - abs(2.0 * t - 1.0), 1.0 - 2.0 * t), 0.0, 1.0), 1.0);
+		return;
+	}
+
+	vec3 N = octahedronDecode(texelFetch(u_normal, pixel, 0).rg);
+
+	vec3 lighting = vec3(0.0);
+	for (uint i = 0; i < range.y; i++)
+	{
+		PointLight light = lights[lightIndices[range.x + i]];
+
+		vec3 L = light.positionRadius.xyz - posEye;
+		float dist = length(L);
+		float ndotl = max(0.0, dot(N, L / dist));
+
+		// Same falloff as clusteredLighting_f.glsl
+		float falloff = clamp(1.0 - pow(dist / light.positionRadius.w, 4.0), 0.0, 1.0);
+		falloff *= falloff;
+
+		lighting += ndotl * falloff * light.colour.rgb;
+	}
+
+	vec3 albedo = texelFetch(u_albedo, pixel, 0).rgb;
+	vec3 colour = texelFetch(u_colour, pixel, 0).rgb;
+	FragColor = vec4(lighting * albedo + colour, 1.0);
+}
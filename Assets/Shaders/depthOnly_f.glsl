@@ -0,0 +1,6 @@
+#version 420
+
+// Depth only pass, colour writes are disabled so there is nothing to output
+void main()
+{
+}
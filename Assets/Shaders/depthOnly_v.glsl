@@ -0,0 +1,16 @@
+#version 420
+
+// Position only vertex shader used for the depth pre-pass
+// Only the position attribute is bound, so no other vertex data is fetched
+layout(location = 0) in vec3 vIn_vertex;
+
+uniform mat4 u_mvp;
+
+// The colour pass tests against this depth with GL_EQUAL,
+// so both shaders must compute exactly the same position
+invariant gl_Position;
+
+void main()
+{
+	gl_Position = u_mvp * vec4(vIn_vertex, 1.0);
+}
@@ -0,0 +1,45 @@
+#version 420
+
+// Writes the G-buffer for deferred shading, the lighting happens later in deferredLighting_f.glsl
+// Position is not stored, it is rebuilt from the depth buffer
+
+uniform vec4 u_colour;
+uniform vec4 u_emissive;
+
+layout(binding = 0) uniform sampler2D u_rgb; // rgb texture
+
+// Fragment Shader Inputs
+in VertexData
+{
+	vec3 normal;
+	vec3 texCoord;
+	vec4 colour;
+	vec3 posEye;
+} vIn;
+
+layout(location = 0) out vec4 GAlbedo;		// RGBA8, diffuse colour
+layout(location = 1) out vec2 GNormal;		// RG16F, view space normal folded onto an octahedron
+layout(location = 2) out vec4 GColour;		// RGBA8, u_colour, added on top of the lighting
+layout(location = 3) out vec4 GEmissive;	// RGBA8, u_emissive, read by the first bloom downsample
+
+// Maps the unit sphere onto the [-1, 1] square, two channels instead of three
+// The upper half is the inner diamond, the lower half is folded out to the corners
+vec2 octahedronEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 folded = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	return n.z >= 0.0 ? n.xy : folded;
+}
+
+void main()
+{
+	vec3 diffuseColor = texture(u_rgb, vIn.texCoord.xy).rgb;
+
+	if (length(diffuseColor) == 0)
+		diffuseColor = vec3(0.5);
+
+	GAlbedo = vec4(diffuseColor, 1.0);
+	GNormal = octahedronEncode(normalize(vIn.normal));
+	GColour = vec4(u_colour.rgb, 1.0);
+	GEmissive = vec4(u_emissive.rgb, 1.0);
+}
@@ -4,6 +4,9 @@ layout(binding = 0) uniform sampler2D u_bright; // bright pass image
 
 // (1.0 / windowWidth, 1.0 / windowHeight)
 uniform vec4 u_texelSize; // Remember to set this!
+
+// xy: scales the quad's uv to the part of u_bright that was drawn into, zw: largest uv inside it
+uniform vec4 u_uvScale;
 uniform mat4 kernel;
 uniform float u_bloomThreshold;
 
@@ -20,7 +23,7 @@ layout(location = 0) out vec4 FragColor;
 
 vec3 gaussianBlur(sampler2D blur)
 {
-	vec2 uv = (vIn.texCoord).xy;
+	vec2 uv = (vIn.texCoord).xy * u_uvScale.xy;
 	vec2 offsetCoordinates[9];
 	
 	offsetCoordinates[0] = vec2(-u_texelSize.x, u_texelSize.y) + uv;	// top left
@@ -35,6 +38,10 @@ vec3 gaussianBlur(sampler2D blur)
 	offsetCoordinates[7] = vec2(u_texelSize.x, 0.0f) + uv;				// middle right
 	offsetCoordinates[8] = vec2(u_texelSize.x, -u_texelSize.y) + uv;	// bottom right
 	
+	// Nothing past the drawn part is read, like the edge of the texture
+	for (int i = 0; i < 9; i++)
+		offsetCoordinates[i] = min(offsetCoordinates[i], u_uvScale.zw);
+
 	vec3 blurred = vec3(0.0);
 
 	blurred += texture(blur, offsetCoordinates[0]).rgb * 0.077847;
@@ -0,0 +1,14 @@
+#version 420
+
+// Copies the scene depth into level 0 of the hierarchical depth buffer
+layout(binding = 0) uniform sampler2D u_depth;
+
+// xy: part of u_depth the scene was drawn into, it is stretched over the whole level
+uniform vec4 u_sourceScale;
+
+layout(location = 0) out float FragDepth;
+
+void main()
+{
+	FragDepth = texelFetch(u_depth, ivec2(gl_FragCoord.xy * u_sourceScale.xy), 0).r;
+}
@@ -0,0 +1,42 @@
+#version 420
+
+// Builds one level of the hierarchical depth buffer from the level above it
+// Every texel keeps the furthest depth of the texels it covers
+// The texture's base level is set to the previous level while this runs,
+// so level 0 here is the level we are reading from
+layout(binding = 0) uniform sampler2D u_depth;
+
+layout(location = 0) out float FragDepth;
+
+void main()
+{
+	ivec2 previousSize = textureSize(u_depth, 0);
+	ivec2 coord = ivec2(gl_FragCoord.xy) * 2;
+
+	float d0 = texelFetch(u_depth, coord, 0).r;
+	float d1 = texelFetch(u_depth, min(coord + ivec2(1, 0), previousSize - 1), 0).r;
+	float d2 = texelFetch(u_depth, min(coord + ivec2(0, 1), previousSize - 1), 0).r;
+	float d3 = texelFetch(u_depth, min(coord + ivec2(1, 1), previousSize - 1), 0).r;
+	float maxDepth = max(max(d0, d1), max(d2, d3));
+
+	// Odd sized levels have an extra row / column that would otherwise be skipped
+	bool extraColumn = (previousSize.x & 1) != 0 && previousSize.x > 1 && coord.x == previousSize.x - 3;
+	bool extraRow = (previousSize.y & 1) != 0 && previousSize.y > 1 && coord.y == previousSize.y - 3;
+
+	if (extraColumn)
+	{
+		maxDepth = max(maxDepth, texelFetch(u_depth, coord + ivec2(2, 0), 0).r);
+		maxDepth = max(maxDepth, texelFetch(u_depth, min(coord + ivec2(2, 1), previousSize - 1), 0).r);
+	}
+
+	if (extraRow)
+	{
+		maxDepth = max(maxDepth, texelFetch(u_depth, coord + ivec2(0, 2), 0).r);
+		maxDepth = max(maxDepth, texelFetch(u_depth, min(coord + ivec2(1, 2), previousSize - 1), 0).r);
+	}
+
+	if (extraColumn && extraRow)
+		maxDepth = max(maxDepth, texelFetch(u_depth, coord + ivec2(2, 2), 0).r);
+
+	FragDepth = maxDepth;
+}
@@ -0,0 +1,61 @@
+#version 430
+
+// Bins the lights into the clusters of the view frustum, see LightClusters.h
+// One thread per cluster, every thread tests every light against its box
+// Each cluster writes its list into its own fixed range of lightIndices
+layout(local_size_x = 64) in;
+
+struct PointLight
+{
+	vec4 positionRadius;	// view space position, radius
+	vec4 colour;
+};
+
+layout(std430, binding = 0) readonly buffer Lights { PointLight lights[]; };
+layout(std430, binding = 1) readonly buffer ClusterBounds { vec4 clusterBounds[]; };	// min, max
+layout(std430, binding = 2) writeonly buffer ClusterRanges { uvec2 clusterRanges[]; };	// offset, count
+layout(std430, binding = 3) writeonly buffer LightIndices { uint lightIndices[]; };
+
+uniform int u_numLights;
+uniform int u_maxLightsPerCluster;
+
+// The group loads 64 lights at a time into shared memory, then every thread tests them
+shared vec4 groupLights[64];
+
+void main()
+{
+	uint cluster = gl_GlobalInvocationID.x;
+	vec3 boxMin = clusterBounds[cluster * 2].xyz;
+	vec3 boxMax = clusterBounds[cluster * 2 + 1].xyz;
+
+	uint offset = cluster * uint(u_maxLightsPerCluster);
+	uint count = 0;
+
+	for (int first = 0; first < u_numLights; first += 64)
+	{
+		int index = first + int(gl_LocalInvocationIndex);
+		if (index < u_numLights)
+			groupLights[gl_LocalInvocationIndex] = lights[index].positionRadius;
+
+		barrier();
+
+		int numInGroup = min(64, u_numLights - first);
+		for (int i = 0; i < numInGroup; i++)
+		{
+			// Distance from the light to the closest point of the box
+			vec4 light = groupLights[i];
+			vec3 d = light.xyz - clamp(light.xyz, boxMin, boxMax);
+
+			if (dot(d, d) <= light.w * light.w && count < uint(u_maxLightsPerCluster))
+			{
+				lightIndices[offset + count] = uint(first + i);
+				count++;
+			}
+		}
+
+		// Everyone has to be done with this group before it is overwritten
+		barrier();
+	}
+
+	clusterRanges[cluster] = uvec2(offset, count);
+}
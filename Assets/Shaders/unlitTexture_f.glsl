@@ -4,6 +4,9 @@
 // This lets you specify the texture unit directly in the shader!
 layout(binding = 0) uniform sampler2D u_rgb; // rgb texture
 
+// xy: scales the quad's uv to the part of u_rgb that was drawn into, zw: largest uv inside it
+uniform vec4 u_uvScale;
+
 // Fragment Shader Inputs
 in VertexData
 {
@@ -18,6 +21,6 @@ layout(location = 0) out vec4 FragColor;
 
 void main()
 {
-	vec4 color = texture(u_rgb, vIn.texCoord.xy);
+	vec4 color = texture(u_rgb, min(vIn.texCoord.xy * u_uvScale.xy, u_uvScale.zw));
 	FragColor = vec4(color.xyz, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,359 @@
+#include "Benchmark.h"
+#include "AllocationTracker.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#endif
+
+namespace Benchmark
+{
+	namespace
+	{
+		std::vector<std::unique_ptr<Registration>>& getRegistrations()
+		{
+			// Function local so it exists before the static registrations in other files run
+			static std::vector<std::unique_ptr<Registration>> registrations;
+			return registrations;
+		}
+
+		double realSeconds()
+		{
+			return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// CPU time of the calling thread, so time spent waiting for the OS is not counted
+		double cpuSeconds()
+		{
+#ifdef _WIN32
+			FILETIME creation, exit, kernel, user;
+			if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user))
+				return 0.0;
+
+			// 100 nanosecond ticks
+			unsigned long long ticks = ((unsigned long long)kernel.dwHighDateTime << 32 | kernel.dwLowDateTime) +
+				((unsigned long long)user.dwHighDateTime << 32 | user.dwLowDateTime);
+			return ticks * 1e-7;
+#else
+			timespec time;
+			clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+			return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+		}
+
+		unsigned long long currentAllocations()
+		{
+			return AllocationTracker::getTotal().allocations;
+		}
+
+		const void* volatile sink = nullptr;
+	}
+
+	struct Result
+	{
+		std::string name;
+		std::string label;
+		std::string error;
+		int64_t iterations;
+		double realTime;	// nanoseconds per iteration
+		double cpuTime;
+		double itemsPerSecond;
+		double allocationsPerIteration;
+	};
+
+	struct Runner
+	{
+		static Result run(Registration& registration, bool hasArg, int64_t arg, double minTime)
+		{
+			Result result;
+			result.name = registration.m_pName;
+			if (hasArg)
+				result.name += "/" + std::to_string(arg);
+
+			// Grow the iteration count until one run is long enough to measure
+			int64_t iterations = 1;
+			for (;;)
+			{
+				State state(iterations, arg);
+				registration.m_pFunction(state);
+
+				if (state.m_pRunning)
+					state.pauseTiming();
+
+				if (!state.m_pError.empty())
+				{
+					result.error = state.m_pError;
+					result.iterations = 0;
+					result.realTime = result.cpuTime = result.itemsPerSecond = result.allocationsPerIteration = 0.0;
+					return result;
+				}
+
+				const int64_t MAX_ITERATIONS = 1000000000;
+				if (state.m_pRealTime >= minTime || iterations >= MAX_ITERATIONS)
+				{
+					result.label = state.m_pLabel;
+					result.iterations = iterations;
+					result.realTime = state.m_pRealTime * 1e9 / iterations;
+					result.cpuTime = state.m_pCPUTime * 1e9 / iterations;
+					result.itemsPerSecond = state.m_pItemsProcessed > 0 && state.m_pRealTime > 0.0 ? state.m_pItemsProcessed * iterations / state.m_pRealTime : 0.0;
+					result.allocationsPerIteration = (double)state.m_pAllocations / iterations;
+					return result;
+				}
+
+				// Aim a bit past the minimum time, but never grow by more than 10x at once
+				double scale = state.m_pRealTime > 0.0 ? minTime * 1.4 / state.m_pRealTime : 10.0;
+				if (scale > 10.0)
+					scale = 10.0;
+				int64_t next = (int64_t)(iterations * scale);
+				iterations = next > iterations ? next : iterations + 1;
+				if (iterations > MAX_ITERATIONS)
+					iterations = MAX_ITERATIONS;
+			}
+		}
+
+		static const std::string& getName(const Registration& registration) { return registration.m_pName; }
+		static const std::vector<int64_t>& getArgs(const Registration& registration) { return registration.m_pArgs; }
+	};
+
+	namespace
+	{
+		// Names and labels go into JSON strings, escape what would break them
+		void writeEscaped(FILE* file, const std::string& str)
+		{
+			for (size_t i = 0; i < str.size(); i++)
+			{
+				if (str[i] == '"' || str[i] == '\\')
+					fputc('\\', file);
+				if ((unsigned char)str[i] >= 0x20)
+					fputc(str[i], file);
+			}
+		}
+
+		bool writeJSON(const char* path, const std::vector<Result>& results)
+		{
+			FILE* file = fopen(path, "w");
+			if (!file)
+			{
+				printf("Benchmark: could not open %s for writing\n", path);
+				return false;
+			}
+
+			char date[64];
+			time_t now = time(nullptr);
+			strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", localtime(&now));
+
+			fprintf(file, "{\n  \"context\": {\n");
+			fprintf(file, "    \"date\": \"%s\",\n", date);
+			fprintf(file, "    \"num_cpus\": %u,\n", std::thread::hardware_concurrency());
+#ifdef NDEBUG
+			fprintf(file, "    \"library_build_type\": \"release\"\n");
+#else
+			fprintf(file, "    \"library_build_type\": \"debug\"\n");
+#endif
+			fprintf(file, "  },\n  \"benchmarks\": [");
+
+			for (size_t i = 0; i < results.size(); i++)
+			{
+				const Result& result = results[i];
+				fprintf(file, "%s\n    {\n      \"name\": \"", i ? "," : "");
+				writeEscaped(file, result.name);
+				fprintf(file, "\",\n      \"run_name\": \"");
+				writeEscaped(file, result.name);
+				fprintf(file, "\",\n      \"run_type\": \"iteration\",\n");
+
+				if (!result.error.empty())
+				{
+					fprintf(file, "      \"error_occurred\": true,\n      \"error_message\": \"");
+					writeEscaped(file, result.error);
+					fprintf(file, "\"\n    }");
+					continue;
+				}
+
+				fprintf(file, "      \"iterations\": %lld,\n", (long long)result.iterations);
+				fprintf(file, "      \"real_time\": %.3f,\n", result.realTime);
+				fprintf(file, "      \"cpu_time\": %.3f,\n", result.cpuTime);
+				fprintf(file, "      \"time_unit\": \"ns\",\n");
+				if (result.itemsPerSecond > 0.0)
+					fprintf(file, "      \"items_per_second\": %.3f,\n", result.itemsPerSecond);
+				if (!result.label.empty())
+				{
+					fprintf(file, "      \"label\": \"");
+					writeEscaped(file, result.label);
+					fprintf(file, "\",\n");
+				}
+				fprintf(file, "      \"allocations_per_iteration\": %.3f\n    }", result.allocationsPerIteration);
+			}
+
+			fprintf(file, "\n  ]\n}\n");
+			fclose(file);
+			return true;
+		}
+
+		const char* getOption(const char* arg, const char* name)
+		{
+			size_t length = strlen(name);
+			if (strncmp(arg, name, length) == 0 && arg[length] == '=')
+				return arg + length + 1;
+			return nullptr;
+		}
+	}
+
+	State::State(int64_t iterations, int64_t arg)
+		: m_pIterations(iterations),
+		m_pRemaining(iterations),
+		m_pArg(arg),
+		m_pItemsProcessed(0),
+		m_pStarted(false),
+		m_pRunning(false),
+		m_pRealTime(0.0),
+		m_pCPUTime(0.0),
+		m_pRealStart(0.0),
+		m_pCPUStart(0.0),
+		m_pAllocations(0),
+		m_pAllocationsStart(0)
+	{
+	}
+
+	bool State::keepRunning()
+	{
+		if (!m_pStarted)
+		{
+			m_pStarted = true;
+			if (!m_pError.empty())
+				return false;
+			resumeTiming();
+		}
+
+		if (m_pRemaining > 0)
+		{
+			m_pRemaining--;
+			return true;
+		}
+
+		if (m_pRunning)
+			pauseTiming();
+		return false;
+	}
+
+	void State::pauseTiming()
+	{
+		if (!m_pRunning)
+			return;
+
+		m_pRealTime += realSeconds() - m_pRealStart;
+		m_pCPUTime += cpuSeconds() - m_pCPUStart;
+		m_pAllocations += currentAllocations() - m_pAllocationsStart;
+		m_pRunning = false;
+	}
+
+	void State::resumeTiming()
+	{
+		if (m_pRunning)
+			return;
+
+		m_pAllocationsStart = currentAllocations();
+		m_pCPUStart = cpuSeconds();
+		m_pRealStart = realSeconds();
+		m_pRunning = true;
+	}
+
+	void State::skipWithError(const std::string& message)
+	{
+		m_pError = message;
+		m_pRemaining = 0;
+	}
+
+	Registration::Registration(const char* name, Function function)
+		: m_pName(name),
+		m_pFunction(function)
+	{
+	}
+
+	Registration* Registration::arg(int64_t value)
+	{
+		m_pArgs.push_back(value);
+		return this;
+	}
+
+	Registration* Registration::denseRange(int64_t first, int64_t last)
+	{
+		for (int64_t value = first; value <= last; value++)
+			m_pArgs.push_back(value);
+		return this;
+	}
+
+	Registration* registerBenchmark(const char* name, Function function)
+	{
+		getRegistrations().push_back(std::unique_ptr<Registration>(new Registration(name, function)));
+		return getRegistrations().back().get();
+	}
+
+	int runAll(int argc, char** argv)
+	{
+		const char* filter = "";
+		const char* outPath = nullptr;
+		double minTime = 0.5;
+
+		for (int i = 1; i < argc; i++)
+		{
+			const char* value;
+			if ((value = getOption(argv[i], "--benchmark_filter")))
+				filter = value;
+			else if ((value = getOption(argv[i], "--benchmark_out")))
+				outPath = value;
+			else if ((value = getOption(argv[i], "--benchmark_min_time")))
+				minTime = atof(value);
+		}
+
+		printf("%-48s %14s %14s %12s %12s\n", "Benchmark", "Time (ns)", "CPU (ns)", "Iterations", "Allocs/iter");
+		printf("------------------------------------------------------------------------------------------------------------\n");
+
+		std::vector<Result> results;
+		std::vector<std::unique_ptr<Registration>>& registrations = getRegistrations();
+		for (size_t r = 0; r < registrations.size(); r++)
+		{
+			Registration& registration = *registrations[r];
+			const std::vector<int64_t>& args = Runner::getArgs(registration);
+
+			size_t numRuns = args.empty() ? 1 : args.size();
+			for (size_t a = 0; a < numRuns; a++)
+			{
+				std::string name = Runner::getName(registration);
+				if (!args.empty())
+					name += "/" + std::to_string(args[a]);
+				if (name.find(filter) == std::string::npos)
+					continue;
+
+				Result result = Runner::run(registration, !args.empty(), args.empty() ? 0 : args[a], minTime);
+				if (!result.error.empty())
+					printf("%-48s ERROR: %s\n", result.name.c_str(), result.error.c_str());
+				else
+				{
+					printf("%-48s %14.1f %14.1f %12lld %12.1f", result.name.c_str(), result.realTime, result.cpuTime, (long long)result.iterations, result.allocationsPerIteration);
+					if (result.itemsPerSecond > 0.0)
+						printf("  %.3gM items/s", result.itemsPerSecond * 1e-6);
+					if (!result.label.empty())
+						printf("  %s", result.label.c_str());
+					printf("\n");
+				}
+				results.push_back(result);
+			}
+		}
+
+		if (outPath && !writeJSON(outPath, results))
+			return 1;
+		return 0;
+	}
+
+	void useValue(const void* value)
+	{
+		sink = value;
+	}
+}
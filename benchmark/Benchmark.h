@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A small micro benchmark harness, modelled on Google Benchmark
+//
+//	static void BM_Something(Benchmark::State& state)
+//	{
+//		setUpSomething(state.range());
+//		while (state.keepRunning())
+//			Benchmark::doNotOptimize(doSomething());
+//	}
+//	BENCHMARK(BM_Something)->arg(1000)->arg(10000);
+//
+// Every benchmark is run with more and more iterations until one run takes
+// at least the minimum time, that run is reported. Command line:
+//
+//	--benchmark_filter=<text>		only run benchmarks with text in their name
+//	--benchmark_min_time=<seconds>	minimum time of the reported run, default 0.5
+//	--benchmark_out=<file>			also write the results as JSON (Google Benchmark's format)
+//
+// Allocations per iteration are counted with the AllocationTracker, so the
+// program has to be linked with AllocationTracker.cpp.
+namespace Benchmark
+{
+	class State
+	{
+	public:
+		State(int64_t iterations, int64_t arg);
+
+		// Returns true until the requested number of iterations has run
+		// The clock starts at the first call
+		bool keepRunning();
+
+		// The argument given with arg(), 0 if there is none
+		int64_t range() const { return m_pArg; }
+
+		// Stop the clock for setup that should not be measured
+		void pauseTiming();
+		void resumeTiming();
+
+		// Items (vertices, nodes, uniforms, ...) one iteration handles, reported as items per second
+		void setItemsProcessed(int64_t items) { m_pItemsProcessed = items; }
+
+		// Shows up next to the name, ie. the model that was loaded
+		void setLabel(const std::string& label) { m_pLabel = label; }
+
+		// Reports the benchmark as skipped, ie. when a file it needs is missing
+		void skipWithError(const std::string& message);
+
+	private:
+		friend struct Runner;
+
+		int64_t m_pIterations;
+		int64_t m_pRemaining;
+		int64_t m_pArg;
+		int64_t m_pItemsProcessed;
+		std::string m_pLabel;
+		std::string m_pError;
+
+		bool m_pStarted;
+		bool m_pRunning;
+		double m_pRealTime;		// seconds the clock ran
+		double m_pCPUTime;		// seconds of this thread's CPU time while the clock ran
+		double m_pRealStart;
+		double m_pCPUStart;
+		unsigned long long m_pAllocations;
+		unsigned long long m_pAllocationsStart;
+	};
+
+	typedef void (*Function)(State& state);
+
+	class Registration
+	{
+	public:
+		Registration(const char* name, Function function);
+
+		// Runs the benchmark once for every argument
+		Registration* arg(int64_t value);
+
+		// Runs the benchmark for every argument from first to last
+		Registration* denseRange(int64_t first, int64_t last);
+
+	private:
+		friend struct Runner;
+
+		std::string m_pName;
+		Function m_pFunction;
+		std::vector<int64_t> m_pArgs;
+	};
+
+	Registration* registerBenchmark(const char* name, Function function);
+
+	// Runs every registered benchmark that passes the filter, returns the exit code
+	int runAll(int argc, char** argv);
+
+	// Keeps the compiler from optimising away a value that is never used
+	void useValue(const void* value);
+
+	template <typename T>
+	inline void doNotOptimize(const T& value)
+	{
+		useValue(&value);
+	}
+}
+
+#define BENCHMARK_CONCAT_(a, b) a##b
+#define BENCHMARK_CONCAT(a, b) BENCHMARK_CONCAT_(a, b)
+
+#define BENCHMARK(function) static Benchmark::Registration* BENCHMARK_CONCAT(benchmarkRegistration, __LINE__) = Benchmark::registerBenchmark(#function, function)
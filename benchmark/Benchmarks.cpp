@@ -0,0 +1,335 @@
+// CPU micro benchmarks for the engine's hot functions
+//
+// Runs without a window or GL context, GL calls made by the benchmarked code
+// go to GLMock. Build as a console program from the files in this folder plus:
+//
+//	src/AllocationTracker.cpp src/GameObject.cpp src/GLState.cpp src/JobSystem.cpp
+//	src/RenderQueue.cpp src/RenderStats.cpp src/ShaderProgram.cpp src/Trace.cpp
+//	src/TransformBatch.cpp src/VertexBufferObject.cpp src/TTK/MeshBase.cpp src/TTK/MeshOptimizer.cpp
+//	src/TTK/MeshSimplifier.cpp src/TTK/OBJMesh.cpp src/TTK/Texture2D.cpp src/TTK/Utilities.cpp
+//
+// with the same include paths and libraries as the main project. Always measure a release build.
+// The *SIMD benchmarks only exist when GLM has SIMD enabled, ie. not with GLM_FORCE_PURE.
+//
+//	Benchmarks.exe --benchmark_out=results.json
+//	Benchmarks.exe --benchmark_filter=OBJMesh --assets=../../Assets/Models/
+#include "Benchmark.h"
+#include "GLMock.h"
+#include "GameObject.h"
+#include "Material.h"
+#include "TransformBatch.h"
+#include "TTK/OBJMesh.h"
+#include "TTK/Utilities.h"
+#include <GLM/gtc/type_aligned.hpp>
+#include <GLM/gtx/transform.hpp>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#if (GLM_ARCH & GLM_ARCH_SSE2_BIT) && GLM_HAS_ALIGNED_TYPE
+#define BENCHMARK_GLM_SIMD
+#include <GLM/simd/matrix.h>
+#endif
+
+namespace
+{
+	// Same place the game loads them from, can be changed with --assets=
+	std::string modelPath = "../../Assets/Models/";
+
+	const char* models[] = { "cube.obj", "floor.obj", "sphere.obj", "torus.obj", "teapot.obj" };
+	const int NUM_MODELS = sizeof(models) / sizeof(models[0]);
+
+	// Mesh loading prints its vertex cache stats, keep that out of the measurement
+	class SilenceOutput
+	{
+	public:
+		SilenceOutput() : m_pBuffer(std::cout.rdbuf(nullptr)) {}
+		~SilenceOutput() { std::cout.rdbuf(m_pBuffer); }
+
+	private:
+		std::streambuf* m_pBuffer;
+	};
+
+	// Builds a tree of numNodes game objects, every node has up to branching children
+	// Returns the nodes in breadth first order, nodes[0] is the root
+	std::vector<std::unique_ptr<GameObject>> createHierarchy(int numNodes, int branching)
+	{
+		std::vector<std::unique_ptr<GameObject>> nodes;
+		nodes.reserve(numNodes);
+
+		for (int i = 0; i < numNodes; i++)
+		{
+			float f = (float)i;
+			nodes.push_back(std::unique_ptr<GameObject>(new GameObject(glm::vec3(f * 0.01f, 1.0f, -f * 0.02f), nullptr, nullptr)));
+			nodes[i]->setRotationAngleX(f * 3.0f);
+			nodes[i]->setRotationAngleY(f * 5.0f);
+			nodes[i]->setRotationAngleZ(f * 7.0f);
+			nodes[i]->setScale(1.0f + (i % 3) * 0.1f);
+
+			if (i > 0)
+				nodes[(i - 1) / branching]->addChild(nodes[i].get());
+		}
+
+		return nodes;
+	}
+
+	// Rotations, positions and scales for the matrix benchmarks
+	const int NUM_TRANSFORMS = 1024;
+
+	template <typename Mat4, typename Vec3>
+	Mat4 compose(const Vec3& position, const Vec3& angles, float scale)
+	{
+		// Same order as GameObject::update()
+		Mat4 rx = glm::rotate(glm::radians(angles.x), Vec3(1.0f, 0.0f, 0.0f));
+		Mat4 ry = glm::rotate(glm::radians(angles.y), Vec3(0.0f, 1.0f, 0.0f));
+		Mat4 rz = glm::rotate(glm::radians(angles.z), Vec3(0.0f, 0.0f, 1.0f));
+		return glm::translate(position) * (rz * ry * rx) * glm::scale(Vec3(scale));
+	}
+
+	template <typename Mat4, typename Vec3>
+	void composeTransforms(Benchmark::State& state)
+	{
+		std::vector<Vec3> positions(NUM_TRANSFORMS), angles(NUM_TRANSFORMS);
+		for (int i = 0; i < NUM_TRANSFORMS; i++)
+		{
+			positions[i] = Vec3((float)i, 2.0f, -(float)i);
+			angles[i] = Vec3(i * 3.0f, i * 5.0f, i * 7.0f);
+		}
+
+		Mat4 result;
+		while (state.keepRunning())
+		{
+			for (int i = 0; i < NUM_TRANSFORMS; i++)
+			{
+				result = compose<Mat4, Vec3>(positions[i], angles[i], 1.5f);
+				Benchmark::doNotOptimize(result);
+			}
+		}
+		state.setItemsProcessed(NUM_TRANSFORMS);
+	}
+
+	// Parent * local for a whole array, the multiply GameObject::update() does per node
+	template <typename Mat4, typename Vec3>
+	void multiplyTransforms(Benchmark::State& state)
+	{
+		std::vector<Mat4> locals(NUM_TRANSFORMS), worlds(NUM_TRANSFORMS);
+		for (int i = 0; i < NUM_TRANSFORMS; i++)
+			locals[i] = compose<Mat4, Vec3>(Vec3((float)i, 2.0f, 0.0f), Vec3(i * 3.0f, i * 5.0f, i * 7.0f), 1.0f);
+
+		Mat4 parent = compose<Mat4, Vec3>(Vec3(1.0f, 2.0f, 3.0f), Vec3(10.0f, 20.0f, 30.0f), 2.0f);
+		while (state.keepRunning())
+		{
+			for (int i = 0; i < NUM_TRANSFORMS; i++)
+				worlds[i] = parent * locals[i];
+			Benchmark::doNotOptimize(worlds[NUM_TRANSFORMS - 1]);
+		}
+		state.setItemsProcessed(NUM_TRANSFORMS);
+	}
+}
+
+// Parses, welds, optimises and uploads (to GLMock) one of the bundled models
+static void BM_OBJMeshLoad(Benchmark::State& state)
+{
+	std::string path = modelPath + models[state.range()];
+	state.setLabel(models[state.range()]);
+
+	if (!std::ifstream(path).good())
+	{
+		state.skipWithError(path + " not found, pass --assets=<folder with the models>");
+		return;
+	}
+
+	SilenceOutput silence;
+	unsigned int numTriangles = 0;
+	while (state.keepRunning())
+	{
+		TTK::OBJMesh mesh;
+		mesh.loadMesh(path);
+		numTriangles = mesh.getNumTriangles(0);
+	}
+	state.setItemsProcessed(numTriangles);
+}
+BENCHMARK(BM_OBJMeshLoad)->denseRange(0, NUM_MODELS - 1);
+
+// Updates the whole hierarchy from the root, like the simulation tick does
+static void BM_GameObjectUpdate(Benchmark::State& state)
+{
+	std::vector<std::unique_ptr<GameObject>> nodes = createHierarchy((int)state.range(), 4);
+
+	while (state.keepRunning())
+		nodes[0]->update(1.0f / 60.0f);
+
+	Benchmark::doNotOptimize(nodes.back()->getLocalToWorldMatrix());
+	state.setItemsProcessed(state.range());
+}
+BENCHMARK(BM_GameObjectUpdate)->arg(1000)->arg(10000)->arg(100000);
+
+// A material with range() uniforms of every type, GL calls go to GLMock
+static void BM_MaterialSendUniforms(Benchmark::State& state)
+{
+	Material material;
+	for (int i = 0; i < state.range(); i++)
+	{
+		std::string index = std::to_string(i);
+		material.setVec4(("u_vec4_" + index).c_str(), glm::vec4((float)i));
+		material.setMat4(("u_mat4_" + index).c_str(), glm::mat4((float)i));
+		material.setInt(("u_int_" + index).c_str(), i);
+		material.setFloat(("u_float_" + index).c_str(), (float)i);
+	}
+
+	// One send up front to see how many GL calls it makes
+	GLMock::resetCalls();
+	material.sendUniforms();
+	state.setLabel(std::to_string(GLMock::getNumCalls()) + " GL calls per send");
+
+	while (state.keepRunning())
+		material.sendUniforms();
+
+	state.setItemsProcessed(state.range() * 4);
+}
+BENCHMARK(BM_MaterialSendUniforms)->arg(1)->arg(4)->arg(16);
+
+static void BM_GetColorFromHue(Benchmark::State& state)
+{
+	const int NUM_COLOURS = 256;
+	while (state.keepRunning())
+	{
+		for (int i = 0; i < NUM_COLOURS; i++)
+			Benchmark::doNotOptimize(getColorFromHue(i / (float)NUM_COLOURS));
+	}
+	state.setItemsProcessed(NUM_COLOURS);
+}
+BENCHMARK(BM_GetColorFromHue);
+
+static void BM_RandomDirection(Benchmark::State& state)
+{
+	const int NUM_DIRECTIONS = 256;
+	while (state.keepRunning())
+	{
+		for (int i = 0; i < NUM_DIRECTIONS; i++)
+			Benchmark::doNotOptimize(randomDirection());
+	}
+	state.setItemsProcessed(NUM_DIRECTIONS);
+}
+BENCHMARK(BM_RandomDirection);
+
+// glm::mat4 is what the engine uses, GLM only takes its SIMD paths for the aligned types
+static void BM_Mat4Compose(Benchmark::State& state)
+{
+	composeTransforms<glm::mat4, glm::vec3>(state);
+}
+BENCHMARK(BM_Mat4Compose);
+
+static void BM_Mat4Multiply(Benchmark::State& state)
+{
+	multiplyTransforms<glm::mat4, glm::vec3>(state);
+}
+BENCHMARK(BM_Mat4Multiply);
+
+#ifdef BENCHMARK_GLM_SIMD
+static void BM_Mat4ComposeSIMD(Benchmark::State& state)
+{
+	composeTransforms<glm::tmat4x4<float, glm::aligned_highp>, glm::tvec3<float, glm::aligned_highp>>(state);
+}
+BENCHMARK(BM_Mat4ComposeSIMD);
+
+static void BM_Mat4MultiplySIMD(Benchmark::State& state)
+{
+	multiplyTransforms<glm::tmat4x4<float, glm::aligned_highp>, glm::tvec3<float, glm::aligned_highp>>(state);
+}
+BENCHMARK(BM_Mat4MultiplySIMD);
+
+// GLM's SSE matrix multiply called directly, the lower bound for the two above
+static void BM_Mat4MultiplyIntrinsics(Benchmark::State& state)
+{
+	std::vector<glm::mat4> source(NUM_TRANSFORMS);
+	for (int i = 0; i < NUM_TRANSFORMS; i++)
+		source[i] = compose<glm::mat4, glm::vec3>(glm::vec3((float)i, 2.0f, 0.0f), glm::vec3(i * 3.0f, i * 5.0f, i * 7.0f), 1.0f);
+
+	// Four columns per matrix
+	std::vector<glm_vec4> locals(NUM_TRANSFORMS * 4), worlds(NUM_TRANSFORMS * 4);
+	for (int i = 0; i < NUM_TRANSFORMS * 4; i++)
+		locals[i] = _mm_loadu_ps(&source[i / 4][i % 4][0]);
+
+	glm::mat4 parentMatrix = compose<glm::mat4, glm::vec3>(glm::vec3(1.0f, 2.0f, 3.0f), glm::vec3(10.0f, 20.0f, 30.0f), 2.0f);
+	glm_vec4 parent[4];
+	for (int c = 0; c < 4; c++)
+		parent[c] = _mm_loadu_ps(&parentMatrix[c][0]);
+
+	while (state.keepRunning())
+	{
+		for (int i = 0; i < NUM_TRANSFORMS; i++)
+			glm_mat4_mul(parent, &locals[i * 4], &worlds[i * 4]);
+		Benchmark::doNotOptimize(worlds[NUM_TRANSFORMS * 4 - 1]);
+	}
+	state.setItemsProcessed(NUM_TRANSFORMS);
+}
+BENCHMARK(BM_Mat4MultiplyIntrinsics);
+#endif
+
+// The closed form compose from TransformBatch, compare with BM_Mat4Compose
+static void BM_TransformComposeTRS(Benchmark::State& state)
+{
+	std::vector<TransformBatch::TRS> transforms(NUM_TRANSFORMS);
+	for (int i = 0; i < NUM_TRANSFORMS; i++)
+	{
+		transforms[i].position = glm::vec3((float)i, 2.0f, -(float)i);
+		transforms[i].rotation = glm::vec3(i * 3.0f, i * 5.0f, i * 7.0f);
+		transforms[i].scale = 1.5f;
+	}
+
+	std::vector<glm::mat4> results(NUM_TRANSFORMS);
+	while (state.keepRunning())
+	{
+		TransformBatch::composeTRS(&transforms[0], &results[0], nullptr, NUM_TRANSFORMS);
+		Benchmark::doNotOptimize(results[NUM_TRANSFORMS - 1]);
+	}
+	state.setItemsProcessed(NUM_TRANSFORMS);
+}
+BENCHMARK(BM_TransformComposeTRS);
+
+// TransformBatch::multiply() with every instruction set, range() is the TransformBatch::InstructionSet
+static void BM_TransformMultiply(Benchmark::State& state)
+{
+	TransformBatch::InstructionSet set = (TransformBatch::InstructionSet)state.range();
+	if (set > TransformBatch::getSupported())
+	{
+		state.skipWithError(std::string(TransformBatch::getName(set)) + " is not supported on this CPU");
+		return;
+	}
+
+	std::vector<glm::mat4> locals(NUM_TRANSFORMS), worlds(NUM_TRANSFORMS);
+	for (int i = 0; i < NUM_TRANSFORMS; i++)
+		locals[i] = compose<glm::mat4, glm::vec3>(glm::vec3((float)i, 2.0f, 0.0f), glm::vec3(i * 3.0f, i * 5.0f, i * 7.0f), 1.0f);
+	glm::mat4 parent = compose<glm::mat4, glm::vec3>(glm::vec3(1.0f, 2.0f, 3.0f), glm::vec3(10.0f, 20.0f, 30.0f), 2.0f);
+
+	TransformBatch::InstructionSet previous = TransformBatch::getInstructionSet();
+	TransformBatch::setInstructionSet(set);
+	state.setLabel(TransformBatch::getName(set));
+
+	while (state.keepRunning())
+	{
+		TransformBatch::multiply(parent, &locals[0], &worlds[0], NUM_TRANSFORMS);
+		Benchmark::doNotOptimize(worlds[NUM_TRANSFORMS - 1]);
+	}
+
+	TransformBatch::setInstructionSet(previous);
+	state.setItemsProcessed(NUM_TRANSFORMS);
+}
+BENCHMARK(BM_TransformMultiply)->denseRange(0, TransformBatch::NUM_INSTRUCTION_SETS - 1);
+
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--assets=", 9) == 0)
+			modelPath = argv[i] + 9;
+	}
+
+	GLMock::install();
+	TransformBatch::init();
+	return Benchmark::runAll(argc, argv);
+}
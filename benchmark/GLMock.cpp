@@ -0,0 +1,78 @@
+#include "GLMock.h"
+#include "GLEW/glew.h"
+
+namespace GLMock
+{
+	namespace
+	{
+		unsigned long long numCalls = 0;
+		GLuint nextHandle = 1;
+
+		void generate(GLsizei n, GLuint* handles)
+		{
+			numCalls++;
+			for (GLsizei i = 0; i < n; i++)
+				handles[i] = nextHandle++;
+		}
+
+		// Programs and shaders
+		GLuint GLAPIENTRY createProgram() { numCalls++; return nextHandle++; }
+		void GLAPIENTRY useProgram(GLuint) { numCalls++; }
+		void GLAPIENTRY deleteProgram(GLuint) { numCalls++; }
+		GLint GLAPIENTRY getUniformLocation(GLuint, const GLchar*) { numCalls++; return 0; }
+		void GLAPIENTRY uniform1i(GLint, GLint) { numCalls++; }
+		void GLAPIENTRY uniform1f(GLint, GLfloat) { numCalls++; }
+		void GLAPIENTRY uniform4fv(GLint, GLsizei, const GLfloat*) { numCalls++; }
+		void GLAPIENTRY uniformMatrix4fv(GLint, GLsizei, GLboolean, const GLfloat*) { numCalls++; }
+
+		// Vertex arrays and buffers
+		void GLAPIENTRY genVertexArrays(GLsizei n, GLuint* arrays) { generate(n, arrays); }
+		void GLAPIENTRY bindVertexArray(GLuint) { numCalls++; }
+		void GLAPIENTRY deleteVertexArrays(GLsizei, const GLuint*) { numCalls++; }
+		void GLAPIENTRY genBuffers(GLsizei n, GLuint* buffers) { generate(n, buffers); }
+		void GLAPIENTRY bindBuffer(GLenum, GLuint) { numCalls++; }
+		void GLAPIENTRY bufferData(GLenum, GLsizeiptr, const void*, GLenum) { numCalls++; }
+		void GLAPIENTRY deleteBuffers(GLsizei, const GLuint*) { numCalls++; }
+		void GLAPIENTRY enableVertexAttribArray(GLuint) { numCalls++; }
+		void GLAPIENTRY vertexAttribPointer(GLuint, GLint, GLenum, GLboolean, GLsizei, const void*) { numCalls++; }
+
+		// Textures and queries
+		void GLAPIENTRY activeTexture(GLenum) { numCalls++; }
+		void GLAPIENTRY deleteQueries(GLsizei, const GLuint*) { numCalls++; }
+	}
+
+	void install()
+	{
+		glCreateProgram = createProgram;
+		glUseProgram = useProgram;
+		glDeleteProgram = deleteProgram;
+		glGetUniformLocation = getUniformLocation;
+		glUniform1i = uniform1i;
+		glUniform1f = uniform1f;
+		glUniform4fv = uniform4fv;
+		glUniformMatrix4fv = uniformMatrix4fv;
+
+		glGenVertexArrays = genVertexArrays;
+		glBindVertexArray = bindVertexArray;
+		glDeleteVertexArrays = deleteVertexArrays;
+		glGenBuffers = genBuffers;
+		glBindBuffer = bindBuffer;
+		glBufferData = bufferData;
+		glDeleteBuffers = deleteBuffers;
+		glEnableVertexAttribArray = enableVertexAttribArray;
+		glVertexAttribPointer = vertexAttribPointer;
+
+		glActiveTexture = activeTexture;
+		glDeleteQueries = deleteQueries;
+	}
+
+	unsigned long long getNumCalls()
+	{
+		return numCalls;
+	}
+
+	void resetCalls()
+	{
+		numCalls = 0;
+	}
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+// Fake OpenGL for running engine code without a context
+//
+// GLEW calls everything newer than OpenGL 1.1 through function pointers,
+// install() points the ones the benchmarked code uses at stubs that only
+// count the call. Handles are handed out from a counter so objects look
+// created. OpenGL 1.1 functions (glBindTexture, glDrawElements, glClear, ...)
+// are linked straight from opengl32 and can not be replaced, code that calls
+// them still needs a real context.
+namespace GLMock
+{
+	// Call once before any engine code, instead of glewInit()
+	void install();
+
+	// Number of GL calls made since the last reset
+	unsigned long long getNumCalls();
+	void resetCalls();
+}
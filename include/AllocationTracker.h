@@ -0,0 +1,58 @@
+#pragma once
+
+// Counts every heap allocation made through operator new
+//
+// The global operator new / delete are replaced in AllocationTracker.cpp, so
+// this sees allocations from our code, the standard library and anything else
+// that uses new. Define DISABLE_ALLOCATION_TRACKING to build without the hook.
+//
+// Counts are kept for the whole program, per frame (everything between two
+// beginFrame() calls, on any thread) and per named scope (only the thread the
+// scope lives on). Once the scene is loaded a frame should not allocate at all,
+// allocations show up as jitter when the allocator has to take a lock.
+namespace AllocationTracker
+{
+	// Maximum number of differently named scopes
+	const int MAX_SCOPES = 32;
+
+	struct Counts
+	{
+		unsigned long long allocations;
+		unsigned long long frees;
+		unsigned long long bytes; // bytes requested by the allocations
+	};
+
+	struct ScopeStats
+	{
+		const char* name;
+		Counts lastFrame;
+	};
+
+	// Call once at the start of every frame, moves this frame's counts into the last frame's
+	void beginFrame();
+
+	// Everything since the program started
+	Counts getTotal();
+
+	// Everything between the last two beginFrame() calls
+	const Counts& getLastFrame();
+
+	// Per scope counts of the last frame, in the order the scopes first ran
+	int getNumScopes();
+	const ScopeStats& getScope(int index);
+
+	// Adds the allocations made on this thread while it is alive to the scope with this name
+	// name must be a string literal, scopes are told apart by pointer
+	class Scope
+	{
+	public:
+		Scope(const char* name);
+		~Scope();
+
+	private:
+		int m_pIndex;
+		unsigned long long m_pStartAllocations;
+		unsigned long long m_pStartFrees;
+		unsigned long long m_pStartBytes;
+	};
+}
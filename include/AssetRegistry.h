@@ -0,0 +1,253 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// 32 bit FNV-1a hash of a name
+// constexpr, so names written in the code are hashed by the compiler
+constexpr uint32_t hashName(const char* str, uint32_t hash = 2166136261u)
+{
+	return *str ? hashName(str + 1, (hash ^ (uint32_t)(unsigned char)*str) * 16777619u) : hash;
+}
+
+// An interned asset name
+// Write "quad"_id to get the id of "quad" at compile time
+struct NameID
+{
+	uint32_t value;
+
+	constexpr explicit NameID(uint32_t hash) : value(hash) {}
+	explicit NameID(const std::string& name) : value(hashName(name.c_str())) {}
+
+	constexpr bool operator==(const NameID& other) const { return value == other.value; }
+};
+
+constexpr NameID operator"" _id(const char* str, size_t)
+{
+	return NameID(hashName(str));
+}
+
+// Refers to one asset in an AssetRegistry<T>
+//
+// The generation changes every time a slot is reused, so a handle to an
+// asset that has been removed is detected instead of silently pointing
+// at whatever was put in its place.
+template <typename T>
+struct AssetHandle
+{
+	uint32_t index;
+	uint32_t generation;
+
+	AssetHandle() : index(~0u), generation(0) {}
+	AssetHandle(uint32_t i, uint32_t g) : index(i), generation(g) {}
+
+	bool isValid() const { return index != ~0u; }
+	bool operator==(const AssetHandle& other) const { return index == other.index && generation == other.generation; }
+	bool operator!=(const AssetHandle& other) const { return !(*this == other); }
+};
+
+// Owns every asset of one type and hands out handles to them
+//
+// Assets live in a dense array, so get() is an index and a generation check.
+// Names are only hashed when an asset is added, lookups by NameID go through
+// a small hash map and never touch a string. Look a handle up once and keep it,
+// then the hot path does not even need the map.
+//
+// The registry holds the only reference the engine needs, get() returns a raw
+// pointer so nothing on the hot path does atomic reference counting. Assets that
+// should go away when nobody uses them anymore can opt in with retain() / release().
+template <typename T>
+class AssetRegistry
+{
+public:
+	typedef AssetHandle<T> Handle;
+
+	// Adds an asset under a name
+	// If the name is already taken the existing handle is returned, the new asset is not added
+	// A different name with the same hash asserts and returns an invalid handle
+	Handle add(const std::string& name, std::shared_ptr<T> asset)
+	{
+		NameID id(name);
+
+		Handle existing = find(id);
+		if (existing.isValid())
+			return isCollision(name) ? Handle() : existing;
+
+		uint32_t index;
+		if (!m_pFreeSlots.empty())
+		{
+			index = m_pFreeSlots.back();
+			m_pFreeSlots.pop_back();
+		}
+		else
+		{
+			index = (uint32_t)m_pSlots.size();
+			m_pSlots.push_back(Slot());
+		}
+
+		Slot& slot = m_pSlots[index];
+		slot.asset = asset;
+		slot.name = name;
+		slot.refCount = 0;
+
+		m_pLookup[id.value] = LookupEntry(index, name);
+		return Handle(index, slot.generation);
+	}
+
+	// Returns the asset called name, creating it with create() only if it does not exist yet
+	// Use the file path as the name so loading the same file twice gives the same handle
+	template <typename CreateFunction>
+	Handle getOrCreate(const std::string& name, CreateFunction create)
+	{
+		Handle existing = find(NameID(name));
+		if (existing.isValid())
+			return isCollision(name) ? Handle() : existing;
+
+		return add(name, create());
+	}
+
+	// Makes an existing asset available under another name as well
+	// An alias can't take over a name, or a hash, that already refers to something else
+	void addAlias(const std::string& alias, Handle handle)
+	{
+		if (!get(handle))
+			return;
+
+		NameID id(alias);
+		auto itr = m_pLookup.find(id.value);
+		if (itr != m_pLookup.end() && (itr->second.name != alias || itr->second.index != handle.index))
+		{
+			std::cout << "AssetRegistry: alias \"" << alias << "\" is already taken by \"" << itr->second.name << "\"" << std::endl;
+			assert(false && "AssetRegistry: alias already taken");
+			return;
+		}
+
+		m_pLookup[id.value] = LookupEntry(handle.index, alias);
+	}
+
+	// Invalid handle if there is nothing with this name
+	Handle find(NameID id) const
+	{
+		auto itr = m_pLookup.find(id.value);
+		if (itr == m_pLookup.end())
+			return Handle();
+
+		return Handle(itr->second.index, m_pSlots[itr->second.index].generation);
+	}
+
+	// nullptr if the handle is invalid or the asset has been removed
+	T* get(Handle handle) const
+	{
+		if (handle.index >= m_pSlots.size() || m_pSlots[handle.index].generation != handle.generation)
+			return nullptr;
+
+		return m_pSlots[handle.index].asset.get();
+	}
+
+	T* get(NameID id) const
+	{
+		return get(find(id));
+	}
+
+	// For code that has to share ownership, ie. a GameObject holding on to its mesh
+	std::shared_ptr<T> getShared(Handle handle) const
+	{
+		if (!get(handle))
+			return nullptr;
+
+		return m_pSlots[handle.index].asset;
+	}
+
+	std::shared_ptr<T> getShared(NameID id) const
+	{
+		return getShared(find(id));
+	}
+
+	// Optional reference counting, release() removes the asset when the count gets back to 0
+	// Plain counters, only use these from the thread that owns the registry
+	void retain(Handle handle)
+	{
+		if (get(handle))
+			m_pSlots[handle.index].refCount++;
+	}
+
+	void release(Handle handle)
+	{
+		if (get(handle) && m_pSlots[handle.index].refCount > 0 && --m_pSlots[handle.index].refCount == 0)
+			remove(handle);
+	}
+
+	// Every handle to the asset becomes invalid
+	void remove(Handle handle)
+	{
+		if (!get(handle))
+			return;
+
+		Slot& slot = m_pSlots[handle.index];
+
+		// Aliases point to the same slot, drop them too
+		for (auto itr = m_pLookup.begin(); itr != m_pLookup.end();)
+		{
+			if (itr->second.index == handle.index)
+				itr = m_pLookup.erase(itr);
+			else
+				++itr;
+		}
+
+		slot.asset = nullptr;
+		slot.name.clear();
+		slot.generation++;
+		m_pFreeSlots.push_back(handle.index);
+	}
+
+	// Iterating: slots of removed assets return nullptr from getAt()
+	uint32_t getNumSlots() const { return (uint32_t)m_pSlots.size(); }
+	T* getAt(uint32_t index) const { return m_pSlots[index].asset.get(); }
+
+	const std::string& getName(Handle handle) const { return m_pSlots[handle.index].name; }
+
+private:
+	struct Slot
+	{
+		std::shared_ptr<T> asset;
+		std::string name;
+		uint32_t generation;
+		uint32_t refCount;
+
+		Slot() : generation(1), refCount(0) {}
+	};
+
+	// A name or alias as it was registered, the hash alone can't tell two names apart
+	struct LookupEntry
+	{
+		uint32_t index;
+		std::string name;
+
+		LookupEntry() : index(~0u) {}
+		LookupEntry(uint32_t i, const std::string& n) : index(i), name(n) {}
+	};
+
+	// The lookup entry for name's hash was registered under a different string
+	// Handing out that asset would silently use the wrong one
+	bool isCollision(const std::string& name) const
+	{
+		auto itr = m_pLookup.find(NameID(name).value);
+		if (itr == m_pLookup.end() || itr->second.name == name)
+			return false;
+
+		const std::string& existingName = itr->second.name;
+
+		std::cout << "AssetRegistry: \"" << name << "\" and \"" << existingName << "\" have the same hash, rename one of them" << std::endl;
+		assert(false && "AssetRegistry: name hash collision");
+		return true;
+	}
+
+	std::vector<Slot> m_pSlots;
+	std::vector<uint32_t> m_pFreeSlots;
+	std::unordered_map<uint32_t, LookupEntry> m_pLookup; // name hash to slot index
+};
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "GPUQuery.h"
+
+// Dynamic resolution
+//
+// Picks the fraction of the window the scene is drawn at, so the GPU time of
+// a frame stays under targetTime. The render targets are allocated at full
+// size once, a smaller scale only draws into the bottom left part of them
+// (viewport and scissor), and the composite stretches that part over the
+// whole frame. Changing the scale never reallocates anything.
+//
+// The GPU time comes from a GL_TIME_ELAPSED query around the passes that
+// depend on the scale. Results arrive a few frames late, so after a change
+// the results still in flight are ignored. Going down is done in one go to
+// the scale that should fit, assuming the cost follows the number of pixels.
+// Going up is one step at a time, and only once the next step is expected to
+// fit with room to spare for a while, so the scale does not flip back and forth.
+class DynamicResolution
+{
+public:
+	static const float MIN_SCALE;
+	static const float MAX_SCALE;
+	static const float SCALE_STEP;
+
+	DynamicResolution();
+	~DynamicResolution();
+
+	// Creates the timer query, call once after glewInit()
+	void create();
+
+	// Wrap the passes that get cheaper with the scale
+	// Only frames drawn in full should be timed, partial redraws would look cheap
+	void beginFrame();
+	void endFrame();
+
+	// Picks up the newest GPU time and changes the scale if needed
+	// Call at the start of the frame, before anything reads getScale()
+	void update();
+
+	// Fraction of the window width and height the scene is drawn at
+	float getScale() { return scale; }
+
+	// Last GPU time read back, in ms
+	float getGPUTime() { return gpuTime; }
+
+	// Scaling is on, when off the scale stays at fixedScale
+	bool enabled;
+	float fixedScale;
+
+	// GPU time to stay under, in ms
+	float targetTime;
+
+	// Call while the GL context still exists, the destructor does not
+	void destroy();
+
+private:
+	// Rounds to a whole step and clamps, resets the controller if it changed
+	void setScale(float newScale);
+
+	GPUQuery gpuTimer;
+	unsigned int numResults;	// gpuTimer results seen so far
+
+	float scale;
+	float gpuTime;
+	float averageTime;			// smoothed GPU time at the current scale, 0 until the first result
+	int resultsToSkip;			// results of frames drawn before the last change
+	int resultsUnderBudget;		// results in a row that say the next step up fits
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+// Bump allocator for data that only lives for one frame
+//
+// allocate() just moves an offset forward, and reset() at the start of the
+// next frame throws everything away at once, so transient arrays never go
+// through the heap. Allocating is thread safe, so jobs can use it too.
+// Nothing is destructed, only use it for plain data.
+//
+// Only the render thread may use the arena, the simulation thread runs at its
+// own rate and would have its data reset under it.
+namespace FrameArena
+{
+	// Reserves the memory, call once at startup
+	void init(size_t capacity);
+
+	// Frees the memory
+	void shutdown();
+
+	// Throws away everything allocated this frame, call at the start of every frame
+	// No job may be using the arena while this runs
+	void reset();
+
+	// Returns nullptr (and prints an error) if the arena is full
+	void* allocate(size_t size, size_t alignment = 16);
+
+	template <typename T>
+	T* allocateArray(size_t count)
+	{
+		return (T*)allocate(sizeof(T) * count, alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	size_t getCapacity();
+
+	// Bytes used by the current frame, and the most any frame has used
+	size_t getUsed();
+	size_t getPeak();
+}
@@ -9,7 +9,9 @@ public:
 	FrameBufferObject();
 	~FrameBufferObject();
 
-	void createFrameBuffer(unsigned int fboWidth, unsigned int fboHeight, unsigned int numColourBuffers, bool useDepth);
+	// colourFormats holds the internal format of every colour texture (GL_RGBA8, GL_RG16F, ...)
+	// If it is null they are all GL_RGBA8
+	void createFrameBuffer(unsigned int fboWidth, unsigned int fboHeight, unsigned int numColourBuffers, bool useDepth, const GLenum* colourFormats = nullptr);
 
 	// Set active frame buffer for rendering
 	void bindFrameBufferForDrawing();
@@ -23,6 +25,9 @@ public:
 	void bindTextureForSampling(int textureAttachment, GLenum textureUnit);
 	void unbindTexture(GLenum textureUnit);
 
+	// For binding a colour texture as an image in compute shaders
+	unsigned int getColourTexture(int textureAttachment) { return colourTexHandles[textureAttachment]; }
+
 	unsigned int getWidth() { return width; }
 	unsigned int getHeight() { return height; }
 
@@ -0,0 +1,109 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#include <vector>
+#include <cstddef>
+
+class GameObject;
+
+// Change tracking for incremental redraws
+//
+// Remembers what the camera, the render settings and every object looked like
+// when the last frame was drawn, and compares the next frame against that:
+//
+//	nothing changed			the last composited image can be shown again
+//	only objects changed	the screen boxes they covered last frame and cover now
+//							are merged into one dirty rectangle, grown by how far
+//							post processing can carry light (ie. the bloom blur)
+//	anything else changed	the camera, a light, a setting or the window size,
+//							everything is drawn
+//
+// A scissor test takes a single rectangle, so changes are merged into one
+// instead of keeping a list, which would mean drawing the scene once per rectangle.
+//
+// Occlusion culling tests against depth that is a couple of frames old, so
+// an object uncovered by a moving one can show up a few frames late. Every
+// change is therefore drawn again for historyFrames frames.
+class FrameChanges
+{
+public:
+	enum Redraw
+	{
+		REDRAW_NONE = 0,	// reuse the last frame
+		REDRAW_RECT,		// draw again inside getRect()
+		REDRAW_FULL			// draw everything
+	};
+
+	// Pixels, origin at the bottom left like glScissor, x1 / y1 are one past the last pixel
+	struct Rect
+	{
+		int x0, y0, x1, y1;
+	};
+
+	FrameChanges();
+
+	// Starts a frame
+	// settings points at a plain struct of everything else that changes the image,
+	// it is compared byte for byte so clear it before filling it in
+	void begin(const glm::mat4& viewProj, int width, int height, const void* settings, size_t settingsSize);
+
+	// Compares an object with the last frame, slot must stay the same for the same object
+	// A null object is a removed one, whatever it covered gets drawn again
+	void addObject(unsigned int slot, GameObject* object);
+
+	// Draws everything this frame, ie. when incremental redraws are switched off
+	// Unlike a tracked change this does not keep isStatic() from being true
+	void invalidate();
+
+	// Decides what has to be drawn, dilation grows the dirty rectangle by that many pixels
+	Redraw end(int dilation);
+
+	// What end() decided, the rectangle is the whole window for REDRAW_FULL
+	Redraw getRedraw() { return redraw; }
+	const Rect& getRect() { return rect; }
+
+	// True when the frame matched the last one and no earlier change still has to be drawn again
+	bool isStatic() { return staticFrame; }
+
+	// Frames every change is drawn for, 1 draws it only in the frame it happened
+	int historyFrames;
+
+private:
+	struct ObjectState
+	{
+		glm::mat4 matrix;
+		glm::vec4 colour;
+		glm::vec4 emissive;
+		const void* mesh;
+		const void* material;
+		const void* texture;
+		Rect screen;
+		bool valid;
+	};
+
+	static const int MAX_HISTORY = 8;
+
+	// Screen box of the object's world bounds, the whole window if it reaches behind the camera
+	Rect projectBounds(GameObject* object);
+	void addRect(const Rect& r);
+
+	glm::mat4 viewProj;
+	int width, height;
+	std::vector<unsigned char> settings;
+	bool hasFrame;
+
+	std::vector<ObjectState> objects;
+
+	// This frame's changes
+	bool full;
+	bool forced;
+	Rect dirty;
+
+	// Changes of the last frames, newest first
+	bool historyFull[MAX_HISTORY];
+	Rect historyRects[MAX_HISTORY];
+
+	Redraw redraw;
+	Rect rect;
+	bool staticFrame;
+};
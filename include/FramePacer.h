@@ -0,0 +1,117 @@
+#pragma once
+
+#include "GLEW/glew.h"
+#include <chrono>
+
+// Decides when the next frame starts and how far the CPU may run ahead of the GPU
+//
+// Timing uses a monotonic high resolution clock, so deltaTime is no longer
+// rounded to whole milliseconds like GLUT_ELAPSED_TIME. Waiting for a target
+// frame rate sleeps while the deadline is far away and spins for the last
+// couple of milliseconds, since sleep alone can overshoot by a scheduler tick.
+//
+// Every frame ends with a fence. beginFrame() will not start a new frame while
+// maxFramesInFlight frames are still queued on the GPU, which bounds how old
+// the input a frame was built from can be by the time it reaches the screen.
+//
+// Input to present latency is measured by stamping the first input event of a
+// frame with the CPU clock and putting a GL_TIMESTAMP query right after the swap.
+// The GPU timestamp is converted to CPU time with a regularly refreshed offset.
+class FramePacer
+{
+public:
+	enum Mode
+	{
+		MODE_UNCAPPED = 0,	// start the next frame right away
+		MODE_VSYNC,			// let the swap wait for the display
+		MODE_TARGET_FPS		// sleep until targetFPS says the next frame is due
+	};
+
+	struct Stats
+	{
+		float frameTime;		// ms between the last two frame starts
+		float waitTime;			// ms beginFrame() spent waiting for the deadline
+		float gpuWaitTime;		// ms beginFrame() spent waiting on the frames in flight limit
+		float latency;			// ms from input to the frame being finished on the GPU, averaged
+		float maxLatency;		// worst latency over the last second
+		unsigned int framesInFlight;
+	};
+
+	typedef std::chrono::steady_clock Clock;
+
+	// Hard limit of maxFramesInFlight
+	static const int MAX_FRAMES_IN_FLIGHT = 3;
+
+	FramePacer();
+	~FramePacer();
+
+	// Creates the fences and queries, call once after glewInit()
+	void init();
+
+	// Deletes them and restores the timer resolution, call while the GL context still exists
+	void destroy();
+
+	// Waits until the next frame should start and returns the time since the last one in seconds
+	float beginFrame();
+
+	// Call right after the buffers have been swapped
+	void endFrame();
+
+	// Call from every input callback, the first input since the last frame is what latency is measured from
+	void markInput();
+
+	// Call before the first beginFrame() after the loop stopped starting frames for a while
+	// The pause does not count as frame time, the next deltaTime is one normal frame
+	void resume();
+
+	Mode mode;
+	float targetFPS;
+	int maxFramesInFlight; // 1 - MAX_FRAMES_IN_FLIGHT
+
+	const Stats& getStats() { return m_pStats; }
+
+private:
+	struct FrameSlot
+	{
+		GLsync fence;
+		GLuint timestampQuery;
+		Clock::time_point inputTime;
+		bool hasInput;
+	};
+
+	void waitUntil(Clock::time_point deadline);
+	void applySwapInterval();
+	void calibrateGPUClock();
+
+	// Reads back every finished frame, and waits for the oldest one if there are more than maxFrames
+	void retireFrames(int maxFrames);
+
+	FrameSlot m_pSlots[MAX_FRAMES_IN_FLIGHT];
+	int m_pWriteSlot;
+	int m_pNumInFlight;
+
+	Clock::time_point m_pLastFrameStart;
+	Clock::time_point m_pNextDeadline;
+
+	// Earliest input that no frame has picked up yet
+	Clock::time_point m_pPendingInputTime;
+	bool m_pHasPendingInput;
+
+	// Input picked up by the frame being built right now
+	Clock::time_point m_pFrameInputTime;
+	bool m_pFrameHasInput;
+
+	// GPU time = CPU time + offset, in nanoseconds
+	Clock::time_point m_pCalibrationTime;
+	GLint64 m_pCalibrationGPUTime;
+
+	Mode m_pAppliedMode;
+
+	// Latency is averaged over roughly a second
+	Clock::time_point m_pLatencyWindowStart;
+	float m_pLatencySum;
+	float m_pLatencyMax;
+	unsigned int m_pLatencyCount;
+
+	Stats m_pStats;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "GLEW/glew.h"
+
+// CPU side copy of the OpenGL state we care about
+//
+// Every bind / enable / viewport change in the engine should go through here.
+// If the requested state is already current the GL call is skipped, and
+// "what is bound" questions are answered from memory instead of glGet*,
+// which can force the driver to sync with the GPU.
+//
+// If something changes GL state without going through these functions
+// call invalidate() so the cache is reloaded from OpenGL.
+namespace GLState
+{
+	// Maximum number of texture units we keep track of
+	const int MAX_TEXTURE_UNITS = 32;
+
+	struct Stats
+	{
+		unsigned int callsIssued;  // calls that were passed on to OpenGL
+		unsigned int callsSkipped; // redundant calls that were dropped
+	};
+
+	// Reads the current state from OpenGL, call once after glewInit()
+	void init();
+
+	// Reloads the cache from OpenGL, this is slow so only call it when needed
+	void invalidate();
+
+	// Programs, vertex arrays and buffers
+	void useProgram(GLuint program);
+	void bindVertexArray(GLuint vao);
+	void bindBuffer(GLenum target, GLuint buffer);
+
+	// Binds a uniform / shader storage buffer to a numbered binding point
+	// Indexed bindings are not cached, but it also binds the buffer to target, which is
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+	// Frame buffers
+	// GL_FRAMEBUFFER binds both the draw and read frame buffer
+	void bindFramebuffer(GLenum target, GLuint fbo);
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+	void scissor(GLint x, GLint y, GLsizei width, GLsizei height);
+	void clearColour(float r, float g, float b, float a);
+
+	// Textures
+	// bindTexture() only calls glActiveTexture if the binding actually changes
+	void activeTexture(GLenum textureUnit);
+	void bindTexture(GLenum textureUnit, GLenum target, GLuint texture);
+
+	// Enables, only GL_BLEND, GL_DEPTH_TEST, GL_SCISSOR_TEST and GL_CULL_FACE are cached
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void setEnabled(GLenum cap, bool enabled);
+
+	// Blending / depth / colour writes
+	void blendEquation(GLenum mode);
+	void blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha);
+	void blendFunc(GLenum src, GLenum dst);
+	void blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha);
+	void depthFunc(GLenum func);
+	void depthMask(GLboolean enabled);
+	void colourMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a);
+
+	// Deleting an object also unbinds it, these keep the cache in sync
+	void deleteProgram(GLuint program);
+	void deleteVertexArrays(GLsizei n, const GLuint* vaos);
+	void deleteBuffers(GLsizei n, const GLuint* buffers);
+	void deleteFramebuffers(GLsizei n, const GLuint* fbos);
+	void deleteTextures(GLsizei n, const GLuint* textures);
+
+	// Queries, answered from memory
+	GLuint getProgram();
+	GLuint getVertexArray();
+	GLuint getBuffer(GLenum target);
+	GLuint getDrawFramebuffer();
+	GLuint getReadFramebuffer();
+	void getViewport(GLint* out);
+	void getScissor(GLint* out);
+	GLenum getActiveTexture();
+	GLuint getTexture(GLenum textureUnit);
+	bool isEnabled(GLenum cap);
+	void getBlendEquation(GLenum* modeRGB, GLenum* modeAlpha);
+	void getBlendFunc(GLenum* srcRGB, GLenum* dstRGB, GLenum* srcAlpha, GLenum* dstAlpha);
+	GLenum getDepthFunc();
+	GLboolean getDepthMask();
+
+	// Counts how many calls were saved, reset once per frame
+	const Stats& getStats();
+	void resetStats();
+}
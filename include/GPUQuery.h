@@ -0,0 +1,52 @@
+#pragma once
+
+#include "GLEW/glew.h"
+
+// Wraps a small ring of OpenGL query objects
+//
+// Reading a query result right after ending it makes the CPU wait for the GPU,
+// so instead we keep a few queries in flight and hand back the most recent
+// result that is already available. The value is a frame or two old, which is
+// fine for statistics and feedback loops.
+//
+// Works with any target that uses glBeginQuery / glEndQuery, ie.
+// GL_SAMPLES_PASSED, GL_ANY_SAMPLES_PASSED, GL_TIME_ELAPSED, GL_PRIMITIVES_GENERATED
+class GPUQuery
+{
+public:
+	GPUQuery();
+	~GPUQuery();
+
+	void create(GLenum queryTarget);
+
+	void begin();
+	void end();
+
+	// Returns the result of the most recent query that has finished on the GPU
+	// Never waits, if nothing new is available the previous result is returned
+	GLuint64 getResult();
+
+	// Number of results read back so far, goes up whenever a newer result arrives
+	// Lets feedback loops tell a new result from the same one returned again
+	unsigned int getNumResults() { return numResults; }
+
+	// Handle of the query that was ended last, ie. for glBeginConditionalRender
+	GLuint getLastHandle();
+
+	// Call while the GL context still exists, the destructor does not
+	void destroy();
+
+private:
+	// Number of queries that can be in flight at once
+	static const int NUM_QUERIES = 4;
+
+	GLenum target;
+	GLuint handles[NUM_QUERIES];
+
+	int writeIndex;  // query used by the next begin()
+	int numPending;  // queries that have been ended but not read back yet
+	bool active;     // between begin() and end()
+
+	GLuint64 lastResult;
+	unsigned int numResults;
+};
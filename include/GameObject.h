@@ -14,6 +14,8 @@
 
 #include "Material.h"
 
+class RenderQueue;
+
 class GameObject
 {
 protected:
@@ -27,6 +29,11 @@ protected:
 	glm::mat4 m_pLocalTransformMatrix;
 	glm::mat4 m_pLocalToWorldMatrix;
 
+	// Copy of the world matrix used for drawing
+	// update() runs on the simulation thread and writes m_pLocalToWorldMatrix,
+	// the render thread only ever reads this one (see setRenderMatrix())
+	glm::mat4 m_pRenderMatrix;
+
 	// Forward Kinematics
 	GameObject* m_pParent;
 	std::vector<GameObject*> m_pChildren;
@@ -44,15 +51,39 @@ public:
 
 	glm::mat4 getLocalToWorldMatrix();
 
+	// World matrix the renderer draws with, set from the interpolated simulation snapshot
+	glm::mat4 getRenderMatrix() { return m_pRenderMatrix; }
+	void setRenderMatrix(const glm::mat4& matrix) { m_pRenderMatrix = matrix; }
+
 	virtual void update(float dt);	
+
+	// Updates the transforms of objects that share a parent, then of all their children
+	// parentWorld is the parent's world matrix, null for root objects
+	// The matrix math is done for the whole batch at once, see TransformBatch
+	static void updateTransforms(GameObject* const* objects, size_t count, const glm::mat4* parentWorld);
 	virtual void draw(TTK::Camera &camera);
 
+	// Adds this object and its children to the render queue instead of drawing right away
+	void submit(RenderQueue& queue);
+
+	// Sends the uniforms that change per object (mvp, colour etc.)
+	// Assumes the material's shader is already bound
+	void sendObjectUniforms(TTK::Camera& camera);
+
+	// Same as above with matrices from computeObjectUniforms()
+	// Lets the matrix math happen on other threads while only the GL calls stay here
+	void computeObjectUniforms(TTK::Camera& camera, glm::mat4& outMVP, glm::mat4& outMV);
+	void sendObjectUniforms(glm::mat4& mvp, glm::mat4& mv);
+
 	// Forward Kinematics
 	// Pass in null to make game object a root node
 	void setParent(GameObject* newParent);
 	void addChild(GameObject* newChild);
 	void removeChild(GameObject* rip);
 	glm::vec3 getWorldPosition();
+
+	// World space axis aligned box around the mesh, at the render matrix
+	void getWorldBounds(glm::vec3& outMin, glm::vec3& outMax);
 	glm::mat4 getWorldRotation();
 	bool isRoot();
 
@@ -60,8 +91,21 @@ public:
 	std::string name;
 	glm::vec4 colour; 
 
+	// Written straight into the bloom buffer, makes the object glow no matter how bright it is lit
+	glm::vec4 emissive;
+
 	std::shared_ptr<TTK::MeshBase> mesh;
 	std::shared_ptr<Material> material;
 
 	std::shared_ptr<TTK::Texture2D> diffuseTexture;
+
+	// Occlusion query used when this object is culled with conditional rendering
+	// Created on demand by the OcclusionCuller, 0 if never used
+	unsigned int occlusionQuery;
+
+	// GameObjects outlive the GL context, delete the query before it goes away
+	void destroyOcclusionQuery();
+
+	// Level of detail used last frame, picked by the render queue
+	unsigned int lodLevel;
 };
\ No newline at end of file
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+class Material;
+class FrameBufferObject;
+namespace TTK { class MeshBase; }
+
+// Hierarchical depth buffer
+//
+// Builds a mip pyramid from a frame buffer's depth texture where every texel
+// of a level holds the furthest (max) depth of the 2x2 texels below it.
+// One of the smaller levels is copied back to the CPU through a pixel buffer
+// and a fence, so reading it never waits on the GPU. The copy is a frame or
+// two old, so tests are done with the view projection matrix it was built with.
+class HiZBuffer
+{
+public:
+	HiZBuffer();
+	~HiZBuffer();
+
+	// copyMaterial copies depth into level 0, downsampleMaterial builds the other levels
+	// quad is the full screen quad used to run both
+	void create(unsigned int width, unsigned int height, Material* copyMaterial, Material* downsampleMaterial, TTK::MeshBase* quad);
+
+	// Builds the pyramid from the depth texture of sourceFBO and starts the copy to the CPU
+	// viewProj must be the matrix the depth was rendered with
+	// sourceScale is the part of sourceFBO the depth was drawn into (see DynamicResolution), it is stretched over level 0
+	void build(FrameBufferObject& sourceFBO, const glm::mat4& viewProj, const glm::vec2& sourceScale = glm::vec2(1.0f));
+
+	// Picks up the CPU copy if the GPU has finished with it
+	void update();
+
+	// Returns true if the box is definitely hidden behind the depth in the CPU copy.
+	// Boxes covering more than maxTexels x maxTexels texels of the copy are not tested
+	// and tooLarge is set, these should be handled some other way.
+	bool isOccluded(const glm::vec3& worldMin, const glm::vec3& worldMax, int maxTexels, bool& tooLarge);
+
+	// True once the first CPU copy has arrived
+	bool hasCpuDepth() { return cpuValid; }
+
+	GLuint getTexture() { return texture; }
+	unsigned int getNumLevels() { return numLevels; }
+
+	// Call while the GL context still exists, the destructor does not
+	void destroy();
+
+private:
+	static const int MAX_LEVELS = 16;
+	static const int NUM_READBACKS = 2;
+
+	// R32F texture with a full mip chain, one FBO per level
+	GLuint texture;
+	GLuint fbos[MAX_LEVELS];
+	unsigned int numLevels;
+	unsigned int width, height;
+
+	Material* copyMaterial;
+	Material* downsampleMaterial;
+	TTK::MeshBase* quad;
+
+	// Level that gets copied back to the CPU
+	unsigned int readbackLevel;
+	unsigned int readbackWidth, readbackHeight;
+
+	// Pixel buffers used for the copy, ping ponged so one can be written while the other is read
+	GLuint pbos[NUM_READBACKS];
+	GLsync fences[NUM_READBACKS];
+	glm::mat4 readbackViewProj[NUM_READBACKS];
+	int writeIndex;
+
+	// Latest copy that has arrived on the CPU
+	std::vector<float> cpuDepth;
+	glm::mat4 cpuViewProj;
+	bool cpuValid;
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+
+// Work stealing job system
+//
+// Every thread (the main thread included) has its own queue of jobs.
+// A thread takes work from the back of its own queue and, when that is empty,
+// steals from the front of another thread's queue, so busy threads hand work
+// off without a single shared queue everyone fights over.
+//
+// Jobs come from a per thread ring of MAX_JOBS_PER_THREAD, so creating one
+// never allocates. They must finish before the ring wraps around, which is
+// not a problem as long as each frame waits on the jobs it created.
+//
+// Jobs must not make OpenGL calls, the context only belongs to the main thread.
+namespace JobSystem
+{
+	struct Job;
+	typedef void (*JobFunction)(Job* job, const void* data);
+
+	const unsigned int MAX_JOBS_PER_THREAD = 4096;
+
+	// Bytes of data that can be copied into a job when it is created
+	const unsigned int JOB_DATA_SIZE = 64;
+
+	// Starts numWorkers threads on top of the main thread
+	// 0 uses one thread per core, minus the main thread
+	void init(unsigned int numWorkers = 0);
+
+	// Stops and joins the worker threads
+	void shutdown();
+
+	// Lets a thread the job system did not start (ie. the simulation thread)
+	// create and wait on jobs. Call once from that thread after init()
+	// At most MAX_ATTACHED_THREADS threads can be attached, one more aborts.
+	// Creating or running jobs from a thread that is not attached aborts too.
+	const unsigned int MAX_ATTACHED_THREADS = 2;
+	void attachThread();
+
+	// Worker threads plus the main thread
+	unsigned int getNumThreads();
+
+	// Creates a job, data is copied into it (at most JOB_DATA_SIZE bytes, more aborts)
+	// The job does nothing until run() is called
+	Job* createJob(JobFunction function, const void* data = nullptr, size_t dataSize = 0);
+
+	// A parent job only counts as finished once all of its children are
+	Job* createChildJob(Job* parent, JobFunction function, const void* data = nullptr, size_t dataSize = 0);
+
+	// Same as above, copying data into the job, its size is checked when compiling
+	template <typename T>
+	Job* createJob(JobFunction function, const T& data)
+	{
+		static_assert(sizeof(T) <= JOB_DATA_SIZE, "Job data is bigger than JOB_DATA_SIZE");
+		return createJob(function, &data, sizeof(T));
+	}
+
+	template <typename T>
+	Job* createChildJob(Job* parent, JobFunction function, const T& data)
+	{
+		static_assert(sizeof(T) <= JOB_DATA_SIZE, "Job data is bigger than JOB_DATA_SIZE");
+		return createChildJob(parent, function, &data, sizeof(T));
+	}
+
+	// Runs 'continuation' once 'job' and all of its children have finished
+	// Must be called before 'job' is run
+	void addContinuation(Job* job, Job* continuation);
+
+	// Queues the job on the calling thread
+	void run(Job* job);
+
+	// Runs other jobs until this one is finished, the caller never just sleeps
+	void wait(const Job* job);
+
+	bool isFinished(const Job* job);
+
+	typedef void (*ParallelForFunction)(void* userData, unsigned int start, unsigned int end);
+
+	// Splits [0, count) into batches of batchSize and runs them on every thread
+	// Returns once all of them are done
+	void parallelFor(unsigned int count, unsigned int batchSize, ParallelForFunction function, void* userData);
+
+	// Same as above for a lambda taking (unsigned int start, unsigned int end)
+	template <typename Function>
+	void parallelFor(unsigned int count, unsigned int batchSize, const Function& function)
+	{
+		parallelFor(count, batchSize, [](void* userData, unsigned int start, unsigned int end)
+		{
+			(*(const Function*)userData)(start, end);
+		}, (void*)&function);
+	}
+}
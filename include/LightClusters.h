@@ -0,0 +1,120 @@
+#pragma once
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+#include <vector>
+
+class Material;
+namespace TTK { class Camera; }
+
+// A point light, laid out the way the shaders read it (std430)
+struct PointLight
+{
+	glm::vec4 positionRadius;	// xyz position, w radius, light has no effect past it
+	glm::vec4 colour;			// rgb colour times intensity, w unused
+};
+
+// Clustered forward lighting
+//
+// The view frustum is split into a grid of clusters, CLUSTERS_X x CLUSTERS_Y
+// tiles on screen and CLUSTERS_Z slices in depth. Slices get exponentially
+// deeper further from the camera, so clusters stay roughly cube shaped.
+// Every frame each cluster gets the list of lights whose sphere touches it,
+// and the lighting shader only loops over the list of the cluster its
+// fragment is in, so lights cost only where they actually reach.
+//
+// Lights are binned by a compute shader, or on the CPU with the job system
+// and SSE when useComputeShader is off. Both write the same buffers:
+//
+//	binding 0	PointLight lights[]		view space position
+//	binding 1	vec4 clusterBounds[]	view space min / max of every cluster, compute shader only
+//	binding 2	uvec2 clusterRanges[]	offset and count into lightIndices
+//	binding 3	uint lightIndices[]
+//
+// Needs OpenGL 4.3, the shaders are #version 430. Check isSupported() before
+// using it, and that the shaders compiled.
+class LightClusters
+{
+public:
+	static const int CLUSTERS_X = 16;
+	static const int CLUSTERS_Y = 9;
+	static const int CLUSTERS_Z = 24;
+	static const int NUM_CLUSTERS = CLUSTERS_X * CLUSTERS_Y * CLUSTERS_Z;
+
+	// A cluster keeps the first MAX_LIGHTS_PER_CLUSTER lights that touch it
+	static const int MAX_LIGHTS = 4096;
+	static const int MAX_LIGHTS_PER_CLUSTER = 256;
+
+	// Everything closer than this is in the first slice, the rest is split
+	// exponentially up to the far plane. Starting at the near plane would
+	// spend half the slices on the first metre in front of the camera
+	static const float FIRST_SLICE_DEPTH;
+
+	LightClusters();
+	~LightClusters();
+
+	// True if the driver has OpenGL 4.3, for compute shaders and shader storage buffers
+	static bool isSupported();
+
+	// binMaterial holds the compute shader that bins the lights
+	void create(Material* binMaterial);
+
+	// Bins lights (world space) into the clusters of the camera's frustum
+	// width and height are the size of the frame buffer the lighting is drawn into
+	void update(const TTK::Camera& camera, const PointLight* lights, unsigned int numLights, unsigned int width, unsigned int height);
+
+	// Binds the buffers and sets the uniforms the lighting material needs to find its cluster
+	void bindForShading(Material* lightingMaterial);
+
+	// Lights binned in the last update()
+	// Clusters that had more lights than fit are only counted by the CPU binning
+	unsigned int getNumLights() { return numLights; }
+	unsigned int getNumOverflows() { return numOverflows; }
+
+	bool useComputeShader;
+
+	// Call while the GL context still exists, the destructor does not
+	void destroy();
+
+private:
+	enum Buffers
+	{
+		LIGHTS = 0,
+		BOUNDS,
+		RANGES,
+		INDICES,
+		NUM_BUFFERS
+	};
+
+	// Recomputes the view space box of every cluster, only when the projection changes
+	void updateBounds(const glm::mat4& projection, float nearPlane, float farPlane);
+
+	// CPU binning, fills cpuRanges / cpuIndices and uploads them
+	void binOnCPU();
+
+	GLuint buffers[NUM_BUFFERS];
+	Material* binMaterial;
+
+	// What the cluster boxes were built for
+	glm::mat4 boundsProjection;
+	float sliceScale, sliceBias;
+	glm::vec2 clustersPerPixel;
+
+	// View space lights, and the boxes as min xyz / max xyz pairs
+	std::vector<PointLight> viewLights;
+	std::vector<glm::vec4> bounds;
+	bool boundsUploaded;
+
+	// CPU binning
+	// Lights are first sorted into the depth slices they reach, then every cluster
+	// of a slice tests only those. Every cluster has MAX_LIGHTS_PER_CLUSTER slots,
+	// which are packed into cpuIndices before the upload
+	std::vector<unsigned int> sliceStarts;
+	std::vector<unsigned int> sliceLights;
+	std::vector<unsigned int> cpuRanges;
+	std::vector<unsigned int> cpuSlots;
+	std::vector<unsigned int> cpuIndices;
+
+	unsigned int numLights;
+	unsigned int numOverflows;
+};
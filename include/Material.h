@@ -2,20 +2,30 @@
 
 #include "ShaderProgram.h"
 #include <map>
+#include <memory>
 
 class Material
 {
 public:
 	std::shared_ptr<ShaderProgram> shader;
 
-	std::map<std::string, glm::vec4> vec4Uniforms;
-	std::map<std::string, glm::mat4> mat4Uniforms;
-	std::map<std::string, int> intUniforms;
-	std::map<std::string, float> floatUniforms;
+	// Unique id, used by the render queue to group draws that share a material
+	unsigned int id;
+
+	// Transparent materials are drawn last, back to front, with blending enabled
+	bool transparent;
+
+	// std::less<> lets find() compare against a const char* without building a std::string
+	std::map<std::string, glm::vec4, std::less<>> vec4Uniforms;
+	std::map<std::string, glm::mat4, std::less<>> mat4Uniforms;
+	std::map<std::string, int, std::less<>> intUniforms;
+	std::map<std::string, float, std::less<>> floatUniforms;
 	// maps for other uniform types ...
 
 	Material()
-		: shader(std::make_shared<ShaderProgram>())
+		: shader(std::make_shared<ShaderProgram>()),
+		id(nextId()),
+		transparent(false)
 	{}
 
 	void sendUniforms()
@@ -37,6 +47,13 @@ public:
 			shader->sendUniformFloat(itr->first, itr->second);
 	}
 
+	// Same as vec4Uniforms[name] = value, but only allocates the first time a name is set
+	// Use these for uniforms that change every frame
+	void setVec4(const char* name, const glm::vec4& value) { setUniform(vec4Uniforms, name, value); }
+	void setMat4(const char* name, const glm::mat4& value) { setUniform(mat4Uniforms, name, value); }
+	void setInt(const char* name, int value) { setUniform(intUniforms, name, value); }
+	void setFloat(const char* name, float value) { setUniform(floatUniforms, name, value); }
+
 	void bind()
 	{
 		shader->bind();
@@ -46,4 +63,21 @@ public:
 	{
 		shader->unbind();
 	}
+
+private:
+	template <typename Map, typename T>
+	static void setUniform(Map& uniforms, const char* name, const T& value)
+	{
+		auto itr = uniforms.find(name);
+		if (itr != uniforms.end())
+			itr->second = value;
+		else
+			uniforms[name] = value;
+	}
+
+	static unsigned int nextId()
+	{
+		static unsigned int counter = 0;
+		return ++counter;
+	}
 };
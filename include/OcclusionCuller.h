@@ -0,0 +1,62 @@
+#pragma once
+
+#include "RenderQueue.h"
+
+class HiZBuffer;
+class Material;
+namespace TTK { class MeshBase; }
+
+struct OcclusionStats
+{
+	unsigned int tested;				// opaque items tested against the Hi-Z buffer
+	unsigned int hizRejected;			// removed from the queue by the Hi-Z test
+	unsigned int conditionalDraws;		// too big for the Hi-Z test, drawn with conditional rendering
+	unsigned int conditionalRejected;	// conditional draws from an earlier frame that the GPU skipped
+};
+
+// Removes hidden objects from the render queue before they are drawn
+//
+// Small objects are tested on the CPU against last frame's Hi-Z buffer.
+// Objects that cover too much of the screen for that to be cheap get an
+// occlusion query instead: a box around them is drawn against the depth
+// pre-pass and the real draw only happens if some of the box was visible.
+// The GPU makes that decision, so the CPU never waits for query results.
+class OcclusionCuller
+{
+public:
+	OcclusionCuller();
+	~OcclusionCuller();
+
+	// proxyMaterial should be a position only shader with a u_mvp uniform
+	// boxMesh is a unit cube centered on the origin
+	void init(Material* proxyMaterial, TTK::MeshBase* boxMesh);
+
+	// Tests every opaque item in the sorted queue
+	// If allowConditional is false (no depth pre-pass to test the boxes
+	// against) items that are too big for the Hi-Z test are simply drawn
+	void cull(RenderQueue& queue, TTK::Camera& camera, HiZBuffer& hiz, bool allowConditional);
+
+	// Draws the proxy boxes for the items marked by cull()
+	// Call after the depth pre-pass and before the queue is executed
+	void issueQueries(RenderQueue& queue, TTK::Camera& camera);
+
+	// Objects covering more than this many texels of the Hi-Z copy in either direction use a query
+	int maxHiZTexels;
+
+	const OcclusionStats& getStats() { return m_pStats; }
+
+private:
+	Material* m_pProxyMaterial;
+	TTK::MeshBase* m_pBoxMesh;
+
+	OcclusionStats m_pStats;
+
+	// Result of the Hi-Z test for each opaque item, filled in on the job system
+	// The array only lives for one frame, so it comes from the frame arena
+	enum Result
+	{
+		RESULT_VISIBLE = 0,
+		RESULT_OCCLUDED,
+		RESULT_QUERY
+	};
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <TTK/Camera.h>
+
+class GameObject;
+class Material;
+
+// A single draw that has been submitted to the render queue
+struct RenderItem
+{
+	uint64_t sortKey;
+	GameObject* gameobject;
+
+	// If not 0 the draw is wrapped in conditional rendering on this
+	// occlusion query and skipped by the GPU when no samples passed
+	GLuint conditionalQuery;
+
+	// Level of detail picked for this draw
+	unsigned int lod;
+};
+
+// Per object uniforms, worked out on the job system before drawing
+struct DrawUniforms
+{
+	glm::mat4 mvp;
+	glm::mat4 mv;
+};
+
+// Counters for the last frame, useful to see how much state changing we avoided
+struct RenderQueueStats
+{
+	unsigned int numItems;
+	unsigned int programBinds;
+	unsigned int materialChanges;
+	unsigned int textureBinds;
+	unsigned int meshBinds;
+	unsigned int triangles;
+};
+
+// Collects every draw of a frame, sorts them by a 64 bit key and then
+// draws them in that order. The key is built so that draws which share
+// a shader, material or mesh end up next to each other, which lets us
+// skip binds that are already current.
+//
+// Key layout (most significant bit first):
+//   opaque:      pass(4) | 0 | program(10) | material(10) | mesh(10) | depth(24) | unused(5)
+//   transparent: pass(4) | 1 | inverted depth(24) | program(10) | material(10) | mesh(10) | unused(5)
+// Opaque draws are sorted front to back so early-z rejects hidden fragments,
+// transparent draws are sorted back to front so blending is correct.
+class RenderQueue
+{
+public:
+	enum Pass
+	{
+		PASS_SCENE = 0
+		// ... any other passes ...
+	};
+
+	RenderQueue();
+	~RenderQueue();
+
+	// Empties the queue, call once per frame before submitting
+	void clear();
+
+	// Adds a single game object to the queue
+	// Children are not added, GameObject::submit() takes care of that
+	void submit(GameObject* gameobject, Pass pass = PASS_SCENE);
+
+	// Picks the level of detail and builds the sort key of every item, call before sort()
+	// Runs on the job system
+	void prepare(TTK::Camera& camera);
+
+	// Radix sorts all submitted items by their key
+	void sort();
+
+	// Works out the matrices of every item on the job system, call after
+	// the queue has been sorted and culled. execute() calls this itself if
+	// the number of items changed since.
+	void packUniforms(TTK::Camera& camera);
+
+	// Draws every item in sorted order
+	void execute(TTK::Camera& camera);
+
+	// Draws only the opaque items into the depth buffer using a position only
+	// shader and vertex stream. Used for the depth pre-pass, colour writes
+	// should be disabled by the caller.
+	void executeDepthOnly(TTK::Camera& camera, Material* depthMaterial);
+
+	// Packs the key, exposed so it can be tested and reused
+	static uint64_t makeSortKey(Pass pass, bool transparent, unsigned int program, unsigned int material, unsigned int mesh, float depth01);
+
+	// Meshes with LODs use the coarsest level whose error is below this many pixels
+	float lodPixelError;
+
+	// How far below lodPixelError a coarser level has to be before we switch to it
+	float lodHysteresis;
+
+	const RenderQueueStats& getStats() { return m_pStats; }
+	unsigned int size() { return (unsigned int)m_pItems.size(); }
+
+	// Direct access for passes that cull or annotate items after sorting
+	// Removing items must keep the remaining ones in order
+	std::vector<RenderItem>& getItems() { return m_pItems; }
+
+private:
+	std::vector<RenderItem> m_pItems;
+
+	// Radix sort ping pongs between the items and this array
+	// Kept around so we do not reallocate it every frame
+	std::vector<RenderItem> m_pScratch;
+
+	// Same order as m_pItems, filled by packUniforms()
+	std::vector<DrawUniforms> m_pUniforms;
+
+	void prepareItem(RenderItem& item, TTK::Camera& camera);
+
+	RenderQueueStats m_pStats;
+};
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "GLEW/glew.h"
+#include <cstddef>
+
+// Per frame renderer counters
+//
+// The places where the engine talks to OpenGL report to this: GLState for
+// program / vertex array / texture / frame buffer binds (only the ones that
+// were not skipped), VertexBufferObject for draws, ShaderProgram for uniforms,
+// buffer and texture creation for uploads and FrameBufferObject for clears.
+// Code that calls OpenGL directly has to report itself.
+//
+// With GL_ARB_pipeline_statistics_query every frame is also wrapped in a
+// fragment shader invocation query. Its result arrives a few frames late, so
+// a frame only counts as finished once its query has been read back. Frames
+// are finished in order and all counters of a finished frame belong together.
+//
+// Everything here is called from the GL thread only.
+namespace RenderStats
+{
+	// Frames the averages are taken over
+	const unsigned int AVERAGE_FRAMES = 60;
+
+	// Frames that can wait for their query at the same time
+	// One more than FramePacer::MAX_FRAMES_IN_FLIGHT, so beginFrame() normally never waits
+	const unsigned int MAX_PENDING_FRAMES = 4;
+
+	struct Counters
+	{
+		unsigned int drawCalls;
+		unsigned int triangles;
+		unsigned int programBinds;
+		unsigned int vertexArrayBinds;
+		unsigned int textureBinds;
+		unsigned int framebufferBinds;
+		unsigned int uniformUploads;
+		unsigned int clears;
+		unsigned long long bytesUploaded;		// buffer and texture data sent to the GPU
+		unsigned long long fragmentInvocations;	// 0 without pipeline statistics queries
+	};
+
+	// Call once after glewInit()
+	void init();
+
+	bool hasPipelineStatistics();
+
+	// Everything counted between these two calls belongs to the frame
+	// Call endFrame() after the last draw and before swapping buffers
+	void beginFrame();
+	void endFrame();
+
+	// Last finished frame
+	const Counters& getLastFrame();
+
+	// Average of the last AVERAGE_FRAMES finished frames, rounded down
+	Counters getAverage();
+
+	// Writes one line per finished frame to a CSV file until stopRecording()
+	// Returns false if the file could not be opened
+	bool startRecording(const char* path);
+	void stopRecording();
+	bool isRecording();
+
+	// Called by the GL wrappers
+	void countDraw(GLenum mode, GLsizei count);
+	void countProgramBind();
+	void countVertexArrayBind();
+	void countTextureBind();
+	void countFramebufferBind();
+	void countUniformUpload();
+	void countUpload(size_t bytes);
+	void countClear();
+}
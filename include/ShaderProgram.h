@@ -12,6 +12,7 @@ public:
 
 	// Initialization functions
 	void attachShader(Shader shader);
+	// Returns the program handle, 0 if it failed to link
 	int linkProgram();
 	
 	// Usage functions
@@ -20,18 +21,25 @@ public:
 
 	// Functions to send uniforms to GPU from CPU
 
+	// The const char* versions are picked for string literals,
+	// so sending a uniform does not build a std::string every time
+
 	// Sends a single integer value to GPU
 	// Useful for assigning textures to samplers 
 	void sendUniformInt(const std::string& uniformName, int intVal);
+	void sendUniformInt(const char* uniformName, int intVal);
 	void sendUniformFloat(const std::string& uniformName, float floatVal);
+	void sendUniformFloat(const char* uniformName, float floatVal);
 
 	// Sends four floats stored in an array to GPU
 	// Useful for sending vector4 to GPU
 	void sendUniformVec4(const std::string& uniformName, glm::vec4& vec4);
+	void sendUniformVec4(const char* uniformName, glm::vec4& vec4);
 
 	// Sends a 4x4 matrix stored in an array to GPU
 	// Must have to apply the MVP transform
 	void sendUniformMat4(const std::string& uniformName, glm::mat4& mat4);
+	void sendUniformMat4(const char* uniformName, glm::mat4& mat4);
 
 	void destroy();
 
@@ -46,5 +54,5 @@ private:
 	// Note: This is a pretty slow operation and you do not want to be
 	// calling this every frame. Set up a system, such as a std::map which caches
 	// the location and used the string name as a key
-	int getUniformLocation(const std::string& uniformName);
+	int getUniformLocation(const char* uniformName);
 };
\ No newline at end of file
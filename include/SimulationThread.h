@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// Runs a tick function on its own thread at a fixed rate
+//
+// The tick gets the same dt every time no matter how long frames take on
+// the render thread, so the simulation is deterministic and input or slow
+// frames on one side never hold up the other. If the simulation falls
+// behind it catches up with extra ticks (up to MAX_CATCH_UP_TICKS at once).
+class SimulationThread
+{
+public:
+	// dt is always 1 / ticksPerSecond, time is the simulation time after this tick
+	typedef void (*TickFunction)(float dt, double time);
+
+	SimulationThread();
+	~SimulationThread();
+
+	void start(float ticksPerSecond, TickFunction tick);
+	void stop();
+
+	// Parks the thread, no ticks run until resume() or stop()
+	// Simulation time stands still while parked, resuming does not catch up
+	void pause();
+	void resume();
+
+	float getTickLength() { return m_pTickLength; }
+
+	// Number of ticks run so far
+	unsigned int getTickCount() { return m_pTickCount; }
+
+private:
+	static const int MAX_CATCH_UP_TICKS = 5;
+
+	void threadMain();
+
+	std::thread m_pThread;
+	std::atomic<bool> m_pRunning;
+	std::atomic<bool> m_pPaused;
+	std::atomic<unsigned int> m_pTickCount;
+
+	// The parked thread sleeps here
+	std::mutex m_pSleepLock;
+	std::condition_variable m_pWakeUp;
+
+	TickFunction m_pTick;
+	float m_pTickLength;
+};
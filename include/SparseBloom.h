@@ -0,0 +1,88 @@
+#pragma once
+
+#include "GLEW/glew.h"
+#include "glm/glm.hpp"
+
+class Material;
+class FrameBufferObject;
+
+// Sparse bloom
+//
+// Most frames only have a few spots bright enough to bloom, so most of the
+// blur target is black and blurring all of it is wasted work. After the bloom
+// downsample, one compute shader finds the brightest texel of every
+// TILE_SIZE x TILE_SIZE tile of the blur target. A second one lists the tiles
+// that have a bright tile within blur reach, counting them with an atomic add.
+// That count is the group count of indirect dispatches, so the blur and the
+// composite only run on listed tiles and the CPU never reads the count back.
+//
+// Tiles that are not listed stay black, both blur targets are cleared once per frame.
+//
+//	binding 4	uint tileMax[]		brightest texel of every tile, as float bits
+//	binding 5	uint tileList[]		index of every listed tile
+//	binding 6	uint dispatchArgs[6]	blur group counts, then composite group counts
+//
+// Needs OpenGL 4.3, the shaders are #version 430. Check isSupported() before
+// using it, and that the shaders compiled.
+class SparseBloom
+{
+public:
+	// Must match TILE_SIZE in the bloom compute shaders
+	static const int TILE_SIZE = 8;
+
+	SparseBloom();
+	~SparseBloom();
+
+	// True if the driver has OpenGL 4.3, for compute shaders, shader storage buffers and image load / store
+	static bool isSupported();
+
+	// bloomWidth / bloomHeight are the size of the blur targets, sceneWidth / sceneHeight of the scene it is added to
+	// The materials hold the classify, compact, blur and composite compute shaders
+	void create(unsigned int bloomWidth, unsigned int bloomHeight, unsigned int sceneWidth, unsigned int sceneHeight,
+		Material* classifyMaterial, Material* compactMaterial, Material* blurMaterial, Material* compositeMaterial);
+
+	// Lists the tiles of bloom's first texture that blurPasses blur passes can spread light into
+	// Only the bottom left scale part of the targets holds bloom (see DynamicResolution),
+	// the blur and composite after this use the same part
+	void classify(FrameBufferObject& bloom, int blurPasses, float scale = 1.0f);
+
+	// Blurs the listed tiles of source into target, going back and forth between target and temp
+	// passes must be even so the result ends up in target, and the same as given to classify()
+	void blur(FrameBufferObject& source, FrameBufferObject& target, FrameBufferObject& temp, int passes);
+
+	// Adds bloom on top of scene's first texture, in place, only in the listed tiles
+	// Pixels outside rect (x0, y0, x1, y1, x1 / y1 exclusive) are left alone
+	void composite(FrameBufferObject& bloom, FrameBufferObject& scene, const glm::ivec4& rect);
+
+	// Call while the GL context still exists, the destructor does not
+	void destroy();
+
+private:
+	enum Buffers
+	{
+		TILE_MAX = 0,
+		TILE_LIST,
+		DISPATCH_ARGS,
+		NUM_BUFFERS
+	};
+
+	// Binds the buffers at 4, 5 and 6 and the dispatch arguments for glDispatchComputeIndirect
+	void bindBuffers();
+
+	GLuint buffers[NUM_BUFFERS];
+
+	Material* classifyMaterial;
+	Material* compactMaterial;
+	Material* blurMaterial;
+	Material* compositeMaterial;
+
+	unsigned int bloomWidth, bloomHeight;
+	unsigned int sceneWidth, sceneHeight;
+	unsigned int tilesX, tilesY;
+
+	// Part of the blur targets in use since the last classify()
+	unsigned int activeWidth, activeHeight;
+
+	// Work groups per listed tile in the composite, it runs at scene size
+	unsigned int compositeGroupsX, compositeGroupsY;
+};
@@ -29,7 +29,9 @@ namespace TTK
 			yaw(0.0f),
 			pitch(0.0f),
 			winWidth(1280.0f),
-			winHeight(720.0f)
+			winHeight(720.0f),
+			nearPlane(0.01f),
+			farPlane(100.0f)
 		{
 			processMouseMotion(0, 0, 1, 1, 0.03f);
 		}
@@ -38,7 +40,7 @@ namespace TTK
 		void update()
 		{
 			viewMatrix = glm::lookAt(cameraPosition, cameraPosition + forwardVector, upVector);
-			projMatrix = glm::perspective(glm::radians(60.0f), winWidth / winHeight, 0.01f, 100.0f);
+			projMatrix = glm::perspective(glm::radians(60.0f), winWidth / winHeight, nearPlane, farPlane);
 
 			viewProjMatrix = projMatrix * viewMatrix;
 		}
@@ -117,5 +119,8 @@ namespace TTK
 
 		float winWidth;
 		float winHeight;
+
+		float nearPlane;
+		float farPlane;
 	};
 }
\ No newline at end of file
@@ -24,9 +24,21 @@ namespace TTK
 		Quads
 	};
 
+	// One level of detail, a range of the mesh's index array
+	struct MeshLOD
+	{
+		unsigned int firstIndex;
+		unsigned int numIndices;
+
+		// How far (in object space) the simplified surface is from the original
+		float error;
+	};
+
 	class MeshBase
 	{
 	public:
+		MeshBase();
+
 		// Description:
 		// Very simple draw function which binds all three buffers
 		// Yes, it uses OpenGL 1.0 draw calls... for now.
@@ -35,19 +47,56 @@ namespace TTK
 		// The modern draw function which uses vertex buffer objects!
 		void draw();
 
+		// Draws a level of detail, the VBO must already be bound
+		// Meshes without LODs always draw the whole mesh
+		void drawBoundLOD(unsigned int level);
+
 		// Description:
 		// Sets all per-vertex colours to the specified colour
 		void setAllColours(glm::vec4 colour);
 		
 		void createVBO();
 
+		// Description:
+		// Calculates the axis aligned bounding box of the vertices
+		// Called by createVBO(), so usually you don't need to call this yourself
+		void computeBounds();
+
+		// Description:
+		// Welds the vertices and builds up to numLevels levels of detail (including the
+		// original mesh), each with about reductionPerLevel times the triangles of the last.
+		// All levels index into the same vertices. Recreates the VBO.
+		void generateLODs(unsigned int numLevels = 4, float reductionPerLevel = 0.5f);
+
+		// Description:
+		// Picks the level whose error is less than maxPixelError pixels on screen.
+		// pixelsPerUnit is how many pixels one object space unit covers at the mesh's distance.
+		// Only switches to a coarser level once the error is below maxPixelError * (1 - hysteresis)
+		// so objects sitting near a threshold do not pop back and forth.
+		unsigned int selectLOD(float pixelsPerUnit, unsigned int currentLevel, float maxPixelError, float hysteresis);
+
+		unsigned int getNumLODs() { return lods.size() > 0 ? (unsigned int)lods.size() : 1; }
+		unsigned int getNumTriangles(unsigned int level);
+
 		std::vector<glm::vec3> vertices;
 		std::vector<glm::vec3> normals;
 		std::vector<glm::vec2> textureCoordinates;
 		std::vector<glm::vec4> colours;
 
+		// Optional, if empty the vertices are drawn as a plain triangle list
+		// With LODs every level is a range of this array
+		std::vector<unsigned int> indices;
+		std::vector<MeshLOD> lods;
+
 		PrimitiveType primitiveType;
 
+		// Unique id, used by the render queue to group draws that share a mesh
+		unsigned int id;
+
+		// Local space bounding box
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+
 		VertexBufferObject vbo;
 	};
 }
@@ -0,0 +1,56 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// This header is a part of the Tutorial Tool Kit (TTK) library. 
+// You may not use this header in your GDW games.
+//
+// Reorders indexed meshes so the GPU can draw them faster:
+//   - triangles are reordered to reuse vertices still in the post transform cache (Tipsify)
+//   - groups of those triangles are reordered so outward facing parts are drawn first,
+//     which lets early depth testing reject more of what is drawn after them
+//   - vertices are reordered so they are read from memory in order
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TTK/MeshBase.h"
+#include <string>
+#include <vector>
+
+namespace TTK
+{
+	// Size of the post transform cache we optimize for and simulate
+	const unsigned int VERTEX_CACHE_SIZE = 16;
+
+	struct VertexCacheStats
+	{
+		float acmr; // average cache miss ratio, vertices transformed per triangle (0.5 is perfect, 3 is worst)
+		float atvr; // average transform to vertex ratio, vertices transformed per unique vertex (1 is perfect)
+	};
+
+	// Description:
+	// Simulates a FIFO post transform cache of cacheSize vertices over a triangle list
+	VertexCacheStats analyzeVertexCache(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+	// Description:
+	// Reorders the triangles of a triangle list in place for vertex cache reuse (Sander et al. 2007, "Tipsify").
+	// If clusters is not null it receives the first triangle of every run of triangles that
+	// was generated without a cache flush, optimizeOverdraw() reorders these runs.
+	void optimizeVertexCache(unsigned int* indices, unsigned int numIndices, unsigned int numVertices, unsigned int cacheSize, std::vector<unsigned int>* clusters);
+
+	// Description:
+	// Reorders clusters of triangles so the ones facing away from the middle of the mesh
+	// come first (Sander et al. 2007). Triangles within a cluster keep their order.
+	// The clusters from optimizeVertexCache() are split further as long as the cache miss
+	// ratio stays within threshold (1.05 = 5% worse) of the ratio before reordering.
+	void optimizeOverdraw(unsigned int* indices, unsigned int numIndices, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& clusters, float threshold = 1.05f);
+
+	// Description:
+	// Reorders (and compacts) the vertices in the order the index array first uses them
+	void optimizeVertexFetch(MeshBase& mesh);
+
+	// Description:
+	// Runs all of the above on every level of detail of an indexed mesh.
+	// If name is not empty the cache statistics before and after are printed.
+	void optimizeMesh(MeshBase& mesh, const std::string& name);
+}
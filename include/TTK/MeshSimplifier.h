@@ -0,0 +1,30 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// This header is a part of the Tutorial Tool Kit (TTK) library. 
+// You may not use this header in your GDW games.
+//
+// Mesh simplification using quadric error metrics (Garland & Heckbert).
+// Edges are collapsed onto one of their existing vertices, so simplified
+// meshes never need new vertices and can share the original vertex buffer.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TTK/MeshBase.h"
+#include <vector>
+
+namespace TTK
+{
+	// Description:
+	// Merges vertices that have the same position, normal, uv and colour,
+	// and fills mesh.indices with a triangle list into the merged vertices.
+	// The mesh is expected to be an unindexed triangle list (like OBJMesh).
+	void weldVertices(MeshBase& mesh);
+
+	// Description:
+	// Simplifies a triangle list (indices into mesh.vertices) down to about targetIndexCount indices.
+	// The result is written to outIndices, outError is the largest error (in object space units)
+	// of any collapse that was made. Stops early if no more edges can be collapsed safely.
+	void simplifyMesh(MeshBase& mesh, const std::vector<unsigned int>& srcIndices, std::vector<unsigned int>& outIndices, unsigned int targetIndexCount, float& outError);
+}
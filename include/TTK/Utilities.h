@@ -11,6 +11,9 @@ glm::vec4 getColorFromHue(float t);
 
 std::shared_ptr<TTK::MeshBase> createQuadMesh();
 
+// Unit cube centered at the origin (-0.5 to 0.5), positions only
+std::shared_ptr<TTK::MeshBase> createBoxMesh();
+
 // Returns a random float between 0 and 1
 float randomFloat01();
 
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+
+// CPU and GPU timeline tracing
+//
+// TRACE_SCOPE("name") records how long the rest of the enclosing block took.
+// Every thread writes into its own fixed size buffer, so recording an event
+// is a clock read and a few stores, no locks and no allocations. GPU work is
+// timed with GL_TIMESTAMP queries and ends up on the same timeline as a
+// separate "GPU" thread.
+//
+// Nothing is recorded outside of a session. Trace::endSession() writes the
+// session in the Chrome Trace Event format, open the file in chrome://tracing
+// or https://ui.perfetto.dev
+//
+// Tracing is compiled in for debug builds. Release builds only have it with
+// ENABLE_TRACING defined, otherwise all the macros compile to nothing.
+#if defined(_DEBUG) || defined(ENABLE_TRACING)
+#define TRACING_ENABLED
+#endif
+
+#ifdef TRACING_ENABLED
+
+namespace Trace
+{
+	// Events each thread can record per session, later ones are dropped
+	const unsigned int MAX_EVENTS_PER_THREAD = 16384;
+
+	// GPU zones that can wait for their queries at the same time
+	const unsigned int MAX_GPU_ZONES = 256;
+
+	// Longest detail string kept with an event
+	const unsigned int MAX_DETAIL_LENGTH = 39;
+
+	// Starts recording, anything recorded in an earlier session is thrown away
+	// Can be called before the GL context exists
+	void beginSession();
+
+	// Stops recording and writes everything to path as Chrome Trace Event JSON
+	// Call on the GL thread outside of any GPU zone, it waits for the GPU zones still in flight
+	// Returns false if the file could not be written
+	bool endSession(const char* path);
+
+	bool isActive();
+
+	// Reads back finished GPU zones, call once per frame on the GL thread
+	void update();
+
+	// Shows up as the thread's name in the viewer
+	void setThreadName(const char* name);
+
+	// Nanoseconds on the trace clock
+	uint64_t now();
+
+	// name must be a string literal, detail is copied when the event is recorded
+	void recordEvent(const char* name, const char* detail, uint64_t start, uint64_t end);
+
+	class Zone
+	{
+	public:
+		Zone(const char* name, const char* detail = nullptr);
+		~Zone();
+
+	private:
+		const char* m_pName;
+		const char* m_pDetail;
+		uint64_t m_pStart;
+		bool m_pActive;
+	};
+
+	// Puts a GL_TIMESTAMP query at the start and end of the block
+	// Only use on the GL thread
+	class GPUZone
+	{
+	public:
+		GPUZone(const char* name);
+		~GPUZone();
+
+	private:
+		int m_pSlot;
+	};
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+#define TRACE_SCOPE(name) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name)
+#define TRACE_SCOPE_DETAIL(name, detail) Trace::Zone TRACE_CONCAT(traceZone, __LINE__)(name, detail)
+#define TRACE_GPU_SCOPE(name) Trace::GPUZone TRACE_CONCAT(traceGPUZone, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) Trace::setThreadName(name)
+#define TRACE_BEGIN_SESSION() Trace::beginSession()
+#define TRACE_END_SESSION(path) Trace::endSession(path)
+#define TRACE_UPDATE() Trace::update()
+
+#else
+
+#define TRACE_SCOPE(name)
+#define TRACE_SCOPE_DETAIL(name, detail)
+#define TRACE_GPU_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+#define TRACE_BEGIN_SESSION()
+#define TRACE_END_SESSION(path)
+#define TRACE_UPDATE()
+
+#endif
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <GLM/glm.hpp>
+#include <cstddef>
+
+// Matrix math for many transforms at once
+//
+// Building a world matrix out of three glm::rotate() calls and four full
+// matrix products is most of what the simulation does per object, and the
+// renderer does two more products per draw for the MVP and MV matrices.
+// These functions do the same for whole arrays:
+//
+//	composeTRS() writes out the rotation product in closed form, so an object
+//	costs six sin / cos and a handful of multiplies instead of four mat4 products.
+//
+//	multiply() runs the products with the widest instruction set the CPU has,
+//	picked once at startup: SSE (4 floats at a time, one column), AVX2 + FMA
+//	(two columns) or AVX-512 (the whole matrix).
+//
+// GLM's own SIMD types need GLM's SIMD support switched on for the whole
+// program, so the kernels use intrinsics on plain glm::mat4 instead. Matrices
+// do not have to be aligned.
+namespace TransformBatch
+{
+	enum InstructionSet
+	{
+		SCALAR = 0,
+		SSE,
+		AVX2,
+		AVX512,
+		NUM_INSTRUCTION_SETS
+	};
+
+	// Position, rotation (XYZ Euler angles in degrees, applied X first) and uniform scale
+	struct TRS
+	{
+		glm::vec3 position;
+		glm::vec3 rotation;
+		float scale;
+	};
+
+	// Picks the widest instruction set the CPU and OS support
+	// Everything runs scalar until this is called
+	void init();
+
+	// Best instruction set this machine supports
+	InstructionSet getSupported();
+
+	// The one in use, setInstructionSet() can only go down from getSupported()
+	// Meant for comparing the paths, ie. in benchmarks
+	InstructionSet getInstructionSet();
+	void setInstructionSet(InstructionSet set);
+
+	const char* getName(InstructionSet set);
+
+	// out[i] = translate(position) * rotateZ * rotateY * rotateX * scale, the same as GameObject::update()
+	// outRotations can be null, otherwise it gets the rotation part on its own
+	void composeTRS(const TRS* transforms, glm::mat4* out, glm::mat4* outRotations, size_t count);
+
+	// out[i * outStride] = left * right[i]
+	// outStride is in matrices, ie. 2 to fill one member of an array of structs holding two matrices
+	void multiply(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride = 1);
+}
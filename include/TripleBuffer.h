@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+
+// Lock free triple buffer, one thread writes and one thread reads
+//
+// The writer always has a buffer of its own to fill, and the reader always
+// has a buffer of its own to read, so neither ever waits for the other.
+// The third buffer sits in the middle holding the latest published data.
+// Publishing and picking up swap a buffer with the middle one atomically.
+// If the writer publishes several times before the reader looks,
+// the reader only gets the newest one.
+template <typename T>
+class TripleBuffer
+{
+public:
+	TripleBuffer()
+		: m_pWriteIndex(0),
+		m_pMiddle(1),
+		m_pReadIndex(2)
+	{}
+
+	// Writer side
+	// Fill the buffer returned by getWriteBuffer(), then publish() it
+	T& getWriteBuffer() { return m_pBuffers[m_pWriteIndex]; }
+
+	void publish()
+	{
+		// Hand our buffer to the middle and take whatever was there
+		m_pWriteIndex = m_pMiddle.exchange(m_pWriteIndex | NEW_DATA_BIT, std::memory_order_acq_rel) & INDEX_MASK;
+	}
+
+	// Reader side
+	// Picks up the latest published buffer, returns false if nothing new was published
+	bool update()
+	{
+		if ((m_pMiddle.load(std::memory_order_acquire) & NEW_DATA_BIT) == 0)
+			return false;
+
+		m_pReadIndex = m_pMiddle.exchange(m_pReadIndex, std::memory_order_acq_rel) & INDEX_MASK;
+		return true;
+	}
+
+	const T& getReadBuffer() const { return m_pBuffers[m_pReadIndex]; }
+
+private:
+	static const unsigned int INDEX_MASK = 3;
+	static const unsigned int NEW_DATA_BIT = 4;
+
+	T m_pBuffers[3];
+
+	unsigned int m_pWriteIndex;			// only touched by the writer
+	std::atomic<unsigned int> m_pMiddle;	// index of the middle buffer, plus NEW_DATA_BIT if the reader has not seen it
+	unsigned int m_pReadIndex;			// only touched by the reader
+};
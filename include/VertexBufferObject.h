@@ -52,12 +52,22 @@ private:
 	// We just use the VAO
 	unsigned int vaoHandle;
 
+	// Second VAO that only has the position attribute enabled
+	// Used by depth only passes so they do not fetch normals, uvs etc.
+	unsigned int depthVaoHandle;
+
 	// There can be multiple arrays of data used by a single VBO
 	// ie. a buffer for normals, vertices, texture coords etc.
 	// OR (ideally) there will only be one array where each attribute
 	// is interleaved. 
 	std::vector<unsigned int> vboHandles;
 
+	// Optional index buffer, shared by both VAOs
+	unsigned int indexHandle;
+	unsigned int* indexData;
+	unsigned int numIndices;
+	unsigned int numDrawIndices;	// drawn by drawBound(), the front of the index buffer
+
 public:
 	VertexBufferObject();
 	~VertexBufferObject();
@@ -76,12 +86,31 @@ public:
 	unsigned int getVBO(AttributeLocations loc);
 
 
+	// Pass in an index array to draw with glDrawElements instead of glDrawArrays
+	// Like the attribute arrays, call this before createVBO()
+	// drawCount limits drawBound() to the first drawCount indices, 0 draws all of them
+	// (meshes with LODs keep the coarser levels after the full detail one)
+	void setIndexArray(unsigned int* data, unsigned int count, unsigned int drawCount = 0);
+	bool isIndexed() { return numIndices > 0; }
+
 	// Call this once you add all the AttributeDescriptor objects
 	void createVBO(GLenum vboUsage);
 
 	// Call this when you want to draw the object
 	void draw();
 
+	// Use these when drawing the same object several times in a row
+	// bind() once, then drawBound() as many times as needed
+	void bind();
+	static void unbind();
+	void drawBound();
+
+	// Draws part of the index buffer, the VBO must be indexed and bound
+	void drawBoundRange(unsigned int firstIndex, unsigned int count);
+
+	// Binds the position only VAO, draw with drawBound()
+	void bindDepthOnly();
+
 	// Call this when you want to destroy the object
 	// Tip: Might want to put this in the destructor  
 	void destroy();
@@ -2,6 +2,8 @@
 #include "imgui/imgui.h"
 #include "imgui_impl.h"
 #include "TTK/Texture2D.h"
+#include "GLState.h"
+#include "RenderStats.h"
 #include "GLUT\freeglut.h"
 
 namespace TTK
@@ -11,9 +13,25 @@ namespace TTK
 		Texture2D::Ptr g_imguiFontTex;
 		unsigned int g_ShaderHandle, g_VertHandle, g_FragHandle,
 			g_AttribLocationTex, g_AttribLocationProjMtx, g_AttribLocationPosition,
-			g_AttribLocationUV, g_AttribLocationColor, g_VboHandle, g_ElementsHandle, g_VaoHandle;
+			g_AttribLocationUV, g_AttribLocationColor, g_VaoHandle;
 
 		bool g_imguiIsInit = false;
+
+		// UI geometry is streamed through one buffer that holds both vertices and indices
+		// It is split into one segment per frame in flight, and each segment has a fence
+		// so we never write over data the GPU has not drawn yet.
+		// With ARB_buffer_storage the buffer is mapped once and stays mapped, otherwise
+		// the frame's segment is mapped unsynchronized (the fence already did the syncing).
+		const int IMGUI_RING_SEGMENTS = 3;
+		const GLsizeiptr IMGUI_RING_INITIAL_SEGMENT_SIZE = sizeof(ImDrawVert) * 1024 * 64;
+
+		GLuint g_RingHandle = 0;
+		GLsizeiptr g_RingSegmentSize = 0;
+		GLsync g_RingFences[IMGUI_RING_SEGMENTS];
+		int g_RingSegment = 0;
+		unsigned char* g_RingPersistentPtr = nullptr; // null if the buffer is not persistently mapped
+
+		void imguiCreateRing(GLsizeiptr segmentSize);
 	}
 
 	void TTK::InitImGUI()
@@ -84,12 +102,6 @@ void TTK::internal::imguiInit()
 		GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE, imguiFontTexData);
 
 	io.Fonts->TexID = static_cast<void*>(g_imguiFontTex.get());
-	
-	// Backup GL state
-	GLint last_texture, last_array_buffer, last_vertex_array;
-	glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-	glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
 		
 	const GLchar *vertex_shader =
 		"#version 330\n"
@@ -134,12 +146,58 @@ void TTK::internal::imguiInit()
 	g_AttribLocationUV = glGetAttribLocation(g_ShaderHandle, "UV");
 	g_AttribLocationColor = glGetAttribLocation(g_ShaderHandle, "Color");
 	
-	glGenBuffers(1, &g_VboHandle);
-	glGenBuffers(1, &g_ElementsHandle);
-	
 	glGenVertexArrays(1, &g_VaoHandle);
-	glBindVertexArray(g_VaoHandle);
-	glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+	imguiCreateRing(IMGUI_RING_INITIAL_SEGMENT_SIZE);
+
+	GLState::useProgram(0);
+}
+
+void TTK::internal::imguiCreateRing(GLsizeiptr segmentSize)
+{
+	// Segments start on a whole vertex, so the base vertex of a segment is just offset / sizeof(ImDrawVert)
+	segmentSize = ((segmentSize + sizeof(ImDrawVert) - 1) / sizeof(ImDrawVert)) * sizeof(ImDrawVert);
+
+	// The old buffer may still be in use by the GPU, OpenGL keeps it alive until it is done
+	if (g_RingHandle)
+	{
+		if (g_RingPersistentPtr)
+		{
+			GLState::bindBuffer(GL_ARRAY_BUFFER, g_RingHandle);
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		}
+		GLState::deleteBuffers(1, &g_RingHandle);
+	}
+
+	for (int i = 0; i < IMGUI_RING_SEGMENTS; i++)
+	{
+		if (g_RingFences[i])
+			glDeleteSync(g_RingFences[i]);
+		g_RingFences[i] = 0;
+	}
+
+	g_RingSegmentSize = segmentSize;
+	g_RingSegment = 0;
+	g_RingPersistentPtr = nullptr;
+
+	GLsizeiptr totalSize = segmentSize * IMGUI_RING_SEGMENTS;
+
+	glGenBuffers(1, &g_RingHandle);
+	GLState::bindVertexArray(g_VaoHandle);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, g_RingHandle);
+
+	if (GLEW_ARB_buffer_storage)
+	{
+		// Coherent, so writes are visible to the GPU without an explicit flush
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_ARRAY_BUFFER, totalSize, nullptr, flags);
+		g_RingPersistentPtr = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, totalSize, flags);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, totalSize, nullptr, GL_STREAM_DRAW);
+
+	// Same buffer for indices, the element binding is part of the VAO
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_RingHandle);
+
 	glEnableVertexAttribArray(g_AttribLocationPosition);
 	glEnableVertexAttribArray(g_AttribLocationUV);
 	glEnableVertexAttribArray(g_AttribLocationColor);
@@ -150,12 +208,8 @@ void TTK::internal::imguiInit()
 	glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, col));
 #undef OFFSETOF
 
-	glUseProgram(0);
-	glBindVertexArray(0);
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
-	glDisableVertexAttribArray(g_AttribLocationPosition);
-	glDisableVertexAttribArray(g_AttribLocationUV);
-	glDisableVertexAttribArray(g_AttribLocationColor);
+	GLState::bindVertexArray(0);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 void TTK::internal::imguiDraw(ImDrawData* draw_data)
@@ -171,40 +225,33 @@ void TTK::internal::imguiDraw(ImDrawData* draw_data)
 	draw_data->ScaleClipRects(io.DisplayFramebufferScale);
 
 	// Backup GL state
-	GLint last_active_texture; glGetIntegerv(GL_ACTIVE_TEXTURE, &last_active_texture);
-	glActiveTexture(GL_TEXTURE0);
-	GLint last_program; glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-	GLint last_texture; glGetIntegerv(GL_TEXTURE_BINDING_2D, &last_texture);
-	GLint last_array_buffer; glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-	GLint last_element_array_buffer; glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &last_element_array_buffer);
-	GLint last_vertex_array; glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
-	GLint last_blend_src_rgb; glGetIntegerv(GL_BLEND_SRC_RGB, &last_blend_src_rgb);
-	GLint last_blend_dst_rgb; glGetIntegerv(GL_BLEND_DST_RGB, &last_blend_dst_rgb);
-	GLint last_blend_src_alpha; glGetIntegerv(GL_BLEND_SRC_ALPHA, &last_blend_src_alpha);
-	GLint last_blend_dst_alpha; glGetIntegerv(GL_BLEND_DST_ALPHA, &last_blend_dst_alpha);
-	GLint last_blend_equation_rgb; glGetIntegerv(GL_BLEND_EQUATION_RGB, &last_blend_equation_rgb);
-	GLint last_blend_equation_alpha; glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &last_blend_equation_alpha);
-	GLint last_viewport[4]; glGetIntegerv(GL_VIEWPORT, last_viewport);
-	GLint last_scissor_box[4]; glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box);
-	GLboolean last_enable_blend = glIsEnabled(GL_BLEND);
-	GLboolean last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
-	GLboolean last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
-	GLboolean last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
-
-	glEnableVertexAttribArray(g_AttribLocationPosition);
-	glEnableVertexAttribArray(g_AttribLocationUV);
-	glEnableVertexAttribArray(g_AttribLocationColor);
+	// This comes from the state cache, so no glGet* calls (and no driver syncs)
+	GLenum last_active_texture = GLState::getActiveTexture();
+	GLuint last_program = GLState::getProgram();
+	GLuint last_texture = GLState::getTexture(GL_TEXTURE0);
+	GLuint last_array_buffer = GLState::getBuffer(GL_ARRAY_BUFFER);
+	GLuint last_vertex_array = GLState::getVertexArray();
+	GLenum last_blend_src_rgb, last_blend_dst_rgb, last_blend_src_alpha, last_blend_dst_alpha;
+	GLState::getBlendFunc(&last_blend_src_rgb, &last_blend_dst_rgb, &last_blend_src_alpha, &last_blend_dst_alpha);
+	GLenum last_blend_equation_rgb, last_blend_equation_alpha;
+	GLState::getBlendEquation(&last_blend_equation_rgb, &last_blend_equation_alpha);
+	GLint last_viewport[4]; GLState::getViewport(last_viewport);
+	GLint last_scissor_box[4]; GLState::getScissor(last_scissor_box);
+	bool last_enable_blend = GLState::isEnabled(GL_BLEND);
+	bool last_enable_cull_face = GLState::isEnabled(GL_CULL_FACE);
+	bool last_enable_depth_test = GLState::isEnabled(GL_DEPTH_TEST);
+	bool last_enable_scissor_test = GLState::isEnabled(GL_SCISSOR_TEST);
 
 	// Setup render state: alpha-blending enabled, no face culling, no depth testing, scissor enabled
-	glEnable(GL_BLEND);
-	glBlendEquation(GL_FUNC_ADD);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glDisable(GL_CULL_FACE);
-	glDisable(GL_DEPTH_TEST);
-	glEnable(GL_SCISSOR_TEST);
+	GLState::enable(GL_BLEND);
+	GLState::blendEquation(GL_FUNC_ADD);
+	GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::disable(GL_CULL_FACE);
+	GLState::disable(GL_DEPTH_TEST);
+	GLState::enable(GL_SCISSOR_TEST);
 
 	// Setup viewport, orthographic projection matrix
-	glViewport(0, 0, (GLsizei)fb_width, (GLsizei)fb_height);
+	GLState::viewport(0, 0, (GLsizei)fb_width, (GLsizei)fb_height);
 	const float ortho_projection[4][4] =
 	{
 		{ 2.0f / io.DisplaySize.x, 0.0f,                   0.0f, 0.0f },
@@ -212,59 +259,105 @@ void TTK::internal::imguiDraw(ImDrawData* draw_data)
 		{ 0.0f,                  0.0f,                  -1.0f, 0.0f },
 		{ -1.0f,                  1.0f,                   0.0f, 1.0f },
 	};
-	glUseProgram(g_ShaderHandle);
+	GLState::useProgram(g_ShaderHandle);
 	glUniform1i(g_AttribLocationTex, 0);
 	glUniformMatrix4fv(g_AttribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
-	glBindVertexArray(g_VaoHandle);
+	RenderStats::countUniformUpload();
+	RenderStats::countUniformUpload();
+
+	// All command lists go into one segment of the ring, vertices first and then indices
+	// The vertex size is a multiple of 4, so the indices stay aligned
+	GLsizeiptr vtxBytes = (GLsizeiptr)draw_data->TotalVtxCount * sizeof(ImDrawVert);
+	GLsizeiptr idxBytes = (GLsizeiptr)draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+	if (vtxBytes + idxBytes > g_RingSegmentSize)
+		imguiCreateRing((vtxBytes + idxBytes) * 2);
 
-	for (int n = 0; n < draw_data->CmdListsCount; n++)
+	// The attribute arrays and the ring are set up on the VAO when it is created
+	GLState::bindVertexArray(g_VaoHandle);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, g_RingHandle);
+
+	// Wait until the GPU is done with what was last written to this segment
+	// With a few frames between uses of the same segment this almost never blocks
+	GLsync& fence = g_RingFences[g_RingSegment];
+	if (fence)
 	{
-		const ImDrawList* cmd_list = draw_data->CmdLists[n];
-		const ImDrawIdx* idx_buffer_offset = 0;
+		glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		glDeleteSync(fence);
+		fence = 0;
+	}
 
-		glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
-		glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert), (const GLvoid*)cmd_list->VtxBuffer.Data, GL_STREAM_DRAW);
+	GLsizeiptr segmentOffset = g_RingSegmentSize * g_RingSegment;
+	unsigned char* dst = nullptr;
+	if (g_RingPersistentPtr)
+		dst = g_RingPersistentPtr + segmentOffset;
+	else if (vtxBytes + idxBytes > 0)
+		dst = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, segmentOffset, vtxBytes + idxBytes, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
 
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx), (const GLvoid*)cmd_list->IdxBuffer.Data, GL_STREAM_DRAW);
+	if (dst)
+	{
+		unsigned char* vtxDst = dst;
+		unsigned char* idxDst = dst + vtxBytes;
+		for (int n = 0; n < draw_data->CmdListsCount; n++)
+		{
+			const ImDrawList* cmd_list = draw_data->CmdLists[n];
+			size_t listVtxBytes = cmd_list->VtxBuffer.Size * sizeof(ImDrawVert);
+			size_t listIdxBytes = cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx);
+			memcpy(vtxDst, cmd_list->VtxBuffer.Data, listVtxBytes);
+			memcpy(idxDst, cmd_list->IdxBuffer.Data, listIdxBytes);
+			vtxDst += listVtxBytes;
+			idxDst += listIdxBytes;
+		}
+
+		if (!g_RingPersistentPtr)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		RenderStats::countUpload(vtxBytes + idxBytes);
+
+		// Every list keeps its own 0 based indices, the base vertex moves them to where the list's vertices ended up
+		GLint baseVertex = (GLint)(segmentOffset / sizeof(ImDrawVert));
+		const unsigned char* idxOffset = (const unsigned char*)0 + segmentOffset + vtxBytes;
 
-		for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+		for (int n = 0; n < draw_data->CmdListsCount; n++)
 		{
-			const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
-			if (pcmd->UserCallback)
-			{
-				pcmd->UserCallback(cmd_list, pcmd);
-			}
-			else
+			const ImDrawList* cmd_list = draw_data->CmdLists[n];
+
+			for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
 			{
-				glBindTexture(GL_TEXTURE_2D, (GLuint)((Texture2D*)pcmd->TextureId)->id());
-				glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
-				glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
+				const ImDrawCmd* pcmd = &cmd_list->CmdBuffer[cmd_i];
+				if (pcmd->UserCallback)
+				{
+					pcmd->UserCallback(cmd_list, pcmd);
+				}
+				else
+				{
+					GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, (GLuint)((Texture2D*)pcmd->TextureId)->id());
+					GLState::scissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
+					glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, (const GLvoid*)idxOffset, baseVertex);
+					RenderStats::countDraw(GL_TRIANGLES, (GLsizei)pcmd->ElemCount);
+				}
+				idxOffset += pcmd->ElemCount * sizeof(ImDrawIdx);
 			}
-			idx_buffer_offset += pcmd->ElemCount;
+
+			baseVertex += cmd_list->VtxBuffer.Size;
 		}
+
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		g_RingSegment = (g_RingSegment + 1) % IMGUI_RING_SEGMENTS;
 	}
 
 	// Restore modified GL state
-	glUseProgram(last_program);
-	glBindTexture(GL_TEXTURE_2D, last_texture);
-	glActiveTexture(last_active_texture);
-	glBindVertexArray(last_vertex_array);
-	glBindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, last_element_array_buffer);
-	glBlendEquationSeparate(last_blend_equation_rgb, last_blend_equation_alpha);
-	glBlendFuncSeparate(last_blend_src_rgb, last_blend_dst_rgb, last_blend_src_alpha, last_blend_dst_alpha);
-	if (last_enable_blend) glEnable(GL_BLEND); else glDisable(GL_BLEND);
-	if (last_enable_cull_face) glEnable(GL_CULL_FACE); else glDisable(GL_CULL_FACE);
-	if (last_enable_depth_test) glEnable(GL_DEPTH_TEST); else glDisable(GL_DEPTH_TEST);
-	if (last_enable_scissor_test) glEnable(GL_SCISSOR_TEST); else glDisable(GL_SCISSOR_TEST);
-	glViewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
-	glScissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
-
-	//glUseProgram(0);
-	//glBindVertexArray(0);
-	//glBindBuffer(GL_ARRAY_BUFFER, 0);
-	//glDisableVertexAttribArray(g_AttribLocationPosition);
-	//glDisableVertexAttribArray(g_AttribLocationUV);
-	//glDisableVertexAttribArray(g_AttribLocationColor);
+	// Anything that did not actually change is skipped by the state cache
+	// The element array binding belongs to the VAO, restoring the VAO restores it
+	GLState::useProgram(last_program);
+	GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, last_texture);
+	GLState::activeTexture(last_active_texture);
+	GLState::bindVertexArray(last_vertex_array);
+	GLState::bindBuffer(GL_ARRAY_BUFFER, last_array_buffer);
+	GLState::blendEquationSeparate(last_blend_equation_rgb, last_blend_equation_alpha);
+	GLState::blendFuncSeparate(last_blend_src_rgb, last_blend_dst_rgb, last_blend_src_alpha, last_blend_dst_alpha);
+	GLState::setEnabled(GL_BLEND, last_enable_blend);
+	GLState::setEnabled(GL_CULL_FACE, last_enable_cull_face);
+	GLState::setEnabled(GL_DEPTH_TEST, last_enable_depth_test);
+	GLState::setEnabled(GL_SCISSOR_TEST, last_enable_scissor_test);
+	GLState::viewport(last_viewport[0], last_viewport[1], (GLsizei)last_viewport[2], (GLsizei)last_viewport[3]);
+	GLState::scissor(last_scissor_box[0], last_scissor_box[1], (GLsizei)last_scissor_box[2], (GLsizei)last_scissor_box[3]);
 }
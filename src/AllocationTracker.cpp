@@ -0,0 +1,205 @@
+#include "AllocationTracker.h"
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdlib>
+
+namespace AllocationTracker
+{
+	namespace
+	{
+		// Whole program, updated from every thread
+		std::atomic<unsigned long long> totalAllocations(0);
+		std::atomic<unsigned long long> totalFrees(0);
+		std::atomic<unsigned long long> totalBytes(0);
+
+		// This thread only, scopes look at these so other threads do not show up in them
+		thread_local unsigned long long threadAllocations = 0;
+		thread_local unsigned long long threadFrees = 0;
+		thread_local unsigned long long threadBytes = 0;
+
+		// Totals when the current frame started
+		Counts frameStart = { 0, 0, 0 };
+		Counts lastFrame = { 0, 0, 0 };
+
+		struct ScopeAccumulator
+		{
+			std::atomic<unsigned long long> allocations;
+			std::atomic<unsigned long long> frees;
+			std::atomic<unsigned long long> bytes;
+		};
+
+		ScopeAccumulator scopeAccumulators[MAX_SCOPES];
+		ScopeStats scopeStats[MAX_SCOPES];
+		std::atomic<int> numScopes(0);
+		std::mutex scopeRegisterMutex;
+
+		void recordAllocation(size_t size)
+		{
+			totalAllocations.fetch_add(1, std::memory_order_relaxed);
+			totalBytes.fetch_add(size, std::memory_order_relaxed);
+			threadAllocations++;
+			threadBytes += size;
+		}
+
+		void recordFree()
+		{
+			totalFrees.fetch_add(1, std::memory_order_relaxed);
+			threadFrees++;
+		}
+
+		int findScope(const char* name)
+		{
+			int count = numScopes.load(std::memory_order_acquire);
+			for (int i = 0; i < count; i++)
+			{
+				if (scopeStats[i].name == name)
+					return i;
+			}
+
+			// First time this scope runs, check again under the lock in case another thread just added it
+			std::lock_guard<std::mutex> lock(scopeRegisterMutex);
+
+			count = numScopes.load(std::memory_order_relaxed);
+			for (int i = 0; i < count; i++)
+			{
+				if (scopeStats[i].name == name)
+					return i;
+			}
+
+			if (count == MAX_SCOPES)
+				return -1;
+
+			scopeStats[count].name = name;
+			numScopes.store(count + 1, std::memory_order_release);
+			return count;
+		}
+	}
+
+	void beginFrame()
+	{
+		Counts now = getTotal();
+		lastFrame.allocations = now.allocations - frameStart.allocations;
+		lastFrame.frees = now.frees - frameStart.frees;
+		lastFrame.bytes = now.bytes - frameStart.bytes;
+		frameStart = now;
+
+		int count = numScopes.load(std::memory_order_acquire);
+		for (int i = 0; i < count; i++)
+		{
+			scopeStats[i].lastFrame.allocations = scopeAccumulators[i].allocations.exchange(0);
+			scopeStats[i].lastFrame.frees = scopeAccumulators[i].frees.exchange(0);
+			scopeStats[i].lastFrame.bytes = scopeAccumulators[i].bytes.exchange(0);
+		}
+	}
+
+	Counts getTotal()
+	{
+		Counts counts;
+		counts.allocations = totalAllocations.load(std::memory_order_relaxed);
+		counts.frees = totalFrees.load(std::memory_order_relaxed);
+		counts.bytes = totalBytes.load(std::memory_order_relaxed);
+		return counts;
+	}
+
+	const Counts& getLastFrame()
+	{
+		return lastFrame;
+	}
+
+	int getNumScopes()
+	{
+		return numScopes.load(std::memory_order_acquire);
+	}
+
+	const ScopeStats& getScope(int index)
+	{
+		return scopeStats[index];
+	}
+
+	Scope::Scope(const char* name)
+		: m_pIndex(findScope(name)),
+		m_pStartAllocations(threadAllocations),
+		m_pStartFrees(threadFrees),
+		m_pStartBytes(threadBytes)
+	{
+	}
+
+	Scope::~Scope()
+	{
+		if (m_pIndex < 0)
+			return;
+
+		ScopeAccumulator& accumulator = scopeAccumulators[m_pIndex];
+		accumulator.allocations.fetch_add(threadAllocations - m_pStartAllocations, std::memory_order_relaxed);
+		accumulator.frees.fetch_add(threadFrees - m_pStartFrees, std::memory_order_relaxed);
+		accumulator.bytes.fetch_add(threadBytes - m_pStartBytes, std::memory_order_relaxed);
+	}
+}
+
+#ifndef DISABLE_ALLOCATION_TRACKING
+
+// Replacements for the global operator new / delete
+// All of them are replaced, so nothing allocated here can be freed by the default delete
+void* operator new(size_t size)
+{
+	AllocationTracker::recordAllocation(size);
+
+	// malloc(0) may return null, new has to return a unique pointer
+	void* ptr = malloc(size ? size : 1);
+	if (!ptr)
+		throw std::bad_alloc();
+	return ptr;
+}
+
+void* operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept
+{
+	AllocationTracker::recordAllocation(size);
+	return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t& tag) noexcept
+{
+	return operator new(size, tag);
+}
+
+void operator delete(void* ptr) noexcept
+{
+	if (!ptr)
+		return;
+
+	AllocationTracker::recordFree();
+	free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+	operator delete(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+	operator delete(ptr);
+}
+
+#endif
@@ -0,0 +1,123 @@
+#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+
+const float DynamicResolution::MIN_SCALE = 0.5f;
+const float DynamicResolution::MAX_SCALE = 1.0f;
+const float DynamicResolution::SCALE_STEP = 0.05f;
+
+// Results still in flight when the scale changes, the size of GPUQuery's ring
+#define SETTLE_RESULTS 4
+
+// A step up has to be expected to use less than this much of the target
+#define UPSCALE_HEADROOM 0.85f
+
+// For this many results in a row
+#define UPSCALE_RESULTS 30
+
+// How much of a new result goes into the average
+#define AVERAGE_WEIGHT 0.2f
+
+DynamicResolution::DynamicResolution()
+	: enabled(true),
+	fixedScale(MAX_SCALE),
+	targetTime(13.0f),
+	numResults(0),
+	scale(MAX_SCALE),
+	gpuTime(0.0f),
+	averageTime(0.0f),
+	resultsToSkip(0),
+	resultsUnderBudget(0)
+{
+}
+
+// The global instance outlives the GL context, destroy() is called on window close
+DynamicResolution::~DynamicResolution()
+{
+}
+
+void DynamicResolution::create()
+{
+	gpuTimer.create(GL_TIME_ELAPSED);
+}
+
+void DynamicResolution::beginFrame()
+{
+	gpuTimer.begin();
+}
+
+void DynamicResolution::endFrame()
+{
+	gpuTimer.end();
+}
+
+void DynamicResolution::update()
+{
+	GLuint64 nanoseconds = gpuTimer.getResult();
+
+	if (!enabled)
+	{
+		setScale(fixedScale);
+		numResults = gpuTimer.getNumResults();
+		gpuTime = nanoseconds / 1000000.0f;
+		return;
+	}
+
+	// Nothing new since the last frame
+	if (gpuTimer.getNumResults() == numResults)
+		return;
+	numResults = gpuTimer.getNumResults();
+	gpuTime = nanoseconds / 1000000.0f;
+
+	// Drawn at the old scale
+	if (resultsToSkip > 0)
+	{
+		resultsToSkip--;
+		return;
+	}
+
+	averageTime = averageTime > 0.0f ? averageTime + (gpuTime - averageTime) * AVERAGE_WEIGHT : gpuTime;
+
+	// Over budget, go straight to the scale that should fit, at least one step down
+	// A single slow frame is enough, holding the frame rate matters more than the resolution
+	if (gpuTime > targetTime)
+	{
+		float fit = scale * sqrtf(targetTime / gpuTime);
+		setScale(std::min(fit, scale - SCALE_STEP));
+		return;
+	}
+
+	if (scale >= MAX_SCALE)
+		return;
+
+	// Expected time one step up, the cost going with the number of pixels
+	float next = scale + SCALE_STEP;
+	float expected = averageTime * (next * next) / (scale * scale);
+	if (expected < targetTime * UPSCALE_HEADROOM)
+	{
+		if (++resultsUnderBudget >= UPSCALE_RESULTS)
+			setScale(next);
+	}
+	else
+		resultsUnderBudget = 0;
+}
+
+void DynamicResolution::setScale(float newScale)
+{
+	// Rounded down to a whole step, the small bias keeps exact steps from rounding one lower
+	float steps = floorf((newScale - MIN_SCALE) / SCALE_STEP + 0.01f);
+	newScale = std::min(std::max(MIN_SCALE + steps * SCALE_STEP, MIN_SCALE), MAX_SCALE);
+
+	if (newScale == scale)
+		return;
+
+	scale = newScale;
+	averageTime = 0.0f;
+	resultsToSkip = SETTLE_RESULTS;
+	resultsUnderBudget = 0;
+}
+
+void DynamicResolution::destroy()
+{
+	gpuTimer.destroy();
+}
@@ -0,0 +1,82 @@
+#include "FrameArena.h"
+#include <atomic>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+
+namespace FrameArena
+{
+	namespace
+	{
+		unsigned char* memory = nullptr;
+		size_t capacity = 0;
+		std::atomic<size_t> offset(0);
+		size_t peak = 0;
+		bool reportedFull = false;
+	}
+
+	void init(size_t size)
+	{
+		if (memory)
+			shutdown();
+
+		memory = (unsigned char*)malloc(size);
+		capacity = memory ? size : 0;
+		offset = 0;
+		peak = 0;
+	}
+
+	void shutdown()
+	{
+		free(memory);
+		memory = nullptr;
+		capacity = 0;
+		offset = 0;
+	}
+
+	void reset()
+	{
+		size_t used = getUsed();
+		if (used > peak)
+			peak = used;
+
+		offset.store(0, std::memory_order_relaxed);
+	}
+
+	void* allocate(size_t size, size_t alignment)
+	{
+		// Reserve enough for the worst case padding, then align inside the reservation
+		// This keeps the bump a single atomic add even with several threads allocating
+		size_t start = offset.fetch_add(size + alignment - 1, std::memory_order_relaxed);
+		if (start + size + alignment - 1 > capacity)
+		{
+			if (!reportedFull)
+			{
+				std::cout << "FrameArena: out of memory (" << capacity << " bytes), increase the size passed to FrameArena::init" << std::endl;
+				reportedFull = true;
+			}
+			return nullptr;
+		}
+
+		uintptr_t address = (uintptr_t)(memory + start);
+		address = (address + alignment - 1) & ~(uintptr_t)(alignment - 1);
+		return (void*)address;
+	}
+
+	size_t getCapacity()
+	{
+		return capacity;
+	}
+
+	size_t getUsed()
+	{
+		size_t used = offset.load(std::memory_order_relaxed);
+		return used < capacity ? used : capacity;
+	}
+
+	size_t getPeak()
+	{
+		size_t used = getUsed();
+		return used > peak ? used : peak;
+	}
+}
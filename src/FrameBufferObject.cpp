@@ -1,4 +1,6 @@
 #include "FrameBufferObject.h"
+#include "GLState.h"
+#include "RenderStats.h"
 #include <iostream>
  
 FrameBufferObject::FrameBufferObject()
@@ -19,7 +21,7 @@ FrameBufferObject::~FrameBufferObject()
 // Frame Buffers do not store any actual data but instead we attach textures to them.
 // We can write to the textures in a fragment shader.
 
-void FrameBufferObject::createFrameBuffer(unsigned int fboWidth, unsigned int fboHeight, unsigned int numColourBuffers, bool useDepth)
+void FrameBufferObject::createFrameBuffer(unsigned int fboWidth, unsigned int fboHeight, unsigned int numColourBuffers, bool useDepth, const GLenum* colourFormats)
 {
 	width = fboWidth;
 	height = fboHeight;
@@ -31,7 +33,7 @@ void FrameBufferObject::createFrameBuffer(unsigned int fboWidth, unsigned int fb
 
 	// Bind the FBO
 	// Tell OpenGL we want to do things to this FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, handle);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, handle);
 
 	// We can have multiple textures on one frame buffer object
 	// So we need to generate an id for each of them
@@ -42,12 +44,14 @@ void FrameBufferObject::createFrameBuffer(unsigned int fboWidth, unsigned int fb
 	{
 		// Bind the texture
 		// binding tells OpenGL we want to do something with this texture
-		glBindTexture(GL_TEXTURE_2D, colourTexHandles[i]);
+		GLState::bindTexture(GLState::getActiveTexture(), GL_TEXTURE_2D, colourTexHandles[i]);
 
 		// We need to initialize the size of the texture
 		// Here I am making each texture the same size, but you may want to
 		// extend this class to allow textures of different size
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		// No data is passed, so GL_RGBA / GL_FLOAT works for any non integer format
+		GLenum format = colourFormats ? colourFormats[i] : GL_RGBA8;
+		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, GL_RGBA, GL_FLOAT, 0);
 
 		// Texture filtering
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -68,7 +72,7 @@ void FrameBufferObject::createFrameBuffer(unsigned int fboWidth, unsigned int fb
 	if (useDepth)
 	{
 		glGenTextures(1, &depthTexHandle);
-		glBindTexture(GL_TEXTURE_2D, depthTexHandle);
+		GLState::bindTexture(GLState::getActiveTexture(), GL_TEXTURE_2D, depthTexHandle);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, 0);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -91,21 +95,21 @@ void FrameBufferObject::createFrameBuffer(unsigned int fboWidth, unsigned int fb
 
 	// Unbind FBO
 	// When we unbind an FBO it goes back to the system provided FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void FrameBufferObject::bindFrameBufferForDrawing()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, handle);
-	glViewport(0, 0, width, height);
+	// Both of these are skipped by the state cache if they are already current
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, handle);
+	GLState::viewport(0, 0, width, height);
 }
 
 void FrameBufferObject::bindDepthTextureForSampling(GLenum textureUnit)
 {
 	if (depthTexHandle)
 	{
-		glActiveTexture(textureUnit);
-		glBindTexture(GL_TEXTURE_2D, depthTexHandle);
+		GLState::bindTexture(textureUnit, GL_TEXTURE_2D, depthTexHandle);
 	}
 	else
 		std::cout << "FBO does not have a depth texture!" << std::endl;
@@ -113,42 +117,40 @@ void FrameBufferObject::bindDepthTextureForSampling(GLenum textureUnit)
 
 void FrameBufferObject::unbindFrameBuffer(int backBufferWidth, int backBufferHeight)
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, backBufferWidth, backBufferHeight);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::viewport(0, 0, backBufferWidth, backBufferHeight);
 }
 
 void FrameBufferObject::clearFrameBuffer(glm::vec4 clearColour)
 {
-	glClearColor(clearColour.x, clearColour.y, clearColour.z, clearColour.w);
+	GLState::clearColour(clearColour.x, clearColour.y, clearColour.z, clearColour.w);
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
+	RenderStats::countClear();
 }
 
 void FrameBufferObject::bindTextureForSampling(int textureAttachment, GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_2D, colourTexHandles[textureAttachment]);
+	GLState::bindTexture(textureUnit, GL_TEXTURE_2D, colourTexHandles[textureAttachment]);
 }
 
 void FrameBufferObject::unbindTexture(GLenum textureUnit)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_2D, 0);
+	GLState::bindTexture(textureUnit, GL_TEXTURE_2D, 0);
 }
 
 void FrameBufferObject::destroy()
 {
 	if (colourTexHandles[0])
-		glDeleteTextures(numColorTex, colourTexHandles);
+		GLState::deleteTextures(numColorTex, colourTexHandles);
 
 	if (depthTexHandle)
 	{
-		glDeleteTextures(1, &depthTexHandle);
+		GLState::deleteTextures(1, &depthTexHandle);
 		depthTexHandle = 0;
 	}
 
 	if (handle)
-		glDeleteFramebuffers(1, &handle);
+		GLState::deleteFramebuffers(1, &handle);
 
 	unbindFrameBuffer(width, height);
 }
@@ -0,0 +1,223 @@
+#include "FrameChanges.h"
+#include "GameObject.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <climits>
+#include <cfloat>
+
+// An empty rectangle, anything merged into it replaces it
+static const FrameChanges::Rect EMPTY_RECT = { INT_MAX, INT_MAX, INT_MIN, INT_MIN };
+
+static bool isEmpty(const FrameChanges::Rect& r)
+{
+	return r.x0 >= r.x1 || r.y0 >= r.y1;
+}
+
+FrameChanges::FrameChanges()
+	: historyFrames(1),
+	width(0),
+	height(0),
+	hasFrame(false),
+	full(true),
+	forced(false),
+	dirty(EMPTY_RECT),
+	redraw(REDRAW_FULL),
+	staticFrame(false)
+{
+	for (int i = 0; i < MAX_HISTORY; i++)
+	{
+		historyFull[i] = false;
+		historyRects[i] = EMPTY_RECT;
+	}
+
+	rect = EMPTY_RECT;
+}
+
+void FrameChanges::begin(const glm::mat4& newViewProj, int newWidth, int newHeight, const void* newSettings, size_t settingsSize)
+{
+	full = false;
+	forced = false;
+	dirty = EMPTY_RECT;
+
+	// Anything that moves every pixel
+	if (!hasFrame || newViewProj != viewProj || newWidth != width || newHeight != height ||
+		settingsSize != settings.size() || memcmp(newSettings, settings.data(), settingsSize) != 0)
+	{
+		full = true;
+	}
+
+	viewProj = newViewProj;
+	width = newWidth;
+	height = newHeight;
+	settings.assign((const unsigned char*)newSettings, (const unsigned char*)newSettings + settingsSize);
+	hasFrame = true;
+}
+
+void FrameChanges::addObject(unsigned int slot, GameObject* object)
+{
+	if (slot >= objects.size())
+	{
+		ObjectState empty;
+		memset(&empty, 0, sizeof(empty));
+		objects.resize(slot + 1, empty);
+	}
+
+	ObjectState& state = objects[slot];
+
+	if (!object)
+	{
+		// Removed, its old box has to be drawn over
+		if (state.valid)
+			addRect(state.screen);
+		state.valid = false;
+		return;
+	}
+
+	glm::mat4 matrix = object->getRenderMatrix();
+	const void* mesh = object->mesh.get();
+	const void* material = object->material.get();
+	const void* texture = object->diffuseTexture.get();
+
+	// Boxes are only worth working out when something about the object changed,
+	// or when the next frame can not compare against this one
+	bool changed = !state.valid || matrix != state.matrix || object->colour != state.colour || object->emissive != state.emissive ||
+		mesh != state.mesh || material != state.material || texture != state.texture;
+
+	if (changed || full)
+	{
+		Rect screen = projectBounds(object);
+		if (changed)
+		{
+			if (state.valid)
+				addRect(state.screen);
+			addRect(screen);
+		}
+		state.screen = screen;
+	}
+
+	state.matrix = matrix;
+	state.colour = object->colour;
+	state.emissive = object->emissive;
+	state.mesh = mesh;
+	state.material = material;
+	state.texture = texture;
+	state.valid = true;
+}
+
+void FrameChanges::invalidate()
+{
+	forced = true;
+}
+
+FrameChanges::Redraw FrameChanges::end(int dilation)
+{
+	if (!isEmpty(dirty))
+	{
+		dirty.x0 -= dilation;
+		dirty.y0 -= dilation;
+		dirty.x1 += dilation;
+		dirty.y1 += dilation;
+	}
+
+	// Newest first, the oldest falls off the end
+	for (int i = MAX_HISTORY - 1; i > 0; i--)
+	{
+		historyFull[i] = historyFull[i - 1];
+		historyRects[i] = historyRects[i - 1];
+	}
+	historyFull[0] = full;
+	historyRects[0] = dirty;
+
+	int frames = std::max(1, std::min(historyFrames, (int)MAX_HISTORY));
+	bool anyFull = false;
+	Rect merged = EMPTY_RECT;
+	for (int i = 0; i < frames; i++)
+	{
+		anyFull = anyFull || historyFull[i];
+		if (!isEmpty(historyRects[i]))
+		{
+			merged.x0 = std::min(merged.x0, historyRects[i].x0);
+			merged.y0 = std::min(merged.y0, historyRects[i].y0);
+			merged.x1 = std::max(merged.x1, historyRects[i].x1);
+			merged.y1 = std::max(merged.y1, historyRects[i].y1);
+		}
+	}
+
+	merged.x0 = std::max(merged.x0, 0);
+	merged.y0 = std::max(merged.y0, 0);
+	merged.x1 = std::min(merged.x1, width);
+	merged.y1 = std::min(merged.y1, height);
+
+	staticFrame = !anyFull && isEmpty(merged);
+
+	if (anyFull || forced)
+	{
+		redraw = REDRAW_FULL;
+		rect.x0 = 0;
+		rect.y0 = 0;
+		rect.x1 = width;
+		rect.y1 = height;
+	}
+	else if (!isEmpty(merged))
+	{
+		redraw = REDRAW_RECT;
+		rect = merged;
+	}
+	else
+	{
+		redraw = REDRAW_NONE;
+		rect = EMPTY_RECT;
+	}
+
+	return redraw;
+}
+
+FrameChanges::Rect FrameChanges::projectBounds(GameObject* object)
+{
+	Rect whole = { 0, 0, width, height };
+	if (!object->mesh)
+		return whole;
+
+	glm::vec3 worldMin, worldMax;
+	object->getWorldBounds(worldMin, worldMax);
+
+	glm::vec2 ndcMin(FLT_MAX), ndcMax(-FLT_MAX);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 corner((i & 1) ? worldMax.x : worldMin.x, (i & 2) ? worldMax.y : worldMin.y, (i & 4) ? worldMax.z : worldMin.z, 1.0f);
+		glm::vec4 clip = viewProj * corner;
+
+		// Behind the camera the projection flips, do not guess
+		if (clip.w <= 0.0001f)
+			return whole;
+
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+
+	// One pixel extra for rounding and rasterisation rules
+	Rect r;
+	r.x0 = (int)floorf((ndcMin.x * 0.5f + 0.5f) * width) - 1;
+	r.y0 = (int)floorf((ndcMin.y * 0.5f + 0.5f) * height) - 1;
+	r.x1 = (int)ceilf((ndcMax.x * 0.5f + 0.5f) * width) + 1;
+	r.y1 = (int)ceilf((ndcMax.y * 0.5f + 0.5f) * height) + 1;
+
+	r.x0 = std::max(r.x0, 0);
+	r.y0 = std::max(r.y0, 0);
+	r.x1 = std::min(r.x1, width);
+	r.y1 = std::min(r.y1, height);
+	return isEmpty(r) ? EMPTY_RECT : r;
+}
+
+void FrameChanges::addRect(const Rect& r)
+{
+	if (isEmpty(r))
+		return;
+
+	dirty.x0 = std::min(dirty.x0, r.x0);
+	dirty.y0 = std::min(dirty.y0, r.y0);
+	dirty.x1 = std::max(dirty.x1, r.x1);
+	dirty.y1 = std::max(dirty.y1, r.y1);
+}
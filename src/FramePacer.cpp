@@ -0,0 +1,275 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <thread>
+#include <iostream>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <mmsystem.h>
+#pragma comment(lib, "winmm.lib")
+#endif
+
+// Closer than this to the deadline we spin instead of sleeping
+#define SPIN_THRESHOLD_MS 2.0
+
+// How often the GPU clock offset is measured again, clocks drift apart slowly
+#define CALIBRATION_INTERVAL_SECONDS 1.0
+
+typedef std::chrono::duration<double, std::milli> Milliseconds;
+
+FramePacer::FramePacer()
+	: mode(MODE_VSYNC),
+	targetFPS(60.0f),
+	maxFramesInFlight(2),
+	m_pWriteSlot(0),
+	m_pNumInFlight(0),
+	m_pHasPendingInput(false),
+	m_pFrameHasInput(false),
+	m_pCalibrationGPUTime(0),
+	m_pAppliedMode((Mode)-1),
+	m_pLatencySum(0.0f),
+	m_pLatencyMax(0.0f),
+	m_pLatencyCount(0)
+{
+	std::fill(m_pSlots, m_pSlots + MAX_FRAMES_IN_FLIGHT, FrameSlot());
+	memset(&m_pStats, 0, sizeof(Stats));
+}
+
+FramePacer::~FramePacer()
+{
+}
+
+void FramePacer::init()
+{
+#ifdef _WIN32
+	// The default scheduler tick is ~15.6ms which makes sleep_for useless for pacing
+	timeBeginPeriod(1);
+#endif
+
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		m_pSlots[i].fence = 0;
+		glGenQueries(1, &m_pSlots[i].timestampQuery);
+	}
+
+	m_pLastFrameStart = Clock::now();
+	m_pNextDeadline = m_pLastFrameStart;
+	m_pLatencyWindowStart = m_pLastFrameStart;
+
+	calibrateGPUClock();
+}
+
+void FramePacer::destroy()
+{
+	for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+	{
+		if (m_pSlots[i].fence)
+			glDeleteSync(m_pSlots[i].fence);
+		if (m_pSlots[i].timestampQuery)
+			glDeleteQueries(1, &m_pSlots[i].timestampQuery);
+	}
+
+	std::fill(m_pSlots, m_pSlots + MAX_FRAMES_IN_FLIGHT, FrameSlot());
+	m_pNumInFlight = 0;
+
+#ifdef _WIN32
+	timeEndPeriod(1);
+#endif
+}
+
+void FramePacer::markInput()
+{
+	if (!m_pHasPendingInput)
+	{
+		m_pPendingInputTime = Clock::now();
+		m_pHasPendingInput = true;
+	}
+}
+
+void FramePacer::resume()
+{
+	double seconds = (mode == MODE_TARGET_FPS && targetFPS > 0.0f) ? 1.0 / targetFPS : 1.0 / 60.0;
+	Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+
+	// Due right away, as if the last frame started one period ago
+	Clock::time_point now = Clock::now();
+	m_pLastFrameStart = now - period;
+	m_pNextDeadline = now - period;
+}
+
+void FramePacer::applySwapInterval()
+{
+	if (mode == m_pAppliedMode)
+		return;
+
+#ifdef _WIN32
+	// Only vsync mode lets the swap block, the other modes pace themselves
+	int interval = (mode == MODE_VSYNC) ? 1 : 0;
+
+	typedef BOOL(WINAPI *SwapIntervalProc)(int);
+	SwapIntervalProc wglSwapIntervalEXT = (SwapIntervalProc)wglGetProcAddress("wglSwapIntervalEXT");
+	if (wglSwapIntervalEXT)
+		wglSwapIntervalEXT(interval);
+	else
+		std::cout << "FramePacer: WGL_EXT_swap_control is not supported, swap interval unchanged" << std::endl;
+#else
+	static bool warned = false;
+	if (!warned)
+		std::cout << "FramePacer: setting the swap interval is only implemented for WGL" << std::endl;
+	warned = true;
+#endif
+
+	m_pAppliedMode = mode;
+}
+
+void FramePacer::calibrateGPUClock()
+{
+	// Reading GL_TIMESTAMP does not wait for the GPU to catch up, it returns the GPU's current time
+	glGetInteger64v(GL_TIMESTAMP, &m_pCalibrationGPUTime);
+	m_pCalibrationTime = Clock::now();
+}
+
+void FramePacer::waitUntil(Clock::time_point deadline)
+{
+	const Milliseconds spinThreshold(SPIN_THRESHOLD_MS);
+
+	for (;;)
+	{
+		Clock::duration remaining = deadline - Clock::now();
+		if (remaining <= Clock::duration::zero())
+			return;
+
+		if (remaining > spinThreshold)
+			std::this_thread::sleep_for(remaining - std::chrono::duration_cast<Clock::duration>(spinThreshold));
+		else
+			std::this_thread::yield();
+	}
+}
+
+void FramePacer::retireFrames(int maxFrames)
+{
+	while (m_pNumInFlight > 0)
+	{
+		int oldest = (m_pWriteSlot - m_pNumInFlight + MAX_FRAMES_IN_FLIGHT) % MAX_FRAMES_IN_FLIGHT;
+		FrameSlot& slot = m_pSlots[oldest];
+
+		// Only block when we are over the limit, otherwise just poll
+		GLenum status;
+		if (m_pNumInFlight > maxFrames)
+			status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		else
+			status = glClientWaitSync(slot.fence, 0, 0);
+
+		// Frames finish in order, if this one is not done the newer ones are not either
+		if (status == GL_TIMEOUT_EXPIRED)
+			break;
+
+		// The fence came after the timestamp, so its result is ready and reading it does not stall
+		if (slot.hasInput)
+		{
+			GLuint64 gpuTime = 0;
+			glGetQueryObjectui64v(slot.timestampQuery, GL_QUERY_RESULT, &gpuTime);
+
+			Clock::time_point finished = m_pCalibrationTime +
+				std::chrono::duration_cast<Clock::duration>(std::chrono::nanoseconds((GLint64)gpuTime - m_pCalibrationGPUTime));
+
+			float latency = (float)Milliseconds(finished - slot.inputTime).count();
+			if (latency >= 0.0f)
+			{
+				m_pLatencySum += latency;
+				if (latency > m_pLatencyMax)
+					m_pLatencyMax = latency;
+				m_pLatencyCount++;
+			}
+		}
+
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		m_pNumInFlight--;
+	}
+}
+
+float FramePacer::beginFrame()
+{
+	applySwapInterval();
+
+	if (maxFramesInFlight < 1)
+		maxFramesInFlight = 1;
+	if (maxFramesInFlight > MAX_FRAMES_IN_FLIGHT)
+		maxFramesInFlight = MAX_FRAMES_IN_FLIGHT;
+
+	// Wait for the deadline first, the GPU keeps working meanwhile
+	Clock::time_point waitStart = Clock::now();
+	if (mode == MODE_TARGET_FPS && targetFPS > 0.0f)
+	{
+		Clock::duration period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / targetFPS));
+
+		// Deadlines advance by exactly one period so the average rate is right even if
+		// single frames are late, unless we fell so far behind that catching up would burst
+		m_pNextDeadline += period;
+		if (m_pNextDeadline < waitStart - period)
+			m_pNextDeadline = waitStart;
+
+		waitUntil(m_pNextDeadline);
+	}
+	else
+		m_pNextDeadline = waitStart;
+
+	// Starting this frame would put one more frame in the queue, so keep at most maxFramesInFlight - 1 there
+	Clock::time_point gpuWaitStart = Clock::now();
+	retireFrames(maxFramesInFlight - 1);
+	Clock::time_point frameStart = Clock::now();
+
+	float deltaTime = (float)std::chrono::duration<double>(frameStart - m_pLastFrameStart).count();
+	m_pLastFrameStart = frameStart;
+
+	// Any input from here on lands in the next frame
+	m_pFrameHasInput = m_pHasPendingInput;
+	m_pFrameInputTime = m_pPendingInputTime;
+	m_pHasPendingInput = false;
+
+	if (std::chrono::duration<double>(frameStart - m_pCalibrationTime).count() > CALIBRATION_INTERVAL_SECONDS)
+		calibrateGPUClock();
+
+	if (std::chrono::duration<double>(frameStart - m_pLatencyWindowStart).count() > 1.0)
+	{
+		m_pStats.latency = m_pLatencyCount ? m_pLatencySum / (float)m_pLatencyCount : 0.0f;
+		m_pStats.maxLatency = m_pLatencyMax;
+		m_pLatencySum = 0.0f;
+		m_pLatencyMax = 0.0f;
+		m_pLatencyCount = 0;
+		m_pLatencyWindowStart = frameStart;
+	}
+
+	m_pStats.frameTime = deltaTime * 1000.0f;
+	m_pStats.waitTime = (float)Milliseconds(gpuWaitStart - waitStart).count();
+	m_pStats.gpuWaitTime = (float)Milliseconds(frameStart - gpuWaitStart).count();
+	m_pStats.framesInFlight = m_pNumInFlight;
+
+	return deltaTime;
+}
+
+void FramePacer::endFrame()
+{
+	if (!m_pSlots[0].timestampQuery)
+		return;
+
+	// Every slot is still in use, only happens if beginFrame() was not called
+	if (m_pNumInFlight == MAX_FRAMES_IN_FLIGHT)
+		retireFrames(MAX_FRAMES_IN_FLIGHT - 1);
+
+	FrameSlot& slot = m_pSlots[m_pWriteSlot];
+	slot.hasInput = m_pFrameHasInput;
+	slot.inputTime = m_pFrameInputTime;
+
+	if (slot.hasInput)
+		glQueryCounter(slot.timestampQuery, GL_TIMESTAMP);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	m_pWriteSlot = (m_pWriteSlot + 1) % MAX_FRAMES_IN_FLIGHT;
+	m_pNumInFlight++;
+}
@@ -0,0 +1,535 @@
+#include "GLState.h"
+#include "RenderStats.h"
+#include <cstring>
+
+namespace
+{
+	// Buffer targets we keep track of
+	const GLenum bufferTargets[] =
+	{
+		GL_ARRAY_BUFFER,
+		GL_ELEMENT_ARRAY_BUFFER,
+		GL_UNIFORM_BUFFER,
+		GL_SHADER_STORAGE_BUFFER,
+		GL_DRAW_INDIRECT_BUFFER,
+		GL_DISPATCH_INDIRECT_BUFFER,
+		GL_PIXEL_PACK_BUFFER,
+		GL_PIXEL_UNPACK_BUFFER,
+		GL_COPY_READ_BUFFER,
+		GL_COPY_WRITE_BUFFER
+	};
+	const int NUM_BUFFER_TARGETS = sizeof(bufferTargets) / sizeof(GLenum);
+
+	// Enables we keep track of
+	const GLenum enableCaps[] =
+	{
+		GL_BLEND,
+		GL_DEPTH_TEST,
+		GL_SCISSOR_TEST,
+		GL_CULL_FACE
+	};
+	const int NUM_ENABLE_CAPS = sizeof(enableCaps) / sizeof(GLenum);
+
+	// Used for bindings we do not know, so the next call always goes through
+	const GLuint UNKNOWN = ~0u;
+
+	struct State
+	{
+		GLuint program;
+		GLuint vertexArray;
+		GLuint buffers[NUM_BUFFER_TARGETS];
+		GLuint drawFramebuffer;
+		GLuint readFramebuffer;
+		GLint viewport[4];
+		GLint scissor[4];
+		float clearColour[4];
+
+		GLenum activeTexture;
+		GLuint textures[GLState::MAX_TEXTURE_UNITS];
+
+		bool enabled[NUM_ENABLE_CAPS];
+
+		GLenum blendEquationRGB, blendEquationAlpha;
+		GLenum blendSrcRGB, blendDstRGB, blendSrcAlpha, blendDstAlpha;
+		GLenum depthFunc;
+		GLboolean depthMask;
+		GLboolean colourMask[4];
+	};
+
+	State state;
+	GLState::Stats stats;
+
+	int bufferIndex(GLenum target)
+	{
+		for (int i = 0; i < NUM_BUFFER_TARGETS; i++)
+		{
+			if (bufferTargets[i] == target)
+				return i;
+		}
+		return -1;
+	}
+
+	int enableIndex(GLenum cap)
+	{
+		for (int i = 0; i < NUM_ENABLE_CAPS; i++)
+		{
+			if (enableCaps[i] == cap)
+				return i;
+		}
+		return -1;
+	}
+
+	GLenum bufferBindingQuery(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_ARRAY_BUFFER:				return GL_ARRAY_BUFFER_BINDING;
+		case GL_ELEMENT_ARRAY_BUFFER:		return GL_ELEMENT_ARRAY_BUFFER_BINDING;
+		case GL_UNIFORM_BUFFER:				return GL_UNIFORM_BUFFER_BINDING;
+		case GL_SHADER_STORAGE_BUFFER:		return GL_SHADER_STORAGE_BUFFER_BINDING;
+		case GL_DRAW_INDIRECT_BUFFER:		return GL_DRAW_INDIRECT_BUFFER_BINDING;
+		case GL_DISPATCH_INDIRECT_BUFFER:	return GL_DISPATCH_INDIRECT_BUFFER_BINDING;
+		case GL_PIXEL_PACK_BUFFER:			return GL_PIXEL_PACK_BUFFER_BINDING;
+		case GL_PIXEL_UNPACK_BUFFER:		return GL_PIXEL_UNPACK_BUFFER_BINDING;
+		case GL_COPY_READ_BUFFER:			return GL_COPY_READ_BUFFER_BINDING;
+		case GL_COPY_WRITE_BUFFER:			return GL_COPY_WRITE_BUFFER_BINDING;
+		}
+		return 0;
+	}
+
+	// Returns true if the call should be passed on to OpenGL
+	inline bool changed(bool isDifferent)
+	{
+		if (isDifferent)
+			stats.callsIssued++;
+		else
+			stats.callsSkipped++;
+		return isDifferent;
+	}
+}
+
+void GLState::init()
+{
+	invalidate();
+	resetStats();
+}
+
+void GLState::invalidate()
+{
+	GLint value;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &value);				state.program = value;
+	glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &value);			state.vertexArray = value;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &value);		state.drawFramebuffer = value;
+	glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &value);		state.readFramebuffer = value;
+	glGetIntegerv(GL_VIEWPORT, state.viewport);
+	glGetIntegerv(GL_SCISSOR_BOX, state.scissor);
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, state.clearColour);
+
+	// Some of these targets do not exist on older contexts,
+	// leave those unknown rather than trusting a failed query
+	for (int i = 0; i < NUM_BUFFER_TARGETS; i++)
+	{
+		value = 0;
+		glGetIntegerv(bufferBindingQuery(bufferTargets[i]), &value);
+		state.buffers[i] = glGetError() == GL_NO_ERROR ? value : UNKNOWN;
+	}
+
+	// Texture bindings can only be queried for the active unit
+	glGetIntegerv(GL_ACTIVE_TEXTURE, &value);				state.activeTexture = value;
+
+	GLint numUnits;
+	glGetIntegerv(GL_MAX_COMBINED_TEXTURE_IMAGE_UNITS, &numUnits);
+	for (int i = 0; i < MAX_TEXTURE_UNITS; i++)
+	{
+		state.textures[i] = UNKNOWN;
+		if (i < numUnits)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glGetIntegerv(GL_TEXTURE_BINDING_2D, &value);
+			state.textures[i] = value;
+		}
+	}
+	glActiveTexture(state.activeTexture);
+
+	for (int i = 0; i < NUM_ENABLE_CAPS; i++)
+		state.enabled[i] = glIsEnabled(enableCaps[i]) == GL_TRUE;
+
+	glGetIntegerv(GL_BLEND_EQUATION_RGB, &value);			state.blendEquationRGB = value;
+	glGetIntegerv(GL_BLEND_EQUATION_ALPHA, &value);			state.blendEquationAlpha = value;
+	glGetIntegerv(GL_BLEND_SRC_RGB, &value);				state.blendSrcRGB = value;
+	glGetIntegerv(GL_BLEND_DST_RGB, &value);				state.blendDstRGB = value;
+	glGetIntegerv(GL_BLEND_SRC_ALPHA, &value);				state.blendSrcAlpha = value;
+	glGetIntegerv(GL_BLEND_DST_ALPHA, &value);				state.blendDstAlpha = value;
+	glGetIntegerv(GL_DEPTH_FUNC, &value);					state.depthFunc = value;
+	glGetBooleanv(GL_DEPTH_WRITEMASK, &state.depthMask);
+	glGetBooleanv(GL_COLOR_WRITEMASK, state.colourMask);
+}
+
+void GLState::useProgram(GLuint program)
+{
+	if (changed(state.program != program))
+	{
+		glUseProgram(program);
+		state.program = program;
+		RenderStats::countProgramBind();
+	}
+}
+
+void GLState::bindVertexArray(GLuint vao)
+{
+	if (changed(state.vertexArray != vao))
+	{
+		glBindVertexArray(vao);
+		state.vertexArray = vao;
+		RenderStats::countVertexArrayBind();
+
+		// The element array binding is part of the VAO
+		state.buffers[bufferIndex(GL_ELEMENT_ARRAY_BUFFER)] = UNKNOWN;
+	}
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer)
+{
+	int index = bufferIndex(target);
+	if (index < 0)
+	{
+		stats.callsIssued++;
+		glBindBuffer(target, buffer);
+		return;
+	}
+
+	if (changed(state.buffers[index] != buffer))
+	{
+		glBindBuffer(target, buffer);
+		state.buffers[index] = buffer;
+	}
+}
+
+void GLState::bindBufferBase(GLenum target, GLuint bindingIndex, GLuint buffer)
+{
+	stats.callsIssued++;
+	glBindBufferBase(target, bindingIndex, buffer);
+
+	int index = bufferIndex(target);
+	if (index >= 0)
+		state.buffers[index] = buffer;
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint fbo)
+{
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+
+	bool different = (draw && state.drawFramebuffer != fbo) || (read && state.readFramebuffer != fbo);
+	if (changed(different))
+	{
+		glBindFramebuffer(target, fbo);
+		if (draw) state.drawFramebuffer = fbo;
+		if (read) state.readFramebuffer = fbo;
+		RenderStats::countFramebufferBind();
+	}
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint* v = state.viewport;
+	if (changed(v[0] != x || v[1] != y || v[2] != width || v[3] != height))
+	{
+		glViewport(x, y, width, height);
+		v[0] = x; v[1] = y; v[2] = width; v[3] = height;
+	}
+}
+
+void GLState::scissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	GLint* s = state.scissor;
+	if (changed(s[0] != x || s[1] != y || s[2] != width || s[3] != height))
+	{
+		glScissor(x, y, width, height);
+		s[0] = x; s[1] = y; s[2] = width; s[3] = height;
+	}
+}
+
+void GLState::clearColour(float r, float g, float b, float a)
+{
+	float* c = state.clearColour;
+	if (changed(c[0] != r || c[1] != g || c[2] != b || c[3] != a))
+	{
+		glClearColor(r, g, b, a);
+		c[0] = r; c[1] = g; c[2] = b; c[3] = a;
+	}
+}
+
+void GLState::activeTexture(GLenum textureUnit)
+{
+	if (changed(state.activeTexture != textureUnit))
+	{
+		glActiveTexture(textureUnit);
+		state.activeTexture = textureUnit;
+	}
+}
+
+void GLState::bindTexture(GLenum textureUnit, GLenum target, GLuint texture)
+{
+	int unit = textureUnit - GL_TEXTURE0;
+
+	// Only 2D textures are cached, anything else always goes through
+	if (target != GL_TEXTURE_2D || unit < 0 || unit >= MAX_TEXTURE_UNITS)
+	{
+		activeTexture(textureUnit);
+		stats.callsIssued++;
+		glBindTexture(target, texture);
+		RenderStats::countTextureBind();
+		return;
+	}
+
+	if (changed(state.textures[unit] != texture))
+	{
+		activeTexture(textureUnit);
+		glBindTexture(target, texture);
+		state.textures[unit] = texture;
+		RenderStats::countTextureBind();
+	}
+}
+
+void GLState::enable(GLenum cap)
+{
+	setEnabled(cap, true);
+}
+
+void GLState::disable(GLenum cap)
+{
+	setEnabled(cap, false);
+}
+
+void GLState::setEnabled(GLenum cap, bool enabled)
+{
+	int index = enableIndex(cap);
+	if (index < 0)
+	{
+		stats.callsIssued++;
+		if (enabled) glEnable(cap); else glDisable(cap);
+		return;
+	}
+
+	if (changed(state.enabled[index] != enabled))
+	{
+		if (enabled) glEnable(cap); else glDisable(cap);
+		state.enabled[index] = enabled;
+	}
+}
+
+void GLState::blendEquation(GLenum mode)
+{
+	blendEquationSeparate(mode, mode);
+}
+
+void GLState::blendEquationSeparate(GLenum modeRGB, GLenum modeAlpha)
+{
+	if (changed(state.blendEquationRGB != modeRGB || state.blendEquationAlpha != modeAlpha))
+	{
+		glBlendEquationSeparate(modeRGB, modeAlpha);
+		state.blendEquationRGB = modeRGB;
+		state.blendEquationAlpha = modeAlpha;
+	}
+}
+
+void GLState::blendFunc(GLenum src, GLenum dst)
+{
+	blendFuncSeparate(src, dst, src, dst);
+}
+
+void GLState::blendFuncSeparate(GLenum srcRGB, GLenum dstRGB, GLenum srcAlpha, GLenum dstAlpha)
+{
+	if (changed(state.blendSrcRGB != srcRGB || state.blendDstRGB != dstRGB ||
+		state.blendSrcAlpha != srcAlpha || state.blendDstAlpha != dstAlpha))
+	{
+		glBlendFuncSeparate(srcRGB, dstRGB, srcAlpha, dstAlpha);
+		state.blendSrcRGB = srcRGB;
+		state.blendDstRGB = dstRGB;
+		state.blendSrcAlpha = srcAlpha;
+		state.blendDstAlpha = dstAlpha;
+	}
+}
+
+void GLState::depthFunc(GLenum func)
+{
+	if (changed(state.depthFunc != func))
+	{
+		glDepthFunc(func);
+		state.depthFunc = func;
+	}
+}
+
+void GLState::depthMask(GLboolean enabled)
+{
+	if (changed(state.depthMask != enabled))
+	{
+		glDepthMask(enabled);
+		state.depthMask = enabled;
+	}
+}
+
+void GLState::colourMask(GLboolean r, GLboolean g, GLboolean b, GLboolean a)
+{
+	GLboolean* m = state.colourMask;
+	if (changed(m[0] != r || m[1] != g || m[2] != b || m[3] != a))
+	{
+		glColorMask(r, g, b, a);
+		m[0] = r; m[1] = g; m[2] = b; m[3] = a;
+	}
+}
+
+void GLState::deleteProgram(GLuint program)
+{
+	glDeleteProgram(program);
+
+	// A deleted program stays in use until another one is bound,
+	// so make sure the next useProgram() call goes through
+	if (state.program == program)
+		state.program = UNKNOWN;
+}
+
+void GLState::deleteVertexArrays(GLsizei n, const GLuint* vaos)
+{
+	glDeleteVertexArrays(n, vaos);
+
+	for (int i = 0; i < n; i++)
+	{
+		if (state.vertexArray == vaos[i])
+			state.vertexArray = 0;
+	}
+}
+
+void GLState::deleteBuffers(GLsizei n, const GLuint* buffers)
+{
+	glDeleteBuffers(n, buffers);
+
+	for (int i = 0; i < n; i++)
+	{
+		for (int t = 0; t < NUM_BUFFER_TARGETS; t++)
+		{
+			if (state.buffers[t] == buffers[i])
+				state.buffers[t] = 0;
+		}
+	}
+}
+
+void GLState::deleteFramebuffers(GLsizei n, const GLuint* fbos)
+{
+	glDeleteFramebuffers(n, fbos);
+
+	for (int i = 0; i < n; i++)
+	{
+		if (state.drawFramebuffer == fbos[i])
+			state.drawFramebuffer = 0;
+		if (state.readFramebuffer == fbos[i])
+			state.readFramebuffer = 0;
+	}
+}
+
+void GLState::deleteTextures(GLsizei n, const GLuint* textures)
+{
+	glDeleteTextures(n, textures);
+
+	for (int i = 0; i < n; i++)
+	{
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++)
+		{
+			if (state.textures[unit] == textures[i])
+				state.textures[unit] = 0;
+		}
+	}
+}
+
+GLuint GLState::getProgram()
+{
+	return state.program;
+}
+
+GLuint GLState::getVertexArray()
+{
+	return state.vertexArray;
+}
+
+GLuint GLState::getBuffer(GLenum target)
+{
+	int index = bufferIndex(target);
+	return index < 0 ? 0 : state.buffers[index];
+}
+
+GLuint GLState::getDrawFramebuffer()
+{
+	return state.drawFramebuffer;
+}
+
+GLuint GLState::getReadFramebuffer()
+{
+	return state.readFramebuffer;
+}
+
+void GLState::getViewport(GLint* out)
+{
+	memcpy(out, state.viewport, sizeof(state.viewport));
+}
+
+void GLState::getScissor(GLint* out)
+{
+	memcpy(out, state.scissor, sizeof(state.scissor));
+}
+
+GLenum GLState::getActiveTexture()
+{
+	return state.activeTexture;
+}
+
+GLuint GLState::getTexture(GLenum textureUnit)
+{
+	int unit = textureUnit - GL_TEXTURE0;
+	if (unit < 0 || unit >= MAX_TEXTURE_UNITS)
+		return 0;
+	return state.textures[unit];
+}
+
+bool GLState::isEnabled(GLenum cap)
+{
+	int index = enableIndex(cap);
+	if (index < 0)
+		return glIsEnabled(cap) == GL_TRUE;
+	return state.enabled[index];
+}
+
+void GLState::getBlendEquation(GLenum* modeRGB, GLenum* modeAlpha)
+{
+	*modeRGB = state.blendEquationRGB;
+	*modeAlpha = state.blendEquationAlpha;
+}
+
+void GLState::getBlendFunc(GLenum* srcRGB, GLenum* dstRGB, GLenum* srcAlpha, GLenum* dstAlpha)
+{
+	*srcRGB = state.blendSrcRGB;
+	*dstRGB = state.blendDstRGB;
+	*srcAlpha = state.blendSrcAlpha;
+	*dstAlpha = state.blendDstAlpha;
+}
+
+GLenum GLState::getDepthFunc()
+{
+	return state.depthFunc;
+}
+
+GLboolean GLState::getDepthMask()
+{
+	return state.depthMask;
+}
+
+const GLState::Stats& GLState::getStats()
+{
+	return stats;
+}
+
+void GLState::resetStats()
+{
+	memset(&stats, 0, sizeof(Stats));
+}
@@ -0,0 +1,98 @@
+#include "GPUQuery.h"
+#include <iostream>
+
+GPUQuery::GPUQuery()
+	: target(0),
+	writeIndex(0),
+	numPending(0),
+	active(false),
+	lastResult(0),
+	numResults(0)
+{
+	for (int i = 0; i < NUM_QUERIES; i++)
+		handles[i] = 0;
+}
+
+// Queries are often globals or members of one, which outlive the GL context
+GPUQuery::~GPUQuery()
+{
+}
+
+void GPUQuery::create(GLenum queryTarget)
+{
+	if (handles[0])
+		destroy();
+
+	target = queryTarget;
+	glGenQueries(NUM_QUERIES, handles);
+}
+
+void GPUQuery::begin()
+{
+	if (!handles[0] || active)
+		return;
+
+	// Every query in the ring is still in flight
+	// Read the oldest one back so it can be reused, this may wait on the GPU
+	if (numPending == NUM_QUERIES)
+	{
+		int oldest = (writeIndex - numPending + NUM_QUERIES) % NUM_QUERIES;
+		glGetQueryObjectui64v(handles[oldest], GL_QUERY_RESULT, &lastResult);
+		numPending--;
+		numResults++;
+	}
+
+	glBeginQuery(target, handles[writeIndex]);
+	active = true;
+}
+
+void GPUQuery::end()
+{
+	if (!active)
+		return;
+
+	glEndQuery(target);
+	active = false;
+
+	writeIndex = (writeIndex + 1) % NUM_QUERIES;
+	numPending++;
+}
+
+GLuint64 GPUQuery::getResult()
+{
+	// Queries finish in order, so read from the oldest until one is not ready
+	while (numPending > 0)
+	{
+		int oldest = (writeIndex - numPending + NUM_QUERIES) % NUM_QUERIES;
+
+		GLuint available = 0;
+		glGetQueryObjectuiv(handles[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			break;
+
+		glGetQueryObjectui64v(handles[oldest], GL_QUERY_RESULT, &lastResult);
+		numPending--;
+		numResults++;
+	}
+
+	return lastResult;
+}
+
+GLuint GPUQuery::getLastHandle()
+{
+	return handles[(writeIndex - 1 + NUM_QUERIES) % NUM_QUERIES];
+}
+
+void GPUQuery::destroy()
+{
+	if (handles[0])
+	{
+		glDeleteQueries(NUM_QUERIES, handles);
+		for (int i = 0; i < NUM_QUERIES; i++)
+			handles[i] = 0;
+	}
+
+	writeIndex = 0;
+	numPending = 0;
+	active = false;
+}
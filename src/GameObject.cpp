@@ -1,19 +1,33 @@
 #include "GameObject.h"
+#include "RenderQueue.h"
+#include "TransformBatch.h"
 #include <iostream>
 
 GameObject::GameObject(glm::vec3 position, std::shared_ptr<TTK::MeshBase> _mesh, std::shared_ptr<Material> _material)
 	: m_pScale(1.0f),
 	colour(glm::vec4(0.0f)),
+	emissive(glm::vec4(0.0f)),
 	m_pLocalPosition(position),
 	mesh(_mesh),
 	material(_material),
 	m_pParent(nullptr),
-	m_pRotX(0.0f), m_pRotY(0.0f), m_pRotZ(0.0f)
+	m_pRotX(0.0f), m_pRotY(0.0f), m_pRotZ(0.0f),
+	occlusionQuery(0),
+	lodLevel(0)
 {
 }
 
 GameObject::~GameObject() {}
 
+void GameObject::destroyOcclusionQuery()
+{
+	if (occlusionQuery)
+	{
+		glDeleteQueries(1, &occlusionQuery);
+		occlusionQuery = 0;
+	}
+}
+
 void GameObject::setPosition(glm::vec3 newPosition)
 {
 	m_pLocalPosition = newPosition;
@@ -46,57 +60,79 @@ glm::mat4 GameObject::getLocalToWorldMatrix()
 
 void GameObject::update(float dt)
 {
-	// Create 4x4 transformation matrix
+	GameObject* self = this;
+	updateTransforms(&self, 1, m_pParent ? &m_pParent->m_pLocalToWorldMatrix : nullptr);
+}
 
-	// Create rotation matrix
-	glm::mat4 rx = glm::rotate(glm::radians(m_pRotX), glm::vec3(1.0f, 0.0f, 0.0f));
-	glm::mat4 ry = glm::rotate(glm::radians(m_pRotY), glm::vec3(0.0f, 1.0f, 0.0f));
-	glm::mat4 rz = glm::rotate(glm::radians(m_pRotZ), glm::vec3(0.0f, 0.0f, 1.0f));
+void GameObject::updateTransforms(GameObject* const* objects, size_t count, const glm::mat4* parentWorld)
+{
+	if (count == 0)
+		return;
 
-	// Note: pay attention to rotation order, ZYX is not the same as XYZ
-	m_pLocalRotation = rz * ry * rx;
+	// Scratch space for one batch, it is written back to the objects before the
+	// children are done so the recursion below can reuse it
+	static thread_local std::vector<TransformBatch::TRS> transforms;
+	static thread_local std::vector<glm::mat4> locals;
+	static thread_local std::vector<glm::mat4> rotations;
+	static thread_local std::vector<glm::mat4> worlds;
 
-	// Create translation matrix
-	glm::mat4 tran = glm::translate(m_pLocalPosition);
+	if (transforms.size() < count)
+	{
+		transforms.resize(count);
+		locals.resize(count);
+		rotations.resize(count);
+		worlds.resize(count);
+	}
 
-	// Create scale matrix
-	glm::mat4 scal = glm::scale(glm::vec3(m_pScale, m_pScale, m_pScale));
+	for (size_t i = 0; i < count; i++)
+	{
+		const GameObject* object = objects[i];
+		transforms[i].position = object->m_pLocalPosition;
+		transforms[i].rotation = glm::vec3(object->m_pRotX, object->m_pRotY, object->m_pRotZ);
+		transforms[i].scale = object->m_pScale;
+	}
 
-	// Combine all above transforms into a single matrix
 	// This is the local transformation matrix, ie. where is this game object relative to it's parent
+	// Rotation order is ZYX, same as rotateZ * rotateY * rotateX
+	TransformBatch::composeTRS(&transforms[0], &locals[0], &rotations[0], count);
+
 	// If a game object has no parent (it is a root node) then its local transform is also it's global transform
 	// If a game object has a parent, then we must apply the parent's transform
-	m_pLocalTransformMatrix = tran * m_pLocalRotation * scal;
+	if (parentWorld)
+		TransformBatch::multiply(*parentWorld, &locals[0], &worlds[0], count);
 
-	if (m_pParent)
-		m_pLocalToWorldMatrix = m_pParent->getLocalToWorldMatrix() * m_pLocalTransformMatrix;
-	else
-		m_pLocalToWorldMatrix = m_pLocalTransformMatrix;
+	for (size_t i = 0; i < count; i++)
+	{
+		GameObject* object = objects[i];
+		object->m_pLocalRotation = rotations[i];
+		object->m_pLocalTransformMatrix = locals[i];
+		object->m_pLocalToWorldMatrix = parentWorld ? worlds[i] : locals[i];
+	}
 
-	// Update children
-	for (int i = 0; i < m_pChildren.size(); i++)
-		m_pChildren[i]->update(dt);
+	// Update children, every object's children are a batch of their own
+	for (size_t i = 0; i < count; i++)
+	{
+		GameObject* object = objects[i];
+		if (!object->m_pChildren.empty())
+			updateTransforms(&object->m_pChildren[0], object->m_pChildren.size(), &object->m_pLocalToWorldMatrix);
+	}
 }
 
 void GameObject::draw(TTK::Camera &camera)
 {
 	material->bind();
 
-	material->mat4Uniforms["u_mvp"] = camera.viewProjMatrix * m_pLocalToWorldMatrix;
-	material->mat4Uniforms["u_mv"] = camera.viewMatrix * m_pLocalToWorldMatrix;
-	material->vec4Uniforms["u_colour"] = colour;
-	material->mat4Uniforms["u_model"] = m_pLocalToWorldMatrix;
-
-
 	if (diffuseTexture)
 	{
 		diffuseTexture->bind(GL_TEXTURE0);
 	}
 
 	material->sendUniforms();
+	sendObjectUniforms(camera);
 
 	//mesh->draw_1_0();
-	mesh->draw();
+	mesh->vbo.bind();
+	mesh->drawBoundLOD(lodLevel);
 
 	if (diffuseTexture)
 	{
@@ -108,6 +144,39 @@ void GameObject::draw(TTK::Camera &camera)
 		m_pChildren[i]->draw(camera);
 }
 
+void GameObject::submit(RenderQueue& queue)
+{
+	queue.submit(this);
+
+	// Submit children
+	for (int i = 0; i < m_pChildren.size(); ++i)
+		m_pChildren[i]->submit(queue);
+}
+
+void GameObject::sendObjectUniforms(TTK::Camera& camera)
+{
+	// These are sent straight to the shader rather than stored in the material,
+	// the material's uniforms are shared by every object that uses it
+	glm::mat4 mvp, mv;
+	computeObjectUniforms(camera, mvp, mv);
+	sendObjectUniforms(mvp, mv);
+}
+
+void GameObject::computeObjectUniforms(TTK::Camera& camera, glm::mat4& outMVP, glm::mat4& outMV)
+{
+	outMVP = camera.viewProjMatrix * m_pRenderMatrix;
+	outMV = camera.viewMatrix * m_pRenderMatrix;
+}
+
+void GameObject::sendObjectUniforms(glm::mat4& mvp, glm::mat4& mv)
+{
+	material->shader->sendUniformMat4("u_mvp", mvp);
+	material->shader->sendUniformMat4("u_mv", mv);
+	material->shader->sendUniformVec4("u_colour", colour);
+	material->shader->sendUniformVec4("u_emissive", emissive);
+	material->shader->sendUniformMat4("u_model", m_pRenderMatrix);
+}
+
 void GameObject::setParent(GameObject* newParent)
 {
 	m_pParent = newParent;
@@ -142,6 +211,25 @@ glm::vec3 GameObject::getWorldPosition()
 		return m_pLocalPosition;
 }
 
+void GameObject::getWorldBounds(glm::vec3& outMin, glm::vec3& outMax)
+{
+	// Transform the box center and extents instead of all 8 corners
+	glm::vec3 center = (mesh->boundsMax + mesh->boundsMin) * 0.5f;
+	glm::vec3 extents = (mesh->boundsMax - mesh->boundsMin) * 0.5f;
+
+	glm::vec3 worldCenter = glm::vec3(m_pRenderMatrix * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtents;
+	for (int i = 0; i < 3; i++)
+	{
+		worldExtents[i] = glm::abs(m_pRenderMatrix[0][i]) * extents.x +
+			glm::abs(m_pRenderMatrix[1][i]) * extents.y +
+			glm::abs(m_pRenderMatrix[2][i]) * extents.z;
+	}
+
+	outMin = worldCenter - worldExtents;
+	outMax = worldCenter + worldExtents;
+}
+
 glm::mat4 GameObject::getWorldRotation()
 {
 	if (m_pParent)
@@ -0,0 +1,298 @@
+#include "HiZBuffer.h"
+#include "FrameBufferObject.h"
+#include "Material.h"
+#include "GLState.h"
+#include "TTK/MeshBase.h"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// Largest level we are willing to copy back to the CPU every frame
+#define HIZ_READBACK_MAX_WIDTH 128
+
+HiZBuffer::HiZBuffer()
+	: texture(0),
+	numLevels(0),
+	width(0),
+	height(0),
+	copyMaterial(nullptr),
+	downsampleMaterial(nullptr),
+	quad(nullptr),
+	readbackLevel(0),
+	readbackWidth(0),
+	readbackHeight(0),
+	writeIndex(0),
+	cpuValid(false)
+{
+	memset(fbos, 0, sizeof(fbos));
+	memset(pbos, 0, sizeof(pbos));
+	for (int i = 0; i < NUM_READBACKS; i++)
+		fences[i] = 0;
+}
+
+// The global instance outlives the GL context, destroy() is called on window close
+HiZBuffer::~HiZBuffer()
+{
+}
+
+void HiZBuffer::create(unsigned int hizWidth, unsigned int hizHeight, Material* copyMat, Material* downsampleMat, TTK::MeshBase* quadMesh)
+{
+	if (texture)
+		destroy();
+
+	width = hizWidth;
+	height = hizHeight;
+	copyMaterial = copyMat;
+	downsampleMaterial = downsampleMat;
+	quad = quadMesh;
+
+	// Full chain down to 1x1
+	numLevels = 1;
+	while (numLevels < MAX_LEVELS && ((width >> numLevels) > 0 || (height >> numLevels) > 0))
+		numLevels++;
+
+	glGenTextures(1, &texture);
+	GLState::bindTexture(GLState::getActiveTexture(), GL_TEXTURE_2D, texture);
+
+	for (unsigned int level = 0; level < numLevels; level++)
+	{
+		unsigned int levelWidth = std::max(1u, width >> level);
+		unsigned int levelHeight = std::max(1u, height >> level);
+		glTexImage2D(GL_TEXTURE_2D, level, GL_R32F, levelWidth, levelHeight, 0, GL_RED, GL_FLOAT, 0);
+	}
+
+	// Depth values must never be blended together, only fetched
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+
+	// One FBO per level so each level can be rendered into
+	glGenFramebuffers(numLevels, fbos);
+	for (unsigned int level = 0; level < numLevels; level++)
+	{
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, fbos[level]);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, level);
+
+		GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (fboStatus != GL_FRAMEBUFFER_COMPLETE)
+		{
+			std::cout << "Error Creating Hi-Z level " << level << ": " << fboStatus << std::endl;
+		}
+	}
+
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindTexture(GLState::getActiveTexture(), GL_TEXTURE_2D, 0);
+
+	// Pick the first level small enough to copy back every frame
+	readbackLevel = 0;
+	while (readbackLevel < numLevels - 1 && (width >> readbackLevel) > HIZ_READBACK_MAX_WIDTH)
+		readbackLevel++;
+
+	readbackWidth = std::max(1u, width >> readbackLevel);
+	readbackHeight = std::max(1u, height >> readbackLevel);
+
+	glGenBuffers(NUM_READBACKS, pbos);
+	for (int i = 0; i < NUM_READBACKS; i++)
+	{
+		GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, readbackWidth * readbackHeight * sizeof(float), 0, GL_STREAM_READ);
+	}
+	GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	cpuDepth.resize(readbackWidth * readbackHeight);
+	cpuValid = false;
+
+	// Both passes draw a full screen quad
+	copyMaterial->setMat4("u_mvp", glm::mat4());
+	downsampleMaterial->setMat4("u_mvp", glm::mat4());
+}
+
+void HiZBuffer::build(FrameBufferObject& sourceFBO, const glm::mat4& viewProj, const glm::vec2& sourceScale)
+{
+	if (!texture)
+		return;
+
+	// Put everything back the way the caller had it when we are done
+	GLint previousViewport[4];
+	GLState::getViewport(previousViewport);
+	GLuint previousDrawFBO = GLState::getDrawFramebuffer();
+	GLuint previousReadFBO = GLState::getReadFramebuffer();
+	bool depthTest = GLState::isEnabled(GL_DEPTH_TEST);
+
+	// Every pixel of every level is written, nothing to test against
+	GLState::disable(GL_DEPTH_TEST);
+
+	// Level 0 is a straight copy of the scene depth
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, fbos[0]);
+	GLState::viewport(0, 0, width, height);
+	sourceFBO.bindDepthTextureForSampling(GL_TEXTURE0);
+
+	copyMaterial->setVec4("u_sourceScale", glm::vec4(sourceScale, 0.0f, 0.0f));
+	copyMaterial->bind();
+	copyMaterial->sendUniforms();
+	quad->draw();
+
+	// Every other level reads the one above it
+	// Limiting the texture to the level being read means the level being
+	// written is never visible to the shader, which would be a feedback loop
+	GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, texture);
+	downsampleMaterial->bind();
+	downsampleMaterial->sendUniforms();
+
+	for (unsigned int level = 1; level < numLevels; level++)
+	{
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, fbos[level]);
+		GLState::viewport(0, 0, std::max(1u, width >> level), std::max(1u, height >> level));
+		quad->draw();
+	}
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, numLevels - 1);
+	GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, 0);
+
+	// Start copying the small level back to the CPU
+	// glReadPixels into a pixel buffer returns straight away, the fence
+	// tells us when the data has actually arrived
+	if (fences[writeIndex])
+	{
+		// This copy was never picked up, the newer one replaces it
+		glDeleteSync(fences[writeIndex]);
+		fences[writeIndex] = 0;
+	}
+
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, fbos[readbackLevel]);
+	GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[writeIndex]);
+	glReadPixels(0, 0, readbackWidth, readbackHeight, GL_RED, GL_FLOAT, 0);
+	GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	fences[writeIndex] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	readbackViewProj[writeIndex] = viewProj;
+	writeIndex = (writeIndex + 1) % NUM_READBACKS;
+
+	GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, previousDrawFBO);
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, previousReadFBO);
+	GLState::viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+	GLState::setEnabled(GL_DEPTH_TEST, depthTest);
+}
+
+void HiZBuffer::update()
+{
+	// writeIndex points at the oldest copy, check from oldest to newest
+	// so we end up with the most recent one that has finished
+	for (int i = 0; i < NUM_READBACKS; i++)
+	{
+		int index = (writeIndex + i) % NUM_READBACKS;
+		if (!fences[index])
+			continue;
+
+		// Timeout of 0, just asks if it is done
+		GLenum status = glClientWaitSync(fences[index], 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+			continue;
+
+		GLsizeiptr size = readbackWidth * readbackHeight * sizeof(float);
+
+		GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, pbos[index]);
+		void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+		if (data)
+		{
+			memcpy(&cpuDepth[0], data, size);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+
+			cpuViewProj = readbackViewProj[index];
+			cpuValid = true;
+		}
+		GLState::bindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+		glDeleteSync(fences[index]);
+		fences[index] = 0;
+	}
+}
+
+bool HiZBuffer::isOccluded(const glm::vec3& worldMin, const glm::vec3& worldMax, int maxTexels, bool& tooLarge)
+{
+	tooLarge = false;
+
+	if (!cpuValid)
+		return false;
+
+	// Project the corners of the box with the matrix the depth was rendered with
+	glm::vec2 ndcMin(1.0f), ndcMax(-1.0f);
+	float closestDepth = 1.0f;
+
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner((i & 1) ? worldMax.x : worldMin.x, (i & 2) ? worldMax.y : worldMin.y, (i & 4) ? worldMax.z : worldMin.z);
+		glm::vec4 clip = cpuViewProj * glm::vec4(corner, 1.0f);
+
+		// Box crosses the near plane, it is right in front of the camera
+		if (clip.w <= 0.0f)
+			return false;
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+		ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+		closestDepth = std::min(closestDepth, ndc.z * 0.5f + 0.5f);
+	}
+
+	// Off screen, that is for frustum culling to decide
+	if (ndcMin.x > 1.0f || ndcMin.y > 1.0f || ndcMax.x < -1.0f || ndcMax.y < -1.0f)
+		return false;
+
+	ndcMin = glm::clamp(ndcMin, glm::vec2(-1.0f), glm::vec2(1.0f));
+	ndcMax = glm::clamp(ndcMax, glm::vec2(-1.0f), glm::vec2(1.0f));
+
+	// Texel rectangle covered by the box
+	int x0 = std::min((int)((ndcMin.x * 0.5f + 0.5f) * readbackWidth), (int)readbackWidth - 1);
+	int x1 = std::min((int)((ndcMax.x * 0.5f + 0.5f) * readbackWidth), (int)readbackWidth - 1);
+	int y0 = std::min((int)((ndcMin.y * 0.5f + 0.5f) * readbackHeight), (int)readbackHeight - 1);
+	int y1 = std::min((int)((ndcMax.y * 0.5f + 0.5f) * readbackHeight), (int)readbackHeight - 1);
+
+	if (x1 - x0 + 1 > maxTexels || y1 - y0 + 1 > maxTexels)
+	{
+		tooLarge = true;
+		return false;
+	}
+
+	// Every texel holds the furthest depth under it, if the closest point
+	// of the box is behind all of them the box cannot be seen
+	float furthestDepth = 0.0f;
+	for (int y = y0; y <= y1; y++)
+	{
+		for (int x = x0; x <= x1; x++)
+			furthestDepth = std::max(furthestDepth, cpuDepth[y * readbackWidth + x]);
+	}
+
+	return closestDepth > furthestDepth;
+}
+
+void HiZBuffer::destroy()
+{
+	if (texture)
+	{
+		GLState::deleteTextures(1, &texture);
+		GLState::deleteFramebuffers(numLevels, fbos);
+		GLState::deleteBuffers(NUM_READBACKS, pbos);
+		texture = 0;
+	}
+
+	for (int i = 0; i < NUM_READBACKS; i++)
+	{
+		if (fences[i])
+		{
+			glDeleteSync(fences[i]);
+			fences[i] = 0;
+		}
+		pbos[i] = 0;
+	}
+
+	memset(fbos, 0, sizeof(fbos));
+	numLevels = 0;
+	cpuValid = false;
+}
@@ -0,0 +1,367 @@
+#include "JobSystem.h"
+#include "Trace.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define MAX_CONTINUATIONS 8
+
+namespace JobSystem
+{
+	struct Job
+	{
+		JobFunction function;
+		Job* parent;
+
+		// This job plus its unfinished children
+		std::atomic<int> unfinishedJobs;
+
+		std::atomic<int> numContinuations;
+		Job* continuations[MAX_CONTINUATIONS];
+
+		char data[JOB_DATA_SIZE];
+	};
+
+	// Double ended queue of jobs owned by one thread
+	// The owner pushes and pops at the bottom, other threads steal from the top
+	struct WorkQueue
+	{
+		std::mutex lock;
+		Job* jobs[MAX_JOBS_PER_THREAD];
+		unsigned int top, bottom;
+
+		void push(Job* job)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			jobs[bottom % MAX_JOBS_PER_THREAD] = job;
+			bottom++;
+		}
+
+		Job* pop()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (bottom == top)
+				return nullptr;
+
+			bottom--;
+			return jobs[bottom % MAX_JOBS_PER_THREAD];
+		}
+
+		Job* steal()
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			if (bottom == top)
+				return nullptr;
+
+			Job* job = jobs[top % MAX_JOBS_PER_THREAD];
+			top++;
+			return job;
+		}
+	};
+
+	// Everything one thread owns
+	struct ThreadData
+	{
+		WorkQueue queue;
+		Job jobPool[MAX_JOBS_PER_THREAD];
+		unsigned int numAllocated;
+	};
+
+	namespace
+	{
+		std::vector<ThreadData*> threadData;
+		std::vector<std::thread> workers;
+		std::atomic<bool> running(false);
+
+		// Idle workers sleep here instead of spinning
+		std::mutex sleepLock;
+		std::condition_variable wakeUp;
+		std::atomic<int> queuedJobs(0);
+
+		// Index into threadData, the main thread is 0, then the workers, then attached threads
+		// Threads that are not part of the job system have INVALID_THREAD
+		const unsigned int INVALID_THREAD = ~0u;
+		thread_local unsigned int threadIndex = INVALID_THREAD;
+		std::atomic<unsigned int> nextAttachedIndex(0);
+
+		// Only threads the job system started or attachThread() was called on have a queue
+		ThreadData& getThreadData()
+		{
+			if (threadIndex >= threadData.size())
+			{
+				std::cout << "Jobs can only be created and run from job system threads, call attachThread() first!" << std::endl;
+				std::abort();
+			}
+
+			return *threadData[threadIndex];
+		}
+
+		Job* allocateJob()
+		{
+			ThreadData& data = getThreadData();
+			Job* job = &data.jobPool[data.numAllocated % MAX_JOBS_PER_THREAD];
+			data.numAllocated++;
+			return job;
+		}
+
+		Job* getJob()
+		{
+			Job* job = getThreadData().queue.pop();
+
+			// Our queue is empty, try to steal from the others
+			for (unsigned int i = 1; i < threadData.size() && !job; i++)
+			{
+				unsigned int victim = (threadIndex + i) % threadData.size();
+				job = threadData[victim]->queue.steal();
+			}
+
+			if (job)
+				queuedJobs--;
+
+			return job;
+		}
+
+		void finish(Job* job)
+		{
+			int unfinished = --job->unfinishedJobs;
+			if (unfinished != 0)
+				return;
+
+			if (job->parent)
+				finish(job->parent);
+
+			int numContinuations = job->numContinuations;
+			for (int i = 0; i < numContinuations; i++)
+				run(job->continuations[i]);
+		}
+
+		void execute(Job* job)
+		{
+			TRACE_SCOPE("Job");
+
+			if (job->function)
+				job->function(job, job->data);
+
+			finish(job);
+		}
+
+		void workerMain(unsigned int index)
+		{
+			threadIndex = index;
+
+#ifdef TRACING_ENABLED
+			char name[32];
+			snprintf(name, sizeof(name), "Worker %u", index);
+			TRACE_THREAD_NAME(name);
+#endif
+
+			while (running)
+			{
+				Job* job = getJob();
+				if (job)
+				{
+					execute(job);
+					continue;
+				}
+
+				// Nothing to do, sleep until something is queued
+				std::unique_lock<std::mutex> guard(sleepLock);
+				wakeUp.wait(guard, [] { return queuedJobs > 0 || !running; });
+			}
+		}
+	}
+
+	void init(unsigned int numWorkers)
+	{
+		if (running)
+			return;
+
+		if (numWorkers == 0)
+		{
+			unsigned int numCores = std::thread::hardware_concurrency();
+			numWorkers = numCores > 1 ? numCores - 1 : 0;
+		}
+
+		// Thread data is big, keep it on the heap
+		threadData.resize(numWorkers + 1 + MAX_ATTACHED_THREADS);
+		for (unsigned int i = 0; i < threadData.size(); i++)
+		{
+			threadData[i] = new ThreadData();
+			threadData[i]->queue.top = 0;
+			threadData[i]->queue.bottom = 0;
+			threadData[i]->numAllocated = 0;
+		}
+
+		threadIndex = 0;
+		nextAttachedIndex = numWorkers + 1;
+		running = true;
+
+		for (unsigned int i = 0; i < numWorkers; i++)
+			workers.push_back(std::thread(workerMain, i + 1));
+
+		std::cout << "Job system started with " << numWorkers + 1 << " threads" << std::endl;
+	}
+
+	void shutdown()
+	{
+		if (!running)
+			return;
+
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			running = false;
+		}
+		wakeUp.notify_all();
+
+		for (unsigned int i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+
+		for (unsigned int i = 0; i < threadData.size(); i++)
+			delete threadData[i];
+		threadData.clear();
+	}
+
+	void attachThread()
+	{
+		unsigned int index = nextAttachedIndex++;
+		if (index >= threadData.size())
+		{
+			std::cout << "Too many threads attached to the job system! At most " << MAX_ATTACHED_THREADS << std::endl;
+			std::abort();
+		}
+
+		threadIndex = index;
+	}
+
+	unsigned int getNumThreads()
+	{
+		return (unsigned int)workers.size() + 1;
+	}
+
+	Job* createJob(JobFunction function, const void* data, size_t dataSize)
+	{
+		Job* job = allocateJob();
+		job->function = function;
+		job->parent = nullptr;
+		job->unfinishedJobs = 1;
+		job->numContinuations = 0;
+
+		// Running the job on part of its data would be worse than stopping
+		if (dataSize > JOB_DATA_SIZE)
+		{
+			std::cout << "Job data is too big! " << dataSize << " > " << JOB_DATA_SIZE << std::endl;
+			std::abort();
+		}
+
+		if (data && dataSize > 0)
+			memcpy(job->data, data, dataSize);
+
+		return job;
+	}
+
+	Job* createChildJob(Job* parent, JobFunction function, const void* data, size_t dataSize)
+	{
+		parent->unfinishedJobs++;
+
+		Job* job = createJob(function, data, dataSize);
+		job->parent = parent;
+		return job;
+	}
+
+	void addContinuation(Job* job, Job* continuation)
+	{
+		int index = job->numContinuations++;
+		if (index >= MAX_CONTINUATIONS)
+		{
+			std::cout << "Too many continuations on one job!" << std::endl;
+			job->numContinuations--;
+			return;
+		}
+
+		job->continuations[index] = continuation;
+	}
+
+	void run(Job* job)
+	{
+		getThreadData().queue.push(job);
+
+		// Taking the lock makes sure a worker that is about to sleep sees the new job
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			queuedJobs++;
+		}
+		wakeUp.notify_one();
+	}
+
+	void wait(const Job* job)
+	{
+		while (!isFinished(job))
+		{
+			Job* next = getJob();
+			if (next)
+				execute(next);
+			else
+				std::this_thread::yield();
+		}
+	}
+
+	bool isFinished(const Job* job)
+	{
+		return job->unfinishedJobs == 0;
+	}
+
+	namespace
+	{
+		struct ParallelForData
+		{
+			ParallelForFunction function;
+			void* userData;
+			unsigned int start, end;
+		};
+
+		void parallelForJob(Job* /*job*/, const void* data)
+		{
+			const ParallelForData* range = (const ParallelForData*)data;
+			range->function(range->userData, range->start, range->end);
+		}
+	}
+
+	void parallelFor(unsigned int count, unsigned int batchSize, ParallelForFunction function, void* userData)
+	{
+		if (count == 0)
+			return;
+
+		if (batchSize == 0)
+			batchSize = 1;
+
+		// Not started, not called from a job system thread or not worth splitting, just do it here
+		if (!running || threadIndex >= threadData.size() || count <= batchSize)
+		{
+			function(userData, 0, count);
+			return;
+		}
+
+		Job* root = createJob(nullptr);
+
+		for (unsigned int start = 0; start < count; start += batchSize)
+		{
+			ParallelForData range;
+			range.function = function;
+			range.userData = userData;
+			range.start = start;
+			range.end = start + batchSize < count ? start + batchSize : count;
+
+			run(createChildJob(root, parallelForJob, range));
+		}
+
+		run(root);
+		wait(root);
+	}
+}
@@ -0,0 +1,388 @@
+#include "LightClusters.h"
+#include "Material.h"
+#include "GLState.h"
+#include "JobSystem.h"
+#include "RenderStats.h"
+#include "Trace.h"
+#include "TTK/Camera.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+// SSE2 is always there on x64, no need to check at runtime
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define LIGHT_CLUSTERS_SSE
+#include <emmintrin.h>
+#endif
+
+// Threads per work group in lightClusters_c.glsl
+#define BIN_GROUP_SIZE 64
+
+static_assert(LightClusters::NUM_CLUSTERS % BIN_GROUP_SIZE == 0, "The compute shader runs whole work groups only");
+static_assert(sizeof(PointLight) == 32, "PointLight must match the std430 layout in the shaders");
+
+const float LightClusters::FIRST_SLICE_DEPTH = 1.0f;
+
+LightClusters::LightClusters()
+	: useComputeShader(true),
+	binMaterial(nullptr),
+	sliceScale(0.0f),
+	sliceBias(0.0f),
+	clustersPerPixel(0.0f),
+	boundsUploaded(false),
+	numLights(0),
+	numOverflows(0)
+{
+	memset(buffers, 0, sizeof(buffers));
+}
+
+// Global instances are destroyed after the GL context is gone, the buffers
+// have to be released with destroy() before then
+LightClusters::~LightClusters()
+{
+}
+
+bool LightClusters::isSupported()
+{
+	// The shaders are #version 430, the extensions alone are not enough to compile them
+	return GLEW_VERSION_4_3 != 0;
+}
+
+void LightClusters::create(Material* material)
+{
+	if (buffers[0])
+		destroy();
+
+	binMaterial = material;
+
+	// Everything is allocated at its largest once, update() only overwrites the start
+	const GLsizeiptr sizes[NUM_BUFFERS] =
+	{
+		MAX_LIGHTS * sizeof(PointLight),
+		NUM_CLUSTERS * 2 * sizeof(glm::vec4),
+		NUM_CLUSTERS * 2 * sizeof(unsigned int),
+		NUM_CLUSTERS * MAX_LIGHTS_PER_CLUSTER * sizeof(unsigned int)
+	};
+
+	glGenBuffers(NUM_BUFFERS, buffers);
+	for (int i = 0; i < NUM_BUFFERS; i++)
+	{
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], 0, GL_DYNAMIC_DRAW);
+	}
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	viewLights.reserve(MAX_LIGHTS);
+	bounds.resize(NUM_CLUSTERS * 2);
+	sliceStarts.resize(CLUSTERS_Z + 1);
+	cpuRanges.resize(NUM_CLUSTERS * 2);
+	cpuSlots.resize(NUM_CLUSTERS * MAX_LIGHTS_PER_CLUSTER);
+	cpuIndices.resize(NUM_CLUSTERS * MAX_LIGHTS_PER_CLUSTER);
+
+	// Forces the boxes to be built on the first update
+	boundsProjection = glm::mat4(0.0f);
+	boundsUploaded = false;
+}
+
+void LightClusters::updateBounds(const glm::mat4& projection, float nearPlane, float farPlane)
+{
+	boundsProjection = projection;
+	boundsUploaded = false;
+
+	// Slice 0 is [near, first], the others split [first, far] exponentially:
+	// slice = floor(log(depth) * sliceScale + sliceBias) + 1
+	float firstSlice = std::min(FIRST_SLICE_DEPTH, farPlane * 0.5f);
+	sliceScale = (CLUSTERS_Z - 1) / logf(farPlane / firstSlice);
+	sliceBias = -logf(firstSlice) * sliceScale;
+
+	// With a symmetric perspective projection a point at view depth d
+	// and NDC x lands at view space x = ndc.x * d / projection[0][0]
+	float inverseScaleX = 1.0f / projection[0][0];
+	float inverseScaleY = 1.0f / projection[1][1];
+
+	for (int z = 0; z < CLUSTERS_Z; z++)
+	{
+		float nearDepth = z == 0 ? nearPlane : firstSlice * powf(farPlane / firstSlice, (z - 1) / (float)(CLUSTERS_Z - 1));
+		float farDepth = firstSlice * powf(farPlane / firstSlice, z / (float)(CLUSTERS_Z - 1));
+
+		for (int y = 0; y < CLUSTERS_Y; y++)
+		{
+			float ndcY0 = -1.0f + 2.0f * y / CLUSTERS_Y;
+			float ndcY1 = -1.0f + 2.0f * (y + 1) / CLUSTERS_Y;
+
+			for (int x = 0; x < CLUSTERS_X; x++)
+			{
+				float ndcX0 = -1.0f + 2.0f * x / CLUSTERS_X;
+				float ndcX1 = -1.0f + 2.0f * (x + 1) / CLUSTERS_X;
+
+				// The tile's sides are planes through the eye, so the box
+				// only has to cover its corners on the near and far depth
+				glm::vec3 boxMin(1e30f), boxMax(-1e30f);
+				for (int corner = 0; corner < 8; corner++)
+				{
+					float depth = (corner & 4) ? farDepth : nearDepth;
+					glm::vec3 point(((corner & 1) ? ndcX1 : ndcX0) * depth * inverseScaleX, ((corner & 2) ? ndcY1 : ndcY0) * depth * inverseScaleY, -depth);
+					boxMin = glm::min(boxMin, point);
+					boxMax = glm::max(boxMax, point);
+				}
+
+				int cluster = x + y * CLUSTERS_X + z * CLUSTERS_X * CLUSTERS_Y;
+				bounds[cluster * 2] = glm::vec4(boxMin, 0.0f);
+				bounds[cluster * 2 + 1] = glm::vec4(boxMax, 0.0f);
+			}
+		}
+	}
+}
+
+void LightClusters::update(const TTK::Camera& camera, const PointLight* lights, unsigned int count, unsigned int width, unsigned int height)
+{
+	TRACE_SCOPE("LightClusters::update");
+
+	if (!buffers[0])
+		return;
+
+	if (camera.projMatrix != boundsProjection)
+		updateBounds(camera.projMatrix, camera.nearPlane, camera.farPlane);
+
+	clustersPerPixel = glm::vec2(CLUSTERS_X / (float)width, CLUSTERS_Y / (float)height);
+
+	// Both binning paths and the lighting shader work in view space
+	numLights = std::min(count, (unsigned int)MAX_LIGHTS);
+	viewLights.resize(numLights);
+	for (unsigned int i = 0; i < numLights; i++)
+	{
+		glm::vec3 position = glm::vec3(camera.viewMatrix * glm::vec4(glm::vec3(lights[i].positionRadius), 1.0f));
+		viewLights[i].positionRadius = glm::vec4(position, lights[i].positionRadius.w);
+		viewLights[i].colour = lights[i].colour;
+	}
+
+	if (numLights > 0)
+	{
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[LIGHTS]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numLights * sizeof(PointLight), &viewLights[0]);
+		RenderStats::countUpload(numLights * sizeof(PointLight));
+	}
+
+	if (!useComputeShader)
+	{
+		binOnCPU();
+		return;
+	}
+
+	numOverflows = 0;
+
+	if (!boundsUploaded)
+	{
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[BOUNDS]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bounds.size() * sizeof(glm::vec4), &bounds[0]);
+		RenderStats::countUpload(bounds.size() * sizeof(glm::vec4));
+		boundsUploaded = true;
+	}
+
+	for (int i = 0; i < NUM_BUFFERS; i++)
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, i, buffers[i]);
+
+	binMaterial->setInt("u_numLights", numLights);
+	binMaterial->setInt("u_maxLightsPerCluster", MAX_LIGHTS_PER_CLUSTER);
+	binMaterial->bind();
+	binMaterial->sendUniforms();
+
+	// One thread per cluster
+	glDispatchCompute(NUM_CLUSTERS / BIN_GROUP_SIZE, 1, 1);
+
+	// The lighting shader reads what the compute shader wrote
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void LightClusters::binOnCPU()
+{
+	TRACE_SCOPE("LightClusters::binOnCPU");
+
+	const int CLUSTERS_PER_SLICE = CLUSTERS_X * CLUSTERS_Y;
+
+	// Depth slices every light reaches, sorted by slice with a counting sort
+	// A light behind the camera or past the last slice is dropped here
+	std::fill(sliceStarts.begin(), sliceStarts.end(), 0);
+	sliceLights.clear();
+
+	for (int pass = 0; pass < 2; pass++)
+	{
+		for (unsigned int i = 0; i < numLights; i++)
+		{
+			const glm::vec4& light = viewLights[i].positionRadius;
+			float nearDepth = -light.z - light.w;
+			float farDepth = -light.z + light.w;
+
+			if (farDepth <= 0.0f)
+				continue;
+
+			int first = nearDepth > 0.0f ? (int)floorf(logf(nearDepth) * sliceScale + sliceBias) + 1 : 0;
+			int last = (int)floorf(logf(farDepth) * sliceScale + sliceBias) + 1;
+			first = std::max(first, 0);
+			last = std::min(last, CLUSTERS_Z - 1);
+
+			for (int z = first; z <= last; z++)
+			{
+				if (pass == 0)
+					sliceStarts[z + 1]++;
+				else
+					sliceLights[sliceStarts[z]++] = i;
+			}
+		}
+
+		if (pass == 0)
+		{
+			// Counts to start offsets, the second pass moves every start to its slice's end
+			for (int z = 0; z < CLUSTERS_Z; z++)
+				sliceStarts[z + 1] += sliceStarts[z];
+			sliceLights.resize(sliceStarts[CLUSTERS_Z]);
+		}
+	}
+
+	// sliceStarts[z] now holds the end of slice z, the start is the end of the one before
+	std::atomic<unsigned int> overflows(0);
+
+	// Every slice writes only its own clusters
+	JobSystem::parallelFor(CLUSTERS_Z, 1, [&](unsigned int start, unsigned int end)
+	{
+		// The lights of one slice as separate arrays, so four of them can be tested at once
+		static thread_local std::vector<float> xs, ys, zs, radii;
+
+		for (unsigned int z = start; z < end; z++)
+		{
+			unsigned int sliceStart = z > 0 ? sliceStarts[z - 1] : 0;
+			unsigned int sliceCount = sliceStarts[z] - sliceStart;
+
+			// Padded to a multiple of 4 with lights that can not touch anything
+			unsigned int paddedCount = (sliceCount + 3) & ~3u;
+			if (xs.size() < paddedCount)
+			{
+				xs.resize(paddedCount);
+				ys.resize(paddedCount);
+				zs.resize(paddedCount);
+				radii.resize(paddedCount);
+			}
+
+			for (unsigned int i = 0; i < paddedCount; i++)
+			{
+				if (i < sliceCount)
+				{
+					const glm::vec4& light = viewLights[sliceLights[sliceStart + i]].positionRadius;
+					xs[i] = light.x;
+					ys[i] = light.y;
+					zs[i] = light.z;
+					radii[i] = light.w * light.w;
+				}
+				else
+				{
+					xs[i] = ys[i] = zs[i] = 0.0f;
+					radii[i] = -1.0f;
+				}
+			}
+
+			for (int c = 0; c < CLUSTERS_PER_SLICE; c++)
+			{
+				unsigned int cluster = z * CLUSTERS_PER_SLICE + c;
+				const glm::vec4& boxMin = bounds[cluster * 2];
+				const glm::vec4& boxMax = bounds[cluster * 2 + 1];
+
+				unsigned int* slots = &cpuSlots[cluster * MAX_LIGHTS_PER_CLUSTER];
+				unsigned int numInCluster = 0;
+				bool overflow = false;
+
+				// Distance from the light to the closest point of the box, compared to the radius
+				for (unsigned int i = 0; i < paddedCount && !overflow; i += 4)
+				{
+					int hits;
+#ifdef LIGHT_CLUSTERS_SSE
+					__m128 x = _mm_loadu_ps(&xs[i]);
+					__m128 y = _mm_loadu_ps(&ys[i]);
+					__m128 zz = _mm_loadu_ps(&zs[i]);
+					__m128 dx = _mm_sub_ps(x, _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(boxMin.x)), _mm_set1_ps(boxMax.x)));
+					__m128 dy = _mm_sub_ps(y, _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(boxMin.y)), _mm_set1_ps(boxMax.y)));
+					__m128 dz = _mm_sub_ps(zz, _mm_min_ps(_mm_max_ps(zz, _mm_set1_ps(boxMin.z)), _mm_set1_ps(boxMax.z)));
+					__m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					hits = _mm_movemask_ps(_mm_cmple_ps(distanceSquared, _mm_loadu_ps(&radii[i])));
+#else
+					hits = 0;
+					for (int lane = 0; lane < 4; lane++)
+					{
+						float dx = xs[i + lane] - std::min(std::max(xs[i + lane], boxMin.x), boxMax.x);
+						float dy = ys[i + lane] - std::min(std::max(ys[i + lane], boxMin.y), boxMax.y);
+						float dz = zs[i + lane] - std::min(std::max(zs[i + lane], boxMin.z), boxMax.z);
+						if (dx * dx + dy * dy + dz * dz <= radii[i + lane])
+							hits |= 1 << lane;
+					}
+#endif
+					// Most groups of four miss the cluster entirely
+					for (int lane = 0; hits != 0; lane++, hits >>= 1)
+					{
+						if (!(hits & 1))
+							continue;
+
+						if (numInCluster == MAX_LIGHTS_PER_CLUSTER)
+						{
+							overflow = true;
+							break;
+						}
+						slots[numInCluster++] = sliceLights[sliceStart + i + lane];
+					}
+				}
+
+				cpuRanges[cluster * 2 + 1] = numInCluster;
+				if (overflow)
+					overflows++;
+			}
+		}
+	});
+
+	numOverflows = overflows;
+
+	// Pack the lists together so only the lights that were found get uploaded
+	unsigned int numIndices = 0;
+	for (int cluster = 0; cluster < NUM_CLUSTERS; cluster++)
+	{
+		unsigned int numInCluster = cpuRanges[cluster * 2 + 1];
+		cpuRanges[cluster * 2] = numIndices;
+		if (numInCluster > 0)
+			memcpy(&cpuIndices[numIndices], &cpuSlots[cluster * MAX_LIGHTS_PER_CLUSTER], numInCluster * sizeof(unsigned int));
+		numIndices += numInCluster;
+	}
+
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[RANGES]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cpuRanges.size() * sizeof(unsigned int), &cpuRanges[0]);
+	RenderStats::countUpload(cpuRanges.size() * sizeof(unsigned int));
+
+	if (numIndices > 0)
+	{
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[INDICES]);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, numIndices * sizeof(unsigned int), &cpuIndices[0]);
+		RenderStats::countUpload(numIndices * sizeof(unsigned int));
+	}
+}
+
+void LightClusters::bindForShading(Material* lightingMaterial)
+{
+	if (!buffers[0])
+		return;
+
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHTS, buffers[LIGHTS]);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, RANGES, buffers[RANGES]);
+	GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, INDICES, buffers[INDICES]);
+
+	// xy turn gl_FragCoord into a tile, zw turn view depth into a slice
+	lightingMaterial->setVec4("u_clusterParams", glm::vec4(clustersPerPixel, sliceScale, sliceBias));
+}
+
+void LightClusters::destroy()
+{
+	if (buffers[0])
+	{
+		GLState::deleteBuffers(NUM_BUFFERS, buffers);
+		memset(buffers, 0, sizeof(buffers));
+	}
+
+	numLights = 0;
+	numOverflows = 0;
+}
@@ -0,0 +1,166 @@
+#include "OcclusionCuller.h"
+#include "HiZBuffer.h"
+#include "GameObject.h"
+#include "GLState.h"
+#include "JobSystem.h"
+#include "FrameArena.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cstring>
+
+OcclusionCuller::OcclusionCuller()
+	: maxHiZTexels(16),
+	m_pProxyMaterial(nullptr),
+	m_pBoxMesh(nullptr)
+{
+	memset(&m_pStats, 0, sizeof(OcclusionStats));
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+}
+
+void OcclusionCuller::init(Material* proxyMaterial, TTK::MeshBase* boxMesh)
+{
+	m_pProxyMaterial = proxyMaterial;
+	m_pBoxMesh = boxMesh;
+}
+
+void OcclusionCuller::cull(RenderQueue& queue, TTK::Camera& camera, HiZBuffer& hiz, bool allowConditional)
+{
+	TRACE_SCOPE("OcclusionCuller::cull");
+
+	memset(&m_pStats, 0, sizeof(OcclusionStats));
+
+	std::vector<RenderItem>& items = queue.getItems();
+
+	// Pick up the newest Hi-Z copy if the GPU is done with it
+	hiz.update();
+
+	// Transparent items are sorted last and do not write depth, leave them alone
+	unsigned int numOpaque = 0;
+	while (numOpaque < items.size() && !items[numOpaque].gameobject->material->transparent)
+		numOpaque++;
+
+	unsigned char* results = FrameArena::allocateArray<unsigned char>(numOpaque);
+	if (!results)
+		return;
+
+	m_pStats.tested = numOpaque;
+	memset(results, RESULT_VISIBLE, numOpaque);
+
+	// Boxes are grown by the near plane so one that is about to clip it counts as containing the camera
+	glm::vec3 nearPadding(camera.nearPlane);
+
+	// The Hi-Z tests only read the CPU copy of the depth, so they run on the job system
+	JobSystem::parallelFor(numOpaque, 32, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+		{
+			glm::vec3 worldMin, worldMax;
+			items[i].gameobject->getWorldBounds(worldMin, worldMax);
+
+			bool tooLarge = false;
+			if (hiz.isOccluded(worldMin, worldMax, maxHiZTexels, tooLarge))
+			{
+				results[i] = RESULT_OCCLUDED;
+				continue;
+			}
+
+			if (!tooLarge || !allowConditional)
+				continue;
+
+			// The proxy box would be clipped by the near plane and never pass
+			bool containsCamera = glm::all(glm::greaterThanEqual(camera.cameraPosition, worldMin - nearPadding)) &&
+				glm::all(glm::lessThanEqual(camera.cameraPosition, worldMax + nearPadding));
+			if (!containsCamera)
+				results[i] = RESULT_QUERY;
+		}
+	});
+
+	// Queries are GL objects, so this part stays on the main thread
+	for (unsigned int i = 0; i < numOpaque; i++)
+	{
+		if (results[i] == RESULT_OCCLUDED)
+		{
+			// Mark for removal, the actual erase happens in one pass below
+			items[i].gameobject = nullptr;
+			m_pStats.hizRejected++;
+			continue;
+		}
+
+		if (results[i] != RESULT_QUERY)
+			continue;
+
+		GameObject* gameobject = items[i].gameobject;
+		if (!gameobject->occlusionQuery)
+		{
+			glGenQueries(1, &gameobject->occlusionQuery);
+		}
+		else
+		{
+			// Results are only read if already available, so this never stalls
+			GLuint available = 0;
+			glGetQueryObjectuiv(gameobject->occlusionQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint anySamplesPassed = 0;
+				glGetQueryObjectuiv(gameobject->occlusionQuery, GL_QUERY_RESULT, &anySamplesPassed);
+				if (!anySamplesPassed)
+					m_pStats.conditionalRejected++;
+			}
+		}
+
+		items[i].conditionalQuery = gameobject->occlusionQuery;
+		m_pStats.conditionalDraws++;
+	}
+
+	// Remove the rejected items, remove_if keeps the rest in sorted order
+	auto isRejected = [](const RenderItem& item) { return item.gameobject == nullptr; };
+	items.erase(std::remove_if(items.begin(), items.end(), isRejected), items.end());
+}
+
+void OcclusionCuller::issueQueries(RenderQueue& queue, TTK::Camera& camera)
+{
+	TRACE_SCOPE("OcclusionCuller::issueQueries");
+
+	if (m_pStats.conditionalDraws == 0)
+		return;
+
+	std::vector<RenderItem>& items = queue.getItems();
+
+	// Boxes are tested against the depth buffer but must not change it or the colour buffer
+	GLboolean previousDepthMask = GLState::getDepthMask();
+	GLenum previousDepthFunc = GLState::getDepthFunc();
+	GLState::colourMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	GLState::depthMask(GL_FALSE);
+	GLState::depthFunc(GL_LEQUAL);
+
+	m_pProxyMaterial->bind();
+	m_pProxyMaterial->sendUniforms();
+	m_pBoxMesh->vbo.bindDepthOnly();
+
+	for (size_t i = 0; i < items.size(); i++)
+	{
+		if (!items[i].conditionalQuery)
+			continue;
+
+		glm::vec3 worldMin, worldMax;
+		items[i].gameobject->getWorldBounds(worldMin, worldMax);
+
+		// Unit cube scaled and moved to cover the world space box
+		glm::mat4 boxToWorld = glm::translate((worldMin + worldMax) * 0.5f) * glm::scale(worldMax - worldMin);
+		glm::mat4 mvp = camera.viewProjMatrix * boxToWorld;
+		m_pProxyMaterial->shader->sendUniformMat4("u_mvp", mvp);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, items[i].conditionalQuery);
+		m_pBoxMesh->vbo.drawBound();
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+	}
+
+	VertexBufferObject::unbind();
+
+	GLState::colourMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	GLState::depthMask(previousDepthMask);
+	GLState::depthFunc(previousDepthFunc);
+}
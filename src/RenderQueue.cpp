@@ -0,0 +1,332 @@
+#include "RenderQueue.h"
+#include "GameObject.h"
+#include "GLState.h"
+#include "JobSystem.h"
+#include "Trace.h"
+#include "TransformBatch.h"
+#include <algorithm>
+#include <cstring>
+
+// Number of bits each field gets in the sort key
+#define SORT_KEY_PASS_BITS		4
+#define SORT_KEY_ID_BITS		10
+#define SORT_KEY_DEPTH_BITS		24
+
+#define SORT_KEY_ID_MASK		((1u << SORT_KEY_ID_BITS) - 1)
+#define SORT_KEY_DEPTH_MAX		((1u << SORT_KEY_DEPTH_BITS) - 1)
+
+RenderQueue::RenderQueue()
+	: lodPixelError(1.0f),
+	lodHysteresis(0.25f)
+{
+	memset(&m_pStats, 0, sizeof(RenderQueueStats));
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+void RenderQueue::clear()
+{
+	// clear() keeps the capacity, so after the first frame this does not allocate
+	m_pItems.clear();
+	m_pUniforms.clear();
+	memset(&m_pStats, 0, sizeof(RenderQueueStats));
+}
+
+uint64_t RenderQueue::makeSortKey(Pass pass, bool transparent, unsigned int program, unsigned int material, unsigned int mesh, float depth01)
+{
+	uint64_t depth = (uint64_t)(glm::clamp(depth01, 0.0f, 1.0f) * (float)SORT_KEY_DEPTH_MAX);
+
+	uint64_t state = ((uint64_t)(program & SORT_KEY_ID_MASK) << (SORT_KEY_ID_BITS * 2)) |
+		((uint64_t)(material & SORT_KEY_ID_MASK) << SORT_KEY_ID_BITS) |
+		(uint64_t)(mesh & SORT_KEY_ID_MASK);
+
+	uint64_t key = (uint64_t)pass << (64 - SORT_KEY_PASS_BITS);
+
+	if (transparent)
+	{
+		// Back to front: depth is more important than state and inverted
+		key |= (uint64_t)1 << 59;
+		key |= (SORT_KEY_DEPTH_MAX - depth) << 35;
+		key |= state << 5;
+	}
+	else
+	{
+		// Front to back: group by state first, then depth within the same state
+		key |= state << 29;
+		key |= depth << 5;
+	}
+
+	return key;
+}
+
+void RenderQueue::submit(GameObject* gameobject, Pass pass)
+{
+	RenderItem item;
+	item.gameobject = gameobject;
+	item.conditionalQuery = 0;
+	item.lod = 0;
+
+	// Only the pass is known here, prepare() fills in the rest of the key
+	item.sortKey = (uint64_t)pass << (64 - SORT_KEY_PASS_BITS);
+
+	m_pItems.push_back(item);
+}
+
+void RenderQueue::prepareItem(RenderItem& item, TTK::Camera& camera)
+{
+	GameObject* gameobject = item.gameobject;
+	Material* material = gameobject->material.get();
+	TTK::MeshBase* mesh = gameobject->mesh.get();
+	Pass pass = (Pass)(item.sortKey >> (64 - SORT_KEY_PASS_BITS));
+
+	// Distance along the view direction, normalized to the camera's depth range
+	glm::vec4 posEye = camera.viewMatrix * gameobject->getRenderMatrix()[3];
+	float depth01 = -posEye.z / camera.farPlane;
+
+	// Level of detail from how big the mesh's error would be on screen
+	// The last choice is kept on the object so hysteresis works across frames
+	if (mesh->lods.size() > 1)
+	{
+		glm::mat4 world = gameobject->getRenderMatrix();
+		float worldScale = glm::max(glm::length(glm::vec3(world[0])), glm::max(glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2]))));
+
+		glm::vec3 center = glm::vec3(world * glm::vec4((mesh->boundsMin + mesh->boundsMax) * 0.5f, 1.0f));
+		float radius = glm::length(mesh->boundsMax - mesh->boundsMin) * 0.5f * worldScale;
+		float distance = glm::max(glm::length(center - camera.cameraPosition) - radius, camera.nearPlane);
+
+		// projMatrix[1][1] is 1 / tan(fov / 2), so this is pixels per object space unit at that distance
+		float pixelsPerUnit = worldScale * camera.projMatrix[1][1] * 0.5f * camera.winHeight / distance;
+		gameobject->lodLevel = mesh->selectLOD(pixelsPerUnit, gameobject->lodLevel, lodPixelError, lodHysteresis);
+	}
+	else
+		gameobject->lodLevel = 0;
+
+	item.lod = gameobject->lodLevel;
+	item.sortKey = makeSortKey(pass, material->transparent, material->shader->getHandle(), material->id, mesh->id, depth01);
+}
+
+void RenderQueue::prepare(TTK::Camera& camera)
+{
+	TRACE_SCOPE("RenderQueue::prepare");
+
+	// Every item only touches itself and its own game object, so they can all be done at once
+	JobSystem::parallelFor((unsigned int)m_pItems.size(), 64, [&](unsigned int start, unsigned int end)
+	{
+		for (unsigned int i = start; i < end; i++)
+			prepareItem(m_pItems[i], camera);
+	});
+}
+
+void RenderQueue::packUniforms(TTK::Camera& camera)
+{
+	TRACE_SCOPE("RenderQueue::packUniforms");
+
+	m_pUniforms.resize(m_pItems.size());
+
+	// Lets the batch kernel write the mvp and mv members straight into the array
+	static_assert(sizeof(DrawUniforms) == sizeof(glm::mat4) * 2, "DrawUniforms must be exactly mvp followed by mv");
+	const unsigned int BLOCK_SIZE = 64;
+
+	JobSystem::parallelFor((unsigned int)m_pItems.size(), BLOCK_SIZE, [&](unsigned int start, unsigned int end)
+	{
+		// The render matrices live in the game objects, gather them so the products run over an array
+		glm::mat4 models[BLOCK_SIZE];
+		for (unsigned int block = start; block < end; block += BLOCK_SIZE)
+		{
+			unsigned int count = end - block < BLOCK_SIZE ? end - block : BLOCK_SIZE;
+			for (unsigned int i = 0; i < count; i++)
+				models[i] = m_pItems[block + i].gameobject->getRenderMatrix();
+
+			TransformBatch::multiply(camera.viewProjMatrix, models, &m_pUniforms[block].mvp, count, 2);
+			TransformBatch::multiply(camera.viewMatrix, models, &m_pUniforms[block].mv, count, 2);
+		}
+	});
+}
+
+void RenderQueue::sort()
+{
+	TRACE_SCOPE("RenderQueue::sort");
+
+	size_t numItems = m_pItems.size();
+	if (numItems < 2)
+		return;
+
+	m_pScratch.resize(numItems);
+
+	// Least significant digit radix sort, 8 bits at a time
+	// Build all 8 histograms in a single pass over the keys
+	unsigned int histograms[8][256];
+	memset(histograms, 0, sizeof(histograms));
+
+	for (size_t i = 0; i < numItems; i++)
+	{
+		uint64_t key = m_pItems[i].sortKey;
+		for (int digit = 0; digit < 8; digit++)
+			histograms[digit][(key >> (digit * 8)) & 0xFF]++;
+	}
+
+	RenderItem* src = &m_pItems[0];
+	RenderItem* dst = &m_pScratch[0];
+
+	for (int digit = 0; digit < 8; digit++)
+	{
+		unsigned int* counts = histograms[digit];
+		int shift = digit * 8;
+
+		// Every key has the same value for this digit, this pass would not move anything
+		if (counts[(src[0].sortKey >> shift) & 0xFF] == numItems)
+			continue;
+
+		// Turn counts into starting offsets
+		unsigned int offset = 0;
+		for (int b = 0; b < 256; b++)
+		{
+			unsigned int count = counts[b];
+			counts[b] = offset;
+			offset += count;
+		}
+
+		for (size_t i = 0; i < numItems; i++)
+			dst[counts[(src[i].sortKey >> shift) & 0xFF]++] = src[i];
+
+		std::swap(src, dst);
+	}
+
+	// The sorted result ended up in the scratch array
+	if (src != &m_pItems[0])
+		m_pItems.swap(m_pScratch);
+}
+
+void RenderQueue::execute(TTK::Camera& camera)
+{
+	TRACE_SCOPE("RenderQueue::execute");
+
+	m_pStats.numItems = (unsigned int)m_pItems.size();
+
+	// Items were removed or added since the uniforms were packed
+	if (m_pUniforms.size() != m_pItems.size())
+		packUniforms(camera);
+
+	ShaderProgram* currentProgram = nullptr;
+	Material* currentMaterial = nullptr;
+	TTK::MeshBase* currentMesh = nullptr;
+	unsigned int currentTexture = ~0u; // unknown, forces the first bind
+	bool blending = false;
+
+	// Transparent items change these, put them back the way the caller had them
+	GLenum previousDepthFunc = GLState::getDepthFunc();
+	GLboolean previousDepthMask = GLState::getDepthMask();
+
+	for (size_t i = 0; i < m_pItems.size(); i++)
+	{
+		GameObject* gameobject = m_pItems[i].gameobject;
+		Material* material = gameobject->material.get();
+		TTK::MeshBase* mesh = gameobject->mesh.get();
+
+		// Transparent items are sorted after all of the opaque ones
+		if (material->transparent && !blending)
+		{
+			GLState::enable(GL_BLEND);
+			GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+			GLState::depthMask(GL_FALSE);
+
+			// Transparent items are not in the depth pre-pass, so GL_EQUAL would reject them
+			GLState::depthFunc(GL_LEQUAL);
+			blending = true;
+		}
+
+		if (material->shader.get() != currentProgram)
+		{
+			material->bind();
+			currentProgram = material->shader.get();
+			currentMaterial = nullptr; // uniforms live in the program, so they need to be sent again
+			m_pStats.programBinds++;
+		}
+
+		if (material != currentMaterial)
+		{
+			material->sendUniforms();
+			currentMaterial = material;
+			m_pStats.materialChanges++;
+		}
+
+		unsigned int texture = gameobject->diffuseTexture ? gameobject->diffuseTexture->id() : 0;
+		if (texture != currentTexture)
+		{
+			GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, texture);
+			currentTexture = texture;
+			m_pStats.textureBinds++;
+		}
+
+		if (mesh != currentMesh)
+		{
+			mesh->vbo.bind();
+			currentMesh = mesh;
+			m_pStats.meshBinds++;
+		}
+
+		gameobject->sendObjectUniforms(m_pUniforms[i].mvp, m_pUniforms[i].mv);
+
+		if (m_pItems[i].conditionalQuery)
+		{
+			// The GPU waits for the query itself, the CPU never stalls here
+			glBeginConditionalRender(m_pItems[i].conditionalQuery, GL_QUERY_WAIT);
+			mesh->drawBoundLOD(m_pItems[i].lod);
+			glEndConditionalRender();
+		}
+		else
+			mesh->drawBoundLOD(m_pItems[i].lod);
+
+		m_pStats.triangles += mesh->getNumTriangles(m_pItems[i].lod);
+	}
+
+	VertexBufferObject::unbind();
+
+	if (currentTexture != 0 && currentTexture != ~0u)
+	{
+		GLState::bindTexture(GL_TEXTURE0, GL_TEXTURE_2D, 0);
+	}
+
+	if (blending)
+	{
+		GLState::disable(GL_BLEND);
+		GLState::depthMask(previousDepthMask);
+		GLState::depthFunc(previousDepthFunc);
+	}
+}
+
+void RenderQueue::executeDepthOnly(TTK::Camera& camera, Material* depthMaterial)
+{
+	TRACE_SCOPE("RenderQueue::executeDepthOnly");
+
+	TTK::MeshBase* currentMesh = nullptr;
+
+	if (m_pUniforms.size() != m_pItems.size())
+		packUniforms(camera);
+
+	depthMaterial->bind();
+	depthMaterial->sendUniforms();
+
+	for (size_t i = 0; i < m_pItems.size(); i++)
+	{
+		GameObject* gameobject = m_pItems[i].gameobject;
+
+		// Transparent items are sorted last, nothing after them writes depth
+		if (gameobject->material->transparent)
+			break;
+
+		TTK::MeshBase* mesh = gameobject->mesh.get();
+		if (mesh != currentMesh)
+		{
+			mesh->vbo.bindDepthOnly();
+			currentMesh = mesh;
+		}
+
+		depthMaterial->shader->sendUniformMat4("u_mvp", m_pUniforms[i].mvp);
+
+		// Same level as the colour pass, otherwise GL_EQUAL depth testing would fail
+		mesh->drawBoundLOD(m_pItems[i].lod);
+	}
+}
@@ -0,0 +1,255 @@
+#include "RenderStats.h"
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace RenderStats
+{
+	namespace
+	{
+		struct PendingFrame
+		{
+			Counters counters;
+			unsigned int frameNumber;
+		};
+
+		bool pipelineStatistics = false;
+
+		// Counters of the frame being recorded
+		Counters current;
+		unsigned int frameNumber = 0;
+		bool inFrame = false;
+
+		// Frames that have ended but whose query has not been read back yet, oldest first
+		PendingFrame pending[MAX_PENDING_FRAMES];
+		GLuint queries[MAX_PENDING_FRAMES];
+		unsigned int pendingWrite = 0;
+		unsigned int numPending = 0;
+
+		Counters lastFrame;
+		Counters history[AVERAGE_FRAMES];
+		unsigned int numFinished = 0;
+
+		FILE* recordFile = nullptr;
+
+		void finishFrame(const PendingFrame& frame)
+		{
+			lastFrame = frame.counters;
+			history[numFinished % AVERAGE_FRAMES] = frame.counters;
+			numFinished++;
+
+			if (recordFile)
+			{
+				const Counters& c = frame.counters;
+				fprintf(recordFile, "%u,%u,%u,%u,%u,%u,%u,%u,%u,%llu,%llu\n",
+					frame.frameNumber, c.drawCalls, c.triangles, c.programBinds, c.vertexArrayBinds,
+					c.textureBinds, c.framebufferBinds, c.uniformUploads, c.clears, c.bytesUploaded, c.fragmentInvocations);
+			}
+		}
+
+		// Queries finish in order, so read from the oldest until one is not ready
+		void readPending(bool wait)
+		{
+			while (numPending > 0)
+			{
+				unsigned int oldest = (pendingWrite - numPending + MAX_PENDING_FRAMES) % MAX_PENDING_FRAMES;
+
+				if (!wait)
+				{
+					GLuint available = 0;
+					glGetQueryObjectuiv(queries[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+					if (!available)
+						break;
+				}
+
+				GLuint64 invocations = 0;
+				glGetQueryObjectui64v(queries[oldest], GL_QUERY_RESULT, &invocations);
+				pending[oldest].counters.fragmentInvocations = invocations;
+
+				finishFrame(pending[oldest]);
+				numPending--;
+
+				// Only the oldest one was needed to make room
+				if (wait)
+					break;
+			}
+		}
+	}
+
+	void init()
+	{
+		memset(&current, 0, sizeof(Counters));
+		memset(&lastFrame, 0, sizeof(Counters));
+
+		pipelineStatistics = GLEW_ARB_pipeline_statistics_query != GL_FALSE;
+		if (pipelineStatistics)
+			glGenQueries(MAX_PENDING_FRAMES, queries);
+		else
+			std::cout << "RenderStats: GL_ARB_pipeline_statistics_query not supported, fragment invocations are not counted" << std::endl;
+	}
+
+	bool hasPipelineStatistics()
+	{
+		return pipelineStatistics;
+	}
+
+	void beginFrame()
+	{
+		memset(&current, 0, sizeof(Counters));
+		frameNumber++;
+		inFrame = true;
+
+		if (!pipelineStatistics)
+			return;
+
+		// Every query is still in flight, wait for the oldest so it can be reused
+		if (numPending == MAX_PENDING_FRAMES)
+			readPending(true);
+
+		glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, queries[pendingWrite]);
+	}
+
+	void endFrame()
+	{
+		if (!inFrame)
+			return;
+		inFrame = false;
+
+		PendingFrame frame;
+		frame.counters = current;
+		frame.frameNumber = frameNumber;
+
+		if (!pipelineStatistics)
+		{
+			finishFrame(frame);
+			return;
+		}
+
+		glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+		pending[pendingWrite] = frame;
+		pendingWrite = (pendingWrite + 1) % MAX_PENDING_FRAMES;
+		numPending++;
+
+		readPending(false);
+	}
+
+	const Counters& getLastFrame()
+	{
+		return lastFrame;
+	}
+
+	Counters getAverage()
+	{
+		Counters sum;
+		memset(&sum, 0, sizeof(Counters));
+
+		unsigned int count = numFinished < AVERAGE_FRAMES ? numFinished : AVERAGE_FRAMES;
+		if (count == 0)
+			return sum;
+
+		// The smaller counters are summed in 64 bit so they can not overflow
+		unsigned long long drawCalls = 0, triangles = 0, programBinds = 0, vertexArrayBinds = 0,
+			textureBinds = 0, framebufferBinds = 0, uniformUploads = 0, clears = 0;
+
+		for (unsigned int i = 0; i < count; i++)
+		{
+			const Counters& c = history[i];
+			drawCalls += c.drawCalls;
+			triangles += c.triangles;
+			programBinds += c.programBinds;
+			vertexArrayBinds += c.vertexArrayBinds;
+			textureBinds += c.textureBinds;
+			framebufferBinds += c.framebufferBinds;
+			uniformUploads += c.uniformUploads;
+			clears += c.clears;
+			sum.bytesUploaded += c.bytesUploaded;
+			sum.fragmentInvocations += c.fragmentInvocations;
+		}
+
+		sum.drawCalls = (unsigned int)(drawCalls / count);
+		sum.triangles = (unsigned int)(triangles / count);
+		sum.programBinds = (unsigned int)(programBinds / count);
+		sum.vertexArrayBinds = (unsigned int)(vertexArrayBinds / count);
+		sum.textureBinds = (unsigned int)(textureBinds / count);
+		sum.framebufferBinds = (unsigned int)(framebufferBinds / count);
+		sum.uniformUploads = (unsigned int)(uniformUploads / count);
+		sum.clears = (unsigned int)(clears / count);
+		sum.bytesUploaded /= count;
+		sum.fragmentInvocations /= count;
+		return sum;
+	}
+
+	bool startRecording(const char* path)
+	{
+		stopRecording();
+
+		recordFile = fopen(path, "w");
+		if (!recordFile)
+		{
+			std::cout << "RenderStats: could not open " << path << " for writing" << std::endl;
+			return false;
+		}
+
+		fprintf(recordFile, "frame,drawCalls,triangles,programBinds,vertexArrayBinds,textureBinds,framebufferBinds,uniformUploads,clears,bytesUploaded,fragmentInvocations\n");
+		return true;
+	}
+
+	void stopRecording()
+	{
+		if (recordFile)
+		{
+			fclose(recordFile);
+			recordFile = nullptr;
+		}
+	}
+
+	bool isRecording()
+	{
+		return recordFile != nullptr;
+	}
+
+	void countDraw(GLenum mode, GLsizei count)
+	{
+		current.drawCalls++;
+
+		if (mode == GL_TRIANGLES)
+			current.triangles += count / 3;
+		else if ((mode == GL_TRIANGLE_STRIP || mode == GL_TRIANGLE_FAN) && count >= 3)
+			current.triangles += count - 2;
+	}
+
+	void countProgramBind()
+	{
+		current.programBinds++;
+	}
+
+	void countVertexArrayBind()
+	{
+		current.vertexArrayBinds++;
+	}
+
+	void countTextureBind()
+	{
+		current.textureBinds++;
+	}
+
+	void countFramebufferBind()
+	{
+		current.framebufferBinds++;
+	}
+
+	void countUniformUpload()
+	{
+		current.uniformUploads++;
+	}
+
+	void countUpload(size_t bytes)
+	{
+		current.bytesUploaded += bytes;
+	}
+
+	void countClear()
+	{
+		current.clears++;
+	}
+}
@@ -2,6 +2,7 @@
 #include <iostream>
 #include "GLEW/glew.h"
 #include "TTK/io.h"
+#include "Trace.h"
 
 Shader::Shader()
 {
@@ -15,6 +16,8 @@ Shader::~Shader()
 
 unsigned int Shader::loadShaderFromFile(std::string fileName, GLenum type)
 {
+	TRACE_SCOPE_DETAIL("loadShaderFromFile", fileName.c_str());
+
 	// Load shader file into memory
 	std::string shaderCode = TTK::IO::loadFile(fileName).c_str();
 
@@ -1,4 +1,6 @@
 #include "ShaderProgram.h"
+#include "GLState.h"
+#include "RenderStats.h"
 #include <iostream>
 
 ShaderProgram::ShaderProgram()
@@ -62,52 +64,77 @@ int ShaderProgram::linkProgram()
 	{
 		std::cout << "Shader program failed to link: handle not set" << std::endl;
 	}
+
+	return 0;
 }
 
 void ShaderProgram::bind()
 {
-	glUseProgram(handle);
+	GLState::useProgram(handle);
 }
 
 void ShaderProgram::unbind()
 {
-	glUseProgram(0);
+	GLState::useProgram(0);
 }
 
 void ShaderProgram::sendUniformInt(const std::string& uniformName, int intVal)
+{
+	sendUniformInt(uniformName.c_str(), intVal);
+}
+
+void ShaderProgram::sendUniformInt(const char* uniformName, int intVal)
 {
 	int uniformLocation = getUniformLocation(uniformName);
 	glUniform1i(uniformLocation, intVal);
+	RenderStats::countUniformUpload();
 }
 
 void ShaderProgram::sendUniformFloat(const std::string& uniformName, float floatVal)
+{
+	sendUniformFloat(uniformName.c_str(), floatVal);
+}
+
+void ShaderProgram::sendUniformFloat(const char* uniformName, float floatVal)
 {
 	int uniformLocation = getUniformLocation(uniformName);
 	glUniform1f(uniformLocation, floatVal);
+	RenderStats::countUniformUpload();
 }
 
-
 void ShaderProgram::sendUniformVec4(const std::string& uniformName, glm::vec4& vec4)
+{
+	sendUniformVec4(uniformName.c_str(), vec4);
+}
+
+void ShaderProgram::sendUniformVec4(const char* uniformName, glm::vec4& vec4)
 {
 	int uniformLocation = getUniformLocation(uniformName);
 	glUniform4fv(uniformLocation, 1, &vec4[0]);
+	RenderStats::countUniformUpload();
 }
 
 void ShaderProgram::sendUniformMat4(const std::string& uniformName, glm::mat4& mat4)
+{
+	sendUniformMat4(uniformName.c_str(), mat4);
+}
+
+void ShaderProgram::sendUniformMat4(const char* uniformName, glm::mat4& mat4)
 {
 	int uniformLocation = getUniformLocation(uniformName);
 	glUniformMatrix4fv(uniformLocation, 1, false, &mat4[0][0]);
+	RenderStats::countUniformUpload();
 }
 
 void ShaderProgram::destroy()
 {
 	if (handle)
 	{
-		glDeleteProgram(handle);
+		GLState::deleteProgram(handle);
 	}
 }
 
-int ShaderProgram::getUniformLocation(const std::string& uniformName)
+int ShaderProgram::getUniformLocation(const char* uniformName)
 {
-	return glGetUniformLocation(handle, uniformName.c_str());
+	return glGetUniformLocation(handle, uniformName);
 }
@@ -0,0 +1,105 @@
+#include "SimulationThread.h"
+#include "JobSystem.h"
+#include "Trace.h"
+#include <chrono>
+
+SimulationThread::SimulationThread()
+	: m_pRunning(false),
+	m_pPaused(false),
+	m_pTickCount(0),
+	m_pTick(nullptr),
+	m_pTickLength(0.0f)
+{
+}
+
+SimulationThread::~SimulationThread()
+{
+	stop();
+}
+
+void SimulationThread::start(float ticksPerSecond, TickFunction tick)
+{
+	if (m_pRunning)
+		return;
+
+	m_pTick = tick;
+	m_pTickLength = 1.0f / ticksPerSecond;
+	m_pRunning = true;
+	m_pThread = std::thread(&SimulationThread::threadMain, this);
+}
+
+void SimulationThread::stop()
+{
+	if (!m_pRunning)
+		return;
+
+	{
+		std::lock_guard<std::mutex> guard(m_pSleepLock);
+		m_pRunning = false;
+	}
+	m_pWakeUp.notify_one();
+
+	m_pThread.join();
+}
+
+void SimulationThread::pause()
+{
+	m_pPaused = true;
+}
+
+void SimulationThread::resume()
+{
+	if (!m_pPaused)
+		return;
+
+	// Taking the lock makes sure a thread that is about to park sees the change
+	{
+		std::lock_guard<std::mutex> guard(m_pSleepLock);
+		m_pPaused = false;
+	}
+	m_pWakeUp.notify_one();
+}
+
+void SimulationThread::threadMain()
+{
+	typedef std::chrono::steady_clock Clock;
+
+	TRACE_THREAD_NAME("Simulation");
+
+	// Lets the tick function use parallelFor() from this thread
+	JobSystem::attachThread();
+
+	const Clock::duration tickDuration = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_pTickLength));
+	Clock::time_point nextTick = Clock::now();
+	double time = 0.0;
+
+	while (m_pRunning)
+	{
+		if (m_pPaused)
+		{
+			std::unique_lock<std::mutex> guard(m_pSleepLock);
+			m_pWakeUp.wait(guard, [this] { return !m_pPaused || !m_pRunning; });
+
+			// Start ticking from now, not from before the pause
+			nextTick = Clock::now();
+			continue;
+		}
+
+		int ticks = 0;
+		while (Clock::now() >= nextTick && ticks < MAX_CATCH_UP_TICKS)
+		{
+			time += m_pTickLength;
+			m_pTick(m_pTickLength, time);
+			m_pTickCount++;
+
+			nextTick += tickDuration;
+			ticks++;
+		}
+
+		// Too far behind (ie. stopped in a debugger), don't try to catch all of it up
+		if (ticks == MAX_CATCH_UP_TICKS)
+			nextTick = Clock::now() + tickDuration;
+
+		std::this_thread::sleep_until(nextTick);
+	}
+}
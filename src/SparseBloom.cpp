@@ -0,0 +1,211 @@
+#include "SparseBloom.h"
+#include "FrameBufferObject.h"
+#include "Material.h"
+#include "GLState.h"
+#include "RenderStats.h"
+#include "Trace.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Threads per work group in bloomCompact_c.glsl, the other shaders run TILE_SIZE x TILE_SIZE
+#define COMPACT_GROUP_SIZE 64
+
+// First binding point of the buffers, 0 - 3 belong to LightClusters
+#define FIRST_BINDING 4
+
+// Group counts are 3 uints each, the blur's first
+#define COMPOSITE_ARGS_OFFSET (3 * sizeof(GLuint))
+
+SparseBloom::SparseBloom()
+	: classifyMaterial(nullptr),
+	compactMaterial(nullptr),
+	blurMaterial(nullptr),
+	compositeMaterial(nullptr),
+	bloomWidth(0),
+	bloomHeight(0),
+	sceneWidth(0),
+	sceneHeight(0),
+	tilesX(0),
+	tilesY(0),
+	activeWidth(0),
+	activeHeight(0),
+	compositeGroupsX(0),
+	compositeGroupsY(0)
+{
+	memset(buffers, 0, sizeof(buffers));
+}
+
+// Global instances are destroyed after the GL context is gone, the buffers
+// have to be released with destroy() before then
+SparseBloom::~SparseBloom()
+{
+}
+
+bool SparseBloom::isSupported()
+{
+	// The shaders are #version 430, the extensions alone are not enough to compile them
+	return GLEW_VERSION_4_3 != 0;
+}
+
+void SparseBloom::create(unsigned int bloomW, unsigned int bloomH, unsigned int sceneW, unsigned int sceneH,
+	Material* classify, Material* compact, Material* blurMat, Material* compositeMat)
+{
+	if (buffers[0])
+		destroy();
+
+	classifyMaterial = classify;
+	compactMaterial = compact;
+	blurMaterial = blurMat;
+	compositeMaterial = compositeMat;
+
+	bloomWidth = bloomW;
+	bloomHeight = bloomH;
+	sceneWidth = sceneW;
+	sceneHeight = sceneH;
+	tilesX = (bloomWidth + TILE_SIZE - 1) / TILE_SIZE;
+	tilesY = (bloomHeight + TILE_SIZE - 1) / TILE_SIZE;
+	activeWidth = bloomWidth;
+	activeHeight = bloomHeight;
+
+	const GLsizeiptr sizes[NUM_BUFFERS] =
+	{
+		(GLsizeiptr)(tilesX * tilesY * sizeof(GLuint)),
+		(GLsizeiptr)(tilesX * tilesY * sizeof(GLuint)),
+		(GLsizeiptr)(6 * sizeof(GLuint))
+	};
+
+	glGenBuffers(NUM_BUFFERS, buffers);
+	for (int i = 0; i < NUM_BUFFERS; i++)
+	{
+		GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[i]);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[i], 0, GL_DYNAMIC_DRAW);
+	}
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void SparseBloom::bindBuffers()
+{
+	for (int i = 0; i < NUM_BUFFERS; i++)
+		GLState::bindBufferBase(GL_SHADER_STORAGE_BUFFER, FIRST_BINDING + i, buffers[i]);
+
+	GLState::bindBuffer(GL_DISPATCH_INDIRECT_BUFFER, buffers[DISPATCH_ARGS]);
+}
+
+void SparseBloom::classify(FrameBufferObject& bloom, int blurPasses, float scale)
+{
+	if (!buffers[0])
+		return;
+
+	TRACE_SCOPE("SparseBloom::classify");
+
+	// Same rounding as the viewport the bloom was drawn with
+	activeWidth = std::max((unsigned int)(bloomWidth * scale + 0.5f), 1u);
+	activeHeight = std::max((unsigned int)(bloomHeight * scale + 0.5f), 1u);
+
+	// A tile covers up to ceil(TILE_SIZE * scale) scene pixels per axis, TILE_SIZE per group
+	float scaleX = (float)sceneWidth / (float)activeWidth;
+	float scaleY = (float)sceneHeight / (float)activeHeight;
+	compositeGroupsX = ((unsigned int)ceilf(TILE_SIZE * scaleX) + TILE_SIZE - 1) / TILE_SIZE;
+	compositeGroupsY = ((unsigned int)ceilf(TILE_SIZE * scaleY) + TILE_SIZE - 1) / TILE_SIZE;
+
+	// The counters start at zero, the composite's other group counts follow the scale
+	const GLuint args[6] = { 0, 1, 1, 0, compositeGroupsX, compositeGroupsY };
+	GLState::bindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[DISPATCH_ARGS]);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(args), args);
+	RenderStats::countUpload(sizeof(args));
+
+	bindBuffers();
+	bloom.bindTextureForSampling(0, GL_TEXTURE0);
+
+	// One group per tile, tiles past the active part come out black and are never listed
+	classifyMaterial->setVec4("u_size", glm::vec4((float)activeWidth, (float)activeHeight, (float)tilesX, 0.0f));
+	classifyMaterial->bind();
+	classifyMaterial->sendUniforms();
+	glDispatchCompute(tilesX, tilesY, 1);
+
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	// Every blur pass spreads light one texel further. One tile more keeps a
+	// black border around the listed tiles, so the bilinear composite never
+	// reads light from a tile it does not run on
+	int dilation = blurPasses / TILE_SIZE + 1;
+
+	// One thread per tile
+	compactMaterial->setVec4("u_tiles", glm::vec4((float)tilesX, (float)tilesY, (float)dilation, 0.0f));
+	compactMaterial->bind();
+	compactMaterial->sendUniforms();
+	glDispatchCompute((tilesX * tilesY + COMPACT_GROUP_SIZE - 1) / COMPACT_GROUP_SIZE, 1, 1);
+
+	// The blur and composite read the list, and take their group counts from the counters
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+}
+
+void SparseBloom::blur(FrameBufferObject& source, FrameBufferObject& target, FrameBufferObject& temp, int passes)
+{
+	if (!buffers[0])
+		return;
+
+	TRACE_SCOPE("SparseBloom::blur");
+
+	// Only listed tiles get written, everything else has to be black
+	// The list changes every frame and passes read one texel past their tiles from
+	// both targets, so both are cleared, once per frame since blur() runs once
+	target.bindFrameBufferForDrawing();
+	FrameBufferObject::clearFrameBuffer(glm::vec4(0.0f));
+	temp.bindFrameBufferForDrawing();
+	FrameBufferObject::clearFrameBuffer(glm::vec4(0.0f));
+
+	bindBuffers();
+
+	blurMaterial->setVec4("u_size", glm::vec4((float)activeWidth, (float)activeHeight, (float)tilesX, 0.0f));
+	blurMaterial->bind();
+	blurMaterial->sendUniforms();
+
+	// The first pass reads source, then temp and target take turns
+	FrameBufferObject* read = &source;
+	for (int i = 0; i < passes; i++)
+	{
+		FrameBufferObject* write = (i % 2 == 0) ? &temp : &target;
+
+		read->bindTextureForSampling(0, GL_TEXTURE0);
+		glBindImageTexture(0, write->getColourTexture(0), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+		glDispatchComputeIndirect(0);
+
+		// The next pass samples what this one stored
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		read = write;
+	}
+}
+
+void SparseBloom::composite(FrameBufferObject& bloom, FrameBufferObject& scene, const glm::ivec4& rect)
+{
+	if (!buffers[0])
+		return;
+
+	TRACE_SCOPE("SparseBloom::composite");
+
+	bindBuffers();
+	bloom.bindTextureForSampling(0, GL_TEXTURE0);
+	glBindImageTexture(0, scene.getColourTexture(0), 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA8);
+
+	compositeMaterial->setVec4("u_bloomSize", glm::vec4((float)activeWidth, (float)activeHeight, (float)tilesX, 0.0f));
+	compositeMaterial->setVec4("u_sceneSize", glm::vec4((float)sceneWidth, (float)sceneHeight, 0.0f, 0.0f));
+	compositeMaterial->setVec4("u_rect", glm::vec4(rect));
+	compositeMaterial->bind();
+	compositeMaterial->sendUniforms();
+	glDispatchComputeIndirect(COMPOSITE_ARGS_OFFSET);
+
+	// The scene texture is drawn to the screen next
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+}
+
+void SparseBloom::destroy()
+{
+	if (buffers[0])
+	{
+		GLState::deleteBuffers(NUM_BUFFERS, buffers);
+		memset(buffers, 0, sizeof(buffers));
+	}
+}
@@ -1,10 +1,30 @@
 #include "TTK/MeshBase.h"
+#include "TTK/MeshSimplifier.h"
+#include "TTK/MeshOptimizer.h"
 #include "GLUT/glut.h"
+#include "GLState.h"
+#include "Trace.h"
 #include <iostream>
 
+TTK::MeshBase::MeshBase()
+	: primitiveType(Triangles)
+{
+	static unsigned int counter = 0;
+	id = ++counter;
+}
+
 void TTK::MeshBase::draw()
 {
-	vbo.draw();
+	vbo.bind();
+	drawBoundLOD(0);
+}
+
+void TTK::MeshBase::drawBoundLOD(unsigned int level)
+{
+	if (level < lods.size())
+		vbo.drawBoundRange(lods[level].firstIndex, lods[level].numIndices);
+	else
+		vbo.drawBound();
 }
 
 void TTK::MeshBase::draw_1_0()
@@ -36,8 +56,8 @@ void TTK::MeshBase::draw_1_0()
 		}
 	}
 
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	GLState::enable(GL_BLEND);
+	GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glTexEnvf(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_ADD);
 
 	if (primitiveType == TTK::PrimitiveType::Quads)
@@ -45,8 +65,17 @@ void TTK::MeshBase::draw_1_0()
 	else
 		glBegin(GL_TRIANGLES);
 
-	for (unsigned int i = 0; i < vertices.size(); i++)
+	// Indexed meshes draw their most detailed level
+	unsigned int count = (unsigned int)vertices.size();
+	if (lods.size() > 0)
+		count = lods[0].numIndices;
+	else if (indices.size() > 0)
+		count = (unsigned int)indices.size();
+
+	for (unsigned int n = 0; n < count; n++)
 	{
+		unsigned int i = indices.size() > 0 ? indices[n] : n;
+
 		glTexCoord2f(textureCoordinates[i].x, textureCoordinates[i].y);
 
 		if (useColours)
@@ -60,7 +89,7 @@ void TTK::MeshBase::draw_1_0()
 
 	glEnd();
 
-	glDisable(GL_BLEND);
+	GLState::disable(GL_BLEND);
 }
 
 void TTK::MeshBase::setAllColours(glm::vec4 colour)
@@ -71,9 +100,106 @@ void TTK::MeshBase::setAllColours(glm::vec4 colour)
 	}
 }
 
+void TTK::MeshBase::computeBounds()
+{
+	if (vertices.size() == 0)
+	{
+		boundsMin = boundsMax = glm::vec3(0.0f);
+		return;
+	}
+
+	boundsMin = boundsMax = vertices[0];
+	for (unsigned int i = 1; i < vertices.size(); i++)
+	{
+		boundsMin = glm::min(boundsMin, vertices[i]);
+		boundsMax = glm::max(boundsMax, vertices[i]);
+	}
+}
+
+void TTK::MeshBase::generateLODs(unsigned int numLevels, float reductionPerLevel)
+{
+	TRACE_SCOPE("MeshBase::generateLODs");
+
+	if (vertices.size() == 0)
+		return;
+
+	// Identical vertices need to be merged before edges can be collapsed
+	if (indices.size() == 0)
+		weldVertices(*this);
+	else
+		indices.resize(lods.size() > 0 ? lods[0].numIndices : indices.size()); // drop old LODs
+
+	std::vector<unsigned int> levelIndices = indices;
+	lods.clear();
+
+	MeshLOD lod0;
+	lod0.firstIndex = 0;
+	lod0.numIndices = (unsigned int)indices.size();
+	lod0.error = 0.0f;
+	lods.push_back(lod0);
+
+	for (unsigned int level = 1; level < numLevels; level++)
+	{
+		unsigned int target = (unsigned int)(levelIndices.size() * reductionPerLevel) / 3 * 3;
+
+		std::vector<unsigned int> simplified;
+		float error = 0.0f;
+		simplifyMesh(*this, levelIndices, simplified, target, error);
+
+		// Not worth a level if it barely removed anything
+		if (simplified.size() == 0 || simplified.size() > levelIndices.size() * 0.9f)
+			break;
+
+		MeshLOD lod;
+		lod.firstIndex = (unsigned int)indices.size();
+		lod.numIndices = (unsigned int)simplified.size();
+		lod.error = glm::max(error, lods.back().error); // keep errors increasing for selectLOD()
+		lods.push_back(lod);
+
+		indices.insert(indices.end(), simplified.begin(), simplified.end());
+		levelIndices.swap(simplified);
+	}
+
+	// Simplifying scrambles the triangle order of the new levels
+	optimizeMesh(*this, "");
+
+	createVBO();
+}
+
+unsigned int TTK::MeshBase::getNumTriangles(unsigned int level)
+{
+	if (level < lods.size())
+		return lods[level].numIndices / 3;
+	else if (indices.size() > 0)
+		return (unsigned int)indices.size() / 3;
+	else
+		return (unsigned int)vertices.size() / 3;
+}
+
+unsigned int TTK::MeshBase::selectLOD(float pixelsPerUnit, unsigned int currentLevel, float maxPixelError, float hysteresis)
+{
+	if (lods.size() < 2)
+		return 0;
+
+	unsigned int level = glm::min(currentLevel, (unsigned int)lods.size() - 1);
+
+	// Current level is too coarse, move to finer levels right away
+	while (level > 0 && lods[level].error * pixelsPerUnit > maxPixelError)
+		level--;
+
+	// Only move to a coarser level once it is comfortably under the threshold
+	while (level + 1 < lods.size() && lods[level + 1].error * pixelsPerUnit < maxPixelError * (1.0f - hysteresis))
+		level++;
+
+	return level;
+}
+
 void TTK::MeshBase::createVBO()
 {
-	unsigned int numTris = (unsigned int)(vertices.size()) / 3; // todo: handle non-triangulated meshes
+	computeBounds();
+
+	// Calling createVBO() again (ie. after generating LODs) starts from scratch
+	vbo.destroy();
 
 	// Setup VBO
 	
@@ -86,7 +212,7 @@ void TTK::MeshBase::createVBO()
 		positionAttrib.data = &vertices[0];
 		positionAttrib.elementSize = sizeof(float);
 		positionAttrib.elementType = GL_FLOAT;
-		positionAttrib.numElements = numTris * 3 * 3; // (num triangles * three vertices per triangle * three floats per vertex)
+		positionAttrib.numElements = (unsigned int)vertices.size() * 3; // (num vertices * three floats per vertex)
 		positionAttrib.numElementsPerAttrib = 3;
 		vbo.addAttributeArray(positionAttrib);
 
@@ -101,7 +227,7 @@ void TTK::MeshBase::createVBO()
 		uvAttrib.data = &textureCoordinates[0];
 		uvAttrib.elementSize = sizeof(float);
 		uvAttrib.elementType = GL_FLOAT;
-		uvAttrib.numElements = numTris * 3 * 2;
+		uvAttrib.numElements = (unsigned int)textureCoordinates.size() * 2;
 		uvAttrib.numElementsPerAttrib = 2;
 		vbo.addAttributeArray(uvAttrib);
 	}
@@ -115,12 +241,16 @@ void TTK::MeshBase::createVBO()
 		normalAttrib.data = &normals[0];
 		normalAttrib.elementSize = sizeof(float);
 		normalAttrib.elementType = GL_FLOAT;
-		normalAttrib.numElements = numTris * 3 * 3;
+		normalAttrib.numElements = (unsigned int)normals.size() * 3;
 		normalAttrib.numElementsPerAttrib = 3;
 		vbo.addAttributeArray(normalAttrib);
 	}
 
 	// set up other attributes...
 
+	// drawBound() only draws the full detail level
+	if (indices.size() > 0)
+		vbo.setIndexArray(&indices[0], (unsigned int)indices.size(), lods.size() > 0 ? lods[0].numIndices : 0);
+
 	vbo.createVBO(GL_STATIC_DRAW);
 }
@@ -0,0 +1,396 @@
+#include "TTK/MeshOptimizer.h"
+#include "Trace.h"
+#include <algorithm>
+#include <iostream>
+
+namespace
+{
+	// Triangles that use each vertex, stored as one array with offsets per vertex
+	struct TriangleAdjacency
+	{
+		std::vector<unsigned int> offsets;
+		std::vector<unsigned int> triangles;
+
+		void build(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices)
+		{
+			offsets.assign(numVertices + 1, 0);
+			for (unsigned int i = 0; i < numIndices; i++)
+				offsets[indices[i] + 1]++;
+
+			for (unsigned int v = 0; v < numVertices; v++)
+				offsets[v + 1] += offsets[v];
+
+			std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+			triangles.resize(numIndices);
+			for (unsigned int i = 0; i < numIndices; i++)
+				triangles[fill[indices[i]]++] = i / 3;
+		}
+	};
+
+	struct Cluster
+	{
+		unsigned int firstTriangle;
+		unsigned int numTriangles;
+		float sortKey;
+	};
+
+	// Index ranges to optimize, every LOD is its own triangle list
+	void getRanges(TTK::MeshBase& mesh, std::vector<TTK::MeshLOD>& ranges)
+	{
+		if (mesh.lods.size() > 0)
+		{
+			ranges = mesh.lods;
+		}
+		else
+		{
+			TTK::MeshLOD all;
+			all.firstIndex = 0;
+			all.numIndices = (unsigned int)mesh.indices.size();
+			all.error = 0.0f;
+			ranges.assign(1, all);
+		}
+	}
+}
+
+TTK::VertexCacheStats TTK::analyzeVertexCache(const unsigned int* indices, unsigned int numIndices, unsigned int numVertices, unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	stats.acmr = 0.0f;
+	stats.atvr = 0.0f;
+
+	if (numIndices < 3)
+		return stats;
+
+	// FIFO cache, a vertex is only added on a miss
+	// cachedAt[v] is the miss count when v entered the cache, it has left once cacheSize more misses happened
+	std::vector<unsigned int> cachedAt(numVertices, 0);
+	std::vector<bool> used(numVertices, false);
+	unsigned int misses = 0, uniqueVertices = 0;
+
+	for (unsigned int i = 0; i < numIndices; i++)
+	{
+		unsigned int v = indices[i];
+
+		if (!used[v])
+		{
+			used[v] = true;
+			uniqueVertices++;
+		}
+		else if (misses - cachedAt[v] < cacheSize)
+		{
+			continue;
+		}
+
+		cachedAt[v] = ++misses;
+	}
+
+	stats.acmr = (float)misses / (float)(numIndices / 3);
+	stats.atvr = uniqueVertices > 0 ? (float)misses / (float)uniqueVertices : 0.0f;
+	return stats;
+}
+
+void TTK::optimizeVertexCache(unsigned int* indices, unsigned int numIndices, unsigned int numVertices, unsigned int cacheSize, std::vector<unsigned int>* clusters)
+{
+	unsigned int numTriangles = numIndices / 3;
+	if (numTriangles == 0)
+		return;
+
+	TriangleAdjacency adjacency;
+	adjacency.build(indices, numIndices, numVertices);
+
+	// Number of triangles not yet emitted for each vertex
+	std::vector<unsigned int> liveTriangles(numVertices);
+	for (unsigned int v = 0; v < numVertices; v++)
+		liveTriangles[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+	// Time stamp of when each vertex entered the cache
+	std::vector<unsigned int> cacheTime(numVertices, 0);
+	std::vector<bool> emitted(numTriangles, false);
+
+	// Recently used vertices, the first place to look when we get stuck
+	std::vector<unsigned int> deadEndStack;
+	deadEndStack.reserve(numIndices);
+
+	std::vector<unsigned int> output;
+	output.reserve(numIndices);
+
+	std::vector<unsigned int> candidates;
+
+	unsigned int time = cacheSize + 1;
+	unsigned int cursor = 0;
+
+	if (clusters)
+		clusters->clear();
+
+	// Start with the first vertex that is used at all
+	int fanning = -1;
+	while (cursor < numVertices && liveTriangles[cursor] == 0)
+		cursor++;
+	if (cursor < numVertices)
+		fanning = cursor;
+
+	bool newCluster = true;
+
+	while (fanning >= 0)
+	{
+		if (newCluster && clusters)
+			clusters->push_back((unsigned int)output.size() / 3);
+		newCluster = false;
+
+		// Emit every triangle around the fanning vertex
+		candidates.clear();
+		for (unsigned int i = adjacency.offsets[fanning]; i < adjacency.offsets[fanning + 1]; i++)
+		{
+			unsigned int t = adjacency.triangles[i];
+			if (emitted[t])
+				continue;
+
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				output.push_back(v);
+				deadEndStack.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+
+				// Not in the cache, it gets loaded now
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+
+			emitted[t] = true;
+		}
+
+		// Next fanning vertex: the one in the 1-ring that will still be in the
+		// cache after its remaining triangles are emitted, and has been there longest
+		int best = -1;
+		int bestPriority = -1;
+		for (unsigned int i = 0; i < candidates.size(); i++)
+		{
+			unsigned int v = candidates[i];
+			if (liveTriangles[v] == 0)
+				continue;
+
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize)
+				priority = time - cacheTime[v];
+
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				best = v;
+			}
+		}
+
+		if (best < 0)
+		{
+			// Dead end, try recently used vertices first, then just scan for anything left
+			while (!deadEndStack.empty() && best < 0)
+			{
+				unsigned int v = deadEndStack.back();
+				deadEndStack.pop_back();
+				if (liveTriangles[v] > 0)
+					best = v;
+			}
+
+			while (best < 0 && cursor < numVertices)
+			{
+				if (liveTriangles[cursor] > 0)
+					best = cursor;
+				else
+					cursor++;
+			}
+
+			// Jumping somewhere else breaks the locality, this is where a new cluster starts
+			newCluster = true;
+		}
+
+		fanning = best;
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void TTK::optimizeOverdraw(unsigned int* indices, unsigned int numIndices, const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& hardClusters, float threshold)
+{
+	unsigned int numTriangles = numIndices / 3;
+	unsigned int numVertices = (unsigned int)positions.size();
+	if (numTriangles == 0)
+		return;
+
+	// Tipsify only flushes the cache a few times, which gives very few clusters to sort.
+	// Split the clusters further wherever starting over with an empty cache would
+	// keep the cluster's miss ratio within threshold of the whole mesh's.
+	float meshACMR = analyzeVertexCache(indices, numIndices, numVertices).acmr;
+
+	std::vector<unsigned int> clusterStarts;
+	std::vector<unsigned int> cachedAt(numVertices, 0);
+	std::vector<unsigned int> cacheGeneration(numVertices, 0);
+	unsigned int generation = 0;
+
+	for (unsigned int c = 0; c < hardClusters.size(); c++)
+	{
+		unsigned int end = c + 1 < hardClusters.size() ? hardClusters[c + 1] : numTriangles;
+		unsigned int start = hardClusters[c];
+		unsigned int misses = 0;
+
+		clusterStarts.push_back(start);
+		generation++;
+
+		for (unsigned int t = start; t < end; t++)
+		{
+			// Same FIFO simulation as analyzeVertexCache(), starting empty at the cluster start
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int v = indices[t * 3 + k];
+				if (cacheGeneration[v] == generation && misses - cachedAt[v] < VERTEX_CACHE_SIZE)
+					continue;
+
+				cacheGeneration[v] = generation;
+				cachedAt[v] = ++misses;
+			}
+
+			if (t + 1 < end && (float)misses / (float)(t - start + 1) <= meshACMR * threshold)
+			{
+				clusterStarts.push_back(t + 1);
+				start = t + 1;
+				misses = 0;
+				generation++;
+			}
+		}
+	}
+
+	if (clusterStarts.size() < 2)
+		return;
+
+	// Area weighted center of the whole mesh
+	glm::vec3 meshCenter(0.0f);
+	float meshArea = 0.0f;
+
+	std::vector<Cluster> clusters(clusterStarts.size());
+	std::vector<glm::vec3> clusterCenters(clusters.size()), clusterNormals(clusters.size());
+
+	for (unsigned int c = 0; c < clusters.size(); c++)
+	{
+		clusters[c].firstTriangle = clusterStarts[c];
+		clusters[c].numTriangles = (c + 1 < clusters.size() ? clusterStarts[c + 1] : numTriangles) - clusterStarts[c];
+
+		glm::vec3 center(0.0f), normal(0.0f);
+		float area = 0.0f;
+
+		for (unsigned int t = clusters[c].firstTriangle; t < clusters[c].firstTriangle + clusters[c].numTriangles; t++)
+		{
+			const glm::vec3& p0 = positions[indices[t * 3]];
+			const glm::vec3& p1 = positions[indices[t * 3 + 1]];
+			const glm::vec3& p2 = positions[indices[t * 3 + 2]];
+
+			glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+			float triangleArea = glm::length(n) * 0.5f;
+
+			center += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += n;
+			area += triangleArea;
+		}
+
+		meshCenter += center;
+		meshArea += area;
+
+		clusterCenters[c] = area > 0.0f ? center / area : positions[indices[clusters[c].firstTriangle * 3]];
+		clusterNormals[c] = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f);
+	}
+
+	if (meshArea > 0.0f)
+		meshCenter /= meshArea;
+
+	// Clusters far out and facing outwards are likely to cover the rest of the mesh, draw them first
+	for (unsigned int c = 0; c < clusters.size(); c++)
+		clusters[c].sortKey = glm::dot(clusterCenters[c] - meshCenter, clusterNormals[c]);
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.sortKey > b.sortKey; });
+
+	std::vector<unsigned int> output;
+	output.reserve(numIndices);
+	for (unsigned int c = 0; c < clusters.size(); c++)
+	{
+		unsigned int first = clusters[c].firstTriangle * 3;
+		output.insert(output.end(), indices + first, indices + first + clusters[c].numTriangles * 3);
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+void TTK::optimizeVertexFetch(MeshBase& mesh)
+{
+	unsigned int numVertices = (unsigned int)mesh.vertices.size();
+	const unsigned int UNUSED = ~0u;
+
+	// New index of every vertex, in the order the indices first use them
+	std::vector<unsigned int> remap(numVertices, UNUSED);
+	unsigned int nextVertex = 0;
+
+	for (unsigned int i = 0; i < mesh.indices.size(); i++)
+	{
+		unsigned int v = mesh.indices[i];
+		if (remap[v] == UNUSED)
+			remap[v] = nextVertex++;
+		mesh.indices[i] = remap[v];
+	}
+
+	bool hasNormals = mesh.normals.size() == numVertices;
+	bool hasUVs = mesh.textureCoordinates.size() == numVertices;
+	bool hasColours = mesh.colours.size() == numVertices;
+
+	std::vector<glm::vec3> vertices(nextVertex), normals(hasNormals ? nextVertex : 0);
+	std::vector<glm::vec2> uvs(hasUVs ? nextVertex : 0);
+	std::vector<glm::vec4> colours(hasColours ? nextVertex : 0);
+
+	// Vertices no level uses are dropped
+	for (unsigned int v = 0; v < numVertices; v++)
+	{
+		unsigned int n = remap[v];
+		if (n == UNUSED)
+			continue;
+
+		vertices[n] = mesh.vertices[v];
+		if (hasNormals) normals[n] = mesh.normals[v];
+		if (hasUVs) uvs[n] = mesh.textureCoordinates[v];
+		if (hasColours) colours[n] = mesh.colours[v];
+	}
+
+	mesh.vertices.swap(vertices);
+	if (hasNormals) mesh.normals.swap(normals);
+	if (hasUVs) mesh.textureCoordinates.swap(uvs);
+	if (hasColours) mesh.colours.swap(colours);
+}
+
+void TTK::optimizeMesh(MeshBase& mesh, const std::string& name)
+{
+	TRACE_SCOPE("optimizeMesh");
+
+	if (mesh.indices.size() == 0)
+		return;
+
+	std::vector<MeshLOD> ranges;
+	getRanges(mesh, ranges);
+
+	unsigned int numVertices = (unsigned int)mesh.vertices.size();
+	VertexCacheStats before = analyzeVertexCache(&mesh.indices[ranges[0].firstIndex], ranges[0].numIndices, numVertices);
+
+	std::vector<unsigned int> clusters;
+	for (unsigned int i = 0; i < ranges.size(); i++)
+	{
+		unsigned int* indices = &mesh.indices[ranges[i].firstIndex];
+		optimizeVertexCache(indices, ranges[i].numIndices, numVertices, VERTEX_CACHE_SIZE, &clusters);
+		optimizeOverdraw(indices, ranges[i].numIndices, mesh.vertices, clusters);
+	}
+
+	optimizeVertexFetch(mesh);
+
+	if (name.size() > 0)
+	{
+		VertexCacheStats after = analyzeVertexCache(&mesh.indices[ranges[0].firstIndex], ranges[0].numIndices, (unsigned int)mesh.vertices.size());
+
+		std::cout << name << ": ACMR " << before.acmr << " -> " << after.acmr
+			<< ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+	}
+}
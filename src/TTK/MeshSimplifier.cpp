@@ -0,0 +1,444 @@
+#include "TTK/MeshSimplifier.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+// Boundary edges get an extra plane so the outline of open meshes is kept
+#define BOUNDARY_WEIGHT 10.0
+
+namespace
+{
+	// Symmetric 4x4 matrix, sum of squared distances to a set of planes
+	// Also keeps the total weight so the error can be turned back into a distance
+	struct Quadric
+	{
+		double a2, ab, ac, ad;
+		double b2, bc, bd;
+		double c2, cd;
+		double d2;
+		double weight;
+
+		void clear()
+		{
+			*this = Quadric();
+		}
+
+		void addPlane(const glm::dvec3& n, double d, double w)
+		{
+			a2 += n.x * n.x * w; ab += n.x * n.y * w; ac += n.x * n.z * w; ad += n.x * d * w;
+			b2 += n.y * n.y * w; bc += n.y * n.z * w; bd += n.y * d * w;
+			c2 += n.z * n.z * w; cd += n.z * d * w;
+			d2 += d * d * w;
+			weight += w;
+		}
+
+		void add(const Quadric& q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+			b2 += q.b2; bc += q.bc; bd += q.bd;
+			c2 += q.c2; cd += q.cd;
+			d2 += q.d2;
+			weight += q.weight;
+		}
+
+		// Weighted average distance from p to the planes
+		double error(const glm::vec3& point) const
+		{
+			double x = point.x, y = point.y, z = point.z;
+			double e = a2 * x * x + 2.0 * ab * x * y + 2.0 * ac * x * z + 2.0 * ad * x
+				+ b2 * y * y + 2.0 * bc * y * z + 2.0 * bd * y
+				+ c2 * z * z + 2.0 * cd * z
+				+ d2;
+
+			return weight > 0.0 ? sqrt(std::max(e, 0.0) / weight) : 0.0;
+		}
+	};
+
+	struct Collapse
+	{
+		unsigned int from, to; // position groups
+		float error;
+
+		bool operator<(const Collapse& other) const { return error < other.error; }
+	};
+
+	// Edge of one triangle, used to find the boundary
+	struct TriangleEdge
+	{
+		unsigned int from, to;	// position groups, smaller first
+		unsigned int triangle;	// first index of the triangle in the index list
+	};
+
+	// Vertex attributes compared when welding
+	struct WeldKey
+	{
+		glm::vec3 position;
+		glm::vec3 normal;
+		glm::vec2 uv;
+		glm::vec4 colour;
+		unsigned int vertex;
+	};
+
+	bool weldLess(const WeldKey& a, const WeldKey& b)
+	{
+		// Compare the attributes as raw floats, the vertex index is not part of the key
+		return memcmp(&a, &b, offsetof(WeldKey, vertex)) < 0;
+	}
+
+	bool weldEqual(const WeldKey& a, const WeldKey& b)
+	{
+		return memcmp(&a, &b, offsetof(WeldKey, vertex)) == 0;
+	}
+
+	bool positionLess(const WeldKey& a, const WeldKey& b)
+	{
+		return memcmp(&a.position, &b.position, sizeof(glm::vec3)) < 0;
+	}
+
+	glm::vec3 triangleNormal(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+	{
+		return glm::cross(b - a, c - a);
+	}
+
+	// Squared difference between two vertices' normals and uvs
+	float attributeDistance(TTK::MeshBase& mesh, unsigned int a, unsigned int b)
+	{
+		float d = 0.0f;
+		if (mesh.normals.size() > 0)
+		{
+			glm::vec3 n = mesh.normals[a] - mesh.normals[b];
+			d += glm::dot(n, n);
+		}
+		if (mesh.textureCoordinates.size() > 0)
+		{
+			glm::vec2 uv = mesh.textureCoordinates[a] - mesh.textureCoordinates[b];
+			d += glm::dot(uv, uv);
+		}
+		return d;
+	}
+}
+
+void TTK::weldVertices(MeshBase& mesh)
+{
+	unsigned int numVertices = (unsigned int)mesh.vertices.size();
+	bool hasNormals = mesh.normals.size() == numVertices;
+	bool hasUVs = mesh.textureCoordinates.size() == numVertices;
+	bool hasColours = mesh.colours.size() == numVertices;
+
+	// Sort copies of every vertex so identical ones end up next to each other
+	std::vector<WeldKey> keys(numVertices);
+	for (unsigned int i = 0; i < numVertices; i++)
+	{
+		keys[i] = WeldKey{};
+		keys[i].position = mesh.vertices[i];
+		if (hasNormals) keys[i].normal = mesh.normals[i];
+		if (hasUVs) keys[i].uv = mesh.textureCoordinates[i];
+		if (hasColours) keys[i].colour = mesh.colours[i];
+		keys[i].vertex = i;
+	}
+
+	std::sort(keys.begin(), keys.end(), weldLess);
+
+	std::vector<unsigned int> remap(numVertices);
+	std::vector<glm::vec3> vertices, normals;
+	std::vector<glm::vec2> uvs;
+	std::vector<glm::vec4> colours;
+
+	for (unsigned int i = 0; i < numVertices; i++)
+	{
+		if (i == 0 || !weldEqual(keys[i], keys[i - 1]))
+		{
+			vertices.push_back(keys[i].position);
+			if (hasNormals) normals.push_back(keys[i].normal);
+			if (hasUVs) uvs.push_back(keys[i].uv);
+			if (hasColours) colours.push_back(keys[i].colour);
+		}
+
+		remap[keys[i].vertex] = (unsigned int)vertices.size() - 1;
+	}
+
+	// Unindexed meshes use every vertex once, in order
+	std::vector<unsigned int> indices;
+	if (mesh.indices.size() > 0)
+	{
+		indices.resize(mesh.indices.size());
+		for (unsigned int i = 0; i < mesh.indices.size(); i++)
+			indices[i] = remap[mesh.indices[i]];
+	}
+	else
+	{
+		indices = remap;
+	}
+
+	mesh.vertices.swap(vertices);
+	mesh.indices.swap(indices);
+	if (hasNormals) mesh.normals.swap(normals);
+	if (hasUVs) mesh.textureCoordinates.swap(uvs);
+	if (hasColours) mesh.colours.swap(colours);
+	mesh.lods.clear();
+}
+
+void TTK::simplifyMesh(MeshBase& mesh, const std::vector<unsigned int>& srcIndices, std::vector<unsigned int>& outIndices, unsigned int targetIndexCount, float& outError)
+{
+	unsigned int numVertices = (unsigned int)mesh.vertices.size();
+	const std::vector<glm::vec3>& positions = mesh.vertices;
+
+	outIndices = srcIndices;
+	outError = 0.0f;
+
+	// Vertices split along uv / normal seams share a position, the simplifier
+	// works on positions ("groups") so both sides of a seam collapse together
+	std::vector<WeldKey> keys(numVertices);
+	for (unsigned int i = 0; i < numVertices; i++)
+	{
+		keys[i] = WeldKey{};
+		keys[i].position = positions[i];
+		keys[i].vertex = i;
+	}
+	std::sort(keys.begin(), keys.end(), positionLess);
+
+	std::vector<unsigned int> group(numVertices);
+	std::vector<unsigned int> groupFirst;	// first entry in keys for each group
+	for (unsigned int i = 0; i < numVertices; i++)
+	{
+		if (i == 0 || memcmp(&keys[i].position, &keys[i - 1].position, sizeof(glm::vec3)) != 0)
+			groupFirst.push_back(i);
+
+		group[keys[i].vertex] = (unsigned int)groupFirst.size() - 1;
+	}
+	unsigned int numGroups = (unsigned int)groupFirst.size();
+	groupFirst.push_back(numVertices);
+
+	// Quadric of every group, from the planes of the triangles around it
+	std::vector<Quadric> quadrics(numGroups);
+	for (unsigned int i = 0; i < numGroups; i++)
+		quadrics[i].clear();
+
+	std::vector<TriangleEdge> triangleEdges;
+	for (unsigned int i = 0; i + 2 < outIndices.size(); i += 3)
+	{
+		glm::dvec3 p0 = positions[outIndices[i]];
+		glm::dvec3 n = glm::cross(glm::dvec3(positions[outIndices[i + 1]]) - p0, glm::dvec3(positions[outIndices[i + 2]]) - p0);
+		double area = glm::length(n);
+		if (area <= 0.0)
+			continue;
+
+		n /= area;
+		for (int k = 0; k < 3; k++)
+			quadrics[group[outIndices[i + k]]].addPlane(n, -glm::dot(n, p0), area * 0.5);
+
+		// Remember each edge once per triangle, with the smaller group first
+		for (int k = 0; k < 3; k++)
+		{
+			unsigned int a = group[outIndices[i + k]];
+			unsigned int b = group[outIndices[i + (k + 1) % 3]];
+			TriangleEdge edge;
+			edge.from = std::min(a, b);
+			edge.to = std::max(a, b);
+			edge.triangle = i; // needed to build the boundary plane
+			triangleEdges.push_back(edge);
+		}
+	}
+
+	// Edges used by only one triangle are on the boundary
+	// Add a plane through the edge, perpendicular to its triangle, to both ends
+	auto edgeLess = [](const TriangleEdge& a, const TriangleEdge& b) { return a.from != b.from ? a.from < b.from : a.to < b.to; };
+	std::sort(triangleEdges.begin(), triangleEdges.end(), edgeLess);
+
+	for (unsigned int i = 0; i < triangleEdges.size(); i++)
+	{
+		const TriangleEdge& edge = triangleEdges[i];
+		bool sharedBefore = i > 0 && triangleEdges[i - 1].from == edge.from && triangleEdges[i - 1].to == edge.to;
+		bool sharedAfter = i + 1 < triangleEdges.size() && triangleEdges[i + 1].from == edge.from && triangleEdges[i + 1].to == edge.to;
+		if (sharedBefore || sharedAfter)
+			continue;
+
+		unsigned int tri = edge.triangle;
+		glm::dvec3 p0 = positions[keys[groupFirst[edge.from]].vertex];
+		glm::dvec3 p1 = positions[keys[groupFirst[edge.to]].vertex];
+		glm::dvec3 faceNormal = triangleNormal(positions[outIndices[tri]], positions[outIndices[tri + 1]], positions[outIndices[tri + 2]]);
+
+		glm::dvec3 edgeDir = p1 - p0;
+		double edgeLength = glm::length(edgeDir);
+		glm::dvec3 n = glm::cross(edgeDir, faceNormal);
+		double nLength = glm::length(n);
+		if (edgeLength <= 0.0 || nLength <= 0.0)
+			continue;
+
+		n /= nLength;
+		double w = edgeLength * edgeLength * BOUNDARY_WEIGHT;
+		quadrics[edge.from].addPlane(n, -glm::dot(n, p0), w);
+		quadrics[edge.to].addPlane(n, -glm::dot(n, p0), w);
+	}
+	triangleEdges.clear();
+	triangleEdges.shrink_to_fit();
+
+	// Per pass scratch
+	std::vector<Collapse> edges;
+	std::vector<unsigned int> triangleOffsets(numGroups + 1), triangleCounts(numGroups), groupTriangles;
+	std::vector<unsigned int> vertexRemap(numVertices);
+	std::vector<bool> locked(numGroups);
+
+	for (unsigned int i = 0; i < numVertices; i++)
+		vertexRemap[i] = i;
+
+	// Each pass collapses as many independent edges as it can, cheapest first
+	while (outIndices.size() > targetIndexCount)
+	{
+		unsigned int numTriangles = (unsigned int)outIndices.size() / 3;
+
+		// Triangles around each group
+		std::fill(triangleCounts.begin(), triangleCounts.end(), 0);
+		for (unsigned int i = 0; i < outIndices.size(); i++)
+			triangleCounts[group[outIndices[i]]]++;
+
+		triangleOffsets[0] = 0;
+		for (unsigned int g = 0; g < numGroups; g++)
+			triangleOffsets[g + 1] = triangleOffsets[g] + triangleCounts[g];
+
+		groupTriangles.resize(outIndices.size());
+		std::fill(triangleCounts.begin(), triangleCounts.end(), 0);
+		for (unsigned int i = 0; i < outIndices.size(); i++)
+		{
+			unsigned int g = group[outIndices[i]];
+			groupTriangles[triangleOffsets[g] + triangleCounts[g]++] = i / 3;
+		}
+
+		// Every edge, collapsed in whichever direction is cheaper
+		edges.clear();
+		for (unsigned int t = 0; t < numTriangles; t++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				unsigned int a = group[outIndices[t * 3 + k]];
+				unsigned int b = group[outIndices[t * 3 + (k + 1) % 3]];
+
+				// Shared edges show up once for each triangle, the second copy
+				// is skipped below because the first one locks both ends
+				if (a == b)
+					continue;
+
+				Quadric q = quadrics[a];
+				q.add(quadrics[b]);
+
+				glm::vec3 pa = positions[keys[groupFirst[a]].vertex];
+				glm::vec3 pb = positions[keys[groupFirst[b]].vertex];
+				float errorToB = (float)q.error(pb);
+				float errorToA = (float)q.error(pa);
+
+				Collapse collapse;
+				collapse.from = errorToB <= errorToA ? a : b;
+				collapse.to = errorToB <= errorToA ? b : a;
+				collapse.error = std::min(errorToA, errorToB);
+				edges.push_back(collapse);
+			}
+		}
+
+		std::sort(edges.begin(), edges.end());
+
+		// Each collapse removes about two triangles
+		unsigned int collapsesWanted = std::max(1u, (unsigned int)(outIndices.size() - targetIndexCount) / 6);
+		unsigned int collapsesMade = 0;
+
+		std::fill(locked.begin(), locked.end(), false);
+
+		for (unsigned int e = 0; e < edges.size() && collapsesMade < collapsesWanted; e++)
+		{
+			unsigned int from = edges[e].from;
+			unsigned int to = edges[e].to;
+
+			if (locked[from] || locked[to])
+				continue;
+
+			glm::vec3 newPosition = positions[keys[groupFirst[to]].vertex];
+
+			// Moving 'from' must not flip any of the triangles that survive the collapse
+			bool flips = false;
+			for (unsigned int i = triangleOffsets[from]; i < triangleOffsets[from + 1] && !flips; i++)
+			{
+				unsigned int t = groupTriangles[i] * 3;
+				glm::vec3 p[3];
+				bool hasTo = false;
+				for (int k = 0; k < 3; k++)
+				{
+					unsigned int g = group[outIndices[t + k]];
+					hasTo |= g == to;
+					p[k] = positions[outIndices[t + k]];
+				}
+
+				// This triangle collapses to nothing, it can not flip
+				if (hasTo)
+					continue;
+
+				glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+				for (int k = 0; k < 3; k++)
+				{
+					if (group[outIndices[t + k]] == from)
+						p[k] = newPosition;
+				}
+				glm::vec3 after = triangleNormal(p[0], p[1], p[2]);
+
+				if (glm::dot(before, after) <= 0.0f)
+					flips = true;
+			}
+
+			if (flips)
+				continue;
+
+			// Every vertex at 'from' moves to the vertex at 'to' with the closest normal and uv
+			for (unsigned int i = groupFirst[from]; i < groupFirst[from + 1]; i++)
+			{
+				unsigned int v = keys[i].vertex;
+				unsigned int best = keys[groupFirst[to]].vertex;
+				float bestDistance = attributeDistance(mesh, v, best);
+
+				for (unsigned int j = groupFirst[to] + 1; j < groupFirst[to + 1]; j++)
+				{
+					float distance = attributeDistance(mesh, v, keys[j].vertex);
+					if (distance < bestDistance)
+					{
+						bestDistance = distance;
+						best = keys[j].vertex;
+					}
+				}
+
+				vertexRemap[v] = best;
+			}
+
+			quadrics[to].add(quadrics[from]);
+			outError = std::max(outError, edges[e].error);
+
+			// The triangles around 'from' changed, nothing touching them can be collapsed this pass
+			locked[from] = locked[to] = true;
+			for (unsigned int i = triangleOffsets[from]; i < triangleOffsets[from + 1]; i++)
+			{
+				unsigned int t = groupTriangles[i] * 3;
+				for (int k = 0; k < 3; k++)
+					locked[group[outIndices[t + k]]] = true;
+			}
+
+			collapsesMade++;
+		}
+
+		if (collapsesMade == 0)
+			break;
+
+		// Apply the collapses and drop triangles that became degenerate
+		unsigned int writeIndex = 0;
+		for (unsigned int i = 0; i < outIndices.size(); i += 3)
+		{
+			unsigned int v0 = vertexRemap[outIndices[i]];
+			unsigned int v1 = vertexRemap[outIndices[i + 1]];
+			unsigned int v2 = vertexRemap[outIndices[i + 2]];
+
+			unsigned int g0 = group[v0], g1 = group[v1], g2 = group[v2];
+			if (g0 == g1 || g1 == g2 || g0 == g2)
+				continue;
+
+			outIndices[writeIndex++] = v0;
+			outIndices[writeIndex++] = v1;
+			outIndices[writeIndex++] = v2;
+		}
+		outIndices.resize(writeIndex);
+	}
+}
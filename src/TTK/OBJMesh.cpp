@@ -1,4 +1,7 @@
 #include "TTK/OBJMesh.h"
+#include "TTK/MeshSimplifier.h"
+#include "TTK/MeshOptimizer.h"
+#include "Trace.h"
 #include "glm/glm.hpp"
 #include <vector>
 #include <fstream>
@@ -14,6 +17,8 @@ typedef struct
 
 void TTK::OBJMesh::loadMesh(std::string filename)
 {
+	TRACE_SCOPE_DETAIL("OBJMesh::loadMesh", filename.c_str());
+
 	std::ifstream file;
 
 	//open file
@@ -102,6 +107,10 @@ void TTK::OBJMesh::loadMesh(std::string filename)
 		textureCoordinates.push_back(objUVs[face->texture3 - 1]);
 	}
 
+	// Index the mesh and reorder it for the vertex cache, early-z and vertex fetch
+	weldVertices(*this);
+	optimizeMesh(*this, filename);
+
 	createVBO();
 }
 
@@ -1,5 +1,7 @@
 #include <GLEW/glew.h>
 #include "TTK/Texture2D.h"
+#include "GLState.h"
+#include "RenderStats.h"
 #include "FreeImage/FreeImage.h"
 #include <iostream>
 
@@ -50,14 +52,12 @@ GLenum TTK::Texture2D::dataType()
 
 void TTK::Texture2D::bind(GLenum textureUnit /* = GL_TEXTURE0 */)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(m_pTarget, m_pTexID);
+	GLState::bindTexture(textureUnit, m_pTarget, m_pTexID);
 }
 
 void TTK::Texture2D::unbind(GLenum textureUnit /* = GL_TEXTURE0 */)
 {
-	glActiveTexture(textureUnit);
-	glBindTexture(m_pTarget, 0);
+	GLState::bindTexture(textureUnit, m_pTarget, 0);
 }
 
 void TTK::Texture2D::loadTextureFromFile(std::string filePath, bool createGLTexture, bool flipY, bool keepTextureInMemory)
@@ -159,7 +159,7 @@ void TTK::Texture2D::createTexture(int w, int h, GLenum target, GLenum filtering
 		deleteTexture();
 
 	glGenTextures(1, &m_pTexID);
-	glBindTexture(target, m_pTexID);
+	GLState::bindTexture(GLState::getActiveTexture(), target, m_pTexID);
 	error = glGetError();
 
 	glTexParameteri(m_pTarget, GL_TEXTURE_MIN_FILTER, filtering);
@@ -171,16 +171,24 @@ void TTK::Texture2D::createTexture(int w, int h, GLenum target, GLenum filtering
 	glTexImage2D(m_pTarget, 0, internalFormat, w, h, 0, textureFormat, dataType, newDataPtr);
 	error = glGetError();
 
+	// Render targets are created without data, only count real uploads
+	if (newDataPtr)
+	{
+		int numComponents = textureFormat == GL_RED ? 1 : textureFormat == GL_RG ? 2 : (textureFormat == GL_RGB || textureFormat == GL_BGR) ? 3 : 4;
+		int componentSize = (dataType == GL_UNSIGNED_BYTE || dataType == GL_BYTE) ? 1 : (dataType == GL_UNSIGNED_SHORT || dataType == GL_SHORT || dataType == GL_HALF_FLOAT) ? 2 : 4;
+		RenderStats::countUpload((size_t)w * h * numComponents * componentSize);
+	}
+
 	if (error != 0)
 		std::cout << "There was an error somewhere when creating texture. " << std::endl;
 
-	glBindTexture(m_pTarget, 0);
+	GLState::bindTexture(GLState::getActiveTexture(), m_pTarget, 0);
 }
 
 
 void TTK::Texture2D::deleteTexture()
 {
-	glDeleteTextures(1, &m_pTexID);
+	GLState::deleteTextures(1, &m_pTexID);
 }
 
 unsigned int TTK::Texture2D::id()
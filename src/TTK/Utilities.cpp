@@ -34,6 +34,33 @@ std::shared_ptr<TTK::MeshBase> createQuadMesh()
 	return quadMesh;
 }
 
+std::shared_ptr<TTK::MeshBase> createBoxMesh()
+{
+	std::shared_ptr<TTK::MeshBase> boxMesh = std::make_shared<TTK::MeshBase>();
+
+	glm::vec3 corners[8];
+	for (int i = 0; i < 8; i++)
+		corners[i] = glm::vec3((i & 1) ? 0.5f : -0.5f, (i & 2) ? 0.5f : -0.5f, (i & 4) ? 0.5f : -0.5f);
+
+	// Two triangles per face, indices into the corners above
+	const int faces[36] =
+	{
+		0, 2, 3,  0, 3, 1, // -z
+		4, 5, 7,  4, 7, 6, // +z
+		0, 4, 6,  0, 6, 2, // -x
+		1, 3, 7,  1, 7, 5, // +x
+		0, 1, 5,  0, 5, 4, // -y
+		2, 6, 7,  2, 7, 3  // +y
+	};
+
+	for (int i = 0; i < 36; i++)
+		boxMesh->vertices.push_back(corners[faces[i]]);
+
+	boxMesh->createVBO();
+
+	return boxMesh;
+}
+
 float randomFloat01()
 {
 	return (float)rand() / (float)RAND_MAX;
@@ -0,0 +1,330 @@
+#include "Trace.h"
+
+#ifdef TRACING_ENABLED
+
+#include "GLEW/glew.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace Trace
+{
+	namespace
+	{
+		struct Event
+		{
+			const char* name;
+			char detail[MAX_DETAIL_LENGTH + 1];
+			uint64_t start;
+			uint64_t end;
+		};
+
+		// Only the owning thread writes events, endSession() reads the first count of them
+		struct ThreadBuffer
+		{
+			unsigned int threadId;
+			char threadName[32];
+			std::atomic<unsigned int> session;
+			std::atomic<unsigned int> count;
+			unsigned int dropped;
+			Event events[MAX_EVENTS_PER_THREAD];
+		};
+
+		struct GPUZoneSlot
+		{
+			const char* name;
+			GLuint queries[2];
+			bool pending;
+		};
+
+		std::atomic<bool> active(false);
+
+		// Buffers remember which session they were last written in and empty
+		// themselves when that changes, so beginSession() never touches another thread's buffer
+		std::atomic<unsigned int> currentSession(0);
+
+		uint64_t sessionStart = 0;
+
+		std::mutex registerMutex;
+		std::vector<std::unique_ptr<ThreadBuffer>> threadBuffers;
+		thread_local ThreadBuffer* localBuffer = nullptr;
+
+		// GPU zones are written into their own buffer on the GL thread
+		ThreadBuffer* gpuBuffer = nullptr;
+		GPUZoneSlot gpuZones[MAX_GPU_ZONES];
+		unsigned int gpuZoneHead = 0;	// next slot to hand out
+		unsigned int gpuZoneTail = 0;	// oldest slot still waiting for its queries
+
+		// Threads that never named themselves pass nullptr and get a numbered name
+		ThreadBuffer* registerBuffer(const char* name)
+		{
+			std::lock_guard<std::mutex> lock(registerMutex);
+
+			std::unique_ptr<ThreadBuffer> buffer(new ThreadBuffer());
+			buffer->threadId = (unsigned int)threadBuffers.size() + 1;
+			if (name)
+				snprintf(buffer->threadName, sizeof(buffer->threadName), "%s", name);
+			else
+				snprintf(buffer->threadName, sizeof(buffer->threadName), "Thread %u", buffer->threadId);
+			buffer->session = currentSession.load();
+			buffer->count = 0;
+			buffer->dropped = 0;
+
+			ThreadBuffer* result = buffer.get();
+			threadBuffers.push_back(std::move(buffer));
+			return result;
+		}
+
+		ThreadBuffer* getLocalBuffer()
+		{
+			if (!localBuffer)
+				localBuffer = registerBuffer(nullptr);
+			return localBuffer;
+		}
+
+		void pushEvent(ThreadBuffer* buffer, const char* name, const char* detail, uint64_t start, uint64_t end)
+		{
+			unsigned int session = currentSession.load(std::memory_order_relaxed);
+			if (buffer->session.load(std::memory_order_relaxed) != session)
+			{
+				buffer->count.store(0, std::memory_order_relaxed);
+				buffer->dropped = 0;
+				buffer->session.store(session, std::memory_order_relaxed);
+			}
+
+			unsigned int index = buffer->count.load(std::memory_order_relaxed);
+			if (index >= MAX_EVENTS_PER_THREAD)
+			{
+				buffer->dropped++;
+				return;
+			}
+
+			Event& event = buffer->events[index];
+			event.name = name;
+			event.start = start;
+			event.end = end;
+			if (detail)
+			{
+				strncpy(event.detail, detail, MAX_DETAIL_LENGTH);
+				event.detail[MAX_DETAIL_LENGTH] = 0;
+			}
+			else
+				event.detail[0] = 0;
+
+			// Publishes the event to endSession()
+			buffer->count.store(index + 1, std::memory_order_release);
+		}
+
+		// Names and details go into JSON strings, escape what would break them
+		void writeEscaped(FILE* file, const char* str)
+		{
+			for (; *str; str++)
+			{
+				if (*str == '"' || *str == '\\')
+					fputc('\\', file);
+				if ((unsigned char)*str >= 0x20)
+					fputc(*str, file);
+			}
+		}
+
+		void readGPUZones(bool wait)
+		{
+			if (gpuZoneTail == gpuZoneHead)
+				return;
+
+			// Line the GPU clock up with ours, both count nanoseconds
+			GLint64 gpuNow = 0;
+			glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+			int64_t gpuToCPU = (int64_t)now() - (int64_t)gpuNow;
+
+			while (gpuZoneTail != gpuZoneHead)
+			{
+				GPUZoneSlot& slot = gpuZones[gpuZoneTail % MAX_GPU_ZONES];
+				if (slot.pending)
+				{
+					// Zones finish in order, if this one is not done the newer ones are not either
+					GLuint available = 0;
+					glGetQueryObjectuiv(slot.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+					if (!available && !wait)
+						break;
+
+					GLuint64 start = 0, end = 0;
+					glGetQueryObjectui64v(slot.queries[0], GL_QUERY_RESULT, &start);
+					glGetQueryObjectui64v(slot.queries[1], GL_QUERY_RESULT, &end);
+					pushEvent(gpuBuffer, slot.name, nullptr, (uint64_t)((int64_t)start + gpuToCPU), (uint64_t)((int64_t)end + gpuToCPU));
+					slot.pending = false;
+				}
+				gpuZoneTail++;
+			}
+		}
+	}
+
+	uint64_t now()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	void beginSession()
+	{
+		if (active)
+			return;
+
+		// GPU zones still waiting from the last session are never read, drop them
+		for (unsigned int i = 0; i < MAX_GPU_ZONES; i++)
+			gpuZones[i].pending = false;
+
+		gpuZoneHead = gpuZoneTail = 0;
+		sessionStart = now();
+		currentSession++;
+		active = true;
+	}
+
+	bool endSession(const char* path)
+	{
+		if (!active)
+			return false;
+
+		// Whatever the GPU still has in flight is waited for, this is not the hot path anymore
+		readGPUZones(true);
+		active = false;
+
+		FILE* file = fopen(path, "w");
+		if (!file)
+		{
+			std::cout << "Trace: could not open " << path << " for writing" << std::endl;
+			return false;
+		}
+
+		unsigned int session = currentSession.load();
+		unsigned int totalEvents = 0, totalDropped = 0;
+
+		fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Renderer\"}}");
+
+		std::lock_guard<std::mutex> lock(registerMutex);
+		for (size_t b = 0; b < threadBuffers.size(); b++)
+		{
+			ThreadBuffer* buffer = threadBuffers[b].get();
+
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"", buffer->threadId);
+			writeEscaped(file, buffer->threadName);
+			fprintf(file, "\"}}");
+
+			if (buffer->session.load() != session)
+				continue;
+
+			unsigned int count = buffer->count.load(std::memory_order_acquire);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				const Event& event = buffer->events[i];
+
+				// Complete events, timestamps are in microseconds
+				fprintf(file, ",\n{\"name\":\"");
+				writeEscaped(file, event.name);
+				fprintf(file, "\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f",
+					buffer->threadId,
+					(double)(int64_t)(event.start - sessionStart) / 1000.0,
+					(double)(event.end - event.start) / 1000.0);
+
+				if (event.detail[0])
+				{
+					fprintf(file, ",\"args\":{\"detail\":\"");
+					writeEscaped(file, event.detail);
+					fprintf(file, "\"}");
+				}
+				fprintf(file, "}");
+			}
+
+			totalEvents += count;
+			totalDropped += buffer->dropped;
+		}
+
+		fprintf(file, "\n]}\n");
+		fclose(file);
+
+		std::cout << "Trace: wrote " << totalEvents << " events to " << path;
+		if (totalDropped)
+			std::cout << " (" << totalDropped << " dropped, a thread ran out of room)";
+		std::cout << std::endl;
+
+		return true;
+	}
+
+	bool isActive()
+	{
+		return active.load(std::memory_order_relaxed);
+	}
+
+	void update()
+	{
+		if (active)
+			readGPUZones(false);
+	}
+
+	void setThreadName(const char* name)
+	{
+		if (!localBuffer)
+			localBuffer = registerBuffer(name);
+		else
+			snprintf(localBuffer->threadName, sizeof(localBuffer->threadName), "%s", name);
+	}
+
+	void recordEvent(const char* name, const char* detail, uint64_t start, uint64_t end)
+	{
+		if (active.load(std::memory_order_relaxed))
+			pushEvent(getLocalBuffer(), name, detail, start, end);
+	}
+
+	Zone::Zone(const char* name, const char* detail)
+		: m_pName(name),
+		m_pDetail(detail),
+		m_pStart(0),
+		m_pActive(isActive())
+	{
+		if (m_pActive)
+			m_pStart = now();
+	}
+
+	Zone::~Zone()
+	{
+		if (m_pActive)
+			recordEvent(m_pName, m_pDetail, m_pStart, now());
+	}
+
+	GPUZone::GPUZone(const char* name)
+		: m_pSlot(-1)
+	{
+		// Every slot is waiting for the GPU, skip this zone rather than stall
+		if (!isActive() || gpuZoneHead - gpuZoneTail == MAX_GPU_ZONES)
+			return;
+
+		// Created here rather than in beginSession(), so a session can start before there is a GL context
+		if (!gpuBuffer)
+		{
+			gpuBuffer = registerBuffer("GPU");
+			for (unsigned int i = 0; i < MAX_GPU_ZONES; i++)
+				glGenQueries(2, gpuZones[i].queries);
+		}
+
+		m_pSlot = gpuZoneHead % MAX_GPU_ZONES;
+		gpuZoneHead++;
+
+		GPUZoneSlot& slot = gpuZones[m_pSlot];
+		slot.name = name;
+		slot.pending = true;
+		glQueryCounter(slot.queries[0], GL_TIMESTAMP);
+	}
+
+	GPUZone::~GPUZone()
+	{
+		if (m_pSlot >= 0)
+			glQueryCounter(gpuZones[m_pSlot].queries[1], GL_TIMESTAMP);
+	}
+}
+
+#endif
@@ -0,0 +1,258 @@
+#include "TransformBatch.h"
+#include <cmath>
+#include <atomic>
+
+#if defined(_M_X64) || defined(__x86_64__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define TRANSFORM_BATCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+// MSVC lets any function use any intrinsic, GCC and Clang have to be told per function
+#if defined(TRANSFORM_BATCH_X86) && !defined(_MSC_VER)
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+#else
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+namespace TransformBatch
+{
+	namespace
+	{
+		typedef void (*MultiplyFunction)(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride);
+
+		void multiplyScalar(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride)
+		{
+			for (size_t i = 0; i < count; i++)
+				out[i * outStride] = left * right[i];
+		}
+
+#ifdef TRANSFORM_BATCH_X86
+		// Column c of the result is the left matrix's columns weighted by column c of the right one
+		void multiplySSE(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride)
+		{
+			const float* l = &left[0][0];
+			__m128 l0 = _mm_loadu_ps(l);
+			__m128 l1 = _mm_loadu_ps(l + 4);
+			__m128 l2 = _mm_loadu_ps(l + 8);
+			__m128 l3 = _mm_loadu_ps(l + 12);
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const float* r = &right[i][0][0];
+				float* o = &out[i * outStride][0][0];
+
+				for (int c = 0; c < 4; c++)
+				{
+					__m128 column = _mm_mul_ps(l0, _mm_set1_ps(r[c * 4 + 0]));
+					column = _mm_add_ps(column, _mm_mul_ps(l1, _mm_set1_ps(r[c * 4 + 1])));
+					column = _mm_add_ps(column, _mm_mul_ps(l2, _mm_set1_ps(r[c * 4 + 2])));
+					column = _mm_add_ps(column, _mm_mul_ps(l3, _mm_set1_ps(r[c * 4 + 3])));
+					_mm_storeu_ps(o + c * 4, column);
+				}
+			}
+		}
+
+		// Two columns per register, the left matrix is repeated in both halves
+		// _mm256_shuffle_ps works within each half, so one shuffle broadcasts
+		// element k of both right hand columns at once
+		TARGET_AVX2 void multiplyAVX2(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride)
+		{
+			const float* l = &left[0][0];
+			__m256 l0 = _mm256_broadcast_ps((const __m128*)l);
+			__m256 l1 = _mm256_broadcast_ps((const __m128*)(l + 4));
+			__m256 l2 = _mm256_broadcast_ps((const __m128*)(l + 8));
+			__m256 l3 = _mm256_broadcast_ps((const __m128*)(l + 12));
+
+			for (size_t i = 0; i < count; i++)
+			{
+				const float* r = &right[i][0][0];
+				float* o = &out[i * outStride][0][0];
+
+				for (int c = 0; c < 4; c += 2)
+				{
+					__m256 columns = _mm256_loadu_ps(r + c * 4);
+					__m256 result = _mm256_mul_ps(l0, _mm256_shuffle_ps(columns, columns, 0x00));
+					result = _mm256_fmadd_ps(l1, _mm256_shuffle_ps(columns, columns, 0x55), result);
+					result = _mm256_fmadd_ps(l2, _mm256_shuffle_ps(columns, columns, 0xAA), result);
+					result = _mm256_fmadd_ps(l3, _mm256_shuffle_ps(columns, columns, 0xFF), result);
+					_mm256_storeu_ps(o + c * 4, result);
+				}
+			}
+		}
+
+		// The whole right hand matrix fits in one register, four columns at once
+		TARGET_AVX512 void multiplyAVX512(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride)
+		{
+			const float* l = &left[0][0];
+			__m512 l0 = _mm512_broadcast_f32x4(_mm_loadu_ps(l));
+			__m512 l1 = _mm512_broadcast_f32x4(_mm_loadu_ps(l + 4));
+			__m512 l2 = _mm512_broadcast_f32x4(_mm_loadu_ps(l + 8));
+			__m512 l3 = _mm512_broadcast_f32x4(_mm_loadu_ps(l + 12));
+
+			for (size_t i = 0; i < count; i++)
+			{
+				__m512 columns = _mm512_loadu_ps(&right[i][0][0]);
+				__m512 result = _mm512_mul_ps(l0, _mm512_permute_ps(columns, 0x00));
+				result = _mm512_fmadd_ps(l1, _mm512_permute_ps(columns, 0x55), result);
+				result = _mm512_fmadd_ps(l2, _mm512_permute_ps(columns, 0xAA), result);
+				result = _mm512_fmadd_ps(l3, _mm512_permute_ps(columns, 0xFF), result);
+				_mm512_storeu_ps(&out[i * outStride][0][0], result);
+			}
+		}
+
+		void cpuid(int leaf, int subleaf, int registers[4])
+		{
+#ifdef _MSC_VER
+			__cpuidex(registers, leaf, subleaf);
+#else
+			unsigned int a, b, c, d;
+			__cpuid_count(leaf, subleaf, a, b, c, d);
+			registers[0] = (int)a; registers[1] = (int)b; registers[2] = (int)c; registers[3] = (int)d;
+#endif
+		}
+
+		// Which register states the OS saves on a context switch
+		unsigned long long xgetbv()
+		{
+#ifdef _MSC_VER
+			return _xgetbv(0);
+#else
+			unsigned int low, high;
+			__asm__ volatile("xgetbv" : "=a"(low), "=d"(high) : "c"(0));
+			return ((unsigned long long)high << 32) | low;
+#endif
+		}
+
+		InstructionSet detect()
+		{
+			int registers[4];
+			cpuid(0, 0, registers);
+			int maxLeaf = registers[0];
+
+			cpuid(1, 0, registers);
+			bool osxsave = (registers[2] & (1 << 27)) != 0;
+			bool avx = (registers[2] & (1 << 28)) != 0;
+			bool fma = (registers[2] & (1 << 12)) != 0;
+			if (!osxsave || !avx || maxLeaf < 7)
+				return SSE;
+
+			// The OS has to save the YMM registers (and for AVX-512 the ZMM and mask registers too)
+			unsigned long long xcr0 = xgetbv();
+			if ((xcr0 & 0x6) != 0x6)
+				return SSE;
+
+			cpuid(7, 0, registers);
+			bool avx2 = (registers[1] & (1 << 5)) != 0;
+			bool avx512f = (registers[1] & (1 << 16)) != 0;
+
+			if (avx512f && (xcr0 & 0xE6) == 0xE6)
+				return AVX512;
+			if (avx2 && fma)
+				return AVX2;
+			return SSE;
+		}
+#endif
+
+		const MultiplyFunction multiplyFunctions[NUM_INSTRUCTION_SETS] =
+		{
+			multiplyScalar,
+#ifdef TRANSFORM_BATCH_X86
+			multiplySSE,
+			multiplyAVX2,
+			multiplyAVX512
+#else
+			multiplyScalar,
+			multiplyScalar,
+			multiplyScalar
+#endif
+		};
+
+		// The UI can switch sets while the simulation thread is multiplying
+		InstructionSet supported = SCALAR;
+		std::atomic<InstructionSet> current(SCALAR);
+		std::atomic<MultiplyFunction> multiplyFunction(multiplyScalar);
+	}
+
+	void init()
+	{
+#ifdef TRANSFORM_BATCH_X86
+		supported = detect();
+#else
+		supported = SCALAR;
+#endif
+		setInstructionSet(supported);
+	}
+
+	InstructionSet getSupported()
+	{
+		return supported;
+	}
+
+	InstructionSet getInstructionSet()
+	{
+		return current;
+	}
+
+	void setInstructionSet(InstructionSet set)
+	{
+		InstructionSet clamped = set < supported ? set : supported;
+		current = clamped;
+		multiplyFunction = multiplyFunctions[clamped];
+	}
+
+	const char* getName(InstructionSet set)
+	{
+		switch (set)
+		{
+		case SSE: return "SSE";
+		case AVX2: return "AVX2";
+		case AVX512: return "AVX-512";
+		default: return "Scalar";
+		}
+	}
+
+	void composeTRS(const TRS* transforms, glm::mat4* out, glm::mat4* outRotations, size_t count)
+	{
+		const float degreesToRadians = 3.14159265358979f / 180.0f;
+
+		for (size_t i = 0; i < count; i++)
+		{
+			const TRS& t = transforms[i];
+			float sx = sinf(t.rotation.x * degreesToRadians), cx = cosf(t.rotation.x * degreesToRadians);
+			float sy = sinf(t.rotation.y * degreesToRadians), cy = cosf(t.rotation.y * degreesToRadians);
+			float sz = sinf(t.rotation.z * degreesToRadians), cz = cosf(t.rotation.z * degreesToRadians);
+
+			// Columns of rotateZ * rotateY * rotateX
+			glm::vec3 r0(cz * cy, sz * cy, -sy);
+			glm::vec3 r1(cz * sy * sx - sz * cx, sz * sy * sx + cz * cx, cy * sx);
+			glm::vec3 r2(cz * sy * cx + sz * sx, sz * sy * cx - cz * sx, cy * cx);
+
+			glm::mat4& m = out[i];
+			m[0] = glm::vec4(r0 * t.scale, 0.0f);
+			m[1] = glm::vec4(r1 * t.scale, 0.0f);
+			m[2] = glm::vec4(r2 * t.scale, 0.0f);
+			m[3] = glm::vec4(t.position, 1.0f);
+
+			if (outRotations)
+			{
+				glm::mat4& r = outRotations[i];
+				r[0] = glm::vec4(r0, 0.0f);
+				r[1] = glm::vec4(r1, 0.0f);
+				r[2] = glm::vec4(r2, 0.0f);
+				r[3] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+			}
+		}
+	}
+
+	void multiply(const glm::mat4& left, const glm::mat4* right, glm::mat4* out, size_t count, size_t outStride)
+	{
+		multiplyFunction.load()(left, right, out, count, outStride);
+	}
+}
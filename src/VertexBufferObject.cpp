@@ -1,9 +1,16 @@
 #include "VertexBufferObject.h"
+#include "GLState.h"
+#include "RenderStats.h"
 #include <iostream>
 
 VertexBufferObject::VertexBufferObject()
 {
 	vaoHandle = 0;
+	depthVaoHandle = 0;
+	indexHandle = 0;
+	indexData = nullptr;
+	numIndices = 0;
+	numDrawIndices = 0;
 	primitiveType = GL_TRIANGLES;
 }
 
@@ -28,6 +35,13 @@ AttributeDescriptor* VertexBufferObject::getAttributeDescriptor(AttributeLocatio
 	return nullptr;
 }
 
+void VertexBufferObject::setIndexArray(unsigned int* data, unsigned int count, unsigned int drawCount)
+{
+	indexData = data;
+	numIndices = count;
+	numDrawIndices = (drawCount > 0 && drawCount < count) ? drawCount : count;
+}
+
 unsigned int VertexBufferObject::getVAO()
 {
 	return vaoHandle;
@@ -51,7 +65,7 @@ void VertexBufferObject::createVBO(GLenum vboUsage)
 	}
 
 	glGenVertexArrays(1, &vaoHandle);
-	glBindVertexArray(vaoHandle);
+	GLState::bindVertexArray(vaoHandle);
 
 	auto numBuffers = attributeDescriptors.size();
 	vboHandles.resize(numBuffers);
@@ -63,29 +77,97 @@ void VertexBufferObject::createVBO(GLenum vboUsage)
 		AttributeDescriptor* attrib = &attributeDescriptors[i];
 		
 		glEnableVertexAttribArray(attrib->attributeLocation);
-		glBindBuffer(GL_ARRAY_BUFFER, vboHandles[i]);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, vboHandles[i]);
 		glBufferData(GL_ARRAY_BUFFER, attrib->numElements * attrib->elementSize,
 			attrib->data, vboUsage);
+		RenderStats::countUpload(attrib->numElements * attrib->elementSize);
 
 		glVertexAttribPointer(attrib->attributeLocation, attrib->numElementsPerAttrib,
 			attrib->elementType, GL_FALSE, 0, 0);
 
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// The element array binding is part of the VAO, so it stays bound
+	if (numIndices > 0)
+	{
+		glGenBuffers(1, &indexHandle);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexHandle);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, numIndices * sizeof(unsigned int), indexData, vboUsage);
+		RenderStats::countUpload(numIndices * sizeof(unsigned int));
+	}
+
+	// Position only VAO, shares the position VBO with the VAO above
+	glGenVertexArrays(1, &depthVaoHandle);
+	GLState::bindVertexArray(depthVaoHandle);
+
+	for (unsigned int i = 0; i < numBuffers; i++)
+	{
+		AttributeDescriptor* attrib = &attributeDescriptors[i];
+		if (attrib->attributeLocation != AttributeLocations::VERTEX)
+			continue;
+
+		glEnableVertexAttribArray(attrib->attributeLocation);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, vboHandles[i]);
+		glVertexAttribPointer(attrib->attributeLocation, attrib->numElementsPerAttrib,
+			attrib->elementType, GL_FALSE, 0, 0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
 	}
 
-	glBindVertexArray(0);
+	if (indexHandle)
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexHandle);
+
+	GLState::bindVertexArray(0);
 }
 
 void VertexBufferObject::draw()
 {
 	if (vaoHandle)
 	{
-		glBindVertexArray(vaoHandle);
+		// No need to unbind afterwards, the state cache skips the bind
+		// if the next draw uses the same VAO
+		GLState::bindVertexArray(vaoHandle);
+		drawBound();
+	}
+}
+
+void VertexBufferObject::bind()
+{
+	GLState::bindVertexArray(vaoHandle);
+}
+
+void VertexBufferObject::unbind()
+{
+	GLState::bindVertexArray(0);
+}
+
+void VertexBufferObject::bindDepthOnly()
+{
+	GLState::bindVertexArray(depthVaoHandle);
+}
+
+void VertexBufferObject::drawBound()
+{
+	if (vaoHandle && numIndices > 0)
+	{
+		glDrawElements(primitiveType, numDrawIndices, GL_UNSIGNED_INT, 0);
+		RenderStats::countDraw(primitiveType, numDrawIndices);
+	}
+	else if (vaoHandle)
+	{
 		// better way would be to just store the num of vertices
-		glDrawArrays(primitiveType, 0,
-			attributeDescriptors[0].numElements / attributeDescriptors[0].numElementsPerAttrib);
+		GLsizei numVertices = attributeDescriptors[0].numElements / attributeDescriptors[0].numElementsPerAttrib;
+		glDrawArrays(primitiveType, 0, numVertices);
+		RenderStats::countDraw(primitiveType, numVertices);
+	}
+}
 
-		glBindVertexArray(0);
+void VertexBufferObject::drawBoundRange(unsigned int firstIndex, unsigned int count)
+{
+	if (vaoHandle && numIndices > 0)
+	{
+		glDrawElements(primitiveType, count, GL_UNSIGNED_INT, (void*)(firstIndex * sizeof(unsigned int)));
+		RenderStats::countDraw(primitiveType, count);
 	}
 }
 
@@ -93,12 +175,24 @@ void VertexBufferObject::destroy()
 {
 	if (vaoHandle)
 	{
-		glDeleteVertexArrays(1, &vaoHandle);
-		glDeleteBuffers((GLsizei)vboHandles.size(), &vboHandles[0]);
+		GLState::deleteVertexArrays(1, &vaoHandle);
+		GLState::deleteVertexArrays(1, &depthVaoHandle);
+		vaoHandle = 0;
+		depthVaoHandle = 0;
+		GLState::deleteBuffers((GLsizei)vboHandles.size(), &vboHandles[0]);
+	}
+
+	if (indexHandle)
+	{
+		GLState::deleteBuffers(1, &indexHandle);
+		indexHandle = 0;
 	}
 
 	vboHandles.clear();
 	attributeDescriptors.clear();
+	indexData = nullptr;
+	numIndices = 0;
+	numDrawIndices = 0;
 }
 
 
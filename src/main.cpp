@@ -6,9 +6,10 @@
 #include <iostream>
 #include <string>
 #include <math.h>
-#include <map> // for std::map
 #include <memory> // for std::shared_ptr
 #include <fstream>
+#include <atomic>
+#include <chrono>
 
 // 3rd Party Libraries
 #define GLEW_STATIC
@@ -26,11 +27,46 @@
 #include "Shader.h"
 #include "ShaderProgram.h"
 #include "GameObject.h"
+#include "RenderQueue.h"
+#include "GLState.h"
+#include "GPUQuery.h"
+#include "HiZBuffer.h"
+#include "OcclusionCuller.h"
+#include "LightClusters.h"
+#include "SparseBloom.h"
+#include "FrameChanges.h"
+#include "DynamicResolution.h"
+#include "JobSystem.h"
+#include "SimulationThread.h"
+#include "TripleBuffer.h"
+#include "FramePacer.h"
+#include "AllocationTracker.h"
+#include "FrameArena.h"
+#include "RenderStats.h"
+#include "AssetRegistry.h"
+#include "Trace.h"
+#include "TransformBatch.h"
 #include "TTK\Utilities.h"
 
 // Defines and Core variables
 #define FRAMES_PER_SECOND 60
-const int FRAME_DELAY = 1000 / FRAMES_PER_SECOND; // Milliseconds per frame
+
+// Decides when frames start and how far ahead of the GPU we may get
+FramePacer framePacer;
+
+// Idle-aware render loop
+// Frames only run while something changes. Once a frame comes out the same as
+// the one before (see FrameChanges::isStatic()), the idle callback is removed
+// and GLUT blocks until the next event. Input, resizes and requestRedraw()
+// start it again, and an optional keep-alive timer draws a frame every so often.
+bool useIdleLoop = true;
+bool loopIdle = false;
+float keepAliveSeconds = 1.0f;					// 0 for no keep-alive frames
+int settleFrames = 0;							// frames still to draw after the last event
+unsigned int keepAliveGeneration = 0;			// timers from an earlier idle period are ignored
+FramePacer::Clock::time_point idleStart;
+unsigned long long framesSkipped = 0;			// frames the pacer would have drawn while idle
+#define IDLE_SETTLE_FRAMES 3					// ImGui needs a couple of frames to react to input
 
 int windowWidth = 1920;
 int windowHeight = 1080;
@@ -42,13 +78,16 @@ glm::vec3 mousePositionFlipped; // x, height - y, 0
 const float degToRad = 3.14159f / 180.0f;
 const float radToDeg = 180.0f / 3.14159f;
 
-float deltaTime = 0.0f; // amount of time since last update (set every frame in timer callback)
+float deltaTime = 0.0f; // amount of time since last update (set every frame in idle callback)
 
 glm::vec3 position;
 float movementSpeed = 5.0f;
-glm::vec4 lightPos;
+glm::vec4 lightPos; // written by the simulation thread only
+glm::vec4 renderLightPos; // interpolated copy the render thread uses
 
 bool paused = false;
+std::atomic<bool> simPaused(false); // copy of paused the simulation thread reads
+float lightOrbitTime = 0.0f; // how far the scene lights have circled, stops with the moving light
 
 static int mode = 0;
 
@@ -57,14 +96,65 @@ TTK::Camera playerCamera; // the camera you move around with wasd + mouse
 TTK::Camera renderCamera; // the camera we render the scene with when generating the fbo texture
 
 // Asset databases
-// A std::map is just like a std::vector, but instead of using an integer to index into the array, you can use a templated type
-// In the following maps we use strings as the indices into the arrays
-std::map<std::string, std::shared_ptr<TTK::MeshBase>> meshes;
-std::map<std::string, std::shared_ptr<GameObject>> gameobjects;
-std::map<std::string, std::shared_ptr<TTK::Texture2D>> textures;
+// Every asset gets a name when it is added, "name"_id turns a name into its id at compile time.
+// Looking something up by id is a hash map lookup, so do it once and keep the handle,
+// get(handle) is just an array index.
+AssetRegistry<TTK::MeshBase> meshes;
+AssetRegistry<GameObject> gameobjects;
+AssetRegistry<TTK::Texture2D> textures;
 
 // Materials
-std::map<std::string, std::shared_ptr<Material>> materials;
+AssetRegistry<Material> materials;
+
+// Simulation
+// updateScene() runs on its own thread at a fixed rate. After every tick the
+// world matrices are published as a snapshot, the render thread draws an
+// interpolation of the two newest ticks so it never has to wait for the simulation.
+#define SIMULATION_TICKS_PER_SECOND 60
+
+struct SceneSnapshot
+{
+	double publishTime;							// when the newest tick finished, in seconds
+	glm::vec4 lightPos[2];						// previous tick, newest tick
+	std::vector<glm::mat4> worldMatrices[2];	// same order as simObjects
+};
+
+SimulationThread simulationThread;
+TripleBuffer<SceneSnapshot> sceneSnapshots;
+std::vector<GameObject*> simObjects; // every object, in snapshot order
+GameObject* lightSphere = nullptr;
+
+// All scene draws go through here so they can be sorted to minimise state changes
+RenderQueue renderQueue;
+
+// Depth pre-pass
+// Lays down depth first so the lighting shader only runs once per pixel
+bool useDepthPrepass = false;
+GPUQuery sceneFragmentQuery; // counts fragments shaded by the scene colour pass
+
+// Occlusion culling
+// Hidden objects are tested against last frame's depth and dropped before drawing
+bool useOcclusionCulling = true;
+HiZBuffer hizBuffer;
+OcclusionCuller occlusionCuller;
+
+// Clustered lighting
+// Lights are binned into a grid over the view frustum and the default material
+// only loops over the lights of the cluster a pixel is in. Needs OpenGL 4.3,
+// without it the default material is lit by the moving light only.
+bool useClusteredLighting = false;
+bool showClusterLights = false;
+LightClusters lightClusters;
+std::vector<PointLight> sceneLights;	// world space, they circle the middle of the scene
+int numSceneLights = 256;
+#define MAIN_LIGHT_RADIUS 1000.0f		// the moving light reaches everything, like it did before clustering
+
+// Deferred shading
+// The scene only writes albedo, normal and emissive colour into the G-buffer,
+// then one full screen pass lights every pixel from the light clusters and
+// writes the result into aFBO. Needs clustered lighting.
+bool useDeferredShading = false;
+FrameBufferObject gBuffer;
 
 enum GameMode
 {
@@ -80,66 +170,244 @@ GameMode currentMode = DEFAULT;
 // CREATE FRAME BUFFERS HERE
 // HINT: You probably need at least 3. (4 if you want great blur :)
 ////////////////////////////////////////////////////////////////////////// 
-FrameBufferObject aFBO, bFBO, cFBO,dFBO;
+// aFBO has two colour textures, the lit scene and the emissive colour
+// Bloom thresholds the scene while it downsamples, so there is no bright pass
+FrameBufferObject aFBO, cFBO,dFBO;
 float bloomThreshold=0.1f;
+float bloomKnee = 0.5f;
+
+// Half, quarter, eighth and sixteenth size steps of the bloom downsample
+// The last one is the blur's input, the same size as cFBO
+#define NUM_BLOOM_DOWNSAMPLES 4
+FrameBufferObject bloomDownsampleFBO[NUM_BLOOM_DOWNSAMPLES];
+
+// Blur passes back and forth between dFBO and cFBO, kept even so the result ends in cFBO
+int bloomBlurPasses = 16;
+
+// Sparse bloom
+// Only the tiles of cFBO with something bright nearby are blurred and added
+// to the scene, with compute shaders. Needs OpenGL 4.3, without it the whole
+// target is blurred with full screen quads.
+bool useSparseBloom = false;
+bool sparseBloomSupported = false; // OpenGL 4.3 and all of its shaders compiled
+SparseBloom sparseBloom;
+
+// Incremental redraw
+// Frames where nothing moved show the last composited image again, frames where
+// only some objects changed draw the scene and bloom again inside one scissor
+// rectangle around them, see FrameChanges
+bool useIncrementalRedraw = true;
+FrameChanges frameChanges;
+FrameBufferObject frameFBO; // scene plus bloom, kept so it can be shown again
+
+// Occlusion culling uses depth a few frames old, changes are drawn again for this many frames
+#define OCCLUSION_REDRAW_FRAMES 4
+
+// Dynamic resolution
+// The scene and the bloom targets are drawn into their bottom left renderScale,
+// the composite stretches that over the whole frame, see DynamicResolution
+DynamicResolution dynamicResolution;
+float renderScale = 1.0f; // picked at the start of every frame, the same for all of it
+
+// Below full scale the composite upscales the scene with an edge adaptive filter
+// and sharpens it, see bloomComposite_f.glsl, otherwise it is stretched bilinearly
+bool useUpscaler = true;
+float upscaleSharpness = 0.5f;
 
 void initializeFrameBuffers()
 {
+	TRACE_SCOPE("initializeFrameBuffers");
+
 	//////////////////////////////////////////////////////////////////////////
 	// INIT FRAME BUFFERS HERE
 	////////////////////////////////////////////////////////////////////////// 
-	aFBO.createFrameBuffer(windowWidth, windowHeight, 1, true);
-	bFBO.createFrameBuffer(windowWidth, windowHeight, 1, true);
+	aFBO.createFrameBuffer(windowWidth, windowHeight, 2, true);
 	cFBO.createFrameBuffer(windowWidth / 16.f, windowHeight / 16.f, 1, true);
 	dFBO.createFrameBuffer(windowWidth / 16.f, windowHeight / 16.f, 1, true);
+	for (int i = 0; i < NUM_BLOOM_DOWNSAMPLES; i++)
+		bloomDownsampleFBO[i].createFrameBuffer(windowWidth >> (i + 1), windowHeight >> (i + 1), 1, false);
+	frameFBO.createFrameBuffer(windowWidth, windowHeight, 1, false);
+
+	// Albedo, octahedron encoded normal, u_colour and emissive colour, position comes from the depth
+	if (useClusteredLighting)
+	{
+		const GLenum gBufferFormats[] = { GL_RGBA8, GL_RG16F, GL_RGBA8, GL_RGBA8 };
+		gBuffer.createFrameBuffer(windowWidth, windowHeight, 4, true, gBufferFormats);
+	}
+
+	if (useSparseBloom)
+	{
+		sparseBloom.create(cFBO.getWidth(), cFBO.getHeight(), aFBO.getWidth(), aFBO.getHeight(),
+			materials.get("bloomClassify"_id), materials.get("bloomCompact"_id), materials.get("bloomBlurTiles"_id), materials.get("bloomCompositeTiles"_id));
+	}
+
+	// Same size as the scene FBO, its depth is copied into level 0
+	hizBuffer.create(windowWidth, windowHeight, materials.get("hizCopy"_id), materials.get("hizDownsample"_id), meshes.get("quad"_id));
 
 }
 
+// Creates an empty material and registers it under name
+Material* addMaterial(const std::string& name)
+{
+	return materials.get(materials.add(name, std::make_shared<Material>()));
+}
+
 void initializeShaders()
 {
+	TRACE_SCOPE("initializeShaders");
+
 	std::string shaderPath = "../../Assets/Shaders/";
 
 	// Load shaders
 
-	Shader v_default;
+	Shader v_default, v_depthOnly;
 	v_default.loadShaderFromFile(shaderPath + "default_v.glsl", GL_VERTEX_SHADER);
+	v_depthOnly.loadShaderFromFile(shaderPath + "depthOnly_v.glsl", GL_VERTEX_SHADER);
+
+	Shader f_default, f_unlitTex, f_composite, f_blur, f_bloomDownsample, f_depthOnly, f_hizCopy, f_hizDownsample;
 
-	Shader f_default, f_unlitTex, f_bright, f_composite, f_blur;
-	f_default.loadShaderFromFile(shaderPath + "default_f.glsl", GL_FRAGMENT_SHADER);
-	f_bright.loadShaderFromFile(shaderPath + "bright_f.glsl", GL_FRAGMENT_SHADER);
+	// Clustered lighting replaces the default lighting shader when the driver can run it
+	// Its shaders have to compile and link before it is picked, otherwise the single light is used
+	Shader c_lightClusters;
+	useClusteredLighting = LightClusters::isSupported()
+		&& f_default.loadShaderFromFile(shaderPath + "clusteredLighting_f.glsl", GL_FRAGMENT_SHADER)
+		&& c_lightClusters.loadShaderFromFile(shaderPath + "lightClusters_c.glsl", GL_COMPUTE_SHADER);
+
+	// Bins lights into clusters, compute shader only
+	if (useClusteredLighting)
+	{
+		Material* lightClustersMaterial = addMaterial("lightClusters");
+		lightClustersMaterial->shader->attachShader(c_lightClusters);
+		useClusteredLighting = lightClustersMaterial->shader->linkProgram() != 0;
+	}
+
+	if (!useClusteredLighting)
+	{
+		std::cout << "Clustered lighting needs OpenGL 4.3, using a single light" << std::endl;
+		f_default.destroy();
+		f_default.loadShaderFromFile(shaderPath + "default_f.glsl", GL_FRAGMENT_SHADER);
+	}
+
+	f_depthOnly.loadShaderFromFile(shaderPath + "depthOnly_f.glsl", GL_FRAGMENT_SHADER);
+	f_hizCopy.loadShaderFromFile(shaderPath + "hizCopy_f.glsl", GL_FRAGMENT_SHADER);
+	f_hizDownsample.loadShaderFromFile(shaderPath + "hizDownsample_f.glsl", GL_FRAGMENT_SHADER);
 	f_unlitTex.loadShaderFromFile(shaderPath + "unlitTexture_f.glsl", GL_FRAGMENT_SHADER);
 	f_composite.loadShaderFromFile(shaderPath + "bloomComposite_f.glsl", GL_FRAGMENT_SHADER);
 	f_blur.loadShaderFromFile(shaderPath + "gaussianBlur_f.glsl", GL_FRAGMENT_SHADER);
+	f_bloomDownsample.loadShaderFromFile(shaderPath + "bloomDownsample_f.glsl", GL_FRAGMENT_SHADER);
 
 	// Default material that all objects use
-	materials["default"] = std::make_shared<Material>();
-	materials["default"]->shader->attachShader(v_default);
-	materials["default"]->shader->attachShader(f_default);
-	materials["default"]->shader->linkProgram();
+	Material* defaultMaterial = addMaterial("default");
+	defaultMaterial->shader->attachShader(v_default);
+	defaultMaterial->shader->attachShader(f_default);
+	defaultMaterial->shader->linkProgram();
+
+	// Depth pre-pass material, position only
+	Material* depthOnlyMaterial = addMaterial("depthOnly");
+	depthOnlyMaterial->shader->attachShader(v_depthOnly);
+	depthOnlyMaterial->shader->attachShader(f_depthOnly);
+	depthOnlyMaterial->shader->linkProgram();
+
+	// Hi-Z buffer materials, copy the scene depth then build the max depth mip chain
+	Material* hizCopyMaterial = addMaterial("hizCopy");
+	hizCopyMaterial->shader->attachShader(v_default);
+	hizCopyMaterial->shader->attachShader(f_hizCopy);
+	hizCopyMaterial->shader->linkProgram();
+
+	Material* hizDownsampleMaterial = addMaterial("hizDownsample");
+	hizDownsampleMaterial->shader->attachShader(v_default);
+	hizDownsampleMaterial->shader->attachShader(f_hizDownsample);
+	hizDownsampleMaterial->shader->linkProgram();
 
 	// Unlit texture material
-	materials["unlitTexture"] = std::make_shared<Material>();
-	materials["unlitTexture"]->shader->attachShader(v_default);
-	materials["unlitTexture"]->shader->attachShader(f_unlitTex);
-	materials["unlitTexture"]->shader->linkProgram();
-
-	// Invert filter material
-	materials["bright"] = std::make_shared<Material>();
-	materials["bright"]->shader->attachShader(v_default);
-	materials["bright"]->shader->attachShader(f_bright);
-	materials["bright"]->shader->linkProgram();
+	Material* unlitTextureMaterial = addMaterial("unlitTexture");
+	unlitTextureMaterial->shader->attachShader(v_default);
+	unlitTextureMaterial->shader->attachShader(f_unlitTex);
+	unlitTextureMaterial->shader->linkProgram();
 
 	// gaussian blur filter
-	materials["blur"] = std::make_shared<Material>();
-	materials["blur"]->shader->attachShader(v_default);
-	materials["blur"]->shader->attachShader(f_blur);
-	materials["blur"]->shader->linkProgram();
+	Material* blurMaterial = addMaterial("blur");
+	blurMaterial->shader->attachShader(v_default);
+	blurMaterial->shader->attachShader(f_blur);
+	blurMaterial->shader->linkProgram();
+
+	// Bloom downsample, the first step also thresholds the scene
+	Material* bloomDownsampleMaterial = addMaterial("bloomDownsample");
+	bloomDownsampleMaterial->shader->attachShader(v_default);
+	bloomDownsampleMaterial->shader->attachShader(f_bloomDownsample);
+	bloomDownsampleMaterial->shader->linkProgram();
 
 	// Sobel filter material
-	materials["bloom"] = std::make_shared<Material>();
-	materials["bloom"]->shader->attachShader(v_default);
-	materials["bloom"]->shader->attachShader(f_composite);
-	materials["bloom"]->shader->linkProgram();
+	Material* bloomMaterial = addMaterial("bloom");
+	bloomMaterial->shader->attachShader(v_default);
+	bloomMaterial->shader->attachShader(f_composite);
+	bloomMaterial->shader->linkProgram();
+
+	if (useClusteredLighting)
+	{
+		// Deferred shading, objects use the G-buffer material instead of the default one
+		Shader f_gBuffer, f_deferredLighting;
+		f_gBuffer.loadShaderFromFile(shaderPath + "gBuffer_f.glsl", GL_FRAGMENT_SHADER);
+		f_deferredLighting.loadShaderFromFile(shaderPath + "deferredLighting_f.glsl", GL_FRAGMENT_SHADER);
+
+		Material* gBufferMaterial = addMaterial("gBuffer");
+		gBufferMaterial->shader->attachShader(v_default);
+		gBufferMaterial->shader->attachShader(f_gBuffer);
+		gBufferMaterial->shader->linkProgram();
+
+		Material* deferredLightingMaterial = addMaterial("deferredLighting");
+		deferredLightingMaterial->shader->attachShader(v_default);
+		deferredLightingMaterial->shader->attachShader(f_deferredLighting);
+		deferredLightingMaterial->shader->linkProgram();
+	}
+
+	// Sparse bloom, compute shaders only
+	// Only offered when every shader compiled and linked
+	sparseBloomSupported = SparseBloom::isSupported();
+	if (sparseBloomSupported)
+	{
+		Shader c_classify, c_compact, c_blur, c_composite;
+		sparseBloomSupported = c_classify.loadShaderFromFile(shaderPath + "bloomClassify_c.glsl", GL_COMPUTE_SHADER)
+			&& c_compact.loadShaderFromFile(shaderPath + "bloomCompact_c.glsl", GL_COMPUTE_SHADER)
+			&& c_blur.loadShaderFromFile(shaderPath + "bloomBlur_c.glsl", GL_COMPUTE_SHADER)
+			&& c_composite.loadShaderFromFile(shaderPath + "bloomComposite_c.glsl", GL_COMPUTE_SHADER);
+
+		if (sparseBloomSupported)
+		{
+			Material* classifyMaterial = addMaterial("bloomClassify");
+			classifyMaterial->shader->attachShader(c_classify);
+
+			Material* compactMaterial = addMaterial("bloomCompact");
+			compactMaterial->shader->attachShader(c_compact);
+
+			Material* blurTilesMaterial = addMaterial("bloomBlurTiles");
+			blurTilesMaterial->shader->attachShader(c_blur);
+
+			Material* compositeTilesMaterial = addMaterial("bloomCompositeTiles");
+			compositeTilesMaterial->shader->attachShader(c_composite);
+
+			sparseBloomSupported = classifyMaterial->shader->linkProgram()
+				&& compactMaterial->shader->linkProgram()
+				&& blurTilesMaterial->shader->linkProgram()
+				&& compositeTilesMaterial->shader->linkProgram();
+		}
+	}
+
+	useSparseBloom = sparseBloomSupported;
+	if (!sparseBloomSupported)
+		std::cout << "Sparse bloom needs OpenGL 4.3, blurring the whole bloom target" << std::endl;
+}
+
+// Meshes are registered under their file path, so asking for the same file
+// twice returns the mesh that is already loaded instead of loading it again
+AssetHandle<TTK::MeshBase> loadOBJMesh(const std::string& path)
+{
+	return meshes.getOrCreate(path, [&]()
+	{
+		std::shared_ptr<TTK::OBJMesh> mesh = std::make_shared<TTK::OBJMesh>();
+		mesh->loadMesh(path);
+		return std::static_pointer_cast<TTK::MeshBase>(mesh);
+	});
 }
 
 void loadMeshes()
@@ -147,25 +415,26 @@ void loadMeshes()
 	// Load meshes
 	std::string meshPath = "../../Assets/Models/";
 
-	std::shared_ptr<TTK::OBJMesh> floorMesh = std::make_shared<TTK::OBJMesh>();
-	std::shared_ptr<TTK::OBJMesh> sphereMesh = std::make_shared<TTK::OBJMesh>();
-	std::shared_ptr<TTK::OBJMesh> torusMesh = std::make_shared<TTK::OBJMesh>();
-	std::shared_ptr<TTK::OBJMesh> cubeMesh = std::make_shared<TTK::OBJMesh>();
+	AssetHandle<TTK::MeshBase> floorMesh = loadOBJMesh(meshPath + "floor.obj");
+	AssetHandle<TTK::MeshBase> sphereMesh = loadOBJMesh(meshPath + "sphere.obj");
+	AssetHandle<TTK::MeshBase> torusMesh = loadOBJMesh(meshPath + "torus.obj");
+	AssetHandle<TTK::MeshBase> cubeMesh = loadOBJMesh(meshPath + "cube.obj");
 
-	floorMesh->loadMesh(meshPath + "floor.obj");
-	sphereMesh->loadMesh(meshPath + "sphere.obj");
-	torusMesh->loadMesh(meshPath + "torus.obj");
-	cubeMesh->loadMesh(meshPath + "cube.obj");
+	// Simplified versions for when these are far away
+	meshes.get(sphereMesh)->generateLODs();
+	meshes.get(torusMesh)->generateLODs();
 
-	// Note: looking up a mesh by it's string name is not the fastest thing,
+	// Short names for the rest of the code
+	// Note: looking up a mesh by name is a hash map lookup,
 	// you don't want to do this every frame, once in a while (like now) is fine.
-	// If you need you need constant access to a mesh (i.e. you need it every frame),
-	// store a reference to it so you don't need to look it up every time.
-	meshes["floor"] = floorMesh;
-	meshes["sphere"] = sphereMesh;
-	meshes["torus"] = torusMesh;
-	meshes["cube"] = cubeMesh;
-	meshes["quad"] = createQuadMesh();
+	// If you need constant access to a mesh (i.e. you need it every frame),
+	// keep its handle so you don't need to look it up every time.
+	meshes.addAlias("floor", floorMesh);
+	meshes.addAlias("sphere", sphereMesh);
+	meshes.addAlias("torus", torusMesh);
+	meshes.addAlias("cube", cubeMesh);
+	meshes.add("quad", createQuadMesh());
+	meshes.add("box", createBoxMesh()); // proxy for occlusion queries
 }
 
 void loadTextures()
@@ -178,18 +447,22 @@ void loadTextures()
 
 void initializeScene()
 {
+	TRACE_SCOPE("initializeScene");
+
 	loadMeshes();
 	loadTextures();
 
 	// Create objects
-	// Get reference to default material (created in initializeShaders())
-	auto defaultMaterial = materials["default"];
+	// Game objects share ownership of their mesh and material
+	std::shared_ptr<Material> defaultMaterial = materials.getShared("default"_id);
+	std::shared_ptr<TTK::MeshBase> torusMesh = meshes.getShared("torus"_id);
 
-	gameobjects["floor"] = std::make_shared<GameObject>(glm::vec3(0.0f, 0.0f, 0.0f), meshes["floor"], defaultMaterial);
-	gameobjects["sphere"] = std::make_shared<GameObject>(glm::vec3(0.0f, 5.0f, 0.0f), meshes["sphere"], defaultMaterial);
+	gameobjects.add("floor", std::make_shared<GameObject>(glm::vec3(0.0f, 0.0f, 0.0f), meshes.getShared("floor"_id), defaultMaterial));
+	gameobjects.add("sphere", std::make_shared<GameObject>(glm::vec3(0.0f, 5.0f, 0.0f), meshes.getShared("sphere"_id), defaultMaterial));
 	
 	// Set object properties
-	gameobjects["sphere"]->colour = glm::vec4(1.0f);
+	gameobjects.get("sphere"_id)->colour = glm::vec4(1.0f);
+	gameobjects.get("sphere"_id)->emissive = glm::vec4(1.0f); // it is the light, so it always glows
 
 	// Generate a bunch of objects in a circle
 	int numObjects = 12;
@@ -202,82 +475,381 @@ void initializeScene()
 		pos.x = cos(circleStep*(float)i*degToRad) * 10.0f;
 		pos.y = 2.0f;
 		pos.z = sin(circleStep*(float)i*degToRad) * 10.0f;
-		gameobjects[name] = std::make_shared<GameObject>(pos, meshes["torus"], defaultMaterial);
-		gameobjects[name]->colour = glm::vec4(colour, 1.0f);
+		std::shared_ptr<GameObject> torus = std::make_shared<GameObject>(pos, torusMesh, defaultMaterial);
+		torus->colour = glm::vec4(colour, 1.0f);
+		gameobjects.add(name, torus);
+	}
+
+	// Small coloured lights scattered over the floor, the moving light is added to them every frame
+	if (useClusteredLighting)
+	{
+		sceneLights.resize(LightClusters::MAX_LIGHTS - 1);
+		for (unsigned int i = 0; i < sceneLights.size(); i++)
+		{
+			float angle = randomFloatRange(0.0f, 360.0f) * degToRad;
+			float distance = sqrtf(randomFloat01()) * 12.0f;
+			glm::vec3 pos(cos(angle) * distance, randomFloatRange(0.5f, 4.0f), sin(angle) * distance);
+
+			sceneLights[i].positionRadius = glm::vec4(pos, randomFloatRange(1.5f, 4.0f));
+			sceneLights[i].colour = getColorFromHue(randomFloat01()) * 2.0f;
+		}
+
+		lightClusters.create(materials.get("lightClusters"_id));
 	}
 }
 
-void updateScene()
+double secondsNow()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Runs on the simulation thread
+// Only touches simulation state (positions, world matrices, lightPos), never GL or render state
+void updateScene(float dt)
 {
 	// Move light in simple circular path
 	static float ang = 0.0f;
 
-	if (!paused)
-		ang += deltaTime; // comment out to pause light
+	if (!simPaused)
+		ang += dt; // comment out to pause light
 	const float radius = 15.0f;
 	lightPos.x = cos(ang) * radius;
 	lightPos.y = cos(ang*4.0f) * 2.0f + 15.0f;
 	lightPos.z = sin(ang) * radius;
 	lightPos.w = 1.0f;
 
-	gameobjects["sphere"]->setPosition(lightPos);
+	lightSphere->setPosition(lightPos);
 
 	// Update all game objects
-	for (auto itr = gameobjects.begin(); itr != gameobjects.end(); ++itr)
+	// Remember: root nodes are responsible for updating all of its children
+	// So we need to make sure to only invoke update() for the root nodes.
+	// Otherwise some objects would get updated twice in a frame!
+	static std::vector<GameObject*> roots;
+	roots.clear();
+	for (unsigned int i = 0; i < simObjects.size(); i++)
 	{
-		auto gameobject = itr->second;
+		if (simObjects[i]->isRoot())
+			roots.push_back(simObjects[i]);
+	}
+
+	// Each root only touches its own hierarchy, so they can update at the same time
+	// Every job updates its roots as one batch, see TransformBatch
+	JobSystem::parallelFor((unsigned int)roots.size(), 4, [&](unsigned int start, unsigned int end)
+	{
+		GameObject::updateTransforms(&roots[start], end - start, nullptr);
+	});
+}
+
+// One fixed step of the simulation, then publish the result for the render thread
+void simulationTick(float dt, double time)
+{
+	// Last tick's state, only used on the simulation thread
+	static glm::vec4 previousLightPos;
+	static std::vector<glm::mat4> previousMatrices;
+
+	AllocationTracker::Scope allocationScope("simulationTick");
+	TRACE_SCOPE("simulationTick");
+
+	updateScene(dt);
+
+	SceneSnapshot& snapshot = sceneSnapshots.getWriteBuffer();
+	snapshot.worldMatrices[1].resize(simObjects.size());
+	for (unsigned int i = 0; i < simObjects.size(); i++)
+		snapshot.worldMatrices[1][i] = simObjects[i]->getLocalToWorldMatrix();
 
-		// Remember: root nodes are responsible for updating all of its children
-		// So we need to make sure to only invoke update() for the root nodes.
-		// Otherwise some objects would get updated twice in a frame!
-		if (gameobject->isRoot())
-			gameobject->update(deltaTime);
+	// Very first tick, nothing to interpolate from yet
+	if (previousMatrices.size() != simObjects.size())
+	{
+		previousMatrices = snapshot.worldMatrices[1];
+		previousLightPos = lightPos;
+	}
+
+	snapshot.worldMatrices[0] = previousMatrices;
+	snapshot.lightPos[0] = previousLightPos;
+	snapshot.lightPos[1] = lightPos;
+	snapshot.publishTime = secondsNow();
+
+	previousMatrices = snapshot.worldMatrices[1];
+	previousLightPos = lightPos;
+
+	sceneSnapshots.publish();
+}
+
+// Runs on the render thread, picks up the newest snapshot and interpolates it
+void applySceneSnapshot()
+{
+	TRACE_SCOPE("applySceneSnapshot");
+
+	sceneSnapshots.update();
+	const SceneSnapshot& snapshot = sceneSnapshots.getReadBuffer();
+
+	if (snapshot.worldMatrices[1].size() != simObjects.size())
+		return;
+
+	// The newest tick is shown one tick after it happened, which is
+	// what lets us blend towards it instead of snapping
+	float alpha = (float)((secondsNow() - snapshot.publishTime) / simulationThread.getTickLength());
+	alpha = glm::clamp(alpha, 0.0f, 1.0f);
+
+	// Straight blend of the matrices, ticks are short enough that
+	// the rotation not being a slerp is not visible
+	for (unsigned int i = 0; i < simObjects.size(); i++)
+	{
+		const glm::mat4& from = snapshot.worldMatrices[0][i];
+		const glm::mat4& to = snapshot.worldMatrices[1][i];
+		simObjects[i]->setRenderMatrix(from + (to - from) * alpha);
 	}
+
+	renderLightPos = glm::mix(snapshot.lightPos[0], snapshot.lightPos[1], alpha);
+}
+
+void stopSimulation()
+{
+	simulationThread.stop();
 }
 
 void drawScene(TTK::Camera& cam)
 {
-	for (auto itr = gameobjects.begin(); itr != gameobjects.end(); ++itr)
+	AllocationTracker::Scope allocationScope("drawScene");
+	TRACE_SCOPE("drawScene");
+	TRACE_GPU_SCOPE("drawScene");
+
+	renderQueue.clear();
+
+	for (uint32_t i = 0; i < gameobjects.getNumSlots(); i++)
+	{
+		GameObject* gameobject = gameobjects.getAt(i);
+
+		// Root nodes submit their children
+		if (gameobject && gameobject->isRoot())
+			gameobject->submit(renderQueue);
+	}
+
+	// Sort by state and depth, then draw everything in that order
+	// Keys, culling and matrices are worked out on the job system, only the GL calls happen here
+	renderQueue.prepare(cam);
+	renderQueue.sort();
+
+	// Occlusion queries are tested against the depth pre-pass, without it only the Hi-Z test is used
+	if (useOcclusionCulling)
+		occlusionCuller.cull(renderQueue, cam, hizBuffer, useDepthPrepass);
+
+	renderQueue.packUniforms(cam);
+
+	if (useDepthPrepass)
 	{
-		auto gameobject = itr->second;
+		static const AssetHandle<Material> depthMaterial = materials.find("depthOnly"_id);
+
+		// Depth only, no colour writes
+		GLState::colourMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		renderQueue.executeDepthOnly(cam, materials.get(depthMaterial));
+		GLState::colourMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		if (useOcclusionCulling)
+			occlusionCuller.issueQueries(renderQueue, cam);
 
-		if (gameobject->isRoot())
-			gameobject->draw(cam);
+		// The depth buffer now holds the closest surface of every pixel,
+		// so only fragments exactly on it pass and get shaded
+		GLState::depthFunc(GL_EQUAL);
+		GLState::depthMask(GL_FALSE);
+	}
+
+	sceneFragmentQuery.begin();
+	renderQueue.execute(cam);
+	sceneFragmentQuery.end();
+
+	if (useDepthPrepass)
+	{
+		GLState::depthFunc(GL_LEQUAL);
+		GLState::depthMask(GL_TRUE);
 	}
 }
 
-// Helpful function to apply a shader program on all objects
-void setMaterialForAllGameObjects(std::string materialName)
+// Size of the part of target that is drawn into at scale, SparseBloom rounds the same way
+glm::ivec2 scaledSize(FrameBufferObject& target, float scale)
 {
-	auto mat = materials[materialName];
-	for (auto itr = gameobjects.begin(); itr != gameobjects.end(); ++itr)
+	return glm::ivec2(std::max((int)(target.getWidth() * scale + 0.5f), 1), std::max((int)(target.getHeight() * scale + 0.5f), 1));
+}
+
+// Binds target for drawing, with the viewport on the part of it drawn into at scale
+void bindFrameBufferScaled(FrameBufferObject& target, float scale)
+{
+	target.bindFrameBufferForDrawing();
+	glm::ivec2 size = scaledSize(target, scale);
+	GLState::viewport(0, 0, size.x, size.y);
+}
+
+// For shaders that read source with a full screen quad's uv, after source was drawn at scale
+// xy scales the uv to the drawn part, zw is the largest uv whose bilinear taps stay inside it
+glm::vec4 uvScale(FrameBufferObject& source, float scale)
+{
+	glm::vec2 size(scaledSize(source, scale));
+	glm::vec2 fullSize((float)source.getWidth(), (float)source.getHeight());
+	return glm::vec4(size / fullSize, (size - 0.5f) / fullSize);
+}
+
+// Gathers this frame's lights and bins them into the clusters of the camera
+void updateLights(TTK::Camera& cam, Material* lightingMaterial)
+{
+	AllocationTracker::Scope allocationScope("updateLights");
+	TRACE_GPU_SCOPE("LightClusters::update");
+
+	static std::vector<PointLight> frameLights(LightClusters::MAX_LIGHTS);
+
+	// The light the simulation moves
+	frameLights[0].positionRadius = glm::vec4(glm::vec3(renderLightPos), MAIN_LIGHT_RADIUS);
+	frameLights[0].colour = glm::vec4(1.0f);
+
+	// The rest slowly circle the middle of the scene, at a few different speeds
+	unsigned int numLights = std::min((unsigned int)numSceneLights, (unsigned int)sceneLights.size());
+	for (unsigned int i = 0; i < numLights; i++)
 	{
-		itr->second->material = mat;
+		const glm::vec4& light = sceneLights[i].positionRadius;
+		float angle = lightOrbitTime * (0.1f + 0.05f * (i % 4));
+		float c = cos(angle), s = sin(angle);
+
+		frameLights[i + 1].positionRadius = glm::vec4(light.x * c - light.z * s, light.y, light.x * s + light.z * c, light.w);
+		frameLights[i + 1].colour = sceneLights[i].colour;
 	}
+
+	// Clusters are found from gl_FragCoord, so they cover the part of the frame buffer drawn into
+	glm::ivec2 sceneSize = scaledSize(aFBO, renderScale);
+	lightClusters.update(cam, &frameLights[0], numLights + 1, sceneSize.x, sceneSize.y);
+	lightClusters.bindForShading(lightingMaterial);
+	lightingMaterial->setInt("u_showClusterLights", showClusterLights ? 1 : 0);
 }
 
-void brightPass()
+// How the bloom material reads the scene, the upscaler only runs when the scene is smaller than the frame
+void setSceneUpscale(Material* bloomMaterial)
 {
-	//////////////////////////////////////////////////////////////////////////
-	// IMPLEMENT BRIGHT PASS HERE
-	// - Bind the appropriate shader and the texture that contains the rendered 
-	//   scene and render a full screen quad to the appropriate fbo
-	////////////////////////////////////////////////////////////////////////// 
-	bFBO.bindFrameBufferForDrawing();
+	bloomMaterial->setVec4("u_sceneUVScale", uvScale(aFBO, renderScale));
+	bloomMaterial->setInt("u_upscale", useUpscaler && renderScale < 1.0f ? 1 : 0);
+	bloomMaterial->setFloat("u_sharpness", upscaleSharpness);
+}
 
-	aFBO.bindTextureForSampling(0, GL_TEXTURE0);
+// Limits drawing into target to the part of the frame being drawn again, plus margin texels of target
+// target is drawn at scale, when everything is drawn the scissor still keeps clears inside that part
+// Switches the scissor test off when the whole target is drawn
+void scissorRedraw(FrameBufferObject& target, int margin, float scale)
+{
+	glm::ivec2 size = scaledSize(target, scale);
+
+	if (frameChanges.getRedraw() != FrameChanges::REDRAW_RECT)
+	{
+		GLState::setEnabled(GL_SCISSOR_TEST, scale < 1.0f);
+		GLState::scissor(0, 0, size.x, size.y);
+		return;
+	}
 
+	// The rectangle is in frame pixels, aFBO's size
+	const FrameChanges::Rect& r = frameChanges.getRect();
+	float scaleX = (float)size.x / (float)aFBO.getWidth();
+	float scaleY = (float)size.y / (float)aFBO.getHeight();
 
-	materials["bright"]->mat4Uniforms["u_mvp"] = glm::mat4();
-	materials["bright"]->floatUniforms["u_bloomThreshold"] = bloomThreshold;
+	int x0 = std::max((int)floorf(r.x0 * scaleX) - margin, 0);
+	int y0 = std::max((int)floorf(r.y0 * scaleY) - margin, 0);
+	int x1 = std::min((int)ceilf(r.x1 * scaleX) + margin, size.x);
+	int y1 = std::min((int)ceilf(r.y1 * scaleY) + margin, size.y);
 
-	materials["bright"]->bind();
+	GLState::enable(GL_SCISSOR_TEST);
+	GLState::scissor(x0, y0, x1 - x0, y1 - y0);
+}
 
-	materials["bright"]->sendUniforms();
+// Lights the G-buffer into aFBO, updateLights() must have run with the deferred lighting material
+void deferredLighting(TTK::Camera& cam)
+{
+	AllocationTracker::Scope allocationScope("deferredLighting");
+	TRACE_SCOPE("deferredLighting");
+	TRACE_GPU_SCOPE("deferredLighting");
+
+	static const AssetHandle<Material> lightingHandle = materials.find("deferredLighting"_id);
+	static const AssetHandle<TTK::MeshBase> quadHandle = meshes.find("quad"_id);
+	Material* lightingMaterial = materials.get(lightingHandle);
+	TTK::MeshBase* quadMesh = meshes.get(quadHandle);
+
+	// Every pixel being drawn again gets written, the scene depth stays in the G-buffer
+	bindFrameBufferScaled(aFBO, renderScale);
+	scissorRedraw(aFBO, 0, renderScale);
+	bool depthTest = GLState::isEnabled(GL_DEPTH_TEST);
+	GLState::disable(GL_DEPTH_TEST);
+
+	gBuffer.bindTextureForSampling(0, GL_TEXTURE0);
+	gBuffer.bindTextureForSampling(1, GL_TEXTURE1);
+	gBuffer.bindTextureForSampling(2, GL_TEXTURE2);
+	gBuffer.bindDepthTextureForSampling(GL_TEXTURE3);
+
+	lightingMaterial->setMat4("u_mvp", glm::mat4());
+	lightingMaterial->setMat4("u_inverseProjection", glm::inverse(cam.projMatrix));
+	lightingMaterial->setVec4("u_sceneSize", glm::vec4(glm::vec2(scaledSize(aFBO, renderScale)), 0.0f, 0.0f));
+	lightingMaterial->bind();
+	lightingMaterial->sendUniforms();
+
+	quadMesh->draw();
+
+	for (int i = 0; i < 4; i++)
+		gBuffer.unbindTexture(GL_TEXTURE0 + i);
+
+	GLState::setEnabled(GL_DEPTH_TEST, depthTest);
+	GLState::disable(GL_SCISSOR_TEST);
+}
+
+// Helpful function to apply a shader program on all objects
+void setMaterialForAllGameObjects(NameID materialName)
+{
+	std::shared_ptr<Material> mat = materials.getShared(materialName);
+	for (uint32_t i = 0; i < gameobjects.getNumSlots(); i++)
+	{
+		if (GameObject* gameobject = gameobjects.getAt(i))
+			gameobject->material = mat;
+	}
+}
 
-	meshes["quad"]->draw();
+// Thresholds the scene and halves it step by step down to cFBO's size
+// The first step reads the full size scene once and writes straight into the
+// half size target, instead of writing a full size bright pass and reading it again
+void downsampleBloom()
+{
+	AllocationTracker::Scope allocationScope("downsampleBloom");
+	TRACE_SCOPE("downsampleBloom");
+	TRACE_GPU_SCOPE("downsampleBloom");
 
-	aFBO.unbindTexture(GL_TEXTURE0);
+	static const AssetHandle<Material> downsampleHandle = materials.find("bloomDownsample"_id);
+	static const AssetHandle<TTK::MeshBase> quadHandle = meshes.find("quad"_id);
+	Material* downsampleMaterial = materials.get(downsampleHandle);
+	TTK::MeshBase* quadMesh = meshes.get(quadHandle);
+
+	// Deferred shading keeps the emissive colour in the G-buffer
+	aFBO.bindTextureForSampling(0, GL_TEXTURE0);
+	if (useDeferredShading)
+		gBuffer.bindTextureForSampling(3, GL_TEXTURE1);
+	else
+		aFBO.bindTextureForSampling(1, GL_TEXTURE1);
+
+	downsampleMaterial->shader->bind();
+	downsampleMaterial->setMat4("u_mvp", glm::mat4());
+	downsampleMaterial->setFloat("u_bloomThreshold", bloomThreshold);
+	downsampleMaterial->setFloat("u_bloomKnee", bloomKnee);
+
+	FrameBufferObject* source = &aFBO;
+	for (int i = 0; i < NUM_BLOOM_DOWNSAMPLES; i++)
+	{
+		FrameBufferObject* target = &bloomDownsampleFBO[i];
+		bindFrameBufferScaled(*target, renderScale);
+		scissorRedraw(*target, 1, renderScale);
+		if (i > 0)
+			source->bindTextureForSampling(0, GL_TEXTURE0);
+
+		downsampleMaterial->setInt("u_prefilter", i == 0 ? 1 : 0);
+		downsampleMaterial->setVec4("u_texelSize", glm::vec4(1.0f / (float)source->getWidth(), 1.0f / (float)source->getHeight(), 0.f, 0.f));
+		downsampleMaterial->setVec4("u_uvScale", uvScale(*source, renderScale));
+		downsampleMaterial->sendUniforms();
+		quadMesh->draw();
+
+		source = target;
+	}
+
+	GLState::disable(GL_SCISSOR_TEST);
+	aFBO.unbindTexture(GL_TEXTURE1);
 }
 
 void blurBrightPass()
@@ -288,128 +860,410 @@ void blurBrightPass()
 	//   and render a full screen quad to the appropriate fbo
 	////////////////////////////////////////////////////////////////////////// 
 
-	cFBO.bindFrameBufferForDrawing();
-	bFBO.bindTextureForSampling(0, GL_TEXTURE0);
+	AllocationTracker::Scope allocationScope("blurBrightPass");
+	TRACE_SCOPE("blurBrightPass");
+	TRACE_GPU_SCOPE("blurBrightPass");
+
+	static const AssetHandle<Material> blurHandle = materials.find("blur"_id);
+	static const AssetHandle<TTK::MeshBase> quadHandle = meshes.find("quad"_id);
+	Material* blurMaterial = materials.get(blurHandle);
+	TTK::MeshBase* quadMesh = meshes.get(quadHandle);
+
+	// Starts from the thresholded scene, downsampled to cFBO's size
+	downsampleBloom();
+	FrameBufferObject& source = bloomDownsampleFBO[NUM_BLOOM_DOWNSAMPLES - 1];
+
+	// Only blurs the tiles light can reach
+	// Compute shaders ignore the scissor, so this always blurs every listed tile
+	if (useSparseBloom)
+	{
+		sparseBloom.classify(source, bloomBlurPasses, renderScale);
+		sparseBloom.blur(source, cFBO, dFBO, bloomBlurPasses);
+		return;
+	}
 	
-	materials["blur"]->shader->bind();
-	materials["blur"]->mat4Uniforms["u_mvp"] = glm::mat4();
-	materials["blur"]->vec4Uniforms["u_texelSize"] = glm::vec4(1.0 / (float)cFBO.getWidth(), 1.0 / (float)cFBO.getHeight(), 0.f, 0.f);
+	blurMaterial->shader->bind();
+	blurMaterial->setMat4("u_mvp", glm::mat4());
+	blurMaterial->setVec4("u_texelSize", glm::vec4(1.0 / (float)cFBO.getWidth(), 1.0 / (float)cFBO.getHeight(), 0.f, 0.f));
+	blurMaterial->setVec4("u_uvScale", uvScale(cFBO, renderScale));
+
+	blurMaterial->sendUniforms();
+
+	// Blur the blurred image, dFBO and cFBO take turns so it ends in cFBO
+	// Every pass reads one texel around what it draws, so when only part of the
+	// frame is drawn the earlier passes cover a larger area than the later ones
+	FrameBufferObject* read = &source;
+	for (int i = 0; i < bloomBlurPasses; i++)
+	{
+		FrameBufferObject* write = (i % 2 == 0) ? &dFBO : &cFBO;
+		bindFrameBufferScaled(*write, renderScale);
+		scissorRedraw(*write, bloomBlurPasses - 1 - i, renderScale);
+		read->bindTextureForSampling(0, GL_TEXTURE0);
+		quadMesh->draw();
+
+		read = write;
+	}
+
+	GLState::disable(GL_SCISSOR_TEST);
+}
+
+// Adds the blurred bloom in cFBO onto the scene, into frameFBO
+// frameFBO is always drawn in full, this is where the scene gets upscaled
+void compositeBloom()
+{
+	AllocationTracker::Scope allocationScope("compositeBloom");
+	TRACE_SCOPE("compositeBloom");
+	TRACE_GPU_SCOPE("compositeBloom");
+
+	static const AssetHandle<Material> bloomHandle = materials.find("bloom"_id);
+	static const AssetHandle<TTK::MeshBase> quadHandle = meshes.find("quad"_id);
+	Material* bloomMaterial = materials.get(bloomHandle);
+	TTK::MeshBase* quadMesh = meshes.get(quadHandle);
 
-	materials["blur"]->sendUniforms();
-	meshes["quad"]->draw();
+	frameFBO.bindFrameBufferForDrawing();
+	scissorRedraw(frameFBO, 0, 1.0f);
 
-	int pass = 30; // pass 30 times
-	for (int i = 0; i < pass; i++) {
-		dFBO.bindFrameBufferForDrawing();
+	bloomMaterial->setMat4("u_mvp", glm::mat4());
+	setSceneUpscale(bloomMaterial);
+
+	if (useSparseBloom)
+	{
+		// Copy (and upscale) the scene, then add the bloom only in the tiles that have any
+		aFBO.bindTextureForSampling(0, GL_TEXTURE1);
+		bloomMaterial->shader->bind();
+		bloomMaterial->setInt("u_addBloom", 0);
+		bloomMaterial->sendUniforms();
+		quadMesh->draw();
+		aFBO.unbindTexture(GL_TEXTURE1);
+
+		const FrameChanges::Rect& r = frameChanges.getRect();
+		sparseBloom.composite(cFBO, frameFBO, glm::ivec4(r.x0, r.y0, r.x1, r.y1));
+	}
+	else
+	{
+		//////////////////////////////////////////////////////////////////////////
+		// COMPOSTIE BLOOM HERE
+		// Bind the original scene texture and the blurred bright texture
+		//////////////////////////////////////////////////////////////////////////
+		// The scene is upscaled in the same pass
+		aFBO.bindTextureForSampling(0, GL_TEXTURE1);
 		cFBO.bindTextureForSampling(0, GL_TEXTURE0);
-		meshes["quad"]->draw();
+
+		bloomMaterial->shader->bind();
+		bloomMaterial->setInt("u_addBloom", 1);
+		bloomMaterial->setVec4("u_brightUVScale", uvScale(cFBO, renderScale));
+		bloomMaterial->sendUniforms();
+		quadMesh->draw();
+
+		aFBO.unbindTexture(GL_TEXTURE1);
 	}
 
-	cFBO.bindFrameBufferForDrawing();
-	dFBO.bindTextureForSampling(0, GL_TEXTURE0);
+	GLState::disable(GL_SCISSOR_TEST);
+	cFBO.unbindTexture(GL_TEXTURE0);
+}
+
+// Compares this frame with the last one and decides how much of it to draw again, see FrameChanges
+FrameChanges::Redraw trackFrameChanges()
+{
+	TRACE_SCOPE("trackFrameChanges");
+
+	// Everything besides the camera and the objects that changes the image
+	struct RedrawSettings
+	{
+		int windowWidth, windowHeight;
+		float renderScale;
+		int mode;
+		float bloomThreshold, bloomKnee;
+		int bloomBlurPasses;
+		bool sparseBloom, deferredShading, showClusterLights, upscaler;
+		float upscaleSharpness;
+		int numSceneLights;
+		float lodPixelError;
+		glm::vec4 lightPos;
+		float lightOrbitTime;
+	} settings;
+
+	// Compared byte for byte, padding included
+	memset(&settings, 0, sizeof(settings));
+	settings.windowWidth = windowWidth;
+	settings.windowHeight = windowHeight;
+	settings.renderScale = renderScale;
+	settings.mode = currentMode;
+	settings.bloomThreshold = bloomThreshold;
+	settings.bloomKnee = bloomKnee;
+	settings.bloomBlurPasses = bloomBlurPasses;
+	settings.sparseBloom = useSparseBloom;
+	settings.deferredShading = useDeferredShading;
+	settings.showClusterLights = showClusterLights;
+	settings.upscaler = useUpscaler;
+	settings.upscaleSharpness = upscaleSharpness;
+	settings.numSceneLights = useClusteredLighting ? numSceneLights : 0;
+	settings.lodPixelError = renderQueue.lodPixelError;
+	settings.lightPos = renderLightPos;
+	settings.lightOrbitTime = useClusteredLighting ? lightOrbitTime : 0.0f;
+
+	frameChanges.historyFrames = useOcclusionCulling ? OCCLUSION_REDRAW_FRAMES : 1;
+	frameChanges.begin(playerCamera.viewProjMatrix, aFBO.getWidth(), aFBO.getHeight(), &settings, sizeof(settings));
+
+	if (!useIncrementalRedraw)
+		frameChanges.invalidate();
+
+	for (uint32_t i = 0; i < gameobjects.getNumSlots(); i++)
+		frameChanges.addObject(i, gameobjects.getAt(i));
+
+	// How far bloom can carry light from a changed pixel, in frame pixels
+	// One cFBO texel per blur pass, plus a few for the downsample and the bilinear composite
+	int dilation = 0;
+	if (currentMode != DEFAULT)
+	{
+		glm::ivec2 bloomSize = scaledSize(cFBO, renderScale);
+		float texelSize = std::max((float)aFBO.getWidth() / (float)bloomSize.x, (float)aFBO.getHeight() / (float)bloomSize.y);
+		dilation = (bloomBlurPasses + 4) * (int)ceilf(texelSize);
+	}
+
+	return frameChanges.end(dilation);
+}
+
+/* function IdleCallbackFunction()
+* Description:
+*  - this is called whenever GLUT has no events left to handle
+*  - waits until the frame pacer says the next frame is due
+*  - no drawing, just changing the state
+*  - calls for a redisplay, input that arrives while waiting still makes it into that frame
+*/
+void IdleCallbackFunction()
+{
+	// Calculate new deltaT for potential updates and physics calculations
+	{
+		TRACE_SCOPE("FramePacer::beginFrame");
+		deltaTime = framePacer.beginFrame();
+	}
+
+	/* this call makes it actually show up on screen */
+	glutPostRedisplay();
+}
+
+// Starts frames again if the loop is idle, call for anything that changes what is on screen
+// Input, resizes and keep-alive ticks already do, so should asset hot-reloads
+void requestRedraw(int frames = IDLE_SETTLE_FRAMES)
+{
+	settleFrames = std::max(settleFrames, frames);
+
+	if (!loopIdle)
+		return;
+
+	// What would have been drawn at the pacer's rate in the meantime
+	float rate = (framePacer.mode == FramePacer::MODE_TARGET_FPS && framePacer.targetFPS > 0.0f) ? framePacer.targetFPS : (float)FRAMES_PER_SECOND;
+	double idleSeconds = std::chrono::duration<double>(FramePacer::Clock::now() - idleStart).count();
+	framesSkipped += (unsigned long long)(idleSeconds * rate);
+
+	loopIdle = false;
+	keepAliveGeneration++;
+	framePacer.resume();
+	simulationThread.resume();
+	glutIdleFunc(IdleCallbackFunction);
+}
+
+void KeepAliveCallbackFunction(int generation)
+{
+	if (loopIdle && (unsigned int)generation == keepAliveGeneration)
+		requestRedraw(1);
+}
+
+// Called at the end of every frame, stops the loop once nothing is changing any more
+void updateIdleLoop(bool animating)
+{
+	if (settleFrames > 0)
+		settleFrames--;
+
+	if (!useIdleLoop || animating || settleFrames > 0 || !frameChanges.isStatic())
+		return;
+
+	loopIdle = true;
+	idleStart = FramePacer::Clock::now();
+	glutIdleFunc(nullptr);
 
-	meshes["quad"]->draw();
+	// Nothing moves while paused, no need to keep ticking until the next event
+	if (paused)
+		simulationThread.pause();
 
+	if (keepAliveSeconds > 0.0f)
+		glutTimerFunc((unsigned int)(keepAliveSeconds * 1000.0f), KeepAliveCallbackFunction, (int)keepAliveGeneration);
 }
 
 // This is where we draw stuff
 void DisplayCallbackFunction(void)
 {
+	// Per frame counters and transient memory start over
+	AllocationTracker::beginFrame();
+	FrameArena::reset();
+
+	// Picks up GPU timings of earlier frames
+	TRACE_UPDATE();
+
+#ifdef TRACING_ENABLED
+	// Frames left to record before the trace is written
+	static int traceFramesLeft = 0;
+#endif
+
+	TRACE_SCOPE("Frame");
+
+	// Everything this function uses from the asset registries, looked up once
+	static const AssetHandle<Material> defaultHandle = materials.find("default"_id);
+	static const AssetHandle<Material> unlitHandle = materials.find("unlitTexture"_id);
+	static const AssetHandle<Material> bloomHandle = materials.find("bloom"_id);
+	static const AssetHandle<Material> deferredLightingHandle = materials.find("deferredLighting"_id);
+	static const AssetHandle<TTK::MeshBase> quadHandle = meshes.find("quad"_id);
+	Material* defaultMaterial = materials.get(defaultHandle);
+	Material* unlitMaterial = materials.get(unlitHandle);
+	Material* bloomMaterial = materials.get(bloomHandle);
+	TTK::MeshBase* quadMesh = meshes.get(quadHandle);
+
+	GLState::resetStats();
+	RenderStats::beginFrame();
 	TTK::StartUI(windowWidth, windowHeight);
 	glm::vec4 clearColor = glm::vec4(0.0);
 	
 	// Clear back buffer
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	RenderStats::countClear();
 
 	// Update cameras
 	playerCamera.update();
 
-	// Update all gameobjects
-	updateScene();
+	// Get the latest state from the simulation thread
+	applySceneSnapshot();
+
+	// The scene lights stop with the moving light
+	if (!paused)
+		lightOrbitTime += deltaTime;
+
+	// Picks the scale of this frame from the GPU time of earlier ones
+	dynamicResolution.update();
+	renderScale = dynamicResolution.getScale();
+
+	// Nothing is drawn into the frame buffers when nothing changed, the post processing
+	// below only shows what they still hold
+	bool redraw = trackFrameChanges() != FrameChanges::REDRAW_NONE;
+
+	// Only frames drawn in full tell how long a frame at this scale takes
+	bool timeFrame = frameChanges.getRedraw() == FrameChanges::REDRAW_FULL;
+	if (timeFrame)
+		dynamicResolution.beginFrame();
 
 	//////////////////////////////////////////////////////////////////////////
 	// BIND SCENE FBO HERE
 	////////////////////////////////////////////////////////////////////////// 
-	aFBO.bindFrameBufferForDrawing();
-	aFBO.clearFrameBuffer(clearColor);
-
-	// Set material properties
-	materials["default"]->vec4Uniforms["u_lightPos"] = playerCamera.viewMatrix * lightPos;
-
-	// draw the scene to the fbo
-	drawScene(playerCamera);
+	// With deferred shading the scene goes into the G-buffer and is lit into aFBO afterwards
+	FrameBufferObject& sceneFBO = useDeferredShading ? gBuffer : aFBO;
+	if (redraw)
+	{
+		// The clear is scissored too, only the changed part is drawn again
+		bindFrameBufferScaled(sceneFBO, renderScale);
+		scissorRedraw(sceneFBO, 0, renderScale);
+		sceneFBO.clearFrameBuffer(clearColor);
+
+		// Set material properties
+		defaultMaterial->setVec4("u_lightPos", playerCamera.viewMatrix * renderLightPos);
+		if (useClusteredLighting)
+			updateLights(playerCamera, useDeferredShading ? materials.get(deferredLightingHandle) : defaultMaterial);
+
+		// draw the scene to the fbo
+		drawScene(playerCamera);
+		GLState::disable(GL_SCISSOR_TEST);
+
+		// Build next frame's Hi-Z buffer from this frame's depth
+		if (useOcclusionCulling)
+		{
+			TRACE_SCOPE("HiZBuffer::build");
+			TRACE_GPU_SCOPE("HiZBuffer::build");
+			hizBuffer.build(sceneFBO, playerCamera.viewProjMatrix, glm::vec2(uvScale(sceneFBO, renderScale)));
+		}
+
+		if (useDeferredShading)
+			deferredLighting(playerCamera);
+	}
 
 	//////////////////////////////////////////////////////////////////////////
 	// UNBIND SCENE FBO HERE
 	////////////////////////////////////////////////////////////////////////// 
 	aFBO.unbindFrameBuffer(windowWidth, windowHeight);
 
-	static auto unlitMaterial = materials["unlitTexture"];
-
 	// Apply a post process filter
 	switch (currentMode)
 	{
 		// No filter
 	case DEFAULT: // press 1
 	{
+		TRACE_SCOPE("PostProcess");
+		TRACE_GPU_SCOPE("PostProcess");
+
 		//////////////////////////////////////////////////////////////////////////
 		// BIND SCENE FBO TEXTURE HERE
 		////////////////////////////////////////////////////////////////////////// 
 		// The code below draws a full screen quad using the currently bound texture
 		// uncomment it when you are ready to use it
 		
-		aFBO.bindTextureForSampling(0, GL_TEXTURE0);
+		// The bloom composite without the bloom, so a scene drawn at a lower scale is upscaled the same way
+		aFBO.bindTextureForSampling(0, GL_TEXTURE1);
 		// Tell opengl which shader we want it to use
-		unlitMaterial->shader->bind();
+		bloomMaterial->shader->bind();
 
 		// Send uniform varibles to GPU
-		unlitMaterial->mat4Uniforms["u_mvp"] = glm::mat4();
-		unlitMaterial->sendUniforms();
+		bloomMaterial->setMat4("u_mvp", glm::mat4());
+		bloomMaterial->setInt("u_addBloom", 0);
+		setSceneUpscale(bloomMaterial);
+		bloomMaterial->sendUniforms();
 
 		// Draw fullscreen quad
-		meshes["quad"]->draw();
+		quadMesh->draw();
 		//////////////////////////////////////////////////////////////////////////
 		// UNBIND SCENE FBO TEXTURE HERE
 		////////////////////////////////////////////////////////////////////////// 
-		aFBO.unbindTexture(GL_TEXTURE0);
+		aFBO.unbindTexture(GL_TEXTURE1);
 	}
 	break;
 
 	// Extract highlights
 	case BRIGHT_PASS: // press 2
 	{
-		//aFBO.bindTextureForSampling(0, GL_TEXTURE0);
-
-		brightPass(); // Implement this function!
-		//aFBO.unbindTexture(GL_TEXTURE0);
+		TRACE_SCOPE("PostProcess");
+		TRACE_GPU_SCOPE("PostProcess");
 
 		//////////////////////////////////////////////////////////////////////////
 		// BIND BRIGHT PASS FBO TEXTURE HERE
 		//////////////////////////////////////////////////////////////////////////
-
-		bFBO.bindTextureForSampling(0, GL_TEXTURE0);
+		// The first, half size step of the bloom downsample, the thresholded scene plus emissive objects
+		if (redraw)
+			downsampleBloom();
+		bloomDownsampleFBO[0].bindTextureForSampling(0, GL_TEXTURE0);
 
 		ImGui::SliderFloat("Bloom Threshold: ", &bloomThreshold, 0.f, 1.f, "%.2f", 1);
+		ImGui::SliderFloat("Bloom Knee: ", &bloomKnee, 0.f, 1.f, "%.2f", 1);
 		FrameBufferObject::unbindFrameBuffer(windowWidth, windowHeight);
 		FrameBufferObject::clearFrameBuffer(clearColor);
 		unlitMaterial->shader->bind();
-		unlitMaterial->mat4Uniforms["u_mvp"] = glm::mat4();
+		unlitMaterial->setMat4("u_mvp", glm::mat4());
+		unlitMaterial->setVec4("u_uvScale", uvScale(bloomDownsampleFBO[0], renderScale));
 		unlitMaterial->sendUniforms();
 
-		meshes["quad"]->draw();
+		quadMesh->draw();
 		
 		//////////////////////////////////////////////////////////////////////////
 		// UNBIND BRIGHT PASS FBO TEXTURE HERE
 		////////////////////////////////////////////////////////////////////////// 
-		bFBO.unbindTexture(GL_TEXTURE0);
+		bloomDownsampleFBO[0].unbindTexture(GL_TEXTURE0);
 	}
 	break;
 
 	// Blur highlights
 	case BLURRED_BRIGHT_PASS: // press 3
 	{
-		brightPass(); // Implement this function!
-		blurBrightPass();// Implement this function!
+		TRACE_SCOPE("PostProcess");
+		TRACE_GPU_SCOPE("PostProcess");
+
+		if (redraw)
+			blurBrightPass();// Implement this function!
 
 		//////////////////////////////////////////////////////////////////////////
 		// BIND BLURRED BRIGHT PASS FBO TEXTURE HERE
@@ -419,10 +1273,11 @@ void DisplayCallbackFunction(void)
 		FrameBufferObject::unbindFrameBuffer(windowWidth, windowHeight);
 		FrameBufferObject::clearFrameBuffer(clearColor);
 		unlitMaterial->shader->bind();
-		unlitMaterial->mat4Uniforms["u_mvp"] = glm::mat4();
+		unlitMaterial->setMat4("u_mvp", glm::mat4());
+		unlitMaterial->setVec4("u_uvScale", uvScale(cFBO, renderScale));
 		unlitMaterial->sendUniforms();
 
-		meshes["quad"]->draw();
+		quadMesh->draw();
 		//////////////////////////////////////////////////////////////////////////
 		// UNBIND BLURRED BRIGHT PASS FBO TEXTURE HERE
 		//////////////////////////////////////////////////////////////////////////
@@ -437,44 +1292,205 @@ void DisplayCallbackFunction(void)
 	// Composite the bloom effect
 	case BLOOM: // press 4
 	{
-		brightPass(); // Implement this function!
-		blurBrightPass(); // Implement this function!
+		TRACE_SCOPE("PostProcess");
+		TRACE_GPU_SCOPE("PostProcess");
+
+		if (redraw)
+		{
+			blurBrightPass(); // Implement this function!
+			compositeBloom();
+		}
 
 		//////////////////////////////////////////////////////////////////////////
-		// COMPOSTIE BLOOM HERE AND DRAW THE RESULT TO THE BACK BUFFER
-		// Bind the original scene texture and the blurred bright texture
+		// DRAW THE COMPOSITED FRAME TO THE BACK BUFFER
 		//////////////////////////////////////////////////////////////////////////
-		aFBO.bindTextureForSampling(0, GL_TEXTURE1);
-		cFBO.bindTextureForSampling(0, GL_TEXTURE0);
-
+		frameFBO.bindTextureForSampling(0, GL_TEXTURE0);
 
 		FrameBufferObject::unbindFrameBuffer(windowWidth, windowHeight);
 		FrameBufferObject::clearFrameBuffer(clearColor);
-		materials["bloom"]->shader->bind();
-		materials["bloom"]->mat4Uniforms["u_mvp"] = glm::mat4();
-		materials["bloom"]->sendUniforms();
+		unlitMaterial->shader->bind();
+		unlitMaterial->setMat4("u_mvp", glm::mat4());
+		unlitMaterial->setVec4("u_uvScale", uvScale(frameFBO, 1.0f));
+		unlitMaterial->sendUniforms();
 
-		meshes["quad"]->draw();
+		quadMesh->draw();
 
 		//////////////////////////////////////////////////////////////////////////
 		// UNBIND TEXTURES
 		//////////////////////////////////////////////////////////////////////////
-		aFBO.unbindTexture(GL_TEXTURE1);
-		cFBO.unbindTexture(GL_TEXTURE0);
+		frameFBO.unbindTexture(GL_TEXTURE0);
 	}
 	break;
 	}
 
+	if (timeFrame)
+		dynamicResolution.endFrame();
+
 	// Draw UI
+	// The scope runs to the end of the frame, so it also covers the swap
+	AllocationTracker::Scope allocationScope("UI");
+	TRACE_SCOPE("UI");
 	ImGui::Checkbox("Animate Light", &paused);
+	simPaused = paused;
 	ImGui::RadioButton("Default Shading", (int*)&currentMode, 0);
 	ImGui::RadioButton("Bright Pass", (int*)&currentMode, 1);
 	ImGui::RadioButton("Blurred Bright Pass", (int*)&currentMode, 2);
 	ImGui::RadioButton("Bloom", (int*)&currentMode, 3);
-	TTK::EndUI();
+
+	// Odd counts are rounded down, the blur has to end in cFBO
+	if (ImGui::SliderInt("Bloom blur passes", &bloomBlurPasses, 2, 32))
+		bloomBlurPasses &= ~1;
+	if (sparseBloomSupported)
+		ImGui::Checkbox("Sparse bloom", &useSparseBloom);
+
+	// Draws only what changed since the last frame
+	ImGui::Checkbox("Incremental redraw", &useIncrementalRedraw);
+	const FrameChanges::Rect& redrawRect = frameChanges.getRect();
+	switch (frameChanges.getRedraw())
+	{
+	case FrameChanges::REDRAW_NONE: ImGui::Text("Redrawn: nothing, last frame reused"); break;
+	case FrameChanges::REDRAW_RECT: ImGui::Text("Redrawn: %d x %d pixels", redrawRect.x1 - redrawRect.x0, redrawRect.y1 - redrawRect.y0); break;
+	default: ImGui::Text("Redrawn: everything"); break;
+	}
+
+	// Lowers the scene resolution while the GPU can not keep up
+	ImGui::Checkbox("Dynamic resolution", &dynamicResolution.enabled);
+	ImGui::SliderFloat("GPU budget (ms)", &dynamicResolution.targetTime, 4.0f, 33.0f, "%.1f", 1);
+	if (!dynamicResolution.enabled)
+		ImGui::SliderFloat("Render scale", &dynamicResolution.fixedScale, DynamicResolution::MIN_SCALE, DynamicResolution::MAX_SCALE, "%.2f", 1);
+	ImGui::Text("Render scale: %d%%  GPU time: %.2f ms", (int)(renderScale * 100.0f + 0.5f), dynamicResolution.getGPUTime());
+	ImGui::Checkbox("Edge adaptive upscale", &useUpscaler);
+	ImGui::SliderFloat("Upscale sharpness", &upscaleSharpness, 0.0f, 1.0f, "%.2f", 1);
+
+	ImGui::Checkbox("Depth Pre-Pass", &useDepthPrepass);
+	ImGui::Text("Shaded fragments: %llu", (unsigned long long)sceneFragmentQuery.getResult());
+
+	if (useClusteredLighting)
+	{
+		ImGui::SliderInt("Lights", &numSceneLights, 0, LightClusters::MAX_LIGHTS - 1);
+		ImGui::Checkbox("Bin lights on the GPU", &lightClusters.useComputeShader);
+		ImGui::Checkbox("Show lights per cluster", &showClusterLights);
+
+		// Switching moves every object between the forward and the G-buffer material
+		if (ImGui::Checkbox("Deferred shading", &useDeferredShading))
+			setMaterialForAllGameObjects(useDeferredShading ? "gBuffer"_id : "default"_id);
+		ImGui::Text("Lights binned: %u  Full clusters: %u", lightClusters.getNumLights(), lightClusters.getNumOverflows());
+	}
+	else
+		ImGui::Text("Clustered lighting needs OpenGL 4.3");
+
+	ImGui::Checkbox("Occlusion Culling", &useOcclusionCulling);
+	const OcclusionStats& occlusionStats = occlusionCuller.getStats();
+	ImGui::Text("Occlusion tested: %u  Hi-Z rejected: %u", occlusionStats.tested, occlusionStats.hizRejected);
+	ImGui::Text("Conditional draws: %u  skipped: %u", occlusionStats.conditionalDraws, occlusionStats.conditionalRejected);
+
+	const RenderQueueStats& queueStats = renderQueue.getStats();
+	ImGui::Text("Draws: %u  Program binds: %u  Material changes: %u", queueStats.numItems, queueStats.programBinds, queueStats.materialChanges);
+	ImGui::Text("Texture binds: %u  Mesh binds: %u", queueStats.textureBinds, queueStats.meshBinds);
+	ImGui::Text("Triangles: %u", queueStats.triangles);
+	ImGui::SliderFloat("LOD Pixel Error", &renderQueue.lodPixelError, 0.f, 8.f, "%.1f", 1);
+
+	// Note: this is read before the UI is drawn, so UI state changes are not included
+	const GLState::Stats& stateStats = GLState::getStats();
+	ImGui::Text("GL state calls issued: %u  skipped: %u", stateStats.callsIssued, stateStats.callsSkipped);
+	ImGui::Text("Job system threads: %u", JobSystem::getNumThreads());
+
+	// Lower instruction sets are there to compare against, the simulation thread picks the change up on its next tick
+	ImGui::Text("Transform math: %s", TransformBatch::getName(TransformBatch::getInstructionSet()));
+	for (int i = 0; i <= TransformBatch::getSupported(); i++)
+	{
+		TransformBatch::InstructionSet set = (TransformBatch::InstructionSet)i;
+		if (i > 0)
+			ImGui::SameLine();
+		if (ImGui::RadioButton(TransformBatch::getName(set), TransformBatch::getInstructionSet() == set))
+			TransformBatch::setInstructionSet(set);
+	}
+
+	// Last finished frame and the average over the last RenderStats::AVERAGE_FRAMES frames
+	// With pipeline statistics these are a few frames old, they wait for the fragment count
+	const RenderStats::Counters& renderStats = RenderStats::getLastFrame();
+	const RenderStats::Counters renderAverage = RenderStats::getAverage();
+	ImGui::Text("Draw calls: %u (avg %u)  Triangles: %u (avg %u)", renderStats.drawCalls, renderAverage.drawCalls, renderStats.triangles, renderAverage.triangles);
+	ImGui::Text("Binds - program: %u  VAO: %u  texture: %u  FBO: %u", renderStats.programBinds, renderStats.vertexArrayBinds, renderStats.textureBinds, renderStats.framebufferBinds);
+	ImGui::Text("  avg - program: %u  VAO: %u  texture: %u  FBO: %u", renderAverage.programBinds, renderAverage.vertexArrayBinds, renderAverage.textureBinds, renderAverage.framebufferBinds);
+	ImGui::Text("Uniforms: %u (avg %u)  Clears: %u  Uploaded: %llu bytes (avg %llu)", renderStats.uniformUploads, renderAverage.uniformUploads, renderStats.clears, renderStats.bytesUploaded, renderAverage.bytesUploaded);
+	if (RenderStats::hasPipelineStatistics())
+		ImGui::Text("Fragment shader invocations: %llu (avg %llu)", renderStats.fragmentInvocations, renderAverage.fragmentInvocations);
+	bool recordStats = RenderStats::isRecording();
+	if (ImGui::Checkbox("Record stats to renderstats.csv", &recordStats))
+	{
+		if (recordStats)
+			RenderStats::startRecording("renderstats.csv");
+		else
+			RenderStats::stopRecording();
+	}
+	ImGui::Text("Simulation ticks: %u (%d per second)", simulationThread.getTickCount(), SIMULATION_TICKS_PER_SECOND);
+
+	// Frame pacing, takes effect on the next beginFrame()
+	ImGui::RadioButton("Uncapped", (int*)&framePacer.mode, FramePacer::MODE_UNCAPPED); ImGui::SameLine();
+	ImGui::RadioButton("VSync", (int*)&framePacer.mode, FramePacer::MODE_VSYNC); ImGui::SameLine();
+	ImGui::RadioButton("Target FPS", (int*)&framePacer.mode, FramePacer::MODE_TARGET_FPS);
+	ImGui::SliderFloat("FPS", &framePacer.targetFPS, 15.0f, 240.0f, "%.0f", 1);
+	ImGui::SliderInt("Max frames in flight", &framePacer.maxFramesInFlight, 1, FramePacer::MAX_FRAMES_IN_FLIGHT);
+	const FramePacer::Stats& paceStats = framePacer.getStats();
+	ImGui::Text("Frame: %.2f ms  waited: %.2f ms  GPU wait: %.2f ms  in flight: %u", paceStats.frameTime, paceStats.waitTime, paceStats.gpuWaitTime, paceStats.framesInFlight);
+	ImGui::Text("Input to present: %.2f ms (max %.2f ms)", paceStats.latency, paceStats.maxLatency);
+
+	// Stops drawing frames while nothing changes
+	ImGui::Checkbox("Idle when nothing changes", &useIdleLoop);
+	ImGui::SliderFloat("Keep-alive interval (s)", &keepAliveSeconds, 0.0f, 10.0f, "%.1f", 1);
+	ImGui::Text("Frames skipped while idle: %llu", framesSkipped);
+
+	// Heap traffic of the last frame, should stay at 0 once everything is loaded
+	// ImGui allocates with malloc, so its own memory is not part of this
+	const AllocationTracker::Counts& frameAllocations = AllocationTracker::getLastFrame();
+	ImGui::Text("Allocations last frame: %llu (%llu bytes)  frees: %llu", frameAllocations.allocations, frameAllocations.bytes, frameAllocations.frees);
+	for (int i = 0; i < AllocationTracker::getNumScopes(); i++)
+	{
+		const AllocationTracker::ScopeStats& scope = AllocationTracker::getScope(i);
+		ImGui::Text("  %s: %llu (%llu bytes)", scope.name, scope.lastFrame.allocations, scope.lastFrame.bytes);
+	}
+	ImGui::Text("Frame arena: %u / %u KB (peak %u KB)", (unsigned int)(FrameArena::getUsed() / 1024), (unsigned int)(FrameArena::getCapacity() / 1024), (unsigned int)(FrameArena::getPeak() / 1024));
+
+#ifdef TRACING_ENABLED
+	// Records the next frames and writes them out, open the file in chrome://tracing or ui.perfetto.dev
+	if (traceFramesLeft > 0)
+		ImGui::Text("Capturing trace: %d frames left", traceFramesLeft);
+	else if (ImGui::Button("Capture trace (120 frames)") && !Trace::isActive())
+	{
+		TRACE_BEGIN_SESSION();
+		traceFramesLeft = 120;
+	}
+#endif
+
+	{
+		TRACE_GPU_SCOPE("UI");
+		TTK::EndUI();
+	}
+
+	// Everything has been drawn, the UI included
+	RenderStats::endFrame();
 
 	/* Swap Buffers to Make it show up on screen */
-	glutSwapBuffers();
+	{
+		TRACE_SCOPE("SwapBuffers");
+		glutSwapBuffers();
+	}
+
+	// Fence the frame so the pacer knows when the GPU is done with it
+	framePacer.endFrame();
+
+#ifdef TRACING_ENABLED
+	if (traceFramesLeft > 0 && --traceFramesLeft == 0)
+		TRACE_END_SESSION("trace_frames.json");
+#endif
+
+	// Keep going while anything animates, otherwise wait for the next event
+	bool animating = !paused;
+#ifdef TRACING_ENABLED
+	animating = animating || traceFramesLeft > 0;
+#endif
+	updateIdleLoop(animating);
 }
 
 /* function void KeyboardCallbackFunction(unsigned char, int,int)
@@ -483,6 +1499,10 @@ void DisplayCallbackFunction(void)
 */
 void KeyboardCallbackFunction(unsigned char key, int x, int y)
 {
+	// Latency is measured from the first input of a frame
+	framePacer.markInput();
+	requestRedraw();
+
 	switch (key)
 	{
 	case 27: // the escape key
@@ -543,6 +1563,8 @@ void KeyboardCallbackFunction(unsigned char key, int x, int y)
 */
 void KeyboardUpCallbackFunction(unsigned char key, int x, int y)
 {
+	requestRedraw();
+
 	// Imgui
 
 	ImGuiIO& io = ImGui::GetIO();
@@ -568,30 +1590,6 @@ void KeyboardUpCallbackFunction(unsigned char key, int x, int y)
 	}
 }
 
-/* function TimerCallbackFunction(int value)
-* Description:
-*  - this is called many times per second
-*  - this enables you to animate things
-*  - no drawing, just changing the state
-*  - changes the frame number and calls for a redisplay
-*  - FRAME_DELAY is the number of milliseconds to wait before calling the timer again
-*/
-void TimerCallbackFunction(int value)
-{
-	// Calculate new deltaT for potential updates and physics calculations
-	static int elapsedTimeAtLastTick = 0;
-	int totalElapsedTime = glutGet(GLUT_ELAPSED_TIME);
-
-	deltaTime = float(totalElapsedTime - elapsedTimeAtLastTick);
-	deltaTime /= 1000.0f;
-	elapsedTimeAtLastTick = totalElapsedTime;
-
-	/* this call makes it actually show up on screen */
-	glutPostRedisplay();
-	/* this call gives it a proper frame delay to hit our target FPS */
-	glutTimerFunc(FRAME_DELAY, TimerCallbackFunction, 0);
-}
-
 /* function WindowReshapeCallbackFunction()
 * Description:
 *  - this is called whenever the window is resized
@@ -606,12 +1604,16 @@ void WindowReshapeCallbackFunction(int w, int h)
 	playerCamera.winHeight = (float)h;
 	playerCamera.winWidth = (float)w;
 
-	glViewport(0, 0, w, h);
+	GLState::viewport(0, 0, w, h);
+	requestRedraw();
 }
 
 
 void MouseClickCallbackFunction(int button, int state, int x, int y)
 {
+	framePacer.markInput();
+	requestRedraw();
+
 	mousePosition.x = (float)x;
 	mousePosition.y = (float)y;
 
@@ -623,6 +1625,9 @@ void MouseClickCallbackFunction(int button, int state, int x, int y)
 
 void SpecialInputCallbackFunction(int key, int x, int y)
 {
+	framePacer.markInput();
+	requestRedraw();
+
 	switch (key)
 	{
 	case GLUT_KEY_UP:
@@ -643,6 +1648,9 @@ void SpecialInputCallbackFunction(int key, int x, int y)
 // Called when the mouse is clicked and moves
 void MouseMotionCallbackFunction(int x, int y)
 {
+	framePacer.markInput();
+	requestRedraw();
+
 	ImGui::GetIO().MousePos = ImVec2((float)x, (float)y);
 
 	if (!ImGui::GetIO().WantCaptureMouse)
@@ -662,12 +1670,32 @@ void MouseMotionCallbackFunction(int x, int y)
 // Called when the mouse is moved inside the window
 void MousePassiveMotionCallbackFunction(int x, int y)
 {
+	requestRedraw();
+
 	ImGui::GetIO().MousePos = ImVec2((float)x, (float)y);
 
 	mousePositionFlipped.x = (float)x;
 	mousePositionFlipped.y = (float)(windowHeight - y);
 }
 
+// Called when the window closes, including through glutExit(), while the GL context still exists
+// GL objects that are globals can't release themselves in their destructors, that runs too late
+void CloseCallbackFunction()
+{
+	lightClusters.destroy();
+	sparseBloom.destroy();
+	hizBuffer.destroy();
+	sceneFragmentQuery.destroy();
+	dynamicResolution.destroy();
+	framePacer.destroy();
+
+	for (uint32_t i = 0; i < gameobjects.getNumSlots(); i++)
+	{
+		if (GameObject* gameobject = gameobjects.getAt(i))
+			gameobject->destroyOcclusionQuery();
+	}
+}
+
 /* function main()
 * Description:
 *  - this is the main function
@@ -680,6 +1708,10 @@ int main(int argc, char **argv)
 	_CrtSetDbgFlag(_CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF);
 #endif
 
+	// Record everything up to the first frame, written to trace_startup.json
+	TRACE_THREAD_NAME("Main");
+	TRACE_BEGIN_SESSION();
+
 	/* initialize the window and OpenGL properly */
 
 	//////////////////////////////////////////////////////////////////////////
@@ -687,12 +1719,15 @@ int main(int argc, char **argv)
 	// Must set a CORE_PROFILE for render doc to work
 	// Must use FREEGLUT instead of GLUT
 	//////////////////////////////////////////////////////////////////////////
-	glutInitContextVersion(4, 0);
-	glutInitContextProfile(GLUT_CORE_PROFILE);
-	glutInit(&argc, argv);
-	glutInitWindowSize(windowWidth, windowHeight);
-	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
-	glutCreateWindow("Tutorial");
+	{
+		TRACE_SCOPE("createWindow");
+		glutInitContextVersion(4, 0);
+		glutInitContextProfile(GLUT_CORE_PROFILE);
+		glutInit(&argc, argv);
+		glutInitWindowSize(windowWidth, windowHeight);
+		glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE);
+		glutCreateWindow("Tutorial");
+	}
 
 	auto s = glGetString(GL_VERSION);
 	std::cout << s << std::endl;
@@ -704,21 +1739,57 @@ int main(int argc, char **argv)
 	glutReshapeFunc(WindowReshapeCallbackFunction);
 	glutMouseFunc(MouseClickCallbackFunction);
 	glutMotionFunc(MouseMotionCallbackFunction);
-	glutTimerFunc(1, TimerCallbackFunction, 0);
+	glutIdleFunc(IdleCallbackFunction);
 	glutSpecialFunc(SpecialInputCallbackFunction);
 	glutPassiveMotionFunc(MousePassiveMotionCallbackFunction);
+	glutCloseFunc(CloseCallbackFunction);
 
 
 	// Init GLEW
-	GLenum err = glewInit();
+	GLenum err;
+	{
+		TRACE_SCOPE("glewInit");
+		err = glewInit();
+	}
 	if (err != GLEW_OK)
 	{
 		std::cout << "TTK::InitializeTTK Error: GLEW failed to init" << std::endl;
 	}
 	printf("OpenGL version: %s, GLSL version: %s\n", glGetString(GL_VERSION), glGetString(GL_SHADING_LANGUAGE_VERSION));
 
+	// Load the current GL state into the state cache
+	// From here on all binds should go through GLState
+	GLState::init();
+
+	// Per frame draw / bind / upload counters, a stats recording still running is closed on exit
+	RenderStats::init();
+	atexit(RenderStats::stopRecording);
+
+	// Transient per frame memory, freed after the job system has stopped
+	FrameArena::init(1024 * 1024);
+	atexit(FrameArena::shutdown);
+
+	// Pick the SIMD path for the transform math before the simulation starts using it
+	TransformBatch::init();
+	std::cout << "Transform batches use " << TransformBatch::getName(TransformBatch::getSupported()) << std::endl;
+
+	// Worker threads for per frame CPU work, stopped when the program exits
+	{
+		TRACE_SCOPE("JobSystem::init");
+		JobSystem::init();
+	}
+	atexit(JobSystem::shutdown);
+
+	// Frame timing and frames in flight limit
+	framePacer.init();
+	framePacer.mode = FramePacer::MODE_TARGET_FPS;
+	framePacer.targetFPS = FRAMES_PER_SECOND;
+
 	// Init ImGUI
-	TTK::InitImGUI();
+	{
+		TRACE_SCOPE("InitImGUI");
+		TTK::InitImGUI();
+	}
 
 	int num_ext = 0;
 	glGetIntegerv(GL_NUM_EXTENSIONS, &num_ext);
@@ -730,17 +1801,42 @@ int main(int argc, char **argv)
 	}
 
 	// Init GL
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LEQUAL);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::depthFunc(GL_LEQUAL);
 
 	// Initialize scene
 	initializeShaders();
 	initializeScene();
 	initializeFrameBuffers();
 
+	occlusionCuller.init(materials.get("depthOnly"_id), meshes.get("box"_id));
+
+	sceneFragmentQuery.create(GL_SAMPLES_PASSED);
+	dynamicResolution.create();
+
+	// Hand the scene over to the simulation thread
+	// The object list is fixed from here on, snapshots index into it
+	for (uint32_t i = 0; i < gameobjects.getNumSlots(); i++)
+	{
+		if (GameObject* gameobject = gameobjects.getAt(i))
+			simObjects.push_back(gameobject);
+	}
+	lightSphere = gameobjects.get("sphere"_id);
+
+	// Run the first tick here so there is a snapshot before the first frame
+	simulationTick(0.0f, 0.0);
+
+	simulationThread.start(SIMULATION_TICKS_PER_SECOND, simulationTick);
+
+	// Registered after the job system, so this runs first and the
+	// simulation is not in the middle of a parallelFor at shutdown
+	atexit(stopSimulation);
+
+	// Frames can be traced from the UI
+	TRACE_END_SESSION("trace_startup.json");
+
 	/* Start Game Loop */
-	deltaTime = (float)glutGet(GLUT_ELAPSED_TIME);
-	deltaTime /= 1000.0f;
+	deltaTime = 0.0f;
 
 	glutMainLoop();
 